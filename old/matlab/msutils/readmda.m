@@ -51,6 +51,13 @@ for j=1:num_dims
 end;
 N=prod(S);
 
+% scaled int16: the value of one unit follows the dimensions
+scale=1;
+if (code==-11)
+    scale=fread(F,1,'double');
+    code=-4;
+end;
+
 if num_dims == 1,
   A = zeros(1,S);
 else
@@ -79,4 +86,8 @@ else
     error('Unsupported data type code: %d',code);
 end;
 
+if (scale~=1)
+    A=A*scale;
+end;
+
 fclose(F);
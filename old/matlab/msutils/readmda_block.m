@@ -55,6 +55,13 @@ for j=1:num_dims
     S(j)=fread(F,1,dim_type_str);
 end;
 
+% scaled int16: the value of one unit follows the dimensions
+scale=1;
+if (code==-11)
+    scale=fread(F,1,'double');
+    code=-4;
+end;
+
 if num_dims == 1,
   num_dims=2;
   S=[1,S(1)];
@@ -109,6 +116,10 @@ else
     error('Unsupported data type code: %d',code);
 end;
 
+if (scale~=1)
+    A=A*scale;
+end;
+
 fclose(F);
 
 function test_readmda_block
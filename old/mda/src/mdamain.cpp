@@ -82,6 +82,8 @@ int main(int argc, char* argv[])
             return -1;
         }
         int format = X.mdaioHeader().data_type;
+        if ((format == MDAIO_TYPE_INT16) && (X.scale() != 1))
+            format = MDAIO_TYPE_FLOAT32; //the chunk holds the scaled values
         bool ret = false;
         if (format == MDAIO_TYPE_BYTE)
             ret = chunk.write8(arg3);
@@ -389,6 +391,8 @@ QString get_json_header_string(const DiskReadMda& X)
     ret["header_size"] = (int)H.header_size;
     ret["data_type"] = H.data_type;
     ret["data_type_string"] = get_data_type_string(H.data_type);
+    if (H.scale != 1)
+        ret["scale"] = H.scale;
     return QJsonDocument(ret).toJson(QJsonDocument::Indented);
 }
 
@@ -405,7 +409,7 @@ bool extract_time_chunk(QString input_fname, QString output_fname, const QMap<QS
         return false;
     }
     MDAIO_HEADER H = X.mdaioHeader();
-    if (H.data_type == MDAIO_TYPE_FLOAT32)
+    if ((H.data_type == MDAIO_TYPE_FLOAT32) || (H.scale != 1)) //the chunk is read with the scale applied
         return Y.write32(output_fname);
     else if (H.data_type == MDAIO_TYPE_FLOAT64)
         return Y.write64(output_fname);
@@ -6,14 +6,18 @@
 
 #include "mdaconvert.h"
 #include "mdaio.h"
+#include "mdatranspose.h"
 
 #include <QFile>
 #include <QFileInfo>
 #include <QTime>
 #include <mda.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 #include "mlcommon.h"
+#include "mlkernels.h"
 
 bigint get_mda_dtype(QString format);
 
@@ -24,18 +28,21 @@ struct working_data {
             fclose(inf);
         if (outf)
             fclose(outf);
-        if (buf)
-            free(buf);
+        free(in_buf);
+        free(out_buf);
     }
 
     MDAIO_HEADER HH_in;
     MDAIO_HEADER HH_out;
     FILE* inf = 0;
     FILE* outf = 0;
-    void* buf = 0;
+    void* in_buf = 0; //only used when the data type changes
+    void* out_buf = 0;
+    bigint buf_size = 0; //number of entries
 };
 
 bool copy_data(working_data& D, bigint N);
+void apply_scale(void* data, bigint dtype, double scale, bigint N);
 bigint get_num_bytes_per_entry(bigint dtype);
 bool convert_ncs(const mdaconvert_opts& opts);
 bool convert_nrd(const mdaconvert_opts& opts);
@@ -77,7 +84,7 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
             return false;
         }
     }
-    else if (opts.input_format == "raw_timeseries") {
+    else if ((opts.input_format == "raw_timeseries") || (opts.input_format == "raw_channel_major")) {
         if (opts.input_dtype.isEmpty()) {
             qWarning() << "Input datatype (e.g., --dtype=int16)  must be specified";
             return false;
@@ -101,6 +108,12 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
         }
         printf("Auto-setting number of timepoints to %ld\n", num_timepoints);
         opts.dims << num_timepoints;
+        if (opts.input_format == "raw_channel_major") {
+            //each channel is contiguous in the file, i.e., the array is TxM and is transposed to MxT
+            opts.dims.clear();
+            opts.dims << num_timepoints << opts.num_channels;
+            opts.transpose = true;
+        }
     }
     else {
         if (opts.input_dtype.isEmpty()) {
@@ -113,11 +126,22 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
         }
     }
 
+    if ((!opts.input_paths.isEmpty()) && (opts.input_format != "ncs")) {
+        qWarning() << "Multiple input files are only supported for input type ncs";
+        return false;
+    }
+
     //check file existence, etc
     if (!QFile::exists(opts.input_path)) {
         qWarning() << "Input file does not exist: " + opts.input_path;
         return false;
     }
+    foreach (QString path, opts.input_paths) {
+        if (!QFile::exists(path)) {
+            qWarning() << "Input file does not exist: " + path;
+            return false;
+        }
+    }
     if (QFile::exists(opts.output_path)) {
         if (!QFile::remove(opts.output_path)) {
             qWarning() << "Unable to remove output file: " + opts.output_path;
@@ -227,6 +251,16 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
         }
     }
     D.HH_out.num_bytes_per_entry = get_num_bytes_per_entry(D.HH_out.data_type);
+    if (D.HH_out.data_type == D.HH_in.data_type) {
+        //the entries are copied as they are, so a scaled int16 array keeps its scale
+        D.HH_out.scale = D.HH_in.scale;
+        if ((D.HH_in.scale != 1) && (opts.output_format != "mda"))
+            qWarning() << "Note: the output is in units of" << D.HH_in.scale << "(the scale of the input)";
+    }
+    else if ((D.HH_in.scale != 1) && (D.HH_out.data_type != MDAIO_TYPE_FLOAT32) && (D.HH_out.data_type != MDAIO_TYPE_FLOAT64)) {
+        qWarning() << "A scaled int16 array can only be converted to float32 or float64";
+        return false;
+    }
     D.HH_out.num_dims = D.HH_in.num_dims;
     bigint dim_prod = 1;
     for (bigint i = 0; i < D.HH_out.num_dims; i++) {
@@ -258,6 +292,35 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
         }
     }
 
+    if (opts.transpose) {
+        if (dim_prod != D.HH_in.dims[0] * D.HH_in.dims[1]) {
+            qWarning() << "Only two-dimensional arrays can be transposed";
+            return false;
+        }
+        if (D.HH_out.data_type != D.HH_in.data_type) {
+            qWarning() << "Changing the data type is not supported together with transpose";
+            return false;
+        }
+        bigint output_header_size = (opts.output_format == "mda") ? D.HH_out.header_size : 0;
+        //write the header again with the dimensions swapped
+        if (opts.output_format == "mda") {
+            D.HH_out.dims[0] = D.HH_in.dims[1];
+            D.HH_out.dims[1] = D.HH_in.dims[0];
+            fseeko(D.outf, 0, SEEK_SET);
+            if (!mda_write_header(&D.HH_out, D.outf)) {
+                qWarning() << "Error writing output header";
+                return false;
+            }
+        }
+        bool ret = mda_transpose_data(D.inf, D.HH_in.header_size, D.outf, output_header_size, D.HH_in.dims[0], D.HH_in.dims[1], D.HH_in.num_bytes_per_entry, opts.max_memory);
+        if (!ret) {
+            fclose(D.outf);
+            D.outf = 0;
+            QFile::remove(opts.output_path);
+        }
+        return ret;
+    }
+
     bool ret = true;
     bigint chunk_size = 1e7;
     QTime timer;
@@ -280,84 +343,138 @@ bool mdaconvert(const mdaconvert_opts& opts_in)
         D.outf = 0;
         QFile::remove(opts.output_path);
     }
-    return false;
+    return ret;
 }
 
-bool copy_data(working_data& D, bigint N)
+template <typename InType, typename OutType>
+void convert_entries(const InType* in, OutType* out, bigint N)
 {
-    if (!N)
-        return true;
-    if (D.buf) {
-        free(D.buf);
-        D.buf = 0;
-    }
-    bigint buf_size = N * D.HH_out.num_bytes_per_entry;
-    D.buf = malloc(buf_size);
-    if (!D.buf) {
-        qWarning() << QString("Error in malloc of size %1 ").arg(buf_size);
-        return false;
+    // same conversion as std::copy in mdaio, written so that the compiler can vectorize it
+#pragma omp parallel for simd if (N >= 100000)
+    for (bigint i = 0; i < N; i++) {
+        out[i] = (OutType)in[i];
     }
+}
 
-    void* buf = D.buf;
-    bigint num_read = 0;
-    if (D.HH_out.data_type == MDAIO_TYPE_BYTE) {
-        num_read = mda_read_byte((unsigned char*)buf, &D.HH_in, N, D.inf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_UINT16) {
-        num_read = mda_read_uint16((quint16*)buf, &D.HH_in, N, D.inf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_INT16) {
-        num_read = mda_read_int16((qint16*)buf, &D.HH_in, N, D.inf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_INT32) {
-        num_read = mda_read_int32((qint32*)buf, &D.HH_in, N, D.inf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_FLOAT32) {
-        num_read = mda_read_float32((float*)buf, &D.HH_in, N, D.inf);
+// float to int16 rounds and saturates, with the same kernels as mdaio
+template <>
+void convert_entries(const float* in, int16_t* out, bigint N)
+{
+    MLKernels::floatToInt16(N, in, out);
+}
+
+template <>
+void convert_entries(const double* in, int16_t* out, bigint N)
+{
+    MLKernels::doubleToInt16(N, in, out);
+}
+
+template <typename InType>
+bool convert_entries_from(const InType* in, void* out, bigint out_dtype, bigint N)
+{
+    switch (out_dtype) {
+    case MDAIO_TYPE_BYTE:
+        convert_entries(in, (unsigned char*)out, N);
+        return true;
+    case MDAIO_TYPE_UINT16:
+        convert_entries(in, (uint16_t*)out, N);
+        return true;
+    case MDAIO_TYPE_INT16:
+        convert_entries(in, (int16_t*)out, N);
+        return true;
+    case MDAIO_TYPE_INT32:
+        convert_entries(in, (int32_t*)out, N);
+        return true;
+    case MDAIO_TYPE_FLOAT32:
+        convert_entries(in, (float*)out, N);
+        return true;
+    case MDAIO_TYPE_FLOAT64:
+        convert_entries(in, (double*)out, N);
+        return true;
+    case MDAIO_TYPE_UINT32:
+        convert_entries(in, (uint32_t*)out, N);
+        return true;
     }
-    else if (D.HH_out.data_type == MDAIO_TYPE_FLOAT64) {
-        num_read = mda_read_float64((double*)buf, &D.HH_in, N, D.inf);
+    return false;
+}
+
+bool convert_entries(const void* in, bigint in_dtype, void* out, bigint out_dtype, bigint N)
+{
+    switch (in_dtype) {
+    case MDAIO_TYPE_BYTE:
+        return convert_entries_from((const unsigned char*)in, out, out_dtype, N);
+    case MDAIO_TYPE_UINT16:
+        return convert_entries_from((const uint16_t*)in, out, out_dtype, N);
+    case MDAIO_TYPE_INT16:
+        return convert_entries_from((const int16_t*)in, out, out_dtype, N);
+    case MDAIO_TYPE_INT32:
+        return convert_entries_from((const int32_t*)in, out, out_dtype, N);
+    case MDAIO_TYPE_FLOAT32:
+        return convert_entries_from((const float*)in, out, out_dtype, N);
+    case MDAIO_TYPE_FLOAT64:
+        return convert_entries_from((const double*)in, out, out_dtype, N);
+    case MDAIO_TYPE_UINT32:
+        return convert_entries_from((const uint32_t*)in, out, out_dtype, N);
     }
-    else if (D.HH_out.data_type == MDAIO_TYPE_UINT32) {
-        num_read = mda_read_uint32((quint32*)buf, &D.HH_in, N, D.inf);
+    return false;
+}
+
+void apply_scale(void* data, bigint dtype, double scale, bigint N)
+{
+    // the floating point types only (checked in mdaconvert)
+    if (dtype == MDAIO_TYPE_FLOAT32) {
+        float* ptr = (float*)data;
+        float factor = scale; // in float, as in DiskReadMda32
+#pragma omp parallel for simd if (N >= 100000)
+        for (bigint i = 0; i < N; i++)
+            ptr[i] *= factor;
+    }
+    else if (dtype == MDAIO_TYPE_FLOAT64) {
+        double* ptr = (double*)data;
+#pragma omp parallel for simd if (N >= 100000)
+        for (bigint i = 0; i < N; i++)
+            ptr[i] *= scale;
     }
-    else {
-        qWarning() << "Unsupported format for reading";
-        return false;
+}
+
+bool copy_data(working_data& D, bigint N)
+{
+    if (!N)
+        return true;
+    bool same_type = (D.HH_in.data_type == D.HH_out.data_type);
+    if (N > D.buf_size) {
+        // the buffers are allocated once (for the first chunk) and reused for the following chunks
+        free(D.in_buf);
+        free(D.out_buf);
+        D.in_buf = 0;
+        D.out_buf = malloc(N * D.HH_out.num_bytes_per_entry);
+        if (!same_type)
+            D.in_buf = malloc(N * D.HH_in.num_bytes_per_entry);
+        if ((!D.out_buf) || ((!same_type) && (!D.in_buf))) {
+            qWarning() << QString("Error in malloc of size %1 ").arg(N * (D.HH_in.num_bytes_per_entry + D.HH_out.num_bytes_per_entry));
+            D.buf_size = 0;
+            return false;
+        }
+        D.buf_size = N;
     }
 
+    // read the raw entries in one block and convert them in memory (the stdio buffer is bypassed for large reads)
+    void* read_buf = same_type ? D.out_buf : D.in_buf;
+    bigint num_read = fread(read_buf, D.HH_in.num_bytes_per_entry, N, D.inf);
     if (num_read != N) {
         qWarning() << "Error reading data" << num_read << N;
         return false;
     }
-
-    bigint num_written = 0;
-    if (D.HH_out.data_type == MDAIO_TYPE_BYTE) {
-        num_written = mda_write_byte((unsigned char*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_UINT16) {
-        num_written = mda_write_uint16((quint16*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_INT16) {
-        num_written = mda_write_int16((qint16*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_INT32) {
-        num_written = mda_write_int32((qint32*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_FLOAT32) {
-        num_written = mda_write_float32((float*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_FLOAT64) {
-        num_written = mda_write_float64((double*)buf, &D.HH_out, N, D.outf);
-    }
-    else if (D.HH_out.data_type == MDAIO_TYPE_UINT32) {
-        num_written = mda_write_uint32((quint32*)buf, &D.HH_out, N, D.outf);
-    }
-    else {
-        qWarning() << "Unsupported format for writing";
-        return false;
+    if (!same_type) {
+        if (!convert_entries(D.in_buf, D.HH_in.data_type, D.out_buf, D.HH_out.data_type, N)) {
+            qWarning() << "Unsupported data type for conversion";
+            return false;
+        }
+        if (D.HH_in.scale != 1)
+            apply_scale(D.out_buf, D.HH_out.data_type, D.HH_in.scale, N);
     }
 
+    bigint num_written = fwrite(D.out_buf, D.HH_out.num_bytes_per_entry, N, D.outf);
     if (num_written != N) {
         qWarning() << "Error writing data" << num_written << N;
         return false;
@@ -397,58 +514,110 @@ figure; plot(all_data(1:2000));
 
 bool convert_ncs(const mdaconvert_opts& opts)
 {
-    FILE* inf = fopen(opts.input_path.toUtf8().data(), "r");
-    if (!inf) {
-        qWarning() << "Unable to open input file for reading: " + opts.input_path;
-        return false;
+    QStringList paths = opts.input_paths;
+    if (paths.isEmpty())
+        paths << opts.input_path;
+    bigint M = paths.count(); //one channel per file
+    bigint header_size = 16 * 1024;
+    bigint samples_per_record = 512;
+    bigint record_header_size = 20;
+    bigint record_size = record_header_size + samples_per_record * 2;
+
+    bigint num_records = -1;
+    for (bigint m = 0; m < M; m++) {
+        bigint num_records0 = (QFileInfo(paths[m]).size() - header_size) / record_size;
+        if ((num_records >= 0) && (num_records0 != num_records)) {
+            qWarning() << QString("Warning: inconsistent number of records (%1 and %2) in .ncs files, truncating to the smaller").arg(num_records).arg(num_records0);
+        }
+        if ((num_records < 0) || (num_records0 < num_records))
+            num_records = num_records0;
     }
-    FILE* outf = fopen(opts.output_path.toUtf8().data(), "w");
+    if (num_records < 0)
+        num_records = 0;
+
+    std::vector<FILE*> infs(M, (FILE*)0);
+    FILE* outf = 0;
+    auto close_files = [&]() {
+        for (bigint m = 0; m < M; m++) {
+            if (infs[m])
+                fclose(infs[m]);
+        }
+        if (outf)
+            fclose(outf);
+    };
+    for (bigint m = 0; m < M; m++) {
+        infs[m] = fopen(paths[m].toUtf8().data(), "rb");
+        if (!infs[m]) {
+            qWarning() << "Unable to open input file for reading: " + paths[m];
+            close_files();
+            return false;
+        }
+        fseek(infs[m], header_size, SEEK_SET); //skip the header
+    }
+    outf = fopen(opts.output_path.toUtf8().data(), "wb");
     if (!outf) {
         qWarning() << "Unable to open output file for writing: " + opts.output_path;
-        fclose(inf);
+        close_files();
         return false;
     }
-    bigint size_of_input = QFileInfo(opts.input_path).size();
-    bigint header_size = 16 * 1024;
-    bigint record_size = 20 + 512 * 2;
-    bigint num_records = (size_of_input - header_size) / record_size;
-    fseek(inf, header_size, SEEK_SET); //skip the header
     MDAIO_HEADER H_out;
     H_out.data_type = MDAIO_TYPE_INT16;
     H_out.num_bytes_per_entry = 2;
-    H_out.dims[0] = 1;
-    H_out.dims[1] = num_records * 512;
+    H_out.dims[0] = M;
+    H_out.dims[1] = num_records * samples_per_record;
     H_out.num_dims = 2;
     mda_write_header(&H_out, outf);
-    char buffer[record_size];
-    qint16* record_data = (qint16*)(&buffer[record_size - 512 * 2]);
-    for (bigint i = 0; i < num_records; i++) {
-        {
-            bigint ret = fread(buffer, sizeof(char), record_size, inf);
-            if (ret != record_size) {
-                qWarning() << QString("Problem reading record %1 of %2 from .ncs file: ").arg(i).arg(num_records) + opts.input_path;
-                fclose(inf);
-                fclose(outf);
-                return false;
-            }
+
+    // blocks of whole records (about 64 MB in total), read from all the files and interleaved into the MxN output in one pass
+    bigint records_per_block = qMax((bigint)1, (bigint)(64 * 1024 * 1024) / (record_size * M));
+    std::vector<std::vector<char> > buffers(M, std::vector<char>(records_per_block * record_size));
+    std::vector<qint16> out(M * samples_per_record * records_per_block);
+    QTime timer;
+    timer.start();
+    for (bigint r0 = 0; r0 < num_records; r0 += records_per_block) {
+        if (timer.elapsed() > 1000) {
+            printf("%ld%%\n", (bigint)((r0 * 1.0 / num_records) * 100));
+            timer.restart();
         }
-        {
-            bigint ret = mda_write_int16(record_data, &H_out, 512, outf);
-            if (ret != 512) {
-                qWarning() << QString("Problem writing record %1 of %2 from .ncs file: ").arg(i).arg(num_records) + opts.input_path;
-                fclose(inf);
-                fclose(outf);
-                return false;
+        bigint num_records0 = qMin(records_per_block, num_records - r0);
+        bigint num_failed = 0;
+#pragma omp parallel for reduction(+ : num_failed)
+        for (bigint m = 0; m < M; m++) {
+            bigint ret = fread(buffers[m].data(), sizeof(char), num_records0 * record_size, infs[m]);
+            if (ret != num_records0 * record_size)
+                num_failed++;
+        }
+        if (num_failed) {
+            qWarning() << QString("Problem reading records %1-%2 of %3 from .ncs files").arg(r0).arg(r0 + num_records0 - 1).arg(num_records);
+            close_files();
+            return false;
+        }
+#pragma omp parallel for
+        for (bigint r = 0; r < num_records0; r++) {
+            qint16* dst = &out[M * samples_per_record * r];
+            for (bigint m = 0; m < M; m++) {
+                const qint16* src = (const qint16*)&buffers[m][record_size * r + record_header_size];
+                for (bigint s = 0; s < samples_per_record; s++) {
+                    dst[m + M * s] = src[s];
+                }
             }
         }
+        bigint num = M * samples_per_record * num_records0;
+        bigint ret = mda_write_int16(out.data(), &H_out, num, outf);
+        if (ret != num) {
+            qWarning() << QString("Problem writing records %1-%2 of %3 from .ncs files to: ").arg(r0).arg(r0 + num_records0 - 1).arg(num_records) + opts.output_path;
+            close_files();
+            return false;
+        }
     }
-    bigint test_num_bytes = fread(buffer, sizeof(char), record_size, inf);
-    if (test_num_bytes != 0) {
-        qWarning() << "Warning: extra bytes found in input file: " + opts.input_path;
+    for (bigint m = 0; m < M; m++) {
+        char test_byte;
+        if (fread(&test_byte, sizeof(char), 1, infs[m]) != 0) {
+            qWarning() << "Warning: extra bytes found in input file: " + paths[m];
+        }
     }
 
-    fclose(inf);
-    fclose(outf);
+    close_files();
 
     return true;
 }
@@ -488,53 +657,69 @@ figure; plot(all_data(1:25,1:50000)');
 
 bool convert_nrd(const mdaconvert_opts& opts)
 {
-    FILE* inf = fopen(opts.input_path.toUtf8().data(), "r");
+    FILE* inf = fopen(opts.input_path.toUtf8().data(), "rb");
     if (!inf) {
         qWarning() << "Unable to open input file for reading: " + opts.input_path;
         return false;
     }
-    FILE* outf = fopen(opts.output_path.toUtf8().data(), "w");
+    FILE* outf = fopen(opts.output_path.toUtf8().data(), "wb");
     if (!outf) {
         qWarning() << "Unable to open output file for writing: " + opts.output_path;
         fclose(inf);
         return false;
     }
+    bigint M = opts.num_channels;
     bigint size_of_input = QFileInfo(opts.input_path).size();
     bigint header_size = 16 * 1024;
-    bigint record_size = 32 + 40 + 4 * opts.num_channels; //TODO: this should be auto-detected
+    bigint record_size = 32 + 40 + 4 * M; //TODO: this should be auto-detected
+    bigint data_offset = record_size - M * 4 - 4;
     bigint num_records = (size_of_input - header_size) / record_size;
     fseek(inf, header_size, SEEK_SET); //skip the header
     MDAIO_HEADER H_out;
     H_out.data_type = MDAIO_TYPE_INT32;
-    H_out.num_bytes_per_entry = 2;
-    H_out.dims[0] = opts.num_channels;
+    H_out.num_bytes_per_entry = 4;
+    H_out.dims[0] = M;
     H_out.dims[1] = num_records;
     H_out.num_dims = 2;
     mda_write_header(&H_out, outf);
-    char buffer[record_size];
-    qint32* record_data = (qint32*)(&buffer[record_size - opts.num_channels * 4 - 4]);
-    for (bigint i = 0; i < num_records; i++) {
+
+    // blocks of about 64 MB of whole records
+    bigint records_per_block = qMax((bigint)1, (bigint)(64 * 1024 * 1024) / record_size);
+    std::vector<char> buffer(records_per_block * record_size);
+    std::vector<qint32> out(M * records_per_block);
+    QTime timer;
+    timer.start();
+    for (bigint r0 = 0; r0 < num_records; r0 += records_per_block) {
+        if (timer.elapsed() > 1000) {
+            printf("%ld%%\n", (bigint)((r0 * 1.0 / num_records) * 100));
+            timer.restart();
+        }
+        bigint num_records0 = qMin(records_per_block, num_records - r0);
         {
-            bigint ret = fread(buffer, sizeof(char), record_size, inf);
-            if (ret != record_size) {
-                qWarning() << QString("Problem reading record %1 of %2 from .ncs file: ").arg(i).arg(num_records) + opts.input_path;
+            bigint ret = fread(buffer.data(), sizeof(char), num_records0 * record_size, inf);
+            if (ret != num_records0 * record_size) {
+                qWarning() << QString("Problem reading records %1-%2 of %3 from .nrd file: ").arg(r0).arg(r0 + num_records0 - 1).arg(num_records) + opts.input_path;
                 fclose(inf);
                 fclose(outf);
                 return false;
             }
         }
+#pragma omp parallel for
+        for (bigint r = 0; r < num_records0; r++) {
+            memcpy(&out[M * r], &buffer[record_size * r + data_offset], M * sizeof(qint32));
+        }
         {
-            bigint ret = mda_write_int32(record_data, &H_out, 512, outf);
-            if (ret != 512) {
-                qWarning() << QString("Problem writing record %1 of %2 from .ncs file: ").arg(i).arg(num_records) + opts.input_path;
+            bigint ret = mda_write_int32(out.data(), &H_out, M * num_records0, outf);
+            if (ret != M * num_records0) {
+                qWarning() << QString("Problem writing records %1-%2 of %3 from .nrd file: ").arg(r0).arg(r0 + num_records0 - 1).arg(num_records) + opts.input_path;
                 fclose(inf);
                 fclose(outf);
                 return false;
             }
         }
     }
-    bigint test_num_bytes = fread(buffer, sizeof(char), record_size, inf);
-    if (test_num_bytes != 0) {
+    char test_byte;
+    if (fread(&test_byte, sizeof(char), 1, inf) != 0) {
         qWarning() << "Warning: extra bytes found in input file: " + opts.input_path;
     }
 
@@ -12,6 +12,7 @@
 
 struct mdaconvert_opts {
     QString input_path;
+    QStringList input_paths; //for ncs: several single-channel files, interleaved as the channels of one MxN output (input_path is the first of them)
     QString input_dtype; // uint16, float32, ...
     QString input_format; // mda, raw, ...
     int input_num_header_rows = 0; //for csv
@@ -25,6 +26,8 @@ struct mdaconvert_opts {
     QList<bigint> dims;
 
     bool check_input_file_size = true;
+    bool transpose = false; //out-of-core transpose of a two-dimensional array (always done for input type raw_channel_major)
+    bigint max_memory = 512 * 1024 * 1024; //memory budget for the transpose
 };
 bool mdaconvert(const mdaconvert_opts& opts);
 
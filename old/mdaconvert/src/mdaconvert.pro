@@ -11,6 +11,13 @@ MOC_DIR=../build
 TARGET = mdaconvert
 TEMPLATE = app
 
+#OPENMP
+LIBS += -fopenmp
+!macx {
+  QMAKE_LFLAGS += -fopenmp
+  QMAKE_CXXFLAGS += -fopenmp
+}
+
 HEADERS += \
     mdaconvert.h
 
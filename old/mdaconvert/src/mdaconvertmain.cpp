@@ -52,6 +52,11 @@ int main(int argc, char* argv[])
     mdaconvert_opts opts;
 
     opts.input_path = params.unnamed_parameters.value(0);
+    if (opts.input_path.contains(",")) {
+        //e.g., CSC1.ncs,CSC2.ncs,CSC3.ncs
+        opts.input_paths = opts.input_path.split(",", QString::SkipEmptyParts);
+        opts.input_path = opts.input_paths.value(0);
+    }
     opts.input_dtype = params.named_parameters.value("input_dtype").toString();
     opts.input_format = params.named_parameters.value("input_format").toString();
 
@@ -61,6 +66,10 @@ int main(int argc, char* argv[])
 
     if (params.named_parameters.contains("allow-subset"))
         opts.check_input_file_size = false;
+    if (params.named_parameters.contains("transpose"))
+        opts.transpose = true;
+    if (params.named_parameters.contains("max_memory_mb"))
+        opts.max_memory = params.named_parameters["max_memory_mb"].toDouble() * 1024 * 1024;
 
     if (opts.output_path.isEmpty()) {
         //if (opts.input_path.endsWith(".mda")) {
@@ -149,9 +158,12 @@ void print_usage()
     printf("mdaconvert input.mda\n");
     printf("mdaconvert input.dat output.mda --dtype=uint16 --dims=32x100x44\n");
     printf("mdaconvert input.dat output.mda --dtype=int16 --input_format=raw_timeseries --num_channels=32\n");
+    printf("mdaconvert input.dat output.mda --dtype=int16 --input_format=raw_channel_major --num_channels=32 --max_memory_mb=512\n");
+    printf("mdaconvert input.mda output.mda --transpose\n");
     printf("mdaconvert input.file output.file --input_format=dat --input_dtype=float64 --output_format=mda --output_dtype=float32\n");
     printf("mdaconvert input.csv output.mda --input_num_header_rows=1 --input_num_header_cols=0\n");
     printf("mdaconvert input.ncs output.mda\n");
+    printf("mdaconvert CSC1.ncs,CSC2.ncs,CSC3.ncs,CSC4.ncs output.mda\n");
     printf("mdaconvert input.nrd output.mda --num_channels=32\n");
     printf("mdaconvert extract_time_chunk input.mda output.mda --t1=0 --t2=1e6\n");
     printf("mdaconvert extract_channels input.mda output.mda --channels=5,6,7,8,16-20\n");
@@ -116,7 +116,7 @@ private:
 template <typename T>
 using ICounter = ICounterImpl<T, std::is_integral<T>::value>;
 
-using IIntCounter = ICounter<int>;
+using IIntCounter = ICounter<qint64>; //64-bit, so that byte counts do not wrap
 using IDoubleCounter = ICounter<double>;
 
 class CounterGroup : public QObject {
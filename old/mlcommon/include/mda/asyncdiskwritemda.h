@@ -0,0 +1,70 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#ifndef ASYNCDISKWRITEMDA_H
+#define ASYNCDISKWRITEMDA_H
+
+#include "mda.h"
+#include "mda32.h"
+
+#include <QString>
+#include <mdaio.h>
+
+class AsyncDiskWriteMdaPrivate;
+/**
+ * \class AsyncDiskWriteMda
+ * @brief Write a (possibly huge) .mda file from many worker threads at once.
+ *
+ * Same usage as DiskWriteMda, except that writeChunk() is thread-safe and does not block on disk I/O.
+ * The calling (worker) thread converts the chunk to the data type of the file and queues the bytes.
+ * A background thread reorders the queued chunks by file position and writes contiguous runs sequentially.
+ * The queue is bounded by max_queued_bytes, so writeChunk() blocks when the disk cannot keep up.
+ *
+ * Call close() to flush everything -- its return value reports whether all the writes succeeded.
+ */
+class AsyncDiskWriteMda {
+public:
+    friend class AsyncDiskWriteMdaPrivate;
+    AsyncDiskWriteMda();
+    AsyncDiskWriteMda(int data_type, const QString& path, bigint N1, bigint N2, bigint N3 = 1, bigint N4 = 1, bigint N5 = 1, bigint N6 = 1);
+    virtual ~AsyncDiskWriteMda();
+    bool open(int data_type, const QString& path, bigint N1, bigint N2, bigint N3 = 1, bigint N4 = 1, bigint N5 = 1, bigint N6 = 1);
+    bool close();
+    ///Wait until everything queued so far is written, and flush it to the file (which is still <path>.tmp),
+    ///so that another process can read it. Returns false if a write failed.
+    bool flush();
+
+    ///Upper bound on the number of bytes waiting to be written (default 256 MB). Set before open().
+    void setMaxQueuedBytes(bigint num_bytes);
+    ///For an int16 file: the value of one unit. Chunks are divided by it (rounded and saturated) and it is
+    ///stored in the header (see MDAIO_HEADER::scale), so readers get the original values back.
+    ///Set it before open() or before writing any chunk.
+    bool setScale(double scale);
+
+    bigint N1();
+    bigint N2();
+    bigint N3();
+    bigint N4();
+    bigint N5();
+    bigint N6();
+    bigint totalSize();
+
+    bool writeChunk(const Mda& X, bigint i);
+    bool writeChunk(const Mda& X, bigint i1, bigint i2);
+    bool writeChunk(const Mda& X, bigint i1, bigint i2, bigint i3);
+
+    bool writeChunk(const Mda32& X, bigint i);
+    bool writeChunk(const Mda32& X, bigint i1, bigint i2);
+    bool writeChunk(const Mda32& X, bigint i1, bigint i2, bigint i3);
+
+    ///For writing part of a chunk without copying it (see Mda32::columnsView())
+    bool writeChunk(const Mda32View& X, bigint i);
+    bool writeChunk(const Mda32View& X, bigint i1, bigint i2);
+
+private:
+    AsyncDiskWriteMdaPrivate* d;
+};
+
+#endif // ASYNCDISKWRITEMDA_H
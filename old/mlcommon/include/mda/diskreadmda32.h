@@ -48,6 +48,10 @@ public:
     bigint totalSize() const; //product of N1..N6
 
     MDAIO_HEADER mdaioHeader() const;
+    ///The value of one unit of a scaled int16 file (see MDAIO_HEADER::scale), otherwise 1. It is already applied by readChunk() and value().
+    ///Writers that copy the data type from mdaioHeader() should pass it to setScale(). For a concatenation it is the common scale
+    ///of the parts; when they differ the header reports a floating point type instead.
+    double scale() const;
 
     bool reshape(bigint N1b, bigint N2b, bigint N3b = 1, bigint N4b = 1, bigint N5b = 1, bigint N6b = 1);
     DiskReadMda32 reshaped(bigint N1b, bigint N2b, bigint N3b = 1, bigint N4b = 1, bigint N5b = 1, bigint N6b = 1);
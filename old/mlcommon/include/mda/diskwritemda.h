@@ -22,6 +22,9 @@ public:
     bool open(int data_type, const QString& path, bigint N1, bigint N2, bigint N3 = 1, bigint N4 = 1, bigint N5 = 1, bigint N6 = 1);
     bool open(const QString& path);
     void close();
+    ///As AsyncDiskWriteMda::setScale(): for an int16 file, the value of one unit (stored in the header).
+    ///Set it before open() or before writing any chunk.
+    bool setScale(double scale);
 
     bigint N1();
     bigint N2();
@@ -30,6 +30,10 @@ public:
     Mda(const Mda& other);
     ///Assignment operator
     void operator=(const Mda& other);
+    ///Move constructor -- takes the data of other, which is left as a 1x1 array
+    Mda(Mda&& other);
+    ///Move assignment -- takes the data of other, which is left as a 1x1 array
+    void operator=(Mda&& other);
     ///Destructor
     virtual ~Mda();
     ///Allocate an array of size N1xN2x...xN6
@@ -18,6 +18,7 @@ typedef float dtype32;
 extern void* allocate(const bigint nbytes);
 
 class MdaDataFloat;
+class Mda32View;
 
 /** \class Mda32 - a multi-dimensional array corresponding to the .mda file format
  * @brief The Mda32 class
@@ -34,6 +35,10 @@ public:
     Mda32(const Mda32& other);
     ///Assignment operator
     void operator=(const Mda32& other);
+    ///Move constructor -- takes the data of other, which is left as a 1x1 array
+    Mda32(Mda32&& other);
+    ///Move assignment -- takes the data of other, which is left as a 1x1 array
+    void operator=(Mda32&& other);
     ///Destructor
     virtual ~Mda32();
     ///Allocate an array of size N1xN2x...xN6
@@ -137,6 +142,9 @@ public:
     ///Retrieve a chunk of the vectorized data of size N1xN2xN3 starting at position (i1,i2,i3)
     void getChunk(Mda32& ret, bigint i1, bigint i2, bigint i3, bigint size1, bigint size2, bigint size3) const;
 
+    ///A view (no copy) of the columns i2,...,i2+size2-1 of a 2D array, which must lie within the array. The view is valid until this array is modified or destroyed.
+    Mda32View columnsView(bigint i2, bigint size2) const;
+
     ///Set a chunk of the vectorized data starting at position i
     void setChunk(Mda32& X, bigint i);
     ///Set a chunk of the vectorized data starting at position (i1,i2)
@@ -153,4 +161,46 @@ private:
     QSharedDataPointer<MdaDataFloat> d;
 };
 
+/** \class Mda32View - read access to contiguous data laid out as an Mda32, without owning it
+ * @brief The Mda32View class
+ *
+ * For passing part of an array (for example the middle columns of a chunk, without its overlaps) to functions
+ * that only read it, such as AsyncDiskWriteMda::writeChunk(). The data must outlive the view.
+ */
+class Mda32View {
+public:
+    Mda32View()
+    {
+    }
+    Mda32View(const dtype32* data, bigint N1, bigint N2, bigint N3 = 1)
+        : m_data(data)
+        , m_N1(N1)
+        , m_N2(N2)
+        , m_N3(N3)
+    {
+    }
+    ///The whole array (with N4...N6 folded into N3)
+    Mda32View(const Mda32& X)
+        : m_data(X.constDataPtr())
+        , m_N1(X.N1())
+        , m_N2(X.N2())
+        , m_N3(X.N3() * X.N4() * X.N5() * X.N6())
+    {
+    }
+    bigint N1() const { return m_N1; }
+    bigint N2() const { return m_N2; }
+    bigint N3() const { return m_N3; }
+    bigint totalSize() const { return m_N1 * m_N2 * m_N3; }
+    const dtype32* constDataPtr() const { return m_data; }
+    dtype32 get(bigint i) const { return m_data[i]; }
+    dtype32 get(bigint i1, bigint i2) const { return m_data[i1 + m_N1 * i2]; }
+    dtype32 get(bigint i1, bigint i2, bigint i3) const { return m_data[i1 + m_N1 * i2 + m_N1 * m_N2 * i3]; }
+
+private:
+    const dtype32* m_data = 0;
+    bigint m_N1 = 0;
+    bigint m_N2 = 0;
+    bigint m_N3 = 0;
+};
+
 #endif // MDA_H
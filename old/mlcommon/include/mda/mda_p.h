@@ -3,7 +3,7 @@
 
 #include <QSharedData>
 #include "icounter.h"
-#include <objectregistry.h>
+#include "mdaallocator.h"
 #include <cstring>
 #include "mlcommon.h"
 
@@ -22,26 +22,16 @@ public:
         , m_dims(1, 1)
         , total_size(0)
     {
-        ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
-        if (manager) {
-            allocatedCounter = static_cast<IIntCounter*>(manager->counter("allocated_bytes"));
-            freedCounter = static_cast<IIntCounter*>(manager->counter("freed_bytes"));
-            bytesReadCounter = static_cast<IIntCounter*>(manager->counter("bytes_read"));
-            bytesWrittenCounter = static_cast<IIntCounter*>(manager->counter("bytes_written"));
-        }
     }
     MdaData(const MdaData& other)
         : QSharedData(other)
         , m_data(0)
         , m_dims(other.m_dims)
         , total_size(other.total_size)
-        , allocatedCounter(other.allocatedCounter)
-        , freedCounter(other.freedCounter)
-        , bytesReadCounter(other.bytesReadCounter)
-        , bytesWrittenCounter(other.bytesWrittenCounter)
     {
         allocate(total_size);
-        std::copy(other.m_data, other.m_data + other.totalSize(), m_data);
+        if (m_data)
+            std::memcpy(m_data, other.m_data, total_size * sizeof(value_type));
     }
     ~MdaData()
     {
@@ -77,19 +67,16 @@ public:
 
     void allocate(bigint size)
     {
-        //m_data = (value_type*)::allocate(size * sizeof(value_type));
-        m_data = (value_type*)malloc(size * sizeof(value_type));
-        if (!m_data)
-            return;
-        incrementBytesAllocatedCounter(totalSize() * sizeof(value_type));
+        m_data = (value_type*)MdaAllocator::allocate(size * sizeof(value_type));
+        m_allocated_bytes = m_data ? size * sizeof(value_type) : 0;
     }
     void deallocate()
     {
         if (!m_data)
             return;
-        free(m_data);
-        incrementBytesFreedCounter(totalSize() * sizeof(value_type));
+        MdaAllocator::release(m_data, m_allocated_bytes);
         m_data = 0;
+        m_allocated_bytes = 0;
     }
     inline bigint totalSize() const { return total_size; }
     inline void setTotalSize(bigint ts) { total_size = ts; }
@@ -220,35 +207,22 @@ public:
         return TextFile::write(path, lines.join("\n"));
     }
 
-    void incrementBytesAllocatedCounter(int64_t size) const
-    {
-        if (allocatedCounter)
-            allocatedCounter->add(size);
-    }
-    void incrementBytesFreedCounter(int64_t size) const
-    {
-        if (freedCounter)
-            freedCounter->add(size);
-    }
     void incrementBytesReadCounter(int64_t size) const
     {
-        if (bytesReadCounter)
-            bytesReadCounter->add(size);
+        if (IIntCounter* counter = MdaAllocator::bytesReadCounter())
+            counter->add(size);
     }
     void incrementBytesWrittenCounter(int64_t size) const
     {
-        if (bytesWrittenCounter)
-            bytesWrittenCounter->add(size);
+        if (IIntCounter* counter = MdaAllocator::bytesWrittenCounter())
+            counter->add(size);
     }
 
 private:
     pointer m_data;
     std::vector<bigint> m_dims;
     bigint total_size;
-    mutable IIntCounter* allocatedCounter = nullptr;
-    mutable IIntCounter* freedCounter = nullptr;
-    mutable IIntCounter* bytesReadCounter = nullptr;
-    mutable IIntCounter* bytesWrittenCounter = nullptr;
+    bigint m_allocated_bytes = 0;
 };
 
 #endif // MDA_P_H
@@ -0,0 +1,58 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#ifndef MDAALLOCATOR_H
+#define MDAALLOCATOR_H
+
+#include "mlcommon.h"
+#include "icounter.h"
+
+/*
+ * The memory behind Mda and Mda32 (MdaData).
+ *
+ * Blocks are aligned to MDA_ALIGNMENT bytes (a cache line, and enough for any vector instructions).
+ * Sizes up to MDA_POOL_MAX_BYTES are rounded up to a size class (four per power of two, so at most
+ * 25% is wasted) and released blocks are kept in a free list of the calling thread, per class, for
+ * reuse. The processors that allocate the same chunk arrays on every iteration then take them from
+ * that list without a lock or a system call. Each thread keeps at most MDA_POOL_MAX_CACHED_BYTES,
+ * and all threads together at most MDA_POOL_MAX_TOTAL_CACHED_BYTES (the worker threads of OpenMP
+ * never exit). The free list of a thread is returned to the system when the thread exits, or
+ * after trimAll(), which is called between processors that run in the same process. Larger
+ * blocks are not pooled.
+ *
+ * The "allocated_bytes" and "freed_bytes" counters follow the memory taken from and returned to
+ * the system, so blocks waiting in a free list count as allocated. The same outstanding bytes,
+ * and their peak, are also kept here with plain atomics, so that ProcessorProfile does not have
+ * to be notified of every allocation.
+ */
+
+#define MDA_ALIGNMENT 64
+#define MDA_POOL_MAX_BYTES (64LL * 1024 * 1024)
+#define MDA_POOL_MAX_CACHED_BYTES (128LL * 1024 * 1024)
+#define MDA_POOL_MAX_TOTAL_CACHED_BYTES (256LL * 1024 * 1024)
+
+namespace MdaAllocator {
+//returns 0 when out of memory
+void* allocate(bigint num_bytes);
+//num_bytes is the size that was passed to allocate()
+void release(void* ptr, bigint num_bytes);
+//return the blocks in the free lists of the calling thread to the system
+void releaseThreadCache();
+//the same for all threads: the calling thread at once, the others at their next allocate() or release()
+void trimAll();
+//the bytes waiting in the free lists of all threads
+bigint cachedBytes();
+
+//the bytes taken from the system and not yet returned, and the peak of that since the last reset
+bigint outstandingBytes();
+bigint peakOutstandingBytes();
+void resetPeakOutstandingBytes(); //to the current outstanding bytes
+
+//the counters of the ICounterManager, found once (0 when there is none)
+IIntCounter* bytesReadCounter();
+IIntCounter* bytesWrittenCounter();
+}
+
+#endif // MDAALLOCATOR_H
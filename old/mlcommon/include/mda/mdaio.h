@@ -51,6 +51,9 @@ typedef int64_t bigint;
 //FUTURE:
 //#define MDAIO_TYPE_INT64 -9
 //#define MDAIO_TYPE_UINT64 -10
+//Only in the file: an int16 array whose header has a float64 scale after the dimensions (see MDAIO_HEADER::scale).
+//mda_read_header() reports it as MDAIO_TYPE_INT16, and readers that don't know it refuse the file rather than misread it.
+#define MDAIO_TYPE_INT16_SCALED -11
 
 #include <stdint.h>
 
@@ -62,8 +65,11 @@ struct MDAIO_HEADER {
     uint64_t dims[MDAIO_MAX_DIMS]; //the size of the dimensions
 
     //the following make sense for reading but not writing -- purposes of info
-    //note that the header size will be (3+num_dims)x4 or 3x4+num_dims*8
+    //note that the header size will be (3+num_dims)x4 or 3x4+num_dims*8 (plus 8 for the scale of a scaled int16 array)
     bigint header_size; //the size of the header in bytes
+
+    //for MDAIO_TYPE_INT16: the value of one unit. Anything other than 1 is written as MDAIO_TYPE_INT16_SCALED
+    double scale = 1;
 };
 
 //simply read, write or copy the mda header
@@ -89,7 +95,25 @@ bigint mda_write_uint16(uint16_t* data, struct MDAIO_HEADER* H, bigint n, FILE*
 bigint mda_write_float64(double* data, struct MDAIO_HEADER* H, bigint n, FILE* output_file);
 bigint mda_write_uint32(uint32_t* data, struct MDAIO_HEADER* H, bigint n, FILE* output_file);
 
+//convert in memory to the data type of the header (output_buffer must hold n*num_bytes_per_entry bytes)
+//this lets writers do the type conversion outside of the thread that does the actual I/O
+int mda_get_num_bytes_per_entry(int data_type);
+bigint mda_convert_float32(const float* data, const struct MDAIO_HEADER* H, bigint n, void* output_buffer);
+bigint mda_convert_float64(const double* data, const struct MDAIO_HEADER* H, bigint n, void* output_buffer);
+//and the reverse, e.g. for reading straight from a memory mapping of the file (input_buffer starts at an entry)
+bigint mda_decode_float32(const void* input_buffer, const struct MDAIO_HEADER* H, bigint n, float* data);
+bigint mda_decode_float64(const void* input_buffer, const struct MDAIO_HEADER* H, bigint n, double* data);
+
+//float to int16 conversions round to nearest and saturate (with the MLKernels conversions).
+//An int16 array may be stored scaled, with the value of one unit in the header (MDAIO_HEADER::scale), so that
+//the scale is part of the file and of its checksum. The functions above work in the units of the file;
+//DiskReadMda, DiskReadMda32, Mda::read() and Mda32::read() apply the scale when reading, and
+//AsyncDiskWriteMda::setScale() and DiskWriteMda::setScale() set it, so quantized intermediates can be used
+//like float32 ones.
+double mda_read_scale(const QString& mda_path); //from the header; 1 when the file is not a scaled int16 array
+
 //here's an example usage function. See top of file for more info.
+//(it holds the whole array in memory -- for large files use mda_transpose_file in mdatranspose.h)
 void transpose_array(char* infile_path, char* outfile_path);
 
 #endif // MDAIO_H
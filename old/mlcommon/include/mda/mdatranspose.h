@@ -0,0 +1,34 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef MDATRANSPOSE_H
+#define MDATRANSPOSE_H
+
+#include <QString>
+#include <stdio.h>
+#include "mlcommon.h"
+
+/*
+ * Out-of-core transpose of a two-dimensional array stored in a file: the N1xN2 array
+ * (column-major, as in .mda files) at input_offset becomes the N2xN1 array at output_offset.
+ * Typical use is turning a channel-major export (TxM, each channel contiguous) into the
+ * MxT layout expected by the processors, without holding the array in memory.
+ *
+ * The array is processed in tiles that fit in max_memory bytes (two input tiles and one output
+ * tile). The tile shape is chosen so that the reads and writes are long contiguous runs: when
+ * one of the dimensions is small, every tile spans it completely and the reads or writes are
+ * fully sequential. The next tile is read while the current one is transposed (in cache-sized
+ * blocks, on several threads) and written.
+ *
+ * The entries are copied byte for byte, so the data type is preserved.
+ */
+
+const bigint MDA_TRANSPOSE_DEFAULT_MAX_MEMORY = 512 * 1024 * 1024;
+
+bool mda_transpose_data(FILE* input_file, bigint input_offset, FILE* output_file, bigint output_offset, bigint N1, bigint N2, int num_bytes_per_entry, bigint max_memory = MDA_TRANSPOSE_DEFAULT_MAX_MEMORY);
+
+//transpose a two-dimensional .mda file
+bool mda_transpose_file(const QString& input_path, const QString& output_path, bigint max_memory = MDA_TRANSPOSE_DEFAULT_MAX_MEMORY);
+
+#endif // MDATRANSPOSE_H
@@ -24,22 +24,24 @@ public:
     virtual ~RemoteReadMda();
 
     void setRemoteDataType(QString dtype);
-    void setDownloadChunkSize(int size);
-    int downloadChunkSize();
+    void setDownloadChunkSize(bigint size);
+    bigint downloadChunkSize();
+    void setReadAheadChunks(int num); //number of chunks fetched ahead of a sequential read (default 2)
+    void setMaxParallelDownloads(int num); //default 4
 
     void setPath(const QString& path);
     QString makePath() const; //not capturing the reshaping
 
-    bool reshape(int N1b, int N2b, int N3b);
+    bool reshape(bigint N1b, bigint N2b, bigint N3b);
 
-    int N1() const;
-    int N2() const;
-    int N3() const;
+    bigint N1() const;
+    bigint N2() const;
+    bigint N3() const;
     QDateTime fileLastModified() const;
 
     ///Retrieve a chunk of the vectorized data of size 1xN starting at position i
-    bool readChunk(Mda& X, int i, int size) const;
-    bool readChunk32(Mda32& X, int i, int size) const;
+    bool readChunk(Mda& X, bigint i, bigint size) const;
+    bool readChunk32(Mda32& X, bigint i, bigint size) const;
 
 private:
     RemoteReadMdaPrivate* d;
@@ -0,0 +1,85 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef SHAREDMEMORYMDA_H
+#define SHAREDMEMORYMDA_H
+
+#include <QString>
+#include <QStringList>
+#include "mdaio.h"
+
+class Mda;
+class Mda32;
+
+/*
+ * Handoff of arrays between processes on the same machine (MountainView and the processors)
+ * through POSIX shared memory instead of the temporary directory of the CacheManager.
+ *
+ * A published array is a shared memory object holding an ordinary .mda file (header followed
+ * by the data), named from the same checksum as the cache file it replaces. On Linux the
+ * objects live in /dev/shm, so the path returned by publish() can be handed to anything that
+ * only knows about files (mountainprocess, the processors, .prv resolution), while DiskReadMda
+ * and DiskReadMda32 map it and read the chunks straight from memory.
+ *
+ * The objects are named from the checksum (uid and name, no pid), so a process that publishes an
+ * array that is already there -- from another process, or from an earlier session whose
+ * process is still holding it -- reuses the object instead of copying it again. Every process
+ * that publishes or maps an object holds a shared flock on it, and whoever lets go of it last
+ * removes it, so an object never goes away under a process that uses it. Objects are created
+ * with mode 0600, readable only by the user. The registry of this process keeps its objects
+ * within a budget (setMaxPublishedBytes()), letting go of the least recently published or
+ * reused ones first, except the pinned ones: makePath() publishes pinned, since the path goes
+ * to a consumer (a thread or a queued job) that has not opened it yet. The pin ends when a
+ * consumer in this process unmaps it, or by unpin()/release() (or the exit of the process). Objects left behind by processes that crashed
+ * (nobody holds them) are removed when the registry starts up.
+ *
+ * The header of a published array is padded with dimensions of size 1, so that the data starts
+ * 64 bytes into the object and is aligned for the vector kernels.
+ */
+namespace SharedMemoryMda {
+
+//false if the platform has no /dev/shm, or if it was turned off with setEnabled(false)
+bool isEnabled();
+void setEnabled(bool val);
+
+//the name is typically <checksum>.makePath.mda. Returns an empty string if the array could not
+//be published (e.g. not enough shared memory, or the budget is taken by pinned arrays), in which
+//case the caller falls back to a file. A pinned array is not released to make room for others.
+QString publish(const Mda& X, const QString& name, bool pinned = false);
+QString publish(const Mda32& X, const QString& name, bool pinned = false);
+
+bool isSharedMemoryPath(const QString& path);
+bool release(const QString& path);
+//once the consumer of a pinned array is done with it; it is then released when room is needed
+bool unpin(const QString& path);
+void releaseAll();
+QStringList publishedPaths();
+//upper bound on the bytes published by this process (default 1 GB). Arrays larger than that are not published.
+void setMaxPublishedBytes(bigint num_bytes);
+bigint publishedBytes();
+//remove the objects of this user that nobody holds any more (done automatically at startup)
+void sweepStaleObjects();
+}
+
+//read-only mapping of a published array
+class SharedMemoryMdaMappingPrivate;
+class SharedMemoryMdaMapping {
+public:
+    friend class SharedMemoryMdaMappingPrivate;
+    SharedMemoryMdaMapping();
+    virtual ~SharedMemoryMdaMapping();
+
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const;
+
+    MDAIO_HEADER header() const;
+    const char* data() const; //the first entry, right after the header
+
+private:
+    Q_DISABLE_COPY(SharedMemoryMdaMapping)
+    SharedMemoryMdaMappingPrivate* d;
+};
+
+#endif // SHAREDMEMORYMDA_H
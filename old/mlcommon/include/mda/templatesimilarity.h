@@ -0,0 +1,46 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef TEMPLATESIMILARITY_H
+#define TEMPLATESIMILARITY_H
+
+#include <QList>
+#include <QVector>
+#include "mda.h"
+#include "mda32.h"
+
+/*
+ * All-pairs comparisons of a set of templates (MxTxK: K templates of M channels by T timepoints),
+ * for the processors that look for similar clusters.
+ *
+ * Everything is derived from inner products between the templates, computed as a blocked matrix
+ * product of the (M*T)xK template matrix with itself: tiles of 64x64 template pairs, split over
+ * all cores. A time shift of s timepoints is the same product with the rows offset by M*s, so the
+ * best-lag comparisons cost one such product per shift.
+ *
+ * The returned matrices are KxK, with entry (k1,k2) for templates k1 and k2 (zero-based).
+ */
+namespace TemplateSimilarity {
+
+//sum over m,t of X(m,t,k1)*X(m,t,k2)
+Mda innerProducts(const Mda32& templates);
+
+//euclidean distances
+Mda distances(const Mda32& templates);
+
+//Pearson correlation over all M*T entries (as MLCompute::correlation)
+Mda correlations(const Mda32& templates);
+
+//the largest over the shifts s = -max_shift..max_shift of sum over m,t of X(m,t,k1)*X(m,t-s,k2)
+//(zero padded), with the shift that achieves it in best_shifts
+Mda bestLagInnerProducts(Mda& best_shifts, const Mda32& templates, int max_shift);
+
+//the same, normalized by the norms of the two templates
+Mda bestLagCorrelations(Mda& best_shifts, const Mda32& templates, int max_shift);
+
+//for each k, the indices of the num templates closest to it, nearest first (itself excluded)
+QList<QVector<int> > nearestNeighbors(const Mda& distances, int num);
+}
+
+#endif // TEMPLATESIMILARITY_H
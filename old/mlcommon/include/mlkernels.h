@@ -0,0 +1,58 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#ifndef MLKERNELS_H
+#define MLKERNELS_H
+
+#include "mlcommon.h"
+
+/*
+ * Vectorized loops on float arrays, for the inner loops of MLCompute and the processors.
+ *
+ * Each kernel has a scalar version and, on x86, SSE2, AVX2 and AVX-512 versions that are compiled
+ * into the same library (with per-function target attributes) and chosen at runtime from the
+ * instructions that the cpu supports. So a single build runs everywhere and uses what it can.
+ *
+ * Sums and products are accumulated in double, from exact products of the floats, so the result
+ * only differs from the scalar version by the order of the additions. The int16 conversions
+ * round to nearest (ties to even) and saturate; they are identical in every version.
+ */
+
+namespace MLKernels {
+
+enum InstructionSet {
+    Scalar = 0,
+    SSE2 = 1,
+    AVX2 = 2,
+    AVX512 = 3
+};
+
+//the best that the cpu supports (and this build has), unless overridden with setInstructionSet()
+InstructionSet instructionSet();
+//for testing and benchmarking; capped at what the cpu supports. Not thread-safe with running kernels.
+void setInstructionSet(InstructionSet set);
+InstructionSet supportedInstructionSet();
+const char* instructionSetName(InstructionSet set);
+
+double dot(bigint N, const float* X, const float* Y);
+//sum_i (X[i]-mean_x)*(Y[i]-mean_y), in double; the second pass of a variance or covariance
+double centeredDot(bigint N, const float* X, const float* Y, double mean_x, double mean_y);
+double sum(bigint N, const float* X);
+//sum_i (X[i]-Y[i])^2
+double distSquared(bigint N, const float* X, const float* Y);
+//Y += a*X (fused where the cpu has fma, so the last bit may differ between versions)
+void axpy(bigint N, float a, const float* X, float* Y);
+//N must be at least 1. NaN entries are skipped, except that a NaN first entry gives NaN for both
+//(as with a plain loop of < and > comparisons); the result does not depend on the instruction set
+void minMax(bigint N, const float* X, float& min, float& max);
+
+//Y = X*factor, rounded and saturated; and the reverse (for scaled int16 arrays, see mdaio.h)
+void floatToInt16(bigint N, const float* X, qint16* Y, float factor = 1);
+void int16ToFloat(bigint N, const qint16* X, float* Y, float factor = 1);
+//the same rounding and saturation for double (scalar only -- it is bound by memory, not arithmetic)
+void doubleToInt16(bigint N, const double* X, qint16* Y, double factor = 1);
+}
+
+#endif // MLKERNELS_H
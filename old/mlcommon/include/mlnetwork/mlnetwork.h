@@ -14,6 +14,7 @@
 #include <QThread>
 #include <QTime>
 #include <taskprogress.h>
+#include "mlcommon.h"
 
 namespace MLNetwork {
 
@@ -74,16 +75,31 @@ private:
     QFile* m_file = 0;
 };
 
+/*
+ * Downloads a file in parts with HTTP range requests (also passed as the bytes=a-b query
+ * parameter understood by the prv file servers), writing each part at its offset in the
+ * preallocated (sparse) destination file, so there is no concatenation step.
+ *
+ * At most num_threads parts are in flight. A failed part is retried up to max_attempts_per_part
+ * times. The sha1 of every completed part is recorded in <destination_file_name>.download_state,
+ * so an interrupted download resumes with the missing parts (the recorded parts are verified
+ * against their checksums first). When checksum is set, the sha1 of the whole file is verified
+ * at the end.
+ */
+struct DownloadPart;
 class PrvParallelDownloader : public Runner {
     Q_OBJECT
 public:
     virtual ~PrvParallelDownloader();
 
     //input
-    QString source_url; //must be prv protocol
+    QString source_url; //must be prv protocol or a server that honors range requests
     QString destination_file_name;
-    int size = 0; //mandatory
-    int num_threads = 10;
+    bigint size = 0; //mandatory
+    int num_threads = 10; //maximum number of simultaneous requests
+    bigint part_size = 0; //0 means size/num_threads, at least 1 MB and at most 64 MB
+    int max_attempts_per_part = 3;
+    QString checksum; //optional sha1 of the whole file
 
     //output
     bool success = true;
@@ -91,19 +107,25 @@ public:
 
     void start();
     double elapsed_msec();
-    int num_bytes_downloaded();
-private slots:
-    void slot_downloader_progress();
-    void slot_downloader_finished();
-    void slot_concatenate_finished();
+    bigint num_bytes_downloaded();
 
 private:
-    QMutex m_mutex;
     QTime m_timer;
-    int m_num_bytes_downloaded = 0;
+    bigint m_num_bytes_downloaded = 0;
 
     TaskProgress m_task;
-    QList<Downloader*> m_downloaders;
+    QFile* m_file = 0;
+    QList<DownloadPart*> m_parts;
+    QList<QNetworkReply*> m_replies;
+
+    bool resume_or_preallocate();
+    void start_next_parts();
+    void start_part(DownloadPart* P);
+    void on_part_ready_read(DownloadPart* P, QNetworkReply* reply);
+    void on_part_finished(DownloadPart* P, QNetworkReply* reply);
+    void write_state();
+    void fail(const QString& err);
+    void finish();
 };
 
 class Uploader : public Runner {
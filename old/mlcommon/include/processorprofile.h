@@ -0,0 +1,82 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef PROCESSORPROFILE_H
+#define PROCESSORPROFILE_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+/*
+ * Machine-readable profile of a single processor run.
+ *
+ * The processor marks named phases (wall and cpu time, bytes read/written and bytes
+ * allocated during the phase) and the time threads spend waiting to enter critical
+ * sections. Byte counts come from the allocated_bytes/bytes_read/bytes_written counters of
+ * the registered ICounterManager, so those counters should be registered before start() is
+ * called. The peak of the allocated bytes comes from MdaAllocator.
+ *
+ * The processor executable writes the profile to <_tempdir>/_profile.json, from where the
+ * ProcessManager picks it up and stores it with the process record.
+ *
+ * Usage:
+ *   ProcessorProfile::globalInstance()->start("mountainsort.whiten");
+ *   {
+ *       ProfilePhase phase("compute_covariance");
+ *       ...
+ *       ProfileLockWait lock_wait("lock1");
+ *       #pragma omp critical(lock1)
+ *       {
+ *           lock_wait.acquired();
+ *           ...
+ *       }
+ *   }
+ *   ProcessorProfile::globalInstance()->write(tempdir + "/_profile.json");
+ */
+
+class ProcessorProfilePrivate;
+class ProcessorProfile {
+public:
+    friend class ProcessorProfilePrivate;
+    ProcessorProfile();
+    virtual ~ProcessorProfile();
+
+    void start(const QString& processor_name);
+    void setNumThreads(int num_threads); //used for computing the thread utilization
+    void startPhase(const QString& name);
+    void endPhase(const QString& name);
+    void addLockWait(const QString& lock_name, double sec); //thread safe
+
+    QJsonObject toJsonObject() const;
+    bool write(const QString& path) const;
+
+    static ProcessorProfile* globalInstance();
+    // totals over the profiles of many processor runs (e.g., a pipeline), grouped by processor
+    static QJsonObject aggregate(const QList<QJsonObject>& profiles);
+
+private:
+    ProcessorProfilePrivate* d;
+};
+
+class ProfilePhase {
+public:
+    ProfilePhase(const QString& name);
+    virtual ~ProfilePhase();
+
+private:
+    QString m_name;
+};
+
+class ProfileLockWait {
+public:
+    ProfileLockWait(const char* lock_name);
+    void acquired(); //call first thing inside the critical section
+
+private:
+    const char* m_lock_name;
+    double m_start_sec;
+};
+
+#endif // PROCESSORPROFILE_H
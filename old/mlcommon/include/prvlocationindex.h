@@ -0,0 +1,62 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef PRVLOCATIONINDEX_H
+#define PRVLOCATIONINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include "mlcommon.h"
+
+/*
+ * Persistent size -> paths index over the local search paths, consulted by MLUtil::locatePrv
+ * instead of walking the search paths and checksumming every file of the right size.
+ *
+ * One index file is kept per search root (in <tempPath>/prv_location_index). Rescans are
+ * incremental: a directory is only re-listed when its modification time has changed, so an
+ * unchanged tree costs one stat per directory. The fast checksum and checksum of a file are
+ * computed lazily, only when the file is a candidate for a lookup, and are kept in the index
+ * for as long as the size and modification time of the file are unchanged.
+ *
+ * Computed checksums are appended to a journal next to the index file, which is merged into the
+ * index when the directory structure changes or the journal gets long, so a lookup does not
+ * rewrite the whole index. Symbolic links to directories are followed, but each directory
+ * (by canonical path) is scanned only once, so a link to an ancestor does not loop.
+ *
+ * A file that is rewritten in place with a different size (or that appears without changing the
+ * modification time of its directory) is not seen by an incremental rescan, so MLUtil::locatePrv
+ * falls back to searching the paths directly when the index has no match, and records what it
+ * finds with updateFile(). A search that finds nothing is remembered with recordMiss() for
+ * PRV_LOCATION_INDEX_MISS_TTL_SEC seconds (or until a rescan sees a changed directory).
+ */
+
+#define PRV_LOCATION_INDEX_MISS_TTL_SEC 30
+
+class PrvLocationIndexPrivate;
+class PrvLocationIndex {
+public:
+    friend class PrvLocationIndexPrivate;
+    PrvLocationIndex();
+    virtual ~PrvLocationIndex();
+
+    void setIndexDirectory(const QString& path); //default is <tempPath>/prv_location_index
+
+    //returns the paths of all files under the search paths with the given size and checksum (fcs is optional)
+    QStringList locateFiles(bigint size, const QString& checksum, const QString& fcs, const QStringList& search_paths, bool first_only = false);
+    //same as MLUtil::computeSha1SumOfFile, but uses (and records) the checksum in the index when path is under one of the search paths
+    QString checksumOfFile(const QString& path, const QStringList& search_paths);
+    void rescan(const QStringList& search_paths);
+    //re-reads the size and modification time of a file under one of the search paths (adding it if it is not indexed)
+    void updateFile(const QString& path, const QStringList& search_paths);
+    //negative results of the direct search in MLUtil::locatePrv (key identifies the object and the search paths)
+    bool isRecentMiss(const QString& key);
+    void recordMiss(const QString& key);
+
+    static PrvLocationIndex* globalInstance();
+
+private:
+    PrvLocationIndexPrivate* d;
+};
+
+#endif // PRVLOCATIONINDEX_H
@@ -48,7 +48,7 @@ struct TaskInfo {
     QString description;
     QList<TaskProgressLogMessage> log_messages;
     QString error;
-    double progress;
+    double progress = 0;
     QDateTime start_time;
     QDateTime end_time;
 };
@@ -118,6 +118,7 @@ protected:
 private:
     TaskInfo m_info;
     int m_id;
+    int m_recorded_permille = -1; // the progress last sent to the monitor, in thousandths
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(TaskProgress::StandardCategories);
@@ -5,6 +5,9 @@ unix:PRE_TARGETDEPS += $$MLCOMMONLIB
 
 QT += network
 
+#shm_open (SharedMemoryMda), which older glibc keeps in librt
+unix:!macx:LIBS += -lrt
+
 #The old version was as follows
 #INCLUDEPATH += $$PWD/include $$PWD/include/cachemanager
 #LIBS += $$PWD/lib/libmlcommon.a
@@ -0,0 +1,465 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "asyncdiskwritemda.h"
+#include "mdaio.h"
+#include "mlkernels.h"
+
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <QDebug>
+#include <math.h>
+#include <unistd.h>
+#include <icounter.h>
+#include <objectregistry.h>
+
+class AsyncDiskWriteMdaThread : public QThread {
+public:
+    AsyncDiskWriteMdaPrivate* d;
+    void run();
+};
+
+class AsyncDiskWriteMdaPrivate {
+public:
+    AsyncDiskWriteMda* q;
+    QString m_path;
+    MDAIO_HEADER m_header;
+    FILE* m_file = 0;
+    bigint m_max_queued_bytes = 256 * 1024 * 1024;
+    double m_scale = 1; //as set before open()
+    AsyncDiskWriteMdaThread m_thread;
+    IIntCounter* m_bytes_written_counter = 0;
+
+    //everything below is protected by m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_queue_not_empty;
+    QWaitCondition m_queue_not_full;
+    QMap<bigint, QByteArray> m_queue; //entry index -> converted bytes
+    bigint m_queued_bytes = 0;
+    bigint m_next_index = 0; //where the file position will be after the previous write
+    bool m_closing = false;
+    bool m_flushing = false;
+    bool m_writing = false; //a chunk taken from the queue is being written
+    bool m_error = false;
+    bool m_data_enqueued = false;
+
+    int determine_ndims(bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6);
+    bigint clip_size(bigint i, bigint size);
+    bool enqueue(bigint i, const QByteArray& bytes);
+    void run_writer();
+};
+
+void AsyncDiskWriteMdaThread::run()
+{
+    d->run_writer();
+}
+
+AsyncDiskWriteMda::AsyncDiskWriteMda()
+{
+    d = new AsyncDiskWriteMdaPrivate;
+    d->q = this;
+    d->m_thread.d = d;
+    ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
+    if (manager)
+        d->m_bytes_written_counter = static_cast<IIntCounter*>(manager->counter("bytes_written"));
+}
+
+AsyncDiskWriteMda::AsyncDiskWriteMda(int data_type, const QString& path, bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6)
+{
+    d = new AsyncDiskWriteMdaPrivate;
+    d->q = this;
+    d->m_thread.d = d;
+    ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
+    if (manager)
+        d->m_bytes_written_counter = static_cast<IIntCounter*>(manager->counter("bytes_written"));
+    this->open(data_type, path, N1, N2, N3, N4, N5, N6);
+}
+
+AsyncDiskWriteMda::~AsyncDiskWriteMda()
+{
+    close();
+    delete d;
+}
+
+bool AsyncDiskWriteMda::open(int data_type, const QString& path, bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6)
+{
+    if (d->m_file) {
+        qWarning() << "Error in AsyncDiskWriteMda::open -- cannot open the file twice";
+        return false;
+    }
+
+    if (QFile::exists(path)) {
+        if (!QFile::remove(path)) {
+            qWarning() << "Unable to remove file in AsyncDiskWriteMda::open" << path;
+            return false;
+        }
+    }
+    d->m_path = path;
+
+    d->m_header.data_type = data_type;
+    d->m_header.scale = d->m_scale;
+    for (int i = 0; i < MDAIO_MAX_DIMS; i++)
+        d->m_header.dims[i] = 1;
+    d->m_header.dims[0] = N1;
+    d->m_header.dims[1] = N2;
+    d->m_header.dims[2] = N3;
+    d->m_header.dims[3] = N4;
+    d->m_header.dims[4] = N5;
+    d->m_header.dims[5] = N6;
+    d->m_header.num_dims = d->determine_ndims(N1, N2, N3, N4, N5, N6);
+
+    d->m_file = fopen((path + ".tmp").toLatin1().data(), "wb");
+    if (!d->m_file) {
+        qWarning() << "Error in AsyncDiskWriteMda::open -- problem in fopen: " + path + ".tmp";
+        return false;
+    }
+    //a large stdio buffer so that contiguous chunks are coalesced into big sequential writes
+    setvbuf(d->m_file, 0, _IOFBF, 4 * 1024 * 1024);
+
+    if (!mda_write_header(&d->m_header, d->m_file)) {
+        qWarning() << "Error in AsyncDiskWriteMda::open -- problem writing header: " + path + ".tmp";
+        fclose(d->m_file);
+        d->m_file = 0;
+        return false;
+    }
+
+    //extend the file to its full size -- regions never written will read as zeros
+    bigint NN = N1 * N2 * N3 * N4 * N5 * N6;
+    if (NN > 0) {
+        fseeko(d->m_file, d->m_header.header_size + d->m_header.num_bytes_per_entry * NN - 1, SEEK_SET);
+        unsigned char zero = 0;
+        fwrite(&zero, 1, 1, d->m_file);
+    }
+
+    d->m_queue.clear();
+    d->m_queued_bytes = 0;
+    d->m_next_index = -1; //force a seek before the first write
+    d->m_closing = false;
+    d->m_flushing = false;
+    d->m_writing = false;
+    d->m_error = false;
+    d->m_data_enqueued = false;
+    d->m_thread.start();
+
+    return true;
+}
+
+bool AsyncDiskWriteMda::close()
+{
+    if (!d->m_file)
+        return true;
+
+    {
+        QMutexLocker locker(&d->m_mutex);
+        d->m_closing = true;
+        d->m_queue_not_empty.wakeAll();
+    }
+    d->m_thread.wait();
+
+    bool ret = !d->m_error;
+    if (fclose(d->m_file) != 0)
+        ret = false;
+    d->m_file = 0;
+    if (!QFile::rename(d->m_path + ".tmp", d->m_path)) {
+        qWarning() << "Unable to rename file in AsyncDiskWriteMda::close" << d->m_path + ".tmp" << d->m_path;
+        ret = false;
+    }
+    return ret;
+}
+
+bool AsyncDiskWriteMda::flush()
+{
+    if (!d->m_file)
+        return false;
+    QMutexLocker locker(&d->m_mutex);
+    d->m_flushing = true;
+    d->m_queue_not_empty.wakeAll();
+    while ((!d->m_error) && ((!d->m_queue.isEmpty()) || (d->m_writing))) {
+        d->m_queue_not_full.wait(&d->m_mutex);
+    }
+    d->m_flushing = false;
+    if (d->m_error)
+        return false;
+    //the writer only uses the file while m_writing, so it is ours while the mutex is held
+    return (fflush(d->m_file) == 0);
+}
+
+void AsyncDiskWriteMda::setMaxQueuedBytes(bigint num_bytes)
+{
+    d->m_max_queued_bytes = num_bytes;
+}
+
+bool AsyncDiskWriteMda::setScale(double scale)
+{
+    if (!d->m_file) {
+        d->m_scale = scale;
+        return true;
+    }
+    if ((d->m_header.data_type != MDAIO_TYPE_INT16) || (scale == d->m_header.scale))
+        return true;
+    QMutexLocker locker(&d->m_mutex);
+    if (d->m_data_enqueued) {
+        qWarning() << "Error in AsyncDiskWriteMda::setScale -- the scale must be set before writing any data" << d->m_path;
+        return false;
+    }
+    //the writer thread is idle until the first chunk, and the data is all zeros, so
+    //the header can be rewritten and the size of the file follow it
+    d->m_header.scale = scale;
+    bool ok = ((fseeko(d->m_file, 0, SEEK_SET) == 0) && (mda_write_header(&d->m_header, d->m_file)) && (fflush(d->m_file) == 0));
+    if (ok)
+        ok = (ftruncate(fileno(d->m_file), d->m_header.header_size + d->m_header.num_bytes_per_entry * totalSize()) == 0);
+    if (!ok) {
+        qWarning() << "Error in AsyncDiskWriteMda::setScale -- problem rewriting the header" << d->m_path;
+        d->m_error = true;
+    }
+    d->m_next_index = -1;
+    return ok;
+}
+
+bigint AsyncDiskWriteMda::N1()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[0];
+}
+
+bigint AsyncDiskWriteMda::N2()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[1];
+}
+
+bigint AsyncDiskWriteMda::N3()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[2];
+}
+
+bigint AsyncDiskWriteMda::N4()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[3];
+}
+
+bigint AsyncDiskWriteMda::N5()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[4];
+}
+
+bigint AsyncDiskWriteMda::N6()
+{
+    if (!d->m_file)
+        return 0;
+    return d->m_header.dims[5];
+}
+
+bigint AsyncDiskWriteMda::totalSize()
+{
+    return N1() * N2() * N3() * N4() * N5() * N6();
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda& X, bigint i)
+{
+    if (!d->m_file)
+        return false;
+    bigint size = d->clip_size(i, X.totalSize());
+    if (size <= 0) {
+        qWarning() << "size is zero in AsyncDiskWriteMda::writeChunk";
+        return false;
+    }
+    //convert in the calling thread, not in the writer thread
+    QByteArray bytes(size * d->m_header.num_bytes_per_entry, Qt::Uninitialized);
+    if (d->m_header.data_type == MDAIO_TYPE_INT16)
+        MLKernels::doubleToInt16(size, X.constDataPtr(), (int16_t*)bytes.data(), 1.0 / d->m_header.scale);
+    else
+        mda_convert_float64(X.constDataPtr(), &d->m_header, size, bytes.data());
+    return d->enqueue(i, bytes);
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda& X, bigint i1, bigint i2)
+{
+    if ((X.N1() == N1()) && (i1 == 0)) {
+        return writeChunk(X, i1 + this->N1() * i2);
+    }
+    else {
+        qWarning() << "This case not yet supported in 2d AsyncDiskWriteMda::writeChunk" << X.N1() << X.N2() << N1() << N2() << i1 << i2;
+        return false;
+    }
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda& X, bigint i1, bigint i2, bigint i3)
+{
+    if ((i3 == 0) && (X.N3() == 1))
+        return writeChunk(X, i1, i2);
+    if ((X.N1() == N1()) && (X.N2() == N2()) && (i1 == 0) && (i2 == 0)) {
+        return writeChunk(X, i1 + this->N1() * i2 + this->N1() * this->N2() * i3);
+    }
+    else {
+        qWarning() << "This case not yet supported in 3d AsyncDiskWriteMda::writeChunk" << X.N1() << X.N2() << X.N3() << N1() << N2() << N3() << i1 << i2 << i3;
+        return false;
+    }
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda32& X, bigint i)
+{
+    return writeChunk(Mda32View(X), i);
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda32& X, bigint i1, bigint i2)
+{
+    return writeChunk(Mda32View(X), i1, i2);
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda32& X, bigint i1, bigint i2, bigint i3)
+{
+    if ((i3 == 0) && (X.N3() == 1))
+        return writeChunk(X, i1, i2);
+    if ((X.N1() == N1()) && (X.N2() == N2()) && (i1 == 0) && (i2 == 0)) {
+        return writeChunk(X, i1 + this->N1() * i2 + this->N1() * this->N2() * i3);
+    }
+    else {
+        qWarning() << "This case not yet supported in 3d AsyncDiskWriteMda::writeChunk" << X.N1() << X.N2() << X.N3() << N1() << N2() << N3() << i1 << i2 << i3;
+        return false;
+    }
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda32View& X, bigint i)
+{
+    if (!d->m_file)
+        return false;
+    bigint size = d->clip_size(i, X.totalSize());
+    if (size <= 0) {
+        qWarning() << "size is zero in AsyncDiskWriteMda::writeChunk";
+        return false;
+    }
+    //convert in the calling thread, not in the writer thread
+    QByteArray bytes(size * d->m_header.num_bytes_per_entry, Qt::Uninitialized);
+    if (d->m_header.data_type == MDAIO_TYPE_INT16)
+        MLKernels::floatToInt16(size, X.constDataPtr(), (int16_t*)bytes.data(), 1.0 / d->m_header.scale);
+    else
+        mda_convert_float32(X.constDataPtr(), &d->m_header, size, bytes.data());
+    return d->enqueue(i, bytes);
+}
+
+bool AsyncDiskWriteMda::writeChunk(const Mda32View& X, bigint i1, bigint i2)
+{
+    if ((X.N1() == N1()) && (i1 == 0)) {
+        return writeChunk(X, i1 + this->N1() * i2);
+    }
+    else {
+        qWarning() << "This case not yet supported in 2d AsyncDiskWriteMda::writeChunk" << X.N1() << X.N2() << N1() << N2() << i1 << i2;
+        return false;
+    }
+}
+
+int AsyncDiskWriteMdaPrivate::determine_ndims(bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6)
+{
+    Q_UNUSED(N1)
+    Q_UNUSED(N2)
+    if (N6 > 1)
+        return 6;
+    if (N5 > 1)
+        return 5;
+    if (N4 > 1)
+        return 4;
+    if (N3 > 1)
+        return 3;
+    return 2;
+}
+
+bigint AsyncDiskWriteMdaPrivate::clip_size(bigint i, bigint size)
+{
+    bigint total_size = q->totalSize();
+    if (i + size > total_size)
+        size = total_size - i;
+    return size;
+}
+
+bool AsyncDiskWriteMdaPrivate::enqueue(bigint i, const QByteArray& bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    //block while the queue is full (but always accept a chunk into an empty queue, however large)
+    while ((!m_error) && (!m_queue.isEmpty()) && (m_queued_bytes + bytes.count() > m_max_queued_bytes)) {
+        m_queue_not_full.wait(&m_mutex);
+    }
+    if (m_error)
+        return false;
+    if (m_queue.contains(i)) {
+        //the same region written twice before it reached the disk -- the later write wins
+        m_queued_bytes -= m_queue[i].count();
+    }
+    m_queue[i] = bytes;
+    m_queued_bytes += bytes.count();
+    m_data_enqueued = true;
+    m_queue_not_empty.wakeAll();
+    return true;
+}
+
+void AsyncDiskWriteMdaPrivate::run_writer()
+{
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        if (m_queue.isEmpty()) {
+            if (m_closing)
+                break;
+            m_queue_not_empty.wait(&m_mutex);
+            continue;
+        }
+        //Prefer the chunk that continues where the previous write left off so the file is written sequentially.
+        //Otherwise wait for it to arrive, unless the queue is full (or we are closing), in which case take the lowest position.
+        QMap<bigint, QByteArray>::iterator it = m_queue.find(m_next_index);
+        if (it == m_queue.end()) {
+            bool full = (m_queued_bytes >= m_max_queued_bytes / 2);
+            if ((!full) && (!m_closing) && (!m_flushing) && (m_next_index >= 0)) {
+                if (!m_queue_not_empty.wait(&m_mutex, 100)) {
+                    //nothing arrived for a while -- the missing chunk may never come, so don't stall
+                    m_next_index = -1;
+                }
+                continue;
+            }
+            it = m_queue.begin();
+        }
+        bigint i = it.key();
+        QByteArray bytes = it.value();
+        m_queue.erase(it);
+        m_queued_bytes -= bytes.count();
+        m_queue_not_full.wakeAll();
+        bool needs_seek = (i != m_next_index);
+        m_next_index = i + bytes.count() / m_header.num_bytes_per_entry;
+        if (m_error)
+            continue; //keep draining so that blocked workers are released
+
+        m_writing = true;
+        locker.unlock();
+        bool ok = true;
+        if (needs_seek) {
+            if (fseeko(m_file, m_header.header_size + m_header.num_bytes_per_entry * i, SEEK_SET) != 0)
+                ok = false;
+        }
+        if (ok) {
+            if (fwrite(bytes.constData(), 1, bytes.count(), m_file) != (size_t)bytes.count())
+                ok = false;
+            else if (m_bytes_written_counter)
+                m_bytes_written_counter->add(bytes.count());
+        }
+        locker.relock();
+        m_writing = false;
+        m_queue_not_full.wakeAll(); //also for flush()
+
+        if (!ok) {
+            qWarning() << "Error writing chunk in AsyncDiskWriteMda" << m_path << i;
+            m_error = true;
+            m_queue_not_full.wakeAll();
+        }
+    }
+}
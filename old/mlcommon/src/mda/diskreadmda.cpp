@@ -12,6 +12,7 @@
 #include <QJsonArray>
 #include <icounter.h>
 #include <objectregistry.h>
+#include "sharedmemorymda.h"
 
 #define MAX_PATH_LEN 10000
 #define DEFAULT_CHUNK_SIZE 1e5
@@ -34,6 +35,8 @@ public:
     bool m_use_concat = false;
     int m_concat_dimension = 2;
     QList<DiskReadMda> m_concat_list;
+    SharedMemoryMdaMapping* m_mapping = 0; //when the path is a shared memory array
+    double m_scale = 1; //of a scaled int16 file, see MDAIO_HEADER::scale
 
     QString m_path;
     QJsonObject m_prv_object;
@@ -46,6 +49,8 @@ public:
     void construct_and_clear();
     bool read_header_if_needed();
     bool open_file_if_needed();
+    void close_file();
+    bigint read_entries(double* data, bigint i, bigint n);
     void copy_from(const DiskReadMda& other);
     bigint total_size();
     static QStringList find_all_mda_files_in_directory(QString dir_path, bool recursive);
@@ -165,9 +170,7 @@ DiskReadMda::DiskReadMda(int concat_dimension, const QStringList& array_paths)
 
 DiskReadMda::~DiskReadMda()
 {
-    if (d->m_file) {
-        fclose(d->m_file);
-    }
+    d->close_file();
     delete d;
 }
 
@@ -178,10 +181,7 @@ void DiskReadMda::operator=(const DiskReadMda& other)
 
 void DiskReadMda::setPath(const QString& file_path)
 {
-    if (d->m_file) {
-        fclose(d->m_file);
-        d->m_file = 0;
-    }
+    d->close_file();
     d->construct_and_clear();
 
     if ((file_path.endsWith(".txt")) || (file_path.endsWith(".csv"))) {
@@ -282,6 +282,13 @@ QString DiskReadMda::makePath() const
         return d->m_path;
     if (d->m_use_memory_mda) {
         QString checksum = compute_mda_checksum(d->m_memory_mda);
+        if (SharedMemoryMda::isEnabled()) {
+            //no disk round trip when the consumer is on the same machine. Pinned, so that it is still
+            //there when the consumer gets to it
+            QString path = SharedMemoryMda::publish(d->m_memory_mda, checksum + ".makePath.mda", true);
+            if (!path.isEmpty())
+                return path;
+        }
         QString fname = CacheManager::globalInstance()->makeLocalFile(checksum + ".makePath.mda", CacheManager::ShortTerm);
         if (QFile::exists(fname))
             return fname;
@@ -424,6 +431,13 @@ bigint DiskReadMda::totalSize() const
     return d->total_size();
 }
 
+double DiskReadMda::scale() const
+{
+    if (!d->read_header_if_needed())
+        return 1;
+    return d->m_scale;
+}
+
 MDAIO_HEADER DiskReadMda::mdaioHeader() const
 {
     d->read_header_if_needed();
@@ -561,8 +575,7 @@ bool DiskReadMda::readChunk(Mda& X, bigint i, bigint size) const
     bigint jB = qMin(i + size - 1, d->total_size() - 1);
     bigint size_to_read = jB - jA + 1;
     if (size_to_read > 0) {
-        fseeko(d->m_file, d->m_header.header_size + d->m_header.num_bytes_per_entry * (jA), SEEK_SET);
-        bigint bytes_read = mda_read_float64(&X.dataPtr()[jA - i], &d->m_header, size_to_read, d->m_file);
+        bigint bytes_read = d->read_entries(&X.dataPtr()[jA - i], jA, size_to_read);
         if (d->bytesReadCounter)
             d->bytesReadCounter->add(bytes_read);
         if (bytes_read != size_to_read) {
@@ -596,8 +609,7 @@ bool DiskReadMda::readChunk(Mda& X, bigint i1, bigint i2, bigint size1, bigint s
         bigint jB = qMin(i2 + size2 - 1, N2() - 1);
         bigint size2_to_read = jB - jA + 1;
         if (size2_to_read > 0) {
-            fseeko(d->m_file, d->m_header.header_size + d->m_header.num_bytes_per_entry * (i1 + N1() * jA), SEEK_SET);
-            bigint bytes_read = mda_read_float64(&X.dataPtr()[(jA - i2) * size1], &d->m_header, size1 * size2_to_read, d->m_file);
+            bigint bytes_read = d->read_entries(&X.dataPtr()[(jA - i2) * size1], i1 + N1() * jA, size1 * size2_to_read);
             if (d->bytesReadCounter)
                 d->bytesReadCounter->add(bytes_read);
             if (bytes_read != size1 * size2_to_read) {
@@ -641,8 +653,7 @@ bool DiskReadMda::readChunk(Mda& X, bigint i1, bigint i2, bigint i3, bigint size
         bigint jB = qMin(i3 + size3 - 1, N3() - 1);
         bigint size3_to_read = jB - jA + 1;
         if (size3_to_read > 0) {
-            fseeko(d->m_file, d->m_header.header_size + d->m_header.num_bytes_per_entry * (i1 + N1() * i2 + N1() * N2() * jA), SEEK_SET);
-            bigint bytes_read = mda_read_float64(&X.dataPtr()[(jA - i3) * size1 * size2], &d->m_header, size1 * size2 * size3_to_read, d->m_file);
+            bigint bytes_read = d->read_entries(&X.dataPtr()[(jA - i3) * size1 * size2], i1 + N1() * i2 + N1() * N2() * jA, size1 * size2 * size3_to_read);
             if (d->bytesReadCounter)
                 d->bytesReadCounter->add(bytes_read);
             if (bytes_read != size1 * size2 * size3_to_read) {
@@ -652,6 +663,23 @@ bool DiskReadMda::readChunk(Mda& X, bigint i1, bigint i2, bigint i3, bigint size
         }
         return true;
     }
+    else if ((size1 == N1()) && (i1 == 0)) {
+        //a range of the second dimension: one contiguous run for each index of the third
+        X.allocate(size1, size2, size3);
+        bigint jA = qMax(i2, (bigint)0);
+        bigint jB = qMin(i2 + size2 - 1, N2() - 1);
+        bigint size2_to_read = jB - jA + 1;
+        for (bigint k = qMax(i3, (bigint)0); (k < i3 + size3) && (k < N3()) && (size2_to_read > 0); k++) {
+            bigint bytes_read = d->read_entries(&X.dataPtr()[(jA - i2) * size1 + size1 * size2 * (k - i3)], N1() * jA + N1() * N2() * k, size1 * size2_to_read);
+            if (d->bytesReadCounter)
+                d->bytesReadCounter->add(bytes_read);
+            if (bytes_read != size1 * size2_to_read) {
+                printf("Warning problem reading 3d chunk in diskreadmda: %ld<>%ld\n", (bigint)bytes_read, (bigint)(size1 * size2_to_read));
+                return false;
+            }
+        }
+        return true;
+    }
     else {
         printf("Warning: This case not yet supported (diskreadmda::readchunk 3d).\n");
         return false;
@@ -715,6 +743,7 @@ void DiskReadMdaPrivate::construct_and_clear()
     this->m_mda_header_total_size = 0;
     this->m_memory_mda = Mda();
     this->m_path = "";
+    this->m_scale = 1;
 }
 
 bool DiskReadMdaPrivate::read_header_if_needed()
@@ -749,6 +778,18 @@ bool DiskReadMdaPrivate::read_header_if_needed()
             N2 += m_concat_list[i].N2();
         }
         m_header.dims[1] = N2;
+        //each part applies its own scale. When they all agree, a writer can keep the scaled int16 type;
+        //otherwise the concatenation only has a floating point representation
+        m_scale = m_concat_list[0].scale();
+        for (int i = 1; i < m_concat_list.count(); i++) {
+            if ((m_concat_list[i].mdaioHeader().data_type != m_header.data_type) || (m_concat_list[i].scale() != m_scale)) {
+                m_header.data_type = MDAIO_TYPE_FLOAT64;
+                m_header.num_bytes_per_entry = mda_get_num_bytes_per_entry(MDAIO_TYPE_FLOAT64);
+                m_scale = 1;
+                break;
+            }
+        }
+        m_header.scale = m_scale;
         m_mda_header_total_size = 1;
         for (int i = 0; i < MDAIO_MAX_DIMS; i++)
             m_mda_header_total_size *= m_header.dims[i];
@@ -757,6 +798,8 @@ bool DiskReadMdaPrivate::read_header_if_needed()
     bool file_was_open = (m_file != 0); //so we can restore to previous state (we don't want too many files open unnecessarily)
     if (!open_file_if_needed()) //if successful, it will read the header
         return false;
+    if (m_mapping)
+        return true;
     if (!m_file)
         return false; //should never happen
     if (!file_was_open) {
@@ -774,12 +817,30 @@ bool DiskReadMdaPrivate::open_file_if_needed()
         read_header_if_needed();
         return true;
     }
-    if (m_file)
+    if ((m_file) || (m_mapping))
         return true;
     if (m_file_open_failed)
         return false;
     if (m_path.isEmpty())
         return false;
+    if (SharedMemoryMda::isSharedMemoryPath(m_path)) {
+        m_mapping = new SharedMemoryMdaMapping;
+        if (!m_mapping->open(m_path)) {
+            delete m_mapping;
+            m_mapping = 0;
+            m_file_open_failed = true;
+            return false;
+        }
+        if (!m_header_read) {
+            m_header = m_mapping->header();
+            m_mda_header_total_size = 1;
+            for (int i = 0; i < MDAIO_MAX_DIMS; i++)
+                m_mda_header_total_size *= m_header.dims[i];
+            m_scale = m_header.scale;
+            m_header_read = true;
+        }
+        return true;
+    }
     m_file = fopen(m_path.toUtf8().data(), "rb");
     if (m_file) {
         if (!m_header_read) {
@@ -788,6 +849,7 @@ bool DiskReadMdaPrivate::open_file_if_needed()
             m_mda_header_total_size = 1;
             for (int i = 0; i < MDAIO_MAX_DIMS; i++)
                 m_mda_header_total_size *= m_header.dims[i];
+            m_scale = m_header.scale;
             m_header_read = true;
         }
     }
@@ -809,10 +871,7 @@ void DiskReadMdaPrivate::copy_from(const DiskReadMda& other)
 {
     /// TODO (LOW) think about copying over additional information such as internal chunks
 
-    if (this->m_file) {
-        fclose(this->m_file);
-        this->m_file = 0;
-    }
+    this->close_file();
     this->allocatedCounter = other.d->allocatedCounter;
     this->freedCounter = other.d->freedCounter;
     this->bytesReadCounter = other.d->bytesReadCounter;
@@ -827,12 +886,40 @@ void DiskReadMdaPrivate::copy_from(const DiskReadMda& other)
     this->m_path = other.d->m_path;
     this->m_prv_object = other.d->m_prv_object;
     this->m_reshaped = other.d->m_reshaped;
+    this->m_scale = other.d->m_scale;
     this->m_use_memory_mda = other.d->m_use_memory_mda;
     this->m_use_concat = other.d->m_use_concat;
     this->m_concat_dimension = other.d->m_concat_dimension;
     this->m_concat_list = other.d->m_concat_list;
 }
 
+void DiskReadMdaPrivate::close_file()
+{
+    if (m_file) {
+        fclose(m_file);
+        m_file = 0;
+    }
+    if (m_mapping) {
+        delete m_mapping;
+        m_mapping = 0;
+    }
+}
+
+bigint DiskReadMdaPrivate::read_entries(double* data, bigint i, bigint n)
+{
+    if (m_mapping) {
+        //straight from the shared memory, no system calls and no intermediate buffer
+        return mda_decode_float64(m_mapping->data() + m_header.num_bytes_per_entry * i, &m_header, n, data);
+    }
+    fseeko(m_file, m_header.header_size + m_header.num_bytes_per_entry * i, SEEK_SET);
+    bigint ret = mda_read_float64(data, &m_header, n, m_file);
+    if (m_scale != 1) {
+        for (bigint j = 0; j < ret; j++)
+            data[j] *= m_scale;
+    }
+    return ret;
+}
+
 bigint DiskReadMdaPrivate::total_size()
 {
     if (m_use_memory_mda)
@@ -1,11 +1,17 @@
 #include "diskwritemda.h"
 #include "mdaio.h"
+#include "mlkernels.h"
 
 #include <QFile>
 #include <QString>
 #include <mda32.h>
 #include "mda.h"
 #include <QDebug>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+#include <icounter.h>
+#include <objectregistry.h>
 
 class DiskWriteMdaPrivate {
 public:
@@ -14,7 +20,13 @@ public:
     MDAIO_HEADER m_header;
     FILE* m_file;
     bool m_requires_rename = false;
+    double m_scale = 1; //as set before open()
+    bool m_data_written = false;
+    IIntCounter* bytesWrittenCounter = nullptr;
 
+    void init_counters();
+    void increment_bytes_written_counter(bigint num_entries);
+    bool rewrite_header();
     int determine_ndims(bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6);
 };
 
@@ -23,6 +35,7 @@ DiskWriteMda::DiskWriteMda()
     d = new DiskWriteMdaPrivate;
     d->q = this;
     d->m_file = 0;
+    d->init_counters();
 }
 
 DiskWriteMda::DiskWriteMda(int data_type, const QString& path, bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6)
@@ -30,6 +43,7 @@ DiskWriteMda::DiskWriteMda(int data_type, const QString& path, bigint N1, bigint
     d = new DiskWriteMdaPrivate;
     d->q = this;
     d->m_file = 0;
+    d->init_counters();
     this->open(data_type, path, N1, N2, N3, N4, N5, N6);
 }
 
@@ -52,10 +66,10 @@ bool DiskWriteMda::open(int data_type, const QString& path, bigint N1, bigint N2
             return false;
         }
     }
-
     d->m_path = path;
 
     d->m_header.data_type = data_type;
+    d->m_header.scale = d->m_scale;
     for (int i = 0; i < MDAIO_MAX_DIMS; i++)
         d->m_header.dims[i] = 1;
     d->m_header.dims[0] = N1;
@@ -68,6 +82,7 @@ bool DiskWriteMda::open(int data_type, const QString& path, bigint N1, bigint N2
 
     d->m_file = fopen((path + ".tmp").toLatin1().data(), "wb");
     d->m_requires_rename = true;
+    d->m_data_written = false;
 
     if (!d->m_file) {
         qWarning() << "Error in DiskWriteMda::open -- problem in fopen: " + path + ".tmp";
@@ -110,10 +125,10 @@ bool DiskWriteMda::open(const QString& path)
 
     d->m_requires_rename = false;
     d->m_file = fopen(path.toLatin1().data(), "r+"); //open file for update, both read and write
-    mda_read_header(&d->m_header, d->m_file);
-
     if (!d->m_file)
         return false;
+    mda_read_header(&d->m_header, d->m_file); //keep writing in the units of the file
+    d->m_data_written = true; //the data is already there, so the header can't change size
 
     return true;
 }
@@ -131,6 +146,26 @@ void DiskWriteMda::close()
     }
 }
 
+bool DiskWriteMda::setScale(double scale)
+{
+    if (!d->m_file) {
+        d->m_scale = scale;
+        return true;
+    }
+    if ((d->m_header.data_type != MDAIO_TYPE_INT16) || (scale == d->m_header.scale))
+        return true;
+    if (d->m_data_written) {
+        qWarning() << "Error in DiskWriteMda::setScale -- the scale must be set before writing any data" << d->m_path;
+        return false;
+    }
+    d->m_header.scale = scale;
+    if (!d->rewrite_header()) {
+        qWarning() << "Error in DiskWriteMda::setScale -- problem rewriting the header" << d->m_path;
+        return false;
+    }
+    return true;
+}
+
 bigint DiskWriteMda::N1()
 {
     if (!d->m_file)
@@ -187,8 +222,16 @@ bool DiskWriteMda::writeChunk(Mda& X, bigint i)
     if (i + size > this->totalSize())
         size = this->totalSize() - i;
     if (size > 0) {
-        if (!mda_write_float64(X.dataPtr(), &d->m_header, size, d->m_file))
+        d->m_data_written = true;
+        if ((d->m_header.data_type == MDAIO_TYPE_INT16) && (d->m_header.scale != 1)) {
+            std::vector<int16_t> buf(size);
+            MLKernels::doubleToInt16(size, X.constDataPtr(), buf.data(), 1.0 / d->m_header.scale);
+            if (!mda_write_int16(buf.data(), &d->m_header, size, d->m_file))
+                return false;
+        }
+        else if (!mda_write_float64(X.dataPtr(), &d->m_header, size, d->m_file))
             return false;
+        d->increment_bytes_written_counter(size);
     }
     return true;
 }
@@ -227,7 +270,17 @@ bool DiskWriteMda::writeChunk(Mda32& X, bigint i)
     if (i + size > this->totalSize())
         size = this->totalSize() - i;
     if (size > 0) {
-        return mda_write_float32(X.dataPtr(), &d->m_header, size, d->m_file);
+        d->m_data_written = true;
+        if ((d->m_header.data_type == MDAIO_TYPE_INT16) && (d->m_header.scale != 1)) {
+            std::vector<int16_t> buf(size);
+            MLKernels::floatToInt16(size, X.constDataPtr(), buf.data(), 1.0 / d->m_header.scale);
+            if (!mda_write_int16(buf.data(), &d->m_header, size, d->m_file))
+                return false;
+        }
+        else if (!mda_write_float32(X.dataPtr(), &d->m_header, size, d->m_file))
+            return false;
+        d->increment_bytes_written_counter(size);
+        return true;
     }
     else {
         qWarning() << "size is zero in writeChunk";
@@ -260,6 +313,32 @@ bool DiskWriteMda::writeChunk(Mda32& X, bigint i1, bigint i2, bigint i3)
     }
 }
 
+void DiskWriteMdaPrivate::init_counters()
+{
+    ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
+    if (manager) {
+        bytesWrittenCounter = static_cast<IIntCounter*>(manager->counter("bytes_written"));
+    }
+}
+
+void DiskWriteMdaPrivate::increment_bytes_written_counter(bigint num_entries)
+{
+    if (bytesWrittenCounter)
+        bytesWrittenCounter->add(num_entries * m_header.num_bytes_per_entry);
+}
+
+bool DiskWriteMdaPrivate::rewrite_header()
+{
+    if (fseeko(m_file, 0, SEEK_SET) != 0)
+        return false;
+    if (!mda_write_header(&m_header, m_file))
+        return false;
+    if (fflush(m_file) != 0)
+        return false;
+    //nothing has been written, so the data is all zeros and only the size of the file needs to follow the header
+    return (ftruncate(fileno(m_file), m_header.header_size + m_header.num_bytes_per_entry * q->totalSize()) == 0);
+}
+
 int DiskWriteMdaPrivate::determine_ndims(bigint N1, bigint N2, bigint N3, bigint N4, bigint N5, bigint N6)
 {
 #ifdef QT_CORE_LIB
@@ -55,6 +55,31 @@ void Mda::operator=(const Mda& other)
     d = other.d;
 }
 
+//what a moved-from array holds: a 1x1 array, shared until it is written to
+static const QSharedDataPointer<MdaDataDouble>& moved_from_data()
+{
+    static QSharedDataPointer<MdaDataDouble> ret = []() {
+        QSharedDataPointer<MdaDataDouble> X(new MdaDataDouble);
+        X->allocate(0, 1, 1);
+        return X;
+    }();
+    return ret;
+}
+
+Mda::Mda(Mda&& other)
+    : d(moved_from_data())
+{
+    d.swap(other.d);
+}
+
+void Mda::operator=(Mda&& other)
+{
+    if (&other == this)
+        return;
+    d.swap(other.d);
+    other.d = moved_from_data();
+}
+
 Mda::~Mda()
 {
 }
@@ -208,6 +233,11 @@ bool Mda::read(const char* path)
     mda_read_float64(d->data(), &H, d->totalSize(), input_file);
     d->incrementBytesReadCounter(d->totalSize() * H.num_bytes_per_entry);
     fclose(input_file);
+    if (H.scale != 1) {
+        double* ptr = d->data();
+        for (bigint i = 0; i < d->totalSize(); i++)
+            ptr[i] *= H.scale;
+    }
     return true;
 }
 
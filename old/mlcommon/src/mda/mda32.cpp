@@ -36,6 +36,31 @@ void Mda32::operator=(const Mda32& other)
     d = other.d;
 }
 
+//what a moved-from array holds: a 1x1 array, shared until it is written to
+static const QSharedDataPointer<MdaDataFloat>& moved_from_data()
+{
+    static QSharedDataPointer<MdaDataFloat> ret = []() {
+        QSharedDataPointer<MdaDataFloat> X(new MdaDataFloat);
+        X->allocate(0, 1, 1);
+        return X;
+    }();
+    return ret;
+}
+
+Mda32::Mda32(Mda32&& other)
+    : d(moved_from_data())
+{
+    d.swap(other.d);
+}
+
+void Mda32::operator=(Mda32&& other)
+{
+    if (&other == this)
+        return;
+    d.swap(other.d);
+    other.d = moved_from_data();
+}
+
 Mda32::~Mda32()
 {
 }
@@ -91,6 +116,12 @@ bool Mda32::read(const char* path)
     mda_read_float32(d->data(), &H, d->totalSize(), input_file);
     d->incrementBytesReadCounter(d->totalSize() * H.num_bytes_per_entry);
     fclose(input_file);
+    if (H.scale != 1) {
+        float* ptr = d->data();
+        float factor = H.scale; //in float, as in DiskReadMda32
+        for (bigint i = 0; i < d->totalSize(); i++)
+            ptr[i] *= factor;
+    }
     return true;
 }
 
@@ -514,6 +545,15 @@ void Mda32::getChunk(Mda32& ret, bigint i1, bigint i2, bigint i3, bigint size1,
     }
 }
 
+Mda32View Mda32::columnsView(bigint i2, bigint size2) const
+{
+    if ((i2 < 0) || (size2 < 0) || (i2 + size2 > N2()) || (N3() * N4() * N5() * N6() != 1)) {
+        qWarning() << "Unexpected range in Mda32::columnsView" << i2 << size2 << N1() << N2() << N3();
+        return Mda32View();
+    }
+    return Mda32View(constDataPtr() + N1() * i2, N1(), size2);
+}
+
 void Mda32::setChunk(Mda32& X, bigint i)
 {
     bigint size = X.totalSize();
@@ -0,0 +1,233 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "mdaallocator.h"
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QThreadStorage>
+#include <objectregistry.h>
+
+#define MDA_POOL_MIN_BYTES 64
+#define MDA_POOL_NUM_CLASSES 81 // up to MDA_POOL_MAX_BYTES
+#define MDA_POOL_BLOCKS_PER_CLASS 8
+
+struct MdaCounters {
+    IIntCounter* allocated = 0;
+    IIntCounter* freed = 0;
+    IIntCounter* bytes_read = 0;
+    IIntCounter* bytes_written = 0;
+};
+
+class MdaThreadCache {
+public:
+    ~MdaThreadCache();
+    void releaseAll();
+
+    void* blocks[MDA_POOL_NUM_CLASSES][MDA_POOL_BLOCKS_PER_CLASS];
+    int counts[MDA_POOL_NUM_CLASSES] = { 0 };
+    bigint cached_bytes = 0;
+    int trim_generation = 0; //the free list is emptied when this falls behind s_trim_generation
+};
+
+Q_GLOBAL_STATIC(QThreadStorage<MdaThreadCache*>, s_thread_caches)
+static QAtomicPointer<MdaCounters> s_counters;
+static QAtomicInteger<qint64> s_outstanding_bytes;
+static QAtomicInteger<qint64> s_peak_outstanding_bytes;
+static QAtomicInteger<qint64> s_cached_bytes; //in the free lists of all threads
+static QAtomicInteger<int> s_trim_generation;
+
+static const MdaCounters* counters()
+{
+    static MdaCounters no_counters;
+    MdaCounters* C = s_counters.loadAcquire();
+    if (C)
+        return C;
+    //the manager is registered at startup by the programs that have one; until it is found, look again
+    ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
+    if (!manager)
+        return &no_counters;
+    C = new MdaCounters;
+    C->allocated = static_cast<IIntCounter*>(manager->counter("allocated_bytes"));
+    C->freed = static_cast<IIntCounter*>(manager->counter("freed_bytes"));
+    C->bytes_read = static_cast<IIntCounter*>(manager->counter("bytes_read"));
+    C->bytes_written = static_cast<IIntCounter*>(manager->counter("bytes_written"));
+    if (!s_counters.testAndSetOrdered(0, C)) {
+        delete C;
+        C = s_counters.loadAcquire();
+    }
+    return C;
+}
+
+//the index of the smallest class that holds num_bytes, and the size of that class
+static int size_class(bigint num_bytes, bigint& class_bytes)
+{
+    if (num_bytes <= MDA_POOL_MIN_BYTES) {
+        class_bytes = MDA_POOL_MIN_BYTES;
+        return 0;
+    }
+    //2^k < num_bytes <= 2^(k+1), split in four steps
+    int k = 6;
+    while ((2LL << k) < num_bytes)
+        k++;
+    bigint step = (1LL << k) / 4;
+    bigint q = (num_bytes - (1LL << k) + step - 1) / step;
+    class_bytes = (1LL << k) + q * step;
+    return (k - 6) * 4 + (int)q;
+}
+
+//the inverse of size_class()
+static bigint class_size(int c)
+{
+    if (c == 0)
+        return MDA_POOL_MIN_BYTES;
+    int k = 6 + (c - 1) / 4;
+    bigint q = (c - 1) % 4 + 1;
+    return (1LL << k) + q * ((1LL << k) / 4);
+}
+
+static void* system_allocate(bigint num_bytes)
+{
+    void* ret = qMallocAligned(num_bytes, MDA_ALIGNMENT);
+    if (!ret)
+        return 0;
+    qint64 outstanding = s_outstanding_bytes.fetchAndAddRelaxed(num_bytes) + num_bytes;
+    qint64 peak = s_peak_outstanding_bytes.loadAcquire();
+    while ((outstanding > peak) && (!s_peak_outstanding_bytes.testAndSetOrdered(peak, outstanding)))
+        peak = s_peak_outstanding_bytes.loadAcquire();
+    if (counters()->allocated)
+        counters()->allocated->add(num_bytes);
+    return ret;
+}
+
+static void system_release(void* ptr, bigint num_bytes)
+{
+    qFreeAligned(ptr);
+    s_outstanding_bytes.fetchAndAddRelaxed(-num_bytes);
+    if (counters()->freed)
+        counters()->freed->add(num_bytes);
+}
+
+static MdaThreadCache* thread_cache()
+{
+    if (s_thread_caches.isDestroyed())
+        return 0; //at exit
+    QThreadStorage<MdaThreadCache*>& storage = *s_thread_caches;
+    if (!storage.hasLocalData()) {
+        MdaThreadCache* cache = new MdaThreadCache;
+        cache->trim_generation = s_trim_generation.loadAcquire();
+        storage.setLocalData(cache);
+    }
+    MdaThreadCache* cache = storage.localData();
+    int generation = s_trim_generation.loadAcquire();
+    if (cache->trim_generation != generation) {
+        //trimAll() was called since this thread last used its free list
+        cache->releaseAll();
+        cache->trim_generation = generation;
+    }
+    return cache;
+}
+
+MdaThreadCache::~MdaThreadCache()
+{
+    releaseAll();
+}
+
+void MdaThreadCache::releaseAll()
+{
+    for (int c = 0; c < MDA_POOL_NUM_CLASSES; c++) {
+        for (int i = 0; i < counts[c]; i++)
+            system_release(blocks[c][i], class_size(c));
+        counts[c] = 0;
+    }
+    s_cached_bytes.fetchAndAddRelaxed(-cached_bytes);
+    cached_bytes = 0;
+}
+
+namespace MdaAllocator {
+
+void* allocate(bigint num_bytes)
+{
+    if (num_bytes > MDA_POOL_MAX_BYTES)
+        return system_allocate(num_bytes);
+    bigint class_bytes;
+    int c = size_class(num_bytes, class_bytes);
+    MdaThreadCache* cache = thread_cache();
+    if ((cache) && (cache->counts[c])) {
+        cache->cached_bytes -= class_bytes;
+        s_cached_bytes.fetchAndAddRelaxed(-class_bytes);
+        cache->counts[c]--;
+        return cache->blocks[c][cache->counts[c]];
+    }
+    return system_allocate(class_bytes);
+}
+
+void release(void* ptr, bigint num_bytes)
+{
+    if (!ptr)
+        return;
+    if (num_bytes > MDA_POOL_MAX_BYTES) {
+        system_release(ptr, num_bytes);
+        return;
+    }
+    bigint class_bytes;
+    int c = size_class(num_bytes, class_bytes);
+    MdaThreadCache* cache = thread_cache();
+    if ((cache) && (cache->counts[c] < MDA_POOL_BLOCKS_PER_CLASS) && (cache->cached_bytes + class_bytes <= MDA_POOL_MAX_CACHED_BYTES)) {
+        //the threads of an OpenMP team live as long as the process, so the total is capped as well
+        if (s_cached_bytes.fetchAndAddRelaxed(class_bytes) + class_bytes <= MDA_POOL_MAX_TOTAL_CACHED_BYTES) {
+            cache->blocks[c][cache->counts[c]] = ptr;
+            cache->counts[c]++;
+            cache->cached_bytes += class_bytes;
+            return;
+        }
+        s_cached_bytes.fetchAndAddRelaxed(-class_bytes);
+    }
+    system_release(ptr, class_bytes);
+}
+
+void releaseThreadCache()
+{
+    MdaThreadCache* cache = thread_cache();
+    if (cache)
+        cache->releaseAll();
+}
+
+void trimAll()
+{
+    s_trim_generation.fetchAndAddOrdered(1);
+    releaseThreadCache(); //the other threads empty theirs the next time they allocate or release
+}
+
+bigint cachedBytes()
+{
+    return s_cached_bytes.loadAcquire();
+}
+
+bigint outstandingBytes()
+{
+    return s_outstanding_bytes.loadAcquire();
+}
+
+bigint peakOutstandingBytes()
+{
+    return s_peak_outstanding_bytes.loadAcquire();
+}
+
+void resetPeakOutstandingBytes()
+{
+    s_peak_outstanding_bytes.storeRelease(s_outstanding_bytes.loadAcquire());
+}
+
+IIntCounter* bytesReadCounter()
+{
+    return counters()->bytes_read;
+}
+
+IIntCounter* bytesWrittenCounter()
+{
+    return counters()->bytes_written;
+}
+}
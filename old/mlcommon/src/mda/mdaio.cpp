@@ -1,5 +1,6 @@
 #include "mdaio.h"
 #include "usagetracking.h"
+#include "mlkernels.h"
 #include <vector>
 #include <cstring>
 #include <inttypes.h>
@@ -47,6 +48,7 @@ bigint mda_read_header(struct MDAIO_HEADER* HH, FILE* input_file)
     bigint i;
     size_t totsize;
     bool uses64bitdims = false;
+    bool scaled = false;
 
     //initialize
     HH->data_type = 0;
@@ -55,6 +57,7 @@ bigint mda_read_header(struct MDAIO_HEADER* HH, FILE* input_file)
     for (i = 0; i < MDAIO_MAX_DIMS; i++)
         HH->dims[i] = 1;
     HH->header_size = 0;
+    HH->scale = 1;
 
     if (!input_file)
         return 0;
@@ -66,6 +69,11 @@ bigint mda_read_header(struct MDAIO_HEADER* HH, FILE* input_file)
         return 0;
     }
 
+    if (HH->data_type == MDAIO_TYPE_INT16_SCALED) {
+        scaled = true;
+        HH->data_type = MDAIO_TYPE_INT16;
+    }
+
     if ((HH->data_type < -7) || (HH->data_type >= 0)) {
         printf("mda_read_header: Problem with data type:  %d.\n", HH->data_type);
         return 0;
@@ -130,6 +138,18 @@ bigint mda_read_header(struct MDAIO_HEADER* HH, FILE* input_file)
 
     HH->header_size = 3 * sizeof(int32_t) + HH->num_dims * (uses64bitdims ? sizeof(uint64_t) : sizeof(int32_t));
 
+    //the scale
+    if (scaled) {
+        num_read = jfread(&HH->scale, sizeof(double), 1, input_file);
+        if (num_read < 1)
+            return 0;
+        if (!(HH->scale > 0)) {
+            printf("mda_read_header: Problem with scale: %g\n", HH->scale);
+            return 0;
+        }
+        HH->header_size += sizeof(double);
+    }
+
     //we're done!
     return 1;
 }
@@ -149,8 +169,15 @@ bigint mda_write_header(struct MDAIO_HEADER* X, FILE* output_file)
             uses64bitdims = true;
     }
 
+    bool scaled = ((X->data_type == MDAIO_TYPE_INT16) && (X->scale != 1));
+    if ((scaled) && (!(X->scale > 0))) {
+        printf("mda_write_header: Problem with scale: %g\n", X->scale);
+        return 0;
+    }
+
     //data type
-    num_bytes = fwrite(&X->data_type, 4, 1, output_file);
+    int32_t data_type = scaled ? MDAIO_TYPE_INT16_SCALED : X->data_type;
+    num_bytes = fwrite(&data_type, 4, 1, output_file);
     if (num_bytes < 1)
         return 0;
 
@@ -182,6 +209,14 @@ bigint mda_write_header(struct MDAIO_HEADER* X, FILE* output_file)
 
     X->header_size = 3 * sizeof(int32_t) + X->num_dims * (uses64bitdims ? sizeof(uint64_t) : sizeof(int32_t));
 
+    //the scale
+    if (scaled) {
+        num_bytes = fwrite(&X->scale, sizeof(double), 1, output_file);
+        if (num_bytes < 1)
+            return 0;
+        X->header_size += sizeof(double);
+    }
+
     //we're done!
     return 1;
 }
@@ -200,6 +235,15 @@ bigint mdaReadData_impl(TargetType* data, const bigint size, FILE* inputFile)
     }
 }
 
+template <>
+bigint mdaReadData_impl<int16_t, float>(float* data, const bigint size, FILE* inputFile)
+{
+    std::vector<int16_t> tmp(size);
+    const bigint ret = jfread(&tmp[0], sizeof(int16_t), size, inputFile);
+    MLKernels::int16ToFloat(ret, &tmp[0], data);
+    return ret;
+}
+
 template <typename Type>
 bigint mdaReadData(Type* data, const struct MDAIO_HEADER* header, const bigint size, FILE* inputFile)
 {
@@ -241,6 +285,22 @@ bigint mdaWriteData_impl(DataType* data, const bigint size, FILE* outputFile)
     }
 }
 
+template <>
+bigint mdaWriteData_impl<int16_t, const float>(const float* data, const bigint size, FILE* outputFile)
+{
+    std::vector<int16_t> tmp(size);
+    MLKernels::floatToInt16(size, data, &tmp[0]);
+    return fwrite(&tmp[0], sizeof(int16_t), size, outputFile);
+}
+
+template <>
+bigint mdaWriteData_impl<int16_t, double>(double* data, const bigint size, FILE* outputFile)
+{
+    std::vector<int16_t> tmp(size);
+    MLKernels::doubleToInt16(size, data, &tmp[0]);
+    return fwrite(&tmp[0], sizeof(int16_t), size, outputFile);
+}
+
 template <typename DataType>
 bigint mdaWriteData(DataType* data, const bigint size, const struct MDAIO_HEADER* header, FILE* outputFile)
 {
@@ -269,6 +329,103 @@ bigint mdaWriteData(DataType* data, const bigint size, const struct MDAIO_HEADER
         return 0;
 }
 
+template <typename TargetType, typename DataType>
+bigint mdaConvertData_impl(DataType* data, const bigint size, void* outputBuffer)
+{
+    std::copy(data, data + size, (TargetType*)outputBuffer);
+    return size;
+}
+
+template <>
+bigint mdaConvertData_impl<int16_t, const float>(const float* data, const bigint size, void* outputBuffer)
+{
+    MLKernels::floatToInt16(size, data, (int16_t*)outputBuffer);
+    return size;
+}
+
+template <>
+bigint mdaConvertData_impl<int16_t, const double>(const double* data, const bigint size, void* outputBuffer)
+{
+    MLKernels::doubleToInt16(size, data, (int16_t*)outputBuffer);
+    return size;
+}
+
+template <typename DataType>
+bigint mdaConvertData(DataType* data, const bigint size, const struct MDAIO_HEADER* header, void* outputBuffer)
+{
+    if (header->data_type == MDAIO_TYPE_BYTE) {
+        return mdaConvertData_impl<unsigned char>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_FLOAT32) {
+        return mdaConvertData_impl<float>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_INT16) {
+        return mdaConvertData_impl<int16_t>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_INT32) {
+        return mdaConvertData_impl<int32_t>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_UINT16) {
+        return mdaConvertData_impl<uint16_t>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_FLOAT64) {
+        return mdaConvertData_impl<double>(data, size, outputBuffer);
+    }
+    else if (header->data_type == MDAIO_TYPE_UINT32) {
+        return mdaConvertData_impl<uint32_t>(data, size, outputBuffer);
+    }
+    else
+        return 0;
+}
+
+template <typename SourceType, typename DataType>
+bigint mdaDecodeData_impl(const void* inputBuffer, const bigint size, DataType* data)
+{
+    const SourceType* src = (const SourceType*)inputBuffer;
+    if (is_same<SourceType, DataType>::value) {
+        std::memcpy(data, src, sizeof(DataType) * size);
+    }
+    else {
+        std::copy(src, src + size, data);
+    }
+    return size;
+}
+
+template <>
+bigint mdaDecodeData_impl<int16_t, float>(const void* inputBuffer, const bigint size, float* data)
+{
+    MLKernels::int16ToFloat(size, (const int16_t*)inputBuffer, data);
+    return size;
+}
+
+template <typename DataType>
+bigint mdaDecodeData(const void* inputBuffer, const bigint size, const struct MDAIO_HEADER* header, DataType* data)
+{
+    if (header->data_type == MDAIO_TYPE_BYTE) {
+        return mdaDecodeData_impl<unsigned char>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_FLOAT32) {
+        return mdaDecodeData_impl<float>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_INT16) {
+        return mdaDecodeData_impl<int16_t>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_INT32) {
+        return mdaDecodeData_impl<int32_t>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_UINT16) {
+        return mdaDecodeData_impl<uint16_t>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_FLOAT64) {
+        return mdaDecodeData_impl<double>(inputBuffer, size, data);
+    }
+    else if (header->data_type == MDAIO_TYPE_UINT32) {
+        return mdaDecodeData_impl<uint32_t>(inputBuffer, size, data);
+    }
+    else
+        return 0;
+}
+
 bigint mda_read_byte(unsigned char* data, struct MDAIO_HEADER* H, bigint n, FILE* input_file)
 {
     return mdaReadData(data, H, n, input_file);
@@ -339,6 +496,38 @@ bigint mda_write_uint32(uint32_t* data, struct MDAIO_HEADER* H, bigint n, FILE*
     return mdaWriteData(data, n, H, output_file);
 }
 
+bigint mda_convert_float32(const float* data, const struct MDAIO_HEADER* H, bigint n, void* output_buffer)
+{
+    return mdaConvertData(data, n, H, output_buffer);
+}
+
+bigint mda_convert_float64(const double* data, const struct MDAIO_HEADER* H, bigint n, void* output_buffer)
+{
+    return mdaConvertData(data, n, H, output_buffer);
+}
+
+bigint mda_decode_float32(const void* input_buffer, const struct MDAIO_HEADER* H, bigint n, float* data)
+{
+    return mdaDecodeData(input_buffer, n, H, data);
+}
+
+bigint mda_decode_float64(const void* input_buffer, const struct MDAIO_HEADER* H, bigint n, double* data)
+{
+    return mdaDecodeData(input_buffer, n, H, data);
+}
+
+double mda_read_scale(const QString& mda_path)
+{
+    FILE* f = fopen(mda_path.toLatin1().data(), "rb");
+    if (!f)
+        return 1;
+    MDAIO_HEADER H;
+    if (!mda_read_header(&H, f))
+        H.scale = 1;
+    fclose(f);
+    return H.scale;
+}
+
 void mda_copy_header(struct MDAIO_HEADER* ret, const struct MDAIO_HEADER* X)
 {
     std::memcpy(ret, X, sizeof(*ret));
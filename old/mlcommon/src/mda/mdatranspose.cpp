@@ -0,0 +1,246 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "mdatranspose.h"
+#include "mdaio.h"
+
+#include <QDebug>
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace MdaTranspose {
+
+struct Tile {
+    bigint i1, K; //rows of the input (N1 direction)
+    bigint j1, L; //columns of the input (N2 direction)
+};
+
+class Transposer {
+public:
+    FILE* input_file = 0;
+    bigint input_offset = 0;
+    FILE* output_file = 0;
+    bigint output_offset = 0;
+    bigint N1 = 0, N2 = 0;
+    int b = 0; //number of bytes per entry
+
+    bool readTile(const Tile& T, char* buf);
+    void transposeTile(const Tile& T, const char* in, char* out);
+    bool writeTile(const Tile& T, const char* buf);
+};
+
+// out (LxK) = transpose of in (KxL), in blocks that fit in the L1 cache, with the rows of out split between threads
+template <typename T>
+void transpose_block_range(const T* in, T* out, bigint K, bigint L, bigint ii1, bigint ii2)
+{
+    const bigint bs = 64;
+    for (bigint ii0 = ii1; ii0 < ii2; ii0 += bs) {
+        bigint ii_end = qMin(ii0 + bs, ii2);
+        for (bigint jj0 = 0; jj0 < L; jj0 += bs) {
+            bigint jj_end = qMin(jj0 + bs, L);
+            for (bigint ii = ii0; ii < ii_end; ii++) {
+                for (bigint jj = jj0; jj < jj_end; jj++) {
+                    out[jj + L * ii] = in[ii + K * jj];
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+void transpose_block(const T* in, T* out, bigint K, bigint L)
+{
+    bigint num_threads = qMax(1, (int)std::thread::hardware_concurrency());
+    num_threads = qMin(num_threads, (K * L) / (1024 * 1024) + 1); //not worth it for small tiles
+    num_threads = qMin(num_threads, K);
+    if (num_threads <= 1) {
+        transpose_block_range(in, out, K, L, 0, K);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (bigint t = 0; t < num_threads; t++) {
+        bigint ii1 = (K * t) / num_threads;
+        bigint ii2 = (K * (t + 1)) / num_threads;
+        threads.push_back(std::thread(transpose_block_range<T>, in, out, K, L, ii1, ii2));
+    }
+    for (bigint t = 0; t < num_threads; t++) {
+        threads[t].join();
+    }
+}
+
+bool Transposer::readTile(const Tile& T, char* buf)
+{
+    if (T.K == N1) {
+        //whole columns, so the tile is contiguous in the file
+        if (fseeko(input_file, input_offset + b * (N1 * T.j1), SEEK_SET) != 0)
+            return false;
+        return (bigint)fread(buf, b, T.K * T.L, input_file) == T.K * T.L;
+    }
+    for (bigint jj = 0; jj < T.L; jj++) {
+        if (fseeko(input_file, input_offset + b * (T.i1 + N1 * (T.j1 + jj)), SEEK_SET) != 0)
+            return false;
+        if ((bigint)fread(&buf[b * T.K * jj], b, T.K, input_file) != T.K)
+            return false;
+    }
+    return true;
+}
+
+void Transposer::transposeTile(const Tile& T, const char* in, char* out)
+{
+    if (b == 1)
+        transpose_block((const uint8_t*)in, (uint8_t*)out, T.K, T.L);
+    else if (b == 2)
+        transpose_block((const uint16_t*)in, (uint16_t*)out, T.K, T.L);
+    else if (b == 4)
+        transpose_block((const uint32_t*)in, (uint32_t*)out, T.K, T.L);
+    else if (b == 8)
+        transpose_block((const uint64_t*)in, (uint64_t*)out, T.K, T.L);
+    else {
+        for (bigint ii = 0; ii < T.K; ii++) {
+            for (bigint jj = 0; jj < T.L; jj++) {
+                memcpy(&out[b * (jj + T.L * ii)], &in[b * (ii + T.K * jj)], b);
+            }
+        }
+    }
+}
+
+bool Transposer::writeTile(const Tile& T, const char* buf)
+{
+    //the output is N2xN1, so the rows of the input tile are the columns of the output
+    if (T.L == N2) {
+        if (fseeko(output_file, output_offset + b * (N2 * T.i1), SEEK_SET) != 0)
+            return false;
+        return (bigint)fwrite(buf, b, T.K * T.L, output_file) == T.K * T.L;
+    }
+    for (bigint ii = 0; ii < T.K; ii++) {
+        if (fseeko(output_file, output_offset + b * (T.j1 + N2 * (T.i1 + ii)), SEEK_SET) != 0)
+            return false;
+        if ((bigint)fwrite(&buf[b * T.L * ii], b, T.L, output_file) != T.L)
+            return false;
+    }
+    return true;
+}
+}
+
+bool mda_transpose_data(FILE* input_file, bigint input_offset, FILE* output_file, bigint output_offset, bigint N1, bigint N2, int num_bytes_per_entry, bigint max_memory)
+{
+    using namespace MdaTranspose;
+
+    if ((N1 <= 0) || (N2 <= 0))
+        return true;
+    if (num_bytes_per_entry <= 0) {
+        qWarning() << "Invalid number of bytes per entry in mda_transpose_data" << num_bytes_per_entry;
+        return false;
+    }
+
+    Transposer X;
+    X.input_file = input_file;
+    X.input_offset = input_offset;
+    X.output_file = output_file;
+    X.output_offset = output_offset;
+    X.N1 = N1;
+    X.N2 = N2;
+    X.b = num_bytes_per_entry;
+
+    //tile shape: K rows by L columns of the input, with K*L*b at most a third of the memory budget
+    //a side that is small enough is taken whole (sequential reads or writes), otherwise the tile is square
+    bigint tile_size = qMax((bigint)1, max_memory / 3 / X.b);
+    bigint K = qMin(N1, qMax((bigint)sqrt((double)tile_size), tile_size / N2));
+    K = qMax((bigint)1, K);
+    bigint L = qMin(N2, qMax((bigint)1, tile_size / K));
+
+    std::vector<Tile> tiles;
+    for (bigint j1 = 0; j1 < N2; j1 += L) {
+        for (bigint i1 = 0; i1 < N1; i1 += K) {
+            Tile T;
+            T.i1 = i1;
+            T.K = qMin(K, N1 - i1);
+            T.j1 = j1;
+            T.L = qMin(L, N2 - j1);
+            tiles.push_back(T);
+        }
+    }
+
+    std::vector<char> in_bufs[2];
+    in_bufs[0].resize(X.b * K * L);
+    in_bufs[1].resize(X.b * K * L);
+    std::vector<char> out_buf(X.b * K * L);
+
+    if (!X.readTile(tiles[0], in_bufs[0].data())) {
+        qWarning() << "Problem reading data in mda_transpose_data";
+        return false;
+    }
+    for (bigint t = 0; t < (bigint)tiles.size(); t++) {
+        //read the next tile while this one is transposed and written
+        bool next_ok = true;
+        std::thread reader;
+        if (t + 1 < (bigint)tiles.size()) {
+            const Tile& T_next = tiles[t + 1];
+            char* buf_next = in_bufs[(t + 1) % 2].data();
+            reader = std::thread([&X, &next_ok, &T_next, buf_next]() {
+                next_ok = X.readTile(T_next, buf_next);
+            });
+        }
+        X.transposeTile(tiles[t], in_bufs[t % 2].data(), out_buf.data());
+        bool write_ok = X.writeTile(tiles[t], out_buf.data());
+        if (reader.joinable())
+            reader.join();
+        if (!write_ok) {
+            qWarning() << "Problem writing data in mda_transpose_data";
+            return false;
+        }
+        if (!next_ok) {
+            qWarning() << "Problem reading data in mda_transpose_data";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool mda_transpose_file(const QString& input_path, const QString& output_path, bigint max_memory)
+{
+    FILE* inf = fopen(input_path.toUtf8().data(), "rb");
+    if (!inf) {
+        qWarning() << "Unable to open input file for reading: " + input_path;
+        return false;
+    }
+    MDAIO_HEADER H;
+    if (!mda_read_header(&H, inf)) {
+        qWarning() << "Error reading header: " + input_path;
+        fclose(inf);
+        return false;
+    }
+    for (int i = 2; i < H.num_dims; i++) {
+        if (H.dims[i] != 1) {
+            qWarning() << "Only two-dimensional arrays can be transposed: " + input_path;
+            fclose(inf);
+            return false;
+        }
+    }
+    FILE* outf = fopen(output_path.toUtf8().data(), "wb");
+    if (!outf) {
+        qWarning() << "Unable to open output file for writing: " + output_path;
+        fclose(inf);
+        return false;
+    }
+    MDAIO_HEADER H_out;
+    mda_copy_header(&H_out, &H);
+    H_out.num_dims = 2;
+    H_out.dims[0] = H.dims[1];
+    H_out.dims[1] = H.dims[0];
+    if (!mda_write_header(&H_out, outf)) {
+        qWarning() << "Error writing header: " + output_path;
+        fclose(inf);
+        fclose(outf);
+        return false;
+    }
+    bool ret = mda_transpose_data(inf, H.header_size, outf, H_out.header_size, H.dims[0], H.dims[1], H.num_bytes_per_entry, max_memory);
+    fclose(inf);
+    fclose(outf);
+    return ret;
+}
@@ -16,6 +16,7 @@
 #include "mlcommon.h"
 
 #define REMOTE_READ_MDA_CHUNK_SIZE 5e5
+#define REMOTE_READ_MDA_MAX_CACHED_CHUNKS 8
 
 struct RemoteReadMdaInfo {
     RemoteReadMdaInfo()
@@ -23,7 +24,7 @@ struct RemoteReadMdaInfo {
         N1 = N2 = N3 = 0;
     }
 
-    int N1, N2, N3;
+    bigint N1, N2, N3;
     QString checksum;
     QDateTime file_last_modified;
 };
@@ -37,13 +38,25 @@ public:
     bool m_reshaped;
     bool m_info_downloaded;
     QString m_remote_datatype;
-    int m_download_chunk_size;
+    bigint m_download_chunk_size;
     bool m_download_failed; //don't make excessive calls. Once we failed, that's it.
+    int m_read_ahead_chunks;
+    int m_max_parallel_downloads;
+
+    //in-memory cache of the most recently used chunks (the chunk files themselves are kept by the CacheManager)
+    QMap<bigint, Mda> m_chunk_cache;
+    QList<bigint> m_chunk_cache_order; //least recently used first
+    bigint m_last_chunk_index;
 
     void construct_and_clear();
     void copy_from(const RemoteReadMda& other);
     void download_info_if_needed();
-    QString download_chunk_at_index(int ii);
+    bigint num_chunks();
+    QString chunk_file_name(bigint ii);
+    bool download_chunks(const QList<bigint>& inds);
+    bool load_chunks(bigint jj1, bigint jj2, TaskProgress& task);
+    template <typename T>
+    void copy_from_chunks(T* Xptr, bigint i, bigint size);
 };
 
 RemoteReadMda::RemoteReadMda(const QString& path)
@@ -58,8 +71,7 @@ RemoteReadMda::RemoteReadMda(const RemoteReadMda& other)
 {
     d = new RemoteReadMdaPrivate;
     d->q = this;
-    d = new RemoteReadMdaPrivate;
-    d->q = this;
+    d->construct_and_clear();
     d->copy_from(other);
 }
 
@@ -76,18 +88,32 @@ RemoteReadMda::~RemoteReadMda()
 void RemoteReadMda::setRemoteDataType(QString dtype)
 {
     d->m_remote_datatype = dtype;
+    d->m_chunk_cache.clear();
+    d->m_chunk_cache_order.clear();
 }
 
-void RemoteReadMda::setDownloadChunkSize(int size)
+void RemoteReadMda::setDownloadChunkSize(bigint size)
 {
     d->m_download_chunk_size = size;
+    d->m_chunk_cache.clear();
+    d->m_chunk_cache_order.clear();
 }
 
-int RemoteReadMda::downloadChunkSize()
+bigint RemoteReadMda::downloadChunkSize()
 {
     return d->m_download_chunk_size;
 }
 
+void RemoteReadMda::setReadAheadChunks(int num)
+{
+    d->m_read_ahead_chunks = num;
+}
+
+void RemoteReadMda::setMaxParallelDownloads(int num)
+{
+    d->m_max_parallel_downloads = num;
+}
+
 void RemoteReadMda::setPath(const QString& file_path)
 {
     d->construct_and_clear();
@@ -100,7 +126,7 @@ QString RemoteReadMda::makePath() const
     return d->m_path;
 }
 
-bool RemoteReadMda::reshape(int N1b, int N2b, int N3b)
+bool RemoteReadMda::reshape(bigint N1b, bigint N2b, bigint N3b)
 {
     if (this->N1() * this->N2() * this->N3() != N1b * N2b * N3b)
         return false;
@@ -112,19 +138,19 @@ bool RemoteReadMda::reshape(int N1b, int N2b, int N3b)
     return true;
 }
 
-int RemoteReadMda::N1() const
+bigint RemoteReadMda::N1() const
 {
     d->download_info_if_needed();
     return d->m_info.N1;
 }
 
-int RemoteReadMda::N2() const
+bigint RemoteReadMda::N2() const
 {
     d->download_info_if_needed();
     return d->m_info.N2;
 }
 
-int RemoteReadMda::N3() const
+bigint RemoteReadMda::N3() const
 {
     d->download_info_if_needed();
     return d->m_info.N3;
@@ -147,224 +173,48 @@ QString format_num(double num_entries)
     return QString("%1G").arg(num_entries / 1e9, 0, 'f', 2);
 }
 
-bool RemoteReadMda::readChunk(Mda& X, int i, int size) const
+bool RemoteReadMda::readChunk(Mda& X, bigint i, bigint size) const
 {
     if (d->m_download_failed) {
         //don't make excessive calls... once we fail, that's it.
         return false;
     }
-    //double size_mb = size * datatype_size * 1.0 / 1e6;
-    //TaskProgress task(TaskProgress::Download, "Downloading array chunk");
-    //if (size_mb > 0.5) {
-    //    task.setLabel(QString("Downloading array chunk: %1 MB").arg(size_mb));
-    //}
     //read a chunk of the remote array considered as a 1D array
 
     TaskProgress task(TaskProgress::Download, QString("Downloading %1 numbers - %2 (%3x%4x%5)").arg(format_num(size)).arg(d->m_remote_datatype).arg(N1()).arg(N2()).arg(N3()));
     task.log() << "Reading chunk:" << this->makePath() << i << size;
 
     X.allocate(size, 1); //allocate the output array
-    double* Xptr = X.dataPtr(); //pointer to the output data
-    int ii1 = i; //start index of the remote array
-    int ii2 = i + size - 1; //end index of the remote array
-    int jj1 = ii1 / d->m_download_chunk_size; //start chunk index of the remote array
-    int jj2 = ii2 / d->m_download_chunk_size; //end chunk index of the remote array
-    if (jj1 == jj2) { //in this case there is only one chunk we need to worry about
-        task.setProgress(0.2);
-        QString fname = d->download_chunk_at_index(jj1); //download the single chunk
-        if (fname.isEmpty()) {
-            //task.error("fname is empty");
-            if (!MLUtil::threadInterruptRequested()) {
-                TaskProgress errtask("Download chunk at index");
-                errtask.log() << QString("m_remote_data_type = %1, download chunk size = %2").arg(d->m_remote_datatype).arg(d->m_download_chunk_size);
-                errtask.log() << d->m_path;
-                errtask.error() << QString("Failed to download chunk at index %1 *").arg(jj1);
-                d->m_download_failed = true;
-            }
-            return false;
-        }
-        DiskReadMda A(fname);
-        A.readChunk(X, ii1 - jj1 * d->m_download_chunk_size, size); //starting reading at the offset of ii1 relative to the start index of the chunk
+    if (size <= 0)
         return true;
-    }
-    else {
-        for (int jj = jj1; jj <= jj2; jj++) { //otherwise we need to step through the chunks
-            task.setProgress((jj - jj1 + 0.5) / (jj2 - jj1 + 1));
-            if (MLUtil::threadInterruptRequested()) {
-                //X = Mda(); //maybe it's better to return the right size.
-                //task.error("Halted");
-                return false;
-            }
-            QString fname = d->download_chunk_at_index(jj); //download the chunk at index jj
-            if (fname.isEmpty()) {
-                //task.error("fname is empty *");
-                return false;
-            }
-            DiskReadMda A(fname);
-            if (jj == jj1) { //case 1/3, this is the first chunk
-                Mda tmp;
-                int size0 = (jj1 + 1) * d->m_download_chunk_size - ii1; //the size is going to be the difference between ii1 and the start index of the next chunk
-                A.readChunk(tmp, ii1 - jj1 * d->m_download_chunk_size, size0); //again we start reading at the offset of ii1 relative to the start index of the chunk
-                double* tmp_ptr = tmp.dataPtr(); //copy the data directly from tmp_ptr to Xptr
-                const int b = 0;
-                std::copy(tmp_ptr, tmp_ptr + size0, Xptr + b);
-                //                for (int a = 0; a < size0; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-            else if (jj == jj2) { //case 2/3, this is the last chunk
-                Mda tmp;
-                int size0 = ii2 + 1 - jj2 * d->m_download_chunk_size; //the size is going to be the difference between the start index of the last chunk and ii2+1
-                A.readChunk(tmp, 0, size0); //we start reading at position zero
-                double* tmp_ptr = tmp.dataPtr();
-                //copy the data to the last part of X
-                const int b = size - size0;
-                std::copy(tmp_ptr, tmp_ptr + size0, Xptr + b);
-                //                for (int a = 0; a < size0; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-
-            /*
-             ///this was the old code, which was wrong!!!!!!!!! -- fixed on 5/16/2016
-            else if (jj == jj2) {
-                Mda tmp;
-                int size0 = ii2 + 1 - jj2 * d->m_download_chunk_size;
-                A.readChunk(tmp, d->m_download_chunk_size - size0, size0);
-                double* tmp_ptr = tmp.dataPtr();
-                int b = jj2 * d->m_download_chunk_size - ii1;
-                for (int a = 0; a < size0; a++) {
-                    Xptr[b] = tmp_ptr[a];
-                    b++;
-                }
-            }
-            */
-            else { //case 3/3, this is a middle chunk
-                Mda tmp;
-                A.readChunk(tmp, 0, d->m_download_chunk_size); //read the entire chunk, because we'll use it all
-                double* tmp_ptr = tmp.dataPtr();
-                int b = jj * d->m_download_chunk_size - ii1; //we start writing at the offset between the start index of the chunk and the start index
-                std::copy(tmp_ptr, tmp_ptr + d->m_download_chunk_size, Xptr + b);
-                //                for (int a = 0; a < d->m_download_chunk_size; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-        }
-        return true;
-    }
+    bigint jj1 = i / d->m_download_chunk_size; //start chunk index of the remote array
+    bigint jj2 = (i + size - 1) / d->m_download_chunk_size; //end chunk index of the remote array
+    if (!d->load_chunks(jj1, jj2, task))
+        return false;
+    d->copy_from_chunks(X.dataPtr(), i, size);
+    return true;
 }
 
-bool RemoteReadMda::readChunk32(Mda32& X, int i, int size) const
+bool RemoteReadMda::readChunk32(Mda32& X, bigint i, bigint size) const
 {
     if (d->m_download_failed) {
         //don't make excessive calls... once we fail, that's it.
         return false;
     }
-    //double size_mb = size * datatype_size * 1.0 / 1e6;
-    //TaskProgress task(TaskProgress::Download, "Downloading array chunk");
-    //if (size_mb > 0.5) {
-    //    task.setLabel(QString("Downloading array chunk: %1 MB").arg(size_mb));
-    //}
     //read a chunk of the remote array considered as a 1D array
 
     TaskProgress task(TaskProgress::Download, QString("Downloading %1 numbers -- %2 (%3x%4x%5)").arg(format_num(size)).arg(d->m_remote_datatype).arg(N1()).arg(N2()).arg(N3()));
     task.log(this->makePath());
 
     X.allocate(size, 1); //allocate the output array
-    dtype32* Xptr = X.dataPtr(); //pointer to the output data
-    int ii1 = i; //start index of the remote array
-    int ii2 = i + size - 1; //end index of the remote array
-    int jj1 = ii1 / d->m_download_chunk_size; //start chunk index of the remote array
-    int jj2 = ii2 / d->m_download_chunk_size; //end chunk index of the remote array
-    if (jj1 == jj2) { //in this case there is only one chunk we need to worry about
-        task.setProgress(0.2);
-        QString fname = d->download_chunk_at_index(jj1); //download the single chunk
-        if (fname.isEmpty()) {
-            //task.error("fname is empty");
-            if (!MLUtil::threadInterruptRequested()) {
-                TaskProgress errtask("Download chunk at index");
-                errtask.log(QString("m_remote_data_type = %1, download chunk size = %2").arg(d->m_remote_datatype).arg(d->m_download_chunk_size));
-                errtask.log(d->m_path);
-                errtask.error(QString("Failed to download chunk at index %1 -").arg(jj1));
-                d->m_download_failed = true;
-            }
-            return false;
-        }
-        DiskReadMda32 A(fname);
-        A.readChunk(X, ii1 - jj1 * d->m_download_chunk_size, size); //starting reading at the offset of ii1 relative to the start index of the chunk
-        return true;
-    }
-    else {
-        for (int jj = jj1; jj <= jj2; jj++) { //otherwise we need to step through the chunks
-            task.setProgress((jj - jj1 + 0.5) / (jj2 - jj1 + 1));
-            if (MLUtil::threadInterruptRequested()) {
-                //X = Mda32(); //maybe it's better to return the right size.
-                //task.error("Halted");
-                return false;
-            }
-            QString fname = d->download_chunk_at_index(jj); //download the chunk at index jj
-            if (fname.isEmpty()) {
-                //task.error("fname is empty *");
-                return false;
-            }
-            DiskReadMda32 A(fname);
-            if (jj == jj1) { //case 1/3, this is the first chunk
-                Mda32 tmp;
-                int size0 = (jj1 + 1) * d->m_download_chunk_size - ii1; //the size is going to be the difference between ii1 and the start index of the next chunk
-                A.readChunk(tmp, ii1 - jj1 * d->m_download_chunk_size, size0); //again we start reading at the offset of ii1 relative to the start index of the chunk
-                dtype32* tmp_ptr = tmp.dataPtr(); //copy the data directly from tmp_ptr to Xptr
-                std::copy(tmp_ptr, tmp_ptr + size0, Xptr);
-                //                int b = 0;
-                //                for (int a = 0; a < size0; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-            else if (jj == jj2) { //case 2/3, this is the last chunk
-                Mda32 tmp;
-                int size0 = ii2 + 1 - jj2 * d->m_download_chunk_size; //the size is going to be the difference between the start index of the last chunk and ii2+1
-                A.readChunk(tmp, 0, size0); //we start reading at position zero
-                dtype32* tmp_ptr = tmp.dataPtr();
-                //copy the data to the last part of X
-                int b = size - size0;
-                std::copy(tmp_ptr, tmp_ptr + size0, Xptr + b);
-                //                for (int a = 0; a < size0; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-
-            /*
-             ///this was the old code, which was wrong!!!!!!!!! -- fixed on 5/16/2016
-            else if (jj == jj2) {
-                Mda32 tmp;
-                int size0 = ii2 + 1 - jj2 * d->m_download_chunk_size;
-                A.readChunk(tmp, d->m_download_chunk_size - size0, size0);
-                dtype32* tmp_ptr = tmp.dataPtr();
-                int b = jj2 * d->m_download_chunk_size - ii1;
-                for (int a = 0; a < size0; a++) {
-                    Xptr[b] = tmp_ptr[a];
-                    b++;
-                }
-            }
-            */
-            else { //case 3/3, this is a middle chunk
-                Mda32 tmp;
-                A.readChunk(tmp, 0, d->m_download_chunk_size); //read the entire chunk, because we'll use it all
-                dtype32* tmp_ptr = tmp.dataPtr();
-                //const int b = jj * d->m_download_chunk_size - ii1; //we start writing at the offset between the start index of the chunk and the start index
-                std::copy(tmp_ptr, tmp_ptr + d->m_download_chunk_size, Xptr);
-                //                for (int a = 0; a < d->m_download_chunk_size; a++) {
-                //                    Xptr[b] = tmp_ptr[a];
-                //                    b++;
-                //                }
-            }
-        }
+    if (size <= 0)
         return true;
-    }
+    bigint jj1 = i / d->m_download_chunk_size; //start chunk index of the remote array
+    bigint jj2 = (i + size - 1) / d->m_download_chunk_size; //end chunk index of the remote array
+    if (!d->load_chunks(jj1, jj2, task))
+        return false;
+    d->copy_from_chunks(X.dataPtr(), i, size);
+    return true;
 }
 
 void RemoteReadMdaPrivate::construct_and_clear()
@@ -377,6 +227,11 @@ void RemoteReadMdaPrivate::construct_and_clear()
     /// TODO (LOW) use enum instead of string "float64", "float32", etc
     this->m_remote_datatype = "float64";
     this->m_reshaped = false;
+    this->m_read_ahead_chunks = 2;
+    this->m_max_parallel_downloads = 4;
+    this->m_chunk_cache.clear();
+    this->m_chunk_cache_order.clear();
+    this->m_last_chunk_index = -1;
 }
 
 void RemoteReadMdaPrivate::copy_from(const RemoteReadMda& other)
@@ -388,6 +243,11 @@ void RemoteReadMdaPrivate::copy_from(const RemoteReadMda& other)
     this->m_path = other.d->m_path;
     this->m_remote_datatype = other.d->m_remote_datatype;
     this->m_reshaped = other.d->m_reshaped;
+    this->m_read_ahead_chunks = other.d->m_read_ahead_chunks;
+    this->m_max_parallel_downloads = other.d->m_max_parallel_downloads;
+    this->m_chunk_cache = other.d->m_chunk_cache; //implicitly shared
+    this->m_chunk_cache_order = other.d->m_chunk_cache_order;
+    this->m_last_chunk_index = other.d->m_last_chunk_index;
 }
 
 void RemoteReadMdaPrivate::download_info_if_needed()
@@ -405,91 +265,227 @@ void RemoteReadMdaPrivate::download_info_if_needed()
     QString txt = MLNetwork::httpGetTextSync(url2);
     QStringList lines = txt.split("\n");
     QStringList sizes = lines.value(0).split(",");
-    m_info.N1 = sizes.value(0).toLong();
-    m_info.N2 = sizes.value(1).toLong();
-    m_info.N3 = sizes.value(2).toLong();
+    m_info.N1 = sizes.value(0).toLongLong();
+    m_info.N2 = sizes.value(1).toLongLong();
+    m_info.N3 = sizes.value(2).toLongLong();
     m_info.checksum = lines.value(1);
-    m_info.file_last_modified = QDateTime::fromMSecsSinceEpoch(lines.value(2).toLong());
+    m_info.file_last_modified = QDateTime::fromMSecsSinceEpoch(lines.value(2).toLongLong());
 }
 
-void unquantize8(Mda& X, double minval, double maxval);
-QString RemoteReadMdaPrivate::download_chunk_at_index(int ii)
+bigint RemoteReadMdaPrivate::num_chunks()
 {
-    TaskProgress task(QString("Download chunk at index %1 ---").arg(ii));
     download_info_if_needed();
-    int Ntot = m_info.N1 * m_info.N2 * m_info.N3;
-    int size = m_download_chunk_size;
-    if (ii * m_download_chunk_size + size > Ntot) {
-        size = Ntot - ii * m_download_chunk_size;
+    bigint Ntot = m_info.N1 * m_info.N2 * m_info.N3;
+    return (Ntot + m_download_chunk_size - 1) / m_download_chunk_size;
+}
+
+QString RemoteReadMdaPrivate::chunk_file_name(bigint ii)
+{
+    QString file_name = m_info.checksum + "-" + QString("%1-%2").arg(m_download_chunk_size).arg(ii);
+    return CacheManager::globalInstance()->makeLocalFile(file_name, CacheManager::ShortTerm);
+}
+
+bool RemoteReadMdaPrivate::load_chunks(bigint jj1, bigint jj2, TaskProgress& task)
+{
+    //sequential access: fetch the next few chunks along with the requested ones, so that their latency is overlapped
+    bigint jj_end = jj2;
+    if ((m_last_chunk_index >= 0) && (jj1 >= m_last_chunk_index) && (jj1 <= m_last_chunk_index + 1)) {
+        jj_end = qMin(jj2 + m_read_ahead_chunks, num_chunks() - 1);
     }
-    if (size <= 0) {
-        task.log() << m_info.N1 << m_info.N2 << m_info.N3 << Ntot << m_download_chunk_size << ii;
-        task.error() << "Size is:" << size;
-        return "";
+    m_last_chunk_index = jj2;
+
+    QList<bigint> to_download;
+    for (bigint jj = jj1; jj <= jj_end; jj++) {
+        if ((!m_chunk_cache.contains(jj)) && (!QFile::exists(chunk_file_name(jj))))
+            to_download << jj;
     }
+    for (bigint a = 0; a < to_download.count(); a += qMax(1, m_max_parallel_downloads)) {
+        if (MLUtil::threadInterruptRequested()) {
+            return false;
+        }
+        task.setProgress((a + 0.5) / to_download.count());
+        QList<bigint> batch = to_download.mid(a, qMax(1, m_max_parallel_downloads));
+        if (!download_chunks(batch)) {
+            //the read-ahead chunks are not needed to complete this read
+            bool needed = false;
+            foreach (bigint jj, batch) {
+                if ((jj <= jj2) && (!QFile::exists(chunk_file_name(jj))))
+                    needed = true;
+            }
+            if (!needed)
+                break;
+            if (!MLUtil::threadInterruptRequested()) {
+                TaskProgress errtask("Download chunk at index");
+                errtask.log() << QString("m_remote_data_type = %1, download chunk size = %2").arg(m_remote_datatype).arg(m_download_chunk_size);
+                errtask.log() << m_path;
+                errtask.error() << QString("Failed to download chunks at indices %1-%2").arg(batch.first()).arg(batch.last());
+                m_download_failed = true;
+            }
+            return false;
+        }
+    }
+
+    for (bigint jj = jj1; jj <= jj2; jj++) {
+        if (!m_chunk_cache.contains(jj)) {
+            Mda chunk;
+            if (!chunk.read(chunk_file_name(jj))) {
+                task.error() << "Unable to read chunk file: " + chunk_file_name(jj);
+                return false;
+            }
+            m_chunk_cache[jj] = chunk;
+        }
+        m_chunk_cache_order.removeAll(jj);
+        m_chunk_cache_order << jj;
+    }
+    while (m_chunk_cache_order.count() > qMax((bigint)REMOTE_READ_MDA_MAX_CACHED_CHUNKS, jj2 - jj1 + 1)) {
+        m_chunk_cache.remove(m_chunk_cache_order.takeFirst());
+    }
+    return true;
+}
+
+template <typename T>
+void RemoteReadMdaPrivate::copy_from_chunks(T* Xptr, bigint i, bigint size)
+{
+    bigint jj1 = i / m_download_chunk_size;
+    bigint jj2 = (i + size - 1) / m_download_chunk_size;
+    for (bigint jj = jj1; jj <= jj2; jj++) {
+        //the part of [i, i+size) covered by this chunk
+        bigint a1 = qMax(i, jj * m_download_chunk_size);
+        bigint a2 = qMin(i + size, (jj + 1) * m_download_chunk_size);
+        const double* chunk_ptr = m_chunk_cache[jj].constDataPtr();
+        std::copy(chunk_ptr + (a1 - jj * m_download_chunk_size), chunk_ptr + (a2 - jj * m_download_chunk_size), Xptr + (a1 - i));
+    }
+}
+
+void unquantize8(Mda& X, double minval, double maxval);
+bool RemoteReadMdaPrivate::download_chunks(const QList<bigint>& inds)
+{
+    TaskProgress task(QString("Download chunks at indices %1-%2 ---").arg(inds.value(0)).arg(inds.value(inds.count() - 1)));
+    download_info_if_needed();
     if (m_info.checksum.isEmpty()) {
         task.error() << "Info checksum is empty";
-        return "";
+        return false;
     }
-    QString file_name = m_info.checksum + "-" + QString("%1-%2").arg(m_download_chunk_size).arg(ii);
-    QString fname = CacheManager::globalInstance()->makeLocalFile(file_name, CacheManager::ShortTerm);
-    if (QFile::exists(fname))
-        return fname;
-    QString url = m_path;
-    QString url0 = url + QString("?a=readChunk&output=text&index=%1&size=%2&datatype=%3").arg((int)(ii * m_download_chunk_size)).arg(size).arg(m_remote_datatype);
-    QString binary_url = MLNetwork::httpGetTextSync(url0).trimmed();
-    if (binary_url.isEmpty())
-        return "";
-
-    //the following is ugly
-    int ind = m_path.indexOf("/mdaserver");
-    if (ind > 0) {
-        binary_url = m_path.mid(0, ind) + "/mdaserver/" + binary_url;
+    bigint Ntot = m_info.N1 * m_info.N2 * m_info.N3;
+    QList<bigint> sizes;
+    foreach (bigint ii, inds) {
+        bigint size = m_download_chunk_size;
+        if (ii * m_download_chunk_size + size > Ntot) {
+            size = Ntot - ii * m_download_chunk_size;
+        }
+        if (size <= 0) {
+            task.log() << m_info.N1 << m_info.N2 << m_info.N3 << Ntot << m_download_chunk_size << ii;
+            task.error() << "Size is:" << size;
+            return false;
+        }
+        sizes << size;
     }
 
-    task.log() << "binary_url:" << binary_url;
-    QString tmp_mda_fname = MLNetwork::httpGetBinaryFileSync(binary_url);
-    if (tmp_mda_fname.isEmpty())
-        return "";
-    DiskReadMda tmp(tmp_mda_fname);
-    if (tmp.totalSize() != size) {
-        task.error() << "Unexpected total size problem: " << tmp.totalSize() << size;
-        qWarning() << "Unexpected total size problem: " << tmp.totalSize() << size;
-        QFile::remove(tmp_mda_fname);
-        return "";
+    //first ask the server to prepare the chunks (all requests at once), then download them (all at once)
+    QList<MLNetwork::Downloader*> text_downloaders;
+    for (int k = 0; k < inds.count(); k++) {
+        QString url0 = m_path + QString("?a=readChunk&output=text&index=%1&size=%2&datatype=%3").arg(inds[k] * m_download_chunk_size).arg(sizes[k]).arg(m_remote_datatype);
+        MLNetwork::Downloader* D = new MLNetwork::Downloader;
+        D->source_url = url0;
+        D->destination_file_name = CacheManager::globalInstance()->makeLocalFile() + ".RemoteReadMda.txt";
+        D->start();
+        text_downloaders << D;
     }
-    if (m_remote_datatype == "float32_q8") {
-        QString dynamic_range_fname = MLNetwork::httpGetBinaryFileSync(binary_url + ".q8");
-        if (dynamic_range_fname.isEmpty()) {
-            qWarning() << "problem downloading .q8 file: " + binary_url + ".q8";
-            task.error() << "problem downloading .q8 file: " + binary_url + ".q8";
-            return "";
-        }
-        Mda dynamic_range(dynamic_range_fname);
-        if (dynamic_range.totalSize() != 2) {
-            qWarning() << QString("Problem in .q8 file. Unexpected size %1: ").arg(dynamic_range.totalSize()) + binary_url + ".q8";
-            task.error() << QString("Problem in .q8 file. Unexpected size %1: ").arg(dynamic_range.totalSize()) + binary_url + ".q8";
-            return "";
+    QStringList binary_urls;
+    bool ok = true;
+    foreach (MLNetwork::Downloader* D, text_downloaders) {
+        D->waitForFinished(-1);
+        QString binary_url;
+        if (D->success)
+            binary_url = TextFile::read(D->destination_file_name).trimmed();
+        QFile::remove(D->destination_file_name);
+        if (binary_url.isEmpty())
+            ok = false;
+        //the following is ugly
+        int ind = m_path.indexOf("/mdaserver");
+        if (ind > 0) {
+            binary_url = m_path.mid(0, ind) + "/mdaserver/" + binary_url;
         }
-        Mda chunk(tmp_mda_fname);
-        unquantize8(chunk, dynamic_range.value(0), dynamic_range.value(1));
-        if (!chunk.write32(fname)) {
-            QFile::remove(tmp_mda_fname);
-            qWarning() << "Unable to write file: " + fname;
-            task.error() << "Unable to write file: " + fname;
-            return "";
+        binary_urls << binary_url;
+    }
+    qDeleteAll(text_downloaders);
+    if (!ok)
+        return false;
+
+    bool quantized = (m_remote_datatype == "float32_q8");
+    QList<MLNetwork::Downloader*> binary_downloaders;
+    for (int k = 0; k < inds.count(); k++) {
+        task.log() << "binary_url:" << binary_urls[k];
+        QStringList urls;
+        urls << binary_urls[k];
+        if (quantized)
+            urls << binary_urls[k] + ".q8";
+        foreach (QString url, urls) {
+            MLNetwork::Downloader* D = new MLNetwork::Downloader;
+            D->source_url = url;
+            D->destination_file_name = CacheManager::globalInstance()->makeLocalFile() + ".RemoteReadMda";
+            D->start();
+            binary_downloaders << D;
         }
-        QFile::remove(tmp_mda_fname);
     }
-    else {
-        if (!QFile::rename(tmp_mda_fname, fname)) {
-            QFile::remove(tmp_mda_fname);
-            qWarning() << "Unable to rename file: " << tmp_mda_fname << fname;
-            task.error() << "Unable to rename file: " << tmp_mda_fname << fname;
-            return "";
+    foreach (MLNetwork::Downloader* D, binary_downloaders) {
+        D->waitForFinished(-1);
+    }
+
+    for (int k = 0; k < inds.count(); k++) {
+        MLNetwork::Downloader* D = binary_downloaders[quantized ? 2 * k : k];
+        MLNetwork::Downloader* D_q8 = quantized ? binary_downloaders[2 * k + 1] : 0;
+        QString fname = chunk_file_name(inds[k]);
+        QString tmp_mda_fname = D->destination_file_name;
+        if (!D->success) {
+            task.error() << "Problem downloading chunk: " + D->source_url + ": " + D->error;
+            ok = false;
+            continue;
+        }
+        DiskReadMda tmp(tmp_mda_fname);
+        if (tmp.totalSize() != sizes[k]) {
+            task.error() << "Unexpected total size problem: " << tmp.totalSize() << sizes[k];
+            qWarning() << "Unexpected total size problem: " << tmp.totalSize() << sizes[k];
+            ok = false;
+            continue;
         }
+        if (quantized) {
+            if (!D_q8->success) {
+                qWarning() << "problem downloading .q8 file: " + D_q8->source_url;
+                task.error() << "problem downloading .q8 file: " + D_q8->source_url;
+                ok = false;
+                continue;
+            }
+            Mda dynamic_range(D_q8->destination_file_name);
+            if (dynamic_range.totalSize() != 2) {
+                qWarning() << QString("Problem in .q8 file. Unexpected size %1: ").arg(dynamic_range.totalSize()) + D_q8->source_url;
+                task.error() << QString("Problem in .q8 file. Unexpected size %1: ").arg(dynamic_range.totalSize()) + D_q8->source_url;
+                ok = false;
+                continue;
+            }
+            Mda chunk(tmp_mda_fname);
+            unquantize8(chunk, dynamic_range.value(0), dynamic_range.value(1));
+            if (!chunk.write32(fname)) {
+                qWarning() << "Unable to write file: " + fname;
+                task.error() << "Unable to write file: " + fname;
+                ok = false;
+                continue;
+            }
+        }
+        else {
+            if (!QFile::rename(tmp_mda_fname, fname)) {
+                qWarning() << "Unable to rename file: " << tmp_mda_fname << fname;
+                task.error() << "Unable to rename file: " << tmp_mda_fname << fname;
+                ok = false;
+                continue;
+            }
+        }
+    }
+    foreach (MLNetwork::Downloader* D, binary_downloaders) {
+        QFile::remove(D->destination_file_name);
     }
-    return fname;
+    qDeleteAll(binary_downloaders);
+    return ok;
 }
 
 void unit_test_remote_read_mda()
@@ -521,9 +517,9 @@ void unit_test_remote_read_mda_2(const QString& path)
 
 void unquantize8(Mda& X, double minval, double maxval)
 {
-    int N = X.totalSize();
+    bigint N = X.totalSize();
     double* Xptr = X.dataPtr();
-    for (int i = 0; i < N; i++) {
+    for (bigint i = 0; i < N; i++) {
         Xptr[i] = minval + (Xptr[i] / 255) * (maxval - minval);
     }
 }
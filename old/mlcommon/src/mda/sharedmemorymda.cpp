@@ -0,0 +1,529 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "sharedmemorymda.h"
+#include "mda.h"
+#include "mda32.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
+#include <errno.h>
+#include <string.h>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#define ML_HAS_SHARED_MEMORY
+#endif
+
+#define SHARED_MEMORY_DIRECTORY "/dev/shm"
+#define SHARED_MEMORY_PREFIX "mountainlab-"
+#define MAX_HEADER_SIZE (3 * 4 + MDAIO_MAX_DIMS * 8 + 8) //including the scale of a scaled int16 array
+//a header of 3+13 int32's is 64 bytes, so the data starts on a cache line (the extra dimensions are 1)
+#define ALIGNED_NUM_DIMS 13
+#define DEFAULT_MAX_PUBLISHED_BYTES (1024 * 1024 * 1024)
+
+namespace SharedMemoryMda {
+
+void sweep_stale_objects();
+#ifdef ML_HAS_SHARED_MEMORY
+void drop_object(const QString& object_name, int fd);
+#endif
+
+class Registry {
+public:
+    Registry()
+    {
+        sweep_stale_objects();
+    }
+    ~Registry()
+    {
+#ifdef ML_HAS_SHARED_MEMORY
+        for (auto it = m_objects.constBegin(); it != m_objects.constEnd(); it++) {
+            drop_object(it.key(), it.value().fd);
+        }
+#endif
+    }
+
+    struct Entry {
+        bigint num_bytes = 0;
+        bigint last_used = 0;
+        int fd = -1; //held open with a shared lock for as long as the entry exists
+        bool pinned = false;
+    };
+
+    QMutex m_mutex;
+    QMap<QString, Entry> m_objects; //object name -> entry
+    bigint m_total_bytes = 0;
+    bigint m_use_count = 0; //for the least recently used
+    bigint m_max_bytes = DEFAULT_MAX_PUBLISHED_BYTES;
+    bigint m_tmp_count = 0;
+    bool m_enabled = true;
+};
+
+Registry* registry()
+{
+    static Registry R; //destroyed at exit, which drops the objects that are still published
+    return &R;
+}
+
+#ifdef ML_HAS_SHARED_MEMORY
+
+QString object_name_prefix()
+{
+    //the uid keeps the objects of different users apart, since /dev/shm is shared
+    return QString("%1%2-").arg(SHARED_MEMORY_PREFIX).arg(getuid());
+}
+
+QString object_name_for(const QString& name)
+{
+    //the name comes from the checksum of the array, so every process (and every session) that
+    //publishes the same array gets the same object
+    return object_name_prefix() + name;
+}
+
+QString path_for(const QString& object_name)
+{
+    return QString(SHARED_MEMORY_DIRECTORY) + "/" + object_name;
+}
+
+bool has_room_for(bigint num_bytes)
+{
+    //writing past the end of the free space of a tmpfs is a SIGBUS, not an error code
+    struct statvfs st;
+    if (statvfs(SHARED_MEMORY_DIRECTORY, &st) != 0)
+        return false;
+    bigint available = (bigint)st.f_bavail * (bigint)st.f_frsize;
+    return (num_bytes <= available / 2); //leave room for everyone else
+}
+
+//Every process that uses an object (the publishers and the consumers that map it) holds a shared
+//flock on it. Whoever drops it last -- when the exclusive lock can be had -- removes it, so an
+//object never disappears under a process that uses it, and the objects of a process that
+//crashed (whose locks went away with it) are recognized by the sweep.
+void drop_object(const QString& object_name, int fd)
+{
+    if (fd < 0)
+        return;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+        shm_unlink(("/" + object_name).toUtf8().data());
+    ::close(fd);
+}
+
+//opens an existing object with a shared lock; -1 if there is none (or it is being removed), or
+//if it does not have the expected size (when given)
+int acquire_object(const QString& object_name, int flags, bigint expected_num_bytes = -1)
+{
+    int fd = shm_open(("/" + object_name).toUtf8().data(), flags, 0);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    //the lock waits for a process that is removing it, after which it has no links left
+    if ((flock(fd, LOCK_SH) != 0) || (fstat(fd, &st) != 0) || (st.st_nlink == 0)
+        || ((expected_num_bytes >= 0) && (st.st_size != expected_num_bytes))) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sweep_stale_objects()
+{
+    QString prefix = object_name_prefix();
+    foreach (QString object_name, QDir(SHARED_MEMORY_DIRECTORY).entryList(QStringList(prefix + "*"), QDir::Files | QDir::System)) {
+        int fd = shm_open(("/" + object_name).toUtf8().data(), O_RDONLY, 0);
+        if (fd < 0)
+            continue;
+        //nobody holds it: left behind by a process that did not exit normally
+        drop_object(object_name, fd);
+    }
+}
+
+//call with the mutex locked
+void release_object(const QString& object_name)
+{
+    Registry* R = registry();
+    if (!R->m_objects.contains(object_name))
+        return;
+    Registry::Entry entry = R->m_objects.take(object_name);
+    R->m_total_bytes -= entry.num_bytes;
+    //a consumer that has it mapped (or another process that published it) keeps it
+    drop_object(object_name, entry.fd);
+}
+
+//call with the mutex locked. Pinned objects are never released, so this can fail.
+bool make_room_for(bigint num_bytes)
+{
+    Registry* R = registry();
+    while (R->m_total_bytes + num_bytes > R->m_max_bytes) {
+        QString oldest;
+        bigint oldest_use = 0;
+        for (auto it = R->m_objects.constBegin(); it != R->m_objects.constEnd(); it++) {
+            if (it.value().pinned)
+                continue;
+            if ((oldest.isEmpty()) || (it.value().last_used < oldest_use)) {
+                oldest = it.key();
+                oldest_use = it.value().last_used;
+            }
+        }
+        if (oldest.isEmpty())
+            return false;
+        release_object(oldest);
+    }
+    return true;
+}
+
+//call with the mutex locked
+void register_object(const QString& object_name, int fd, bigint num_bytes, bool pin)
+{
+    Registry* R = registry();
+    Registry::Entry entry;
+    entry.num_bytes = num_bytes;
+    entry.last_used = ++R->m_use_count;
+    entry.fd = fd;
+    entry.pinned = pin;
+    R->m_objects[object_name] = entry;
+    R->m_total_bytes += num_bytes;
+}
+
+template <typename MdaType, typename T>
+QString publish_array(const MdaType& X, int data_type, const QString& name, bool pin)
+{
+    if (!isEnabled())
+        return "";
+    Registry* R = registry();
+    QString object_name = object_name_for(name);
+    QString path = path_for(object_name);
+    QString tmp_object_name;
+    {
+        QMutexLocker locker(&R->m_mutex);
+        if (R->m_objects.contains(object_name)) {
+            //same checksum, so same array
+            R->m_objects[object_name].last_used = ++R->m_use_count;
+            if (pin)
+                R->m_objects[object_name].pinned = true;
+            return path;
+        }
+        tmp_object_name = object_name + QString(".tmp.%1.%2").arg(getpid()).arg(++R->m_tmp_count);
+    }
+
+    MDAIO_HEADER H;
+    H.data_type = data_type;
+    H.num_bytes_per_entry = mda_get_num_bytes_per_entry(data_type);
+    H.num_dims = X.ndims();
+    for (int i = 0; i < MDAIO_MAX_DIMS; i++)
+        H.dims[i] = 1;
+    bool uses64bitdims = false;
+    for (int i = 0; i < H.num_dims; i++) {
+        H.dims[i] = X.size(i);
+        if (H.dims[i] > 2e9)
+            uses64bitdims = true;
+    }
+    if ((!uses64bitdims) && (H.num_dims <= ALIGNED_NUM_DIMS))
+        H.num_dims = ALIGNED_NUM_DIMS;
+    char header_buf[MAX_HEADER_SIZE + 1];
+    FILE* hf = fmemopen(header_buf, sizeof(header_buf), "wb");
+    bool header_ok = (hf) && (mda_write_header(&H, hf));
+    if (hf)
+        fclose(hf);
+    if (!header_ok) {
+        qWarning() << "Unable to write header for shared memory array" << name;
+        return "";
+    }
+    bigint num_bytes = H.header_size + sizeof(T) * X.totalSize();
+    {
+        QMutexLocker locker(&R->m_mutex);
+        if (num_bytes > R->m_max_bytes)
+            return "";
+        if (!make_room_for(num_bytes))
+            return "";
+    }
+
+    //another process (or session) may have published the same array already
+    int fd = acquire_object(object_name, O_RDONLY, num_bytes);
+    if (fd < 0) {
+        if (!has_room_for(num_bytes))
+            return "";
+
+        //fill it under a temporary name so that nobody sees a partial array. Only this user may read it.
+        fd = shm_open(("/" + tmp_object_name).toUtf8().data(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            qWarning() << "Unable to create shared memory object" << tmp_object_name << strerror(errno);
+            return "";
+        }
+        flock(fd, LOCK_SH); //before it has a name that the sweep can see
+        void* ptr = MAP_FAILED;
+        if (ftruncate(fd, num_bytes) == 0)
+            ptr = mmap(0, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            qWarning() << "Unable to map shared memory object" << tmp_object_name << strerror(errno);
+            shm_unlink(("/" + tmp_object_name).toUtf8().data());
+            ::close(fd);
+            return "";
+        }
+        memcpy(ptr, header_buf, H.header_size);
+        memcpy((char*)ptr + H.header_size, X.constDataPtr(), sizeof(T) * X.totalSize());
+        munmap(ptr, num_bytes);
+
+        //link() rather than rename(), so that an object published by someone else in the meantime is not replaced
+        bool linked = (link(path_for(tmp_object_name).toUtf8().data(), path.toUtf8().data()) == 0);
+        shm_unlink(("/" + tmp_object_name).toUtf8().data());
+        if (!linked) {
+            ::close(fd);
+            if (errno != EEXIST)
+                return "";
+            fd = acquire_object(object_name, O_RDONLY, num_bytes);
+            if (fd < 0)
+                return "";
+        }
+    }
+
+    QMutexLocker locker(&R->m_mutex);
+    if (R->m_objects.contains(object_name)) {
+        //published by another thread in the meantime
+        ::close(fd); //that thread holds its own lock
+        R->m_objects[object_name].last_used = ++R->m_use_count;
+        if (pin)
+            R->m_objects[object_name].pinned = true;
+        return path;
+    }
+    register_object(object_name, fd, num_bytes, pin);
+    return path;
+}
+
+#else
+
+void sweep_stale_objects()
+{
+}
+
+#endif
+
+bool isEnabled()
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    return ((registry()->m_enabled) && (QFileInfo(SHARED_MEMORY_DIRECTORY).isDir()));
+#else
+    return false;
+#endif
+}
+
+void setEnabled(bool val)
+{
+    registry()->m_enabled = val;
+}
+
+void setMaxPublishedBytes(bigint num_bytes)
+{
+    QMutexLocker locker(&registry()->m_mutex);
+    registry()->m_max_bytes = num_bytes;
+#ifdef ML_HAS_SHARED_MEMORY
+    make_room_for(0);
+#endif
+}
+
+bigint publishedBytes()
+{
+    QMutexLocker locker(&registry()->m_mutex);
+    return registry()->m_total_bytes;
+}
+
+QString publish(const Mda& X, const QString& name, bool pinned)
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    return publish_array<Mda, double>(X, MDAIO_TYPE_FLOAT64, name, pinned);
+#else
+    Q_UNUSED(X)
+    Q_UNUSED(name)
+    Q_UNUSED(pinned)
+    return "";
+#endif
+}
+
+QString publish(const Mda32& X, const QString& name, bool pinned)
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    return publish_array<Mda32, float>(X, MDAIO_TYPE_FLOAT32, name, pinned);
+#else
+    Q_UNUSED(X)
+    Q_UNUSED(name)
+    Q_UNUSED(pinned)
+    return "";
+#endif
+}
+
+bool isSharedMemoryPath(const QString& path)
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    return path.startsWith(QString(SHARED_MEMORY_DIRECTORY) + "/" + SHARED_MEMORY_PREFIX);
+#else
+    Q_UNUSED(path)
+    return false;
+#endif
+}
+
+bool release(const QString& path)
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    QString object_name = QFileInfo(path).fileName();
+    QMutexLocker locker(&registry()->m_mutex);
+    if (!registry()->m_objects.contains(object_name))
+        return false; //not ours
+    release_object(object_name);
+    return true;
+#else
+    Q_UNUSED(path)
+    return false;
+#endif
+}
+
+bool unpin(const QString& path)
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    QString object_name = QFileInfo(path).fileName();
+    QMutexLocker locker(&registry()->m_mutex);
+    if (!registry()->m_objects.contains(object_name))
+        return false;
+    registry()->m_objects[object_name].pinned = false;
+    return true;
+#else
+    Q_UNUSED(path)
+    return false;
+#endif
+}
+
+void releaseAll()
+{
+    foreach (QString path, publishedPaths()) {
+        release(path);
+    }
+}
+
+QStringList publishedPaths()
+{
+    QStringList ret;
+#ifdef ML_HAS_SHARED_MEMORY
+    QMutexLocker locker(&registry()->m_mutex);
+    foreach (QString object_name, registry()->m_objects.keys()) {
+        ret << path_for(object_name);
+    }
+#endif
+    return ret;
+}
+
+void sweepStaleObjects()
+{
+    sweep_stale_objects();
+}
+}
+
+class SharedMemoryMdaMappingPrivate {
+public:
+    SharedMemoryMdaMapping* q;
+    void* m_ptr = 0;
+    bigint m_num_bytes = 0;
+    QString m_object_name;
+    int m_fd = -1; //shared lock, so that the object stays until it is unmapped
+    MDAIO_HEADER m_header;
+};
+
+SharedMemoryMdaMapping::SharedMemoryMdaMapping()
+{
+    d = new SharedMemoryMdaMappingPrivate;
+    d->q = this;
+}
+
+SharedMemoryMdaMapping::~SharedMemoryMdaMapping()
+{
+    close();
+    delete d;
+}
+
+bool SharedMemoryMdaMapping::open(const QString& path)
+{
+    close();
+#ifdef ML_HAS_SHARED_MEMORY
+    QString object_name = QFileInfo(path).fileName();
+    int fd = SharedMemoryMda::acquire_object(object_name, O_RDONLY);
+    if (fd < 0) {
+        qWarning() << "Unable to open shared memory object" << path << strerror(errno);
+        return false;
+    }
+    d->m_object_name = object_name;
+    d->m_fd = fd;
+    struct stat st;
+    void* ptr = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+        ptr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        qWarning() << "Unable to map shared memory object" << path << strerror(errno);
+        close();
+        return false;
+    }
+    d->m_ptr = ptr;
+    d->m_num_bytes = st.st_size;
+
+    FILE* hf = fmemopen(ptr, qMin(d->m_num_bytes, (bigint)MAX_HEADER_SIZE), "rb");
+    bool header_ok = (hf) && (mda_read_header(&d->m_header, hf));
+    if (hf)
+        fclose(hf);
+    if (header_ok) {
+        bigint total_size = 1;
+        for (int i = 0; i < MDAIO_MAX_DIMS; i++)
+            total_size *= d->m_header.dims[i];
+        header_ok = (d->m_header.header_size + d->m_header.num_bytes_per_entry * total_size <= d->m_num_bytes);
+    }
+    if (!header_ok) {
+        qWarning() << "Invalid array in shared memory object" << path;
+        close();
+        return false;
+    }
+    return true;
+#else
+    qWarning() << "Shared memory is not supported on this platform" << path;
+    return false;
+#endif
+}
+
+void SharedMemoryMdaMapping::close()
+{
+#ifdef ML_HAS_SHARED_MEMORY
+    if (d->m_ptr)
+        munmap(d->m_ptr, d->m_num_bytes);
+    //the last one to let go of an object that is no longer published removes it
+    SharedMemoryMda::drop_object(d->m_object_name, d->m_fd);
+    //a consumer in this process is done with it, so it no longer needs to be pinned
+    if (!d->m_object_name.isEmpty())
+        SharedMemoryMda::unpin(SharedMemoryMda::path_for(d->m_object_name));
+#endif
+    d->m_fd = -1;
+    d->m_object_name.clear();
+    d->m_ptr = 0;
+    d->m_num_bytes = 0;
+}
+
+bool SharedMemoryMdaMapping::isOpen() const
+{
+    return (d->m_ptr != 0);
+}
+
+MDAIO_HEADER SharedMemoryMdaMapping::header() const
+{
+    return d->m_header;
+}
+
+const char* SharedMemoryMdaMapping::data() const
+{
+    if (!d->m_ptr)
+        return 0;
+    return (const char*)d->m_ptr + d->m_header.header_size;
+}
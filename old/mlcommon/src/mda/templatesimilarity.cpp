@@ -0,0 +1,308 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "templatesimilarity.h"
+#include "mlcommon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+namespace TemplateSimilarityGemm {
+
+const bigint tile_size = 64; //templates per side of an output tile
+const bigint row_chunk = 256; //rows of the template matrix per pass, so the columns of a tile stay in cache
+
+// C[i + ldc * j] += sum_r a_i[r] * b_j[r] for a 4x4 block
+inline void kernel_4x4(const float* const* a, const float* const* b, bigint n, float* C, bigint ldc)
+{
+    float c00 = 0, c01 = 0, c02 = 0, c03 = 0, c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+    float c20 = 0, c21 = 0, c22 = 0, c23 = 0, c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+    const float *a0 = a[0], *a1 = a[1], *a2 = a[2], *a3 = a[3];
+    const float *b0 = b[0], *b1 = b[1], *b2 = b[2], *b3 = b[3];
+#pragma omp simd reduction(+ : c00, c01, c02, c03, c10, c11, c12, c13, c20, c21, c22, c23, c30, c31, c32, c33)
+    for (bigint r = 0; r < n; r++) {
+        c00 += a0[r] * b0[r];
+        c01 += a0[r] * b1[r];
+        c02 += a0[r] * b2[r];
+        c03 += a0[r] * b3[r];
+        c10 += a1[r] * b0[r];
+        c11 += a1[r] * b1[r];
+        c12 += a1[r] * b2[r];
+        c13 += a1[r] * b3[r];
+        c20 += a2[r] * b0[r];
+        c21 += a2[r] * b1[r];
+        c22 += a2[r] * b2[r];
+        c23 += a2[r] * b3[r];
+        c30 += a3[r] * b0[r];
+        c31 += a3[r] * b1[r];
+        c32 += a3[r] * b2[r];
+        c33 += a3[r] * b3[r];
+    }
+    C[0 + ldc * 0] += c00;
+    C[0 + ldc * 1] += c01;
+    C[0 + ldc * 2] += c02;
+    C[0 + ldc * 3] += c03;
+    C[1 + ldc * 0] += c10;
+    C[1 + ldc * 1] += c11;
+    C[1 + ldc * 2] += c12;
+    C[1 + ldc * 3] += c13;
+    C[2 + ldc * 0] += c20;
+    C[2 + ldc * 1] += c21;
+    C[2 + ldc * 2] += c22;
+    C[2 + ldc * 3] += c23;
+    C[3 + ldc * 0] += c30;
+    C[3 + ldc * 1] += c31;
+    C[3 + ldc * 2] += c32;
+    C[3 + ldc * 3] += c33;
+}
+
+inline float dot(const float* a, const float* b, bigint n)
+{
+    float sum = 0;
+#pragma omp simd reduction(+ : sum)
+    for (bigint r = 0; r < n; r++)
+        sum += a[r] * b[r];
+    return sum;
+}
+
+// C (ni x nj) = A1^T A2, where A1 holds the columns i0..i0+ni-1 of A starting at row ra, and
+// A2 the columns j0..j0+nj-1 starting at row rb (n rows each). A is R x K, one template per column.
+void tile_product(float* C, const float* A, bigint R, bigint i0, bigint ni, bigint j0, bigint nj, bigint ra, bigint rb, bigint n)
+{
+    for (bigint i = 0; i < ni * nj; i++)
+        C[i] = 0;
+    for (bigint r0 = 0; r0 < n; r0 += row_chunk) {
+        bigint nr = qMin(row_chunk, n - r0);
+        for (bigint jj = 0; jj < nj; jj += 4) {
+            for (bigint ii = 0; ii < ni; ii += 4) {
+                if ((ii + 4 <= ni) && (jj + 4 <= nj)) {
+                    const float* a[4];
+                    const float* b[4];
+                    for (int q = 0; q < 4; q++) {
+                        a[q] = &A[R * (i0 + ii + q) + ra + r0];
+                        b[q] = &A[R * (j0 + jj + q) + rb + r0];
+                    }
+                    kernel_4x4(a, b, nr, &C[ii + ni * jj], ni);
+                }
+                else {
+                    for (bigint j = jj; j < qMin(jj + 4, nj); j++) {
+                        for (bigint i = ii; i < qMin(ii + 4, ni); i++) {
+                            C[i + ni * j] += dot(&A[R * (i0 + i) + ra + r0], &A[R * (j0 + j) + rb + r0], nr);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Runs job(t) for t = 0..num_jobs-1 on all cores, handing out the jobs one at a time since they
+// are of unequal size (diagonal tiles are cheaper)
+template <typename Job>
+void run_jobs(bigint num_jobs, Job job)
+{
+    bigint num_threads = qMin((bigint)qMax(1, (int)std::thread::hardware_concurrency()), num_jobs);
+    std::atomic<bigint> next(0);
+    auto worker = [&]() {
+        bigint t;
+        while ((t = next++) < num_jobs)
+            job(t);
+    };
+    if (num_threads <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (bigint i = 0; i < num_threads; i++)
+        threads.push_back(std::thread(worker));
+    for (bigint i = 0; i < num_threads; i++)
+        threads[i].join();
+}
+
+struct TilePair {
+    bigint i0, ni, j0, nj; //i0 <= j0
+};
+
+std::vector<TilePair> upper_tile_pairs(bigint K)
+{
+    std::vector<TilePair> ret;
+    for (bigint j0 = 0; j0 < K; j0 += tile_size) {
+        for (bigint i0 = 0; i0 <= j0; i0 += tile_size) {
+            TilePair P;
+            P.i0 = i0;
+            P.ni = qMin(tile_size, K - i0);
+            P.j0 = j0;
+            P.nj = qMin(tile_size, K - j0);
+            ret.push_back(P);
+        }
+    }
+    return ret;
+}
+
+// The inner products of the templates (the columns of A, each M x T flattened) with the templates
+// delayed by shift timepoints: G[k1 + K * k2] = sum_{m,t} X(m, t, k1) X(m, t - shift, k2), zero padded.
+// The negative shifts follow from G_{-s}(k1, k2) = G_s(k2, k1). Each tile pair (I, J) with I <= J is one
+// job, which computes the I x J tile (and the J x I tile when I != J) for the shifts 0..max_shift and
+// passes them to the handler. The handler can update both the I x J and the J x I blocks of its
+// output, since no other job touches them.
+template <typename Handler>
+void lagged_products(const float* A, bigint M, bigint T, bigint K, bigint max_shift, Handler handler)
+{
+    bigint R = M * T;
+    max_shift = qMin(max_shift, T - 1);
+    std::vector<TilePair> pairs = upper_tile_pairs(K);
+    run_jobs(pairs.size(), [&](bigint t) {
+        const TilePair& P = pairs[t];
+        std::vector<float> C(tile_size * tile_size);
+        for (bigint s = 0; s <= max_shift; s++) {
+            bigint n = M * (T - s);
+            //rows t of the first template against rows t - s of the second
+            tile_product(C.data(), A, R, P.i0, P.ni, P.j0, P.nj, M * s, 0, n);
+            handler(P.i0, P.ni, P.j0, P.nj, s, C.data());
+            if ((s > 0) && (P.i0 != P.j0)) {
+                tile_product(C.data(), A, R, P.j0, P.nj, P.i0, P.ni, M * s, 0, n);
+                handler(P.j0, P.nj, P.i0, P.ni, s, C.data());
+            }
+        }
+    });
+}
+}
+
+namespace TemplateSimilarity {
+
+Mda innerProducts(const Mda32& templates)
+{
+    using namespace TemplateSimilarityGemm;
+    bigint K = templates.N3();
+    Mda ret(K, K);
+    double* G = ret.dataPtr();
+    lagged_products(templates.constDataPtr(), templates.N1(), templates.N2(), K, 0, [G, K](bigint i0, bigint ni, bigint j0, bigint nj, bigint s, const float* C) {
+        Q_UNUSED(s)
+        for (bigint j = 0; j < nj; j++) {
+            for (bigint i = 0; i < ni; i++) {
+                G[(i0 + i) + K * (j0 + j)] = C[i + ni * j];
+                G[(j0 + j) + K * (i0 + i)] = C[i + ni * j];
+            }
+        }
+    });
+    return ret;
+}
+
+Mda distances(const Mda32& templates)
+{
+    bigint K = templates.N3();
+    Mda ret = innerProducts(templates);
+    double* G = ret.dataPtr();
+    QVector<double> sqr_norms(K);
+    for (bigint k = 0; k < K; k++)
+        sqr_norms[k] = G[k + K * k];
+    for (bigint k2 = 0; k2 < K; k2++) {
+        for (bigint k1 = 0; k1 < K; k1++) {
+            double val = sqr_norms[k1] + sqr_norms[k2] - 2 * G[k1 + K * k2];
+            G[k1 + K * k2] = (val > 0) ? sqrt(val) : 0; //can be slightly negative from rounding
+        }
+    }
+    return ret;
+}
+
+Mda correlations(const Mda32& templates)
+{
+    bigint N = templates.N1() * templates.N2();
+    bigint K = templates.N3();
+    Mda ret = innerProducts(templates);
+    double* G = ret.dataPtr();
+    if (N <= 1) {
+        ret.allocate(K, K);
+        return ret;
+    }
+    //centering is a rank one correction of the inner products
+    QVector<double> sums(K), variances(K);
+    for (bigint k = 0; k < K; k++) {
+        sums[k] = MLCompute::sum(N, templates.constDataPtr() + N * k);
+        variances[k] = G[k + K * k] - sums[k] * sums[k] / N;
+    }
+    for (bigint k2 = 0; k2 < K; k2++) {
+        for (bigint k1 = 0; k1 < K; k1++) {
+            double denom = variances[k1] * variances[k2];
+            if (denom > 0)
+                G[k1 + K * k2] = (G[k1 + K * k2] - sums[k1] * sums[k2] / N) / sqrt(denom);
+            else
+                G[k1 + K * k2] = 0;
+        }
+    }
+    return ret;
+}
+
+Mda bestLagInnerProducts(Mda& best_shifts, const Mda32& templates, int max_shift)
+{
+    using namespace TemplateSimilarityGemm;
+    bigint K = templates.N3();
+    Mda ret(K, K);
+    best_shifts.allocate(K, K);
+    double* best = ret.dataPtr();
+    double* shifts = best_shifts.dataPtr();
+    std::vector<char> found(K * K, 0);
+    auto update = [&](bigint a, double val, bigint s) {
+        //ties go to the smaller shift
+        if ((!found[a]) || (val > best[a]) || ((val == best[a]) && (qAbs(s) < qAbs((bigint)shifts[a])))) {
+            best[a] = val;
+            shifts[a] = s;
+            found[a] = 1;
+        }
+    };
+    lagged_products(templates.constDataPtr(), templates.N1(), templates.N2(), K, qMax(max_shift, 0), [&](bigint i0, bigint ni, bigint j0, bigint nj, bigint s, const float* C) {
+        for (bigint j = 0; j < nj; j++) {
+            for (bigint i = 0; i < ni; i++) {
+                update((i0 + i) + K * (j0 + j), C[i + ni * j], s);
+                update((j0 + j) + K * (i0 + i), C[i + ni * j], -s);
+            }
+        }
+    });
+    return ret;
+}
+
+Mda bestLagCorrelations(Mda& best_shifts, const Mda32& templates, int max_shift)
+{
+    bigint N = templates.N1() * templates.N2();
+    bigint K = templates.N3();
+    Mda ret = bestLagInnerProducts(best_shifts, templates, max_shift);
+    double* G = ret.dataPtr();
+    QVector<double> norms(K);
+    for (bigint k = 0; k < K; k++)
+        norms[k] = MLCompute::norm(N, templates.constDataPtr() + N * k);
+    for (bigint k2 = 0; k2 < K; k2++) {
+        for (bigint k1 = 0; k1 < K; k1++) {
+            double denom = norms[k1] * norms[k2];
+            G[k1 + K * k2] = (denom > 0) ? G[k1 + K * k2] / denom : 0;
+        }
+    }
+    return ret;
+}
+
+QList<QVector<int> > nearestNeighbors(const Mda& distances, int num)
+{
+    bigint K = distances.N1();
+    QList<QVector<int> > ret;
+    for (bigint k = 0; k < K; k++) {
+        QVector<int> inds;
+        for (bigint k2 = 0; k2 < K; k2++) {
+            if (k2 != k)
+                inds << k2;
+        }
+        int num0 = qMin(qMax(num, 0), inds.count());
+        //only the first num0 need to be sorted; ties go to the lower index
+        std::partial_sort(inds.begin(), inds.begin() + num0, inds.end(), [&distances, k](int a, int b) {
+            double da = distances.value(k, a), db = distances.value(k, b);
+            return (da < db) || ((da == db) && (a < b));
+        });
+        inds.resize(num0);
+        ret << inds;
+    }
+    return ret;
+}
+}
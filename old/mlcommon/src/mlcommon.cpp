@@ -5,6 +5,7 @@
 *******************************************************/
 
 #include "mlcommon.h"
+#include "mlkernels.h"
 #include "cachemanager/cachemanager.h"
 #include "taskprogress/taskprogress.h"
 
@@ -24,6 +25,7 @@
 #include <QJsonArray>
 #include <QSettings>
 #include "mlnetwork.h"
+#include "prvlocationindex.h"
 
 #define PRV_VERSION "0.11"
 
@@ -409,7 +411,7 @@ double MLCompute::dotProduct(const QVector<float>& X1, const QVector<float>& X2)
 {
     if (X1.count() != X2.count())
         return 0;
-    return std::inner_product(X1.constBegin(), X1.constEnd(), X2.constBegin(), 0.0);
+    return MLKernels::dot(X1.count(), X1.constData(), X2.constData());
 }
 
 double MLCompute::norm(const QVector<float>& X)
@@ -449,8 +451,7 @@ double MLCompute::dotProduct(bigint N, const double* X1, const double* X2)
 
 double MLCompute::dotProduct(bigint N, const float* X1, const float* X2)
 {
-
-    return std::inner_product(X1, X1 + N, X2, 0.0);
+    return MLKernels::dot(N, X1, X2);
 }
 
 QString MLUtil::computeSha1SumOfString(const QString& str)
@@ -631,17 +632,25 @@ bool MLUtil::writeByteArray(const QString& path, const QByteArray& X)
 
 double MLCompute::min(bigint N, const float* X)
 {
-    return N ? *std::min_element(X, X + N) : 0;
+    if (!N)
+        return 0;
+    float min0, max0;
+    MLKernels::minMax(N, X, min0, max0);
+    return min0;
 }
 
 double MLCompute::max(bigint N, const float* X)
 {
-    return N ? *std::max_element(X, X + N) : 0;
+    if (!N)
+        return 0;
+    float min0, max0;
+    MLKernels::minMax(N, X, min0, max0);
+    return max0;
 }
 
 double MLCompute::sum(bigint N, const float* X)
 {
-    return std::accumulate(X, X + N, 0.0);
+    return MLKernels::sum(N, X);
 }
 
 double MLCompute::mean(bigint N, const float* X)
@@ -755,65 +764,20 @@ QString download_file_to_temp_dir(QString url)
 {
     QString tmp_fname = CacheManager::globalInstance()->makeLocalFile(MLUtil::computeSha1SumOfString(url) + "." + make_random_id_22(5) + ".download");
     QFile::remove(tmp_fname);
-    QString cmd = QString("curl %1 -o %2").arg(url).arg(tmp_fname);
-    system_call_return_output(cmd);
-    if (!QFile::exists(tmp_fname))
-        return "";
-    return tmp_fname;
-}
-
-class Downloader : public QThread {
-public:
-    //input
-    QString url;
-    QString output_path;
-
-    //output
-    bool success = false;
-
-    void run()
-    {
-        QFile::remove(output_path);
-
-        QString cmd = QString("curl -s %1 -o %2").arg(url).arg(output_path);
-        if (system(cmd.toUtf8().data()) != 0) {
-            QFile::remove(output_path);
-        }
-        success = QFile::exists(output_path);
-    }
-};
-
-QString concatenate_files_to_temporary_file(QStringList file_paths)
-{
-    /// Witold, this function should be improved by streaming the read/writes
-    foreach (QString str, file_paths) {
-        if (str.isEmpty())
-            return "";
-    }
-
-    QString code = file_paths.join(";");
-    QString tmp_fname = CacheManager::globalInstance()->makeLocalFile(MLUtil::computeSha1SumOfString(code) + "." + make_random_id_22(5) + ".concat.download");
-    QFile f(tmp_fname);
-    if (!f.open(QIODevice::WriteOnly)) {
-        qWarning() << __FUNCTION__ << "Unable to open file for writing: " + tmp_fname;
+    MLNetwork::Downloader downloader;
+    downloader.source_url = url;
+    downloader.destination_file_name = tmp_fname;
+    downloader.start();
+    downloader.waitForFinished(-1);
+    if (!downloader.success) {
+        qWarning() << "Problem downloading file" << url << downloader.error;
+        QFile::remove(tmp_fname);
         return "";
     }
-    foreach (QString str, file_paths) {
-        QFile g(str);
-        if (!g.open(QIODevice::ReadOnly)) {
-            qWarning() << __FUNCTION__ << "Unable to open file for reading: " + str;
-            f.close();
-            return "";
-        }
-        f.write(g.readAll());
-        g.close();
-    }
-
-    f.close();
     return tmp_fname;
 }
 
-QString parallel_download_file_from_prvfileserver_to_temp_dir(QString url, int size, int num_downloads)
+QString parallel_download_file_from_prvfileserver_to_temp_dir(QString url, bigint size, int num_downloads)
 {
 
     QString tmp_fname = CacheManager::globalInstance()->makeLocalFile() + ".parallel_download";
@@ -983,18 +947,13 @@ double MLCompute::correlation(bigint N, const float* X1, const float* X2)
     if (N <= 1)
         return 0;
     double mean1 = mean(N, X1);
-    double stdev1 = stdev(N, X1);
     double mean2 = mean(N, X2);
-    double stdev2 = stdev(N, X2);
-    if ((stdev1 == 0) || (stdev2 == 0))
+    //two passes, on the centered data, without the normalized copies
+    double var1 = MLKernels::centeredDot(N, X1, X1, mean1, mean1);
+    double var2 = MLKernels::centeredDot(N, X2, X2, mean2, mean2);
+    if ((var1 == 0) || (var2 == 0))
         return 0;
-    QVector<double> Y1(N);
-    QVector<double> Y2(N);
-    for (bigint i = 0; i < N; i++) {
-        Y1[i] = (X1[i] - mean1) / stdev1;
-        Y2[i] = (X2[i] - mean2) / stdev2;
-    }
-    return dotProduct(Y1, Y2) / (N - 1);
+    return MLKernels::centeredDot(N, X1, X2, mean1, mean2) / sqrt(var1 * var2);
 }
 
 double MLCompute::stdev(bigint N, const float* X)
@@ -1216,6 +1175,46 @@ QString find_local_file(bigint size, const QString& checksum, const QString& fcs
     return "";
 }
 
+QStringList find_directory_candidates_using_index(const QJsonObject& obj, const QStringList& local_search_paths)
+{
+    // a directory matching obj must be the parent of a file matching its first file
+    // (or of a directory matching its first subdirectory)
+    QStringList ret;
+    QJsonArray files = obj.value("files").toArray();
+    QJsonArray dirs = obj.value("directories").toArray();
+    if (!files.isEmpty()) {
+        QJsonObject prv0 = files[0].toObject().value("prv").toObject();
+        QString name0 = files[0].toObject().value("name").toString();
+        bigint size = prv0["original_size"].toVariant().toLongLong();
+        QStringList paths = PrvLocationIndex::globalInstance()->locateFiles(size, prv0["original_checksum"].toString(), prv0["original_fcs"].toString(), local_search_paths);
+        foreach (QString path, paths) {
+            if (QFileInfo(path).fileName() == name0)
+                ret << QFileInfo(path).path();
+        }
+    }
+    else if (!dirs.isEmpty()) {
+        QString name0 = dirs[0].toObject().value("name").toString();
+        QStringList paths = find_directory_candidates_using_index(dirs[0].toObject().value("prv").toObject(), local_search_paths);
+        foreach (QString path, paths) {
+            if (QFileInfo(path).fileName() == name0)
+                ret << QFileInfo(path).path();
+        }
+    }
+    return ret;
+}
+
+bool directory_prv_object_has_files(const QJsonObject& obj)
+{
+    if (!obj.value("files").toArray().isEmpty())
+        return true;
+    QJsonArray dirs = obj.value("directories").toArray();
+    for (int i = 0; i < dirs.count(); i++) {
+        if (directory_prv_object_has_files(dirs[i].toObject().value("prv").toObject()))
+            return true;
+    }
+    return false;
+}
+
 QString MLUtil::locatePrv(const QJsonObject& obj, const QStringList& local_search_paths)
 {
     if (obj.contains("original_checksum")) {
@@ -1228,14 +1227,27 @@ QString MLUtil::locatePrv(const QJsonObject& obj, const QStringList& local_searc
             if (QFile::exists(original_path)) {
                 if (QFileInfo(original_path).size() == size) {
                     if (matchesFastChecksum(original_path, fcs)) {
-                        if (MLUtil::computeSha1SumOfFile(original_path) == checksum) {
+                        if (PrvLocationIndex::globalInstance()->checksumOfFile(original_path, local_search_paths) == checksum) {
                             return original_path;
                         }
                     }
                 }
             }
         }
-        return find_local_file(size, checksum, fcs, local_search_paths, false);
+        QString fname = PrvLocationIndex::globalInstance()->locateFiles(size, checksum, fcs, local_search_paths, true).value(0);
+        if (!fname.isEmpty())
+            return fname;
+        // the index does not see a file rewritten in place with a different size, so search directly
+        // (but not again and again for a file that is not there)
+        QString miss_key = QString("file:%1:%2:%3").arg(size).arg(checksum).arg(local_search_paths.join(":"));
+        if (PrvLocationIndex::globalInstance()->isRecentMiss(miss_key))
+            return "";
+        fname = find_local_file(size, checksum, fcs, local_search_paths, false);
+        if (!fname.isEmpty())
+            PrvLocationIndex::globalInstance()->updateFile(fname, local_search_paths);
+        else
+            PrvLocationIndex::globalInstance()->recordMiss(miss_key);
+        return fname;
     }
     else {
         QStringList search_paths = local_search_paths;
@@ -1245,7 +1257,20 @@ QString MLUtil::locatePrv(const QJsonObject& obj, const QStringList& local_searc
             if (directory_matches_prv_object(original_path, obj, false))
                 return original_path;
         }
+        if (directory_prv_object_has_files(obj)) {
+            QStringList candidates = find_directory_candidates_using_index(obj, search_paths);
+            foreach (QString candidate, candidates) {
+                if (directory_matches_prv_object(candidate, obj, false))
+                    return candidate;
+            }
+        }
+        // no match in the index (or a tree with no files, which has nothing to index), so search directly
+        QString miss_key = "dir:" + MLUtil::computeSha1SumOfString(QJsonDocument(obj).toJson(QJsonDocument::Compact)) + ":" + search_paths.join(":");
+        if (PrvLocationIndex::globalInstance()->isRecentMiss(miss_key))
+            return "";
         QString fname = find_directory_in_search_paths(obj, search_paths);
+        if (fname.isEmpty())
+            PrvLocationIndex::globalInstance()->recordMiss(miss_key);
         return fname;
     }
 }
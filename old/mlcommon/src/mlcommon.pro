@@ -6,6 +6,9 @@ CONFIG += c++11
 CONFIG -= app_bundle
 CONFIG += staticlib
 
+#vectorize the loops marked with omp simd (no OpenMP runtime is needed)
+!macx:QMAKE_CXXFLAGS += -fopenmp-simd
+
 DESTDIR = ../lib
 OBJECTS_DIR = ../build
 MOC_DIR=../build
@@ -14,7 +17,7 @@ TEMPLATE = lib
 
 INCLUDEPATH += ../include
 VPATH += ../include
-HEADERS += mlcommon.h sumit.h \
+HEADERS += mlcommon.h mlkernels.h sumit.h \
     ../include/mda/mda32.h \
     ../include/mda/diskreadmda32.h \
     ../include/mda/mda_p.h \
@@ -26,10 +29,12 @@ HEADERS += mlcommon.h sumit.h \
     ../include/icounter.h \
     ../include/qprocessmanager.h \
     ../include/signalhandler.h \
-    ../include/mllog.h
+    ../include/mllog.h \
+    ../include/processorprofile.h \
+    ../include/prvlocationindex.h
 
 SOURCES += \
-    mlcommon.cpp sumit.cpp \
+    mlcommon.cpp mlkernels.cpp sumit.cpp \
     mda/mda32.cpp \
     mda/diskreadmda32.cpp \
     objectregistry.cpp \
@@ -38,13 +43,15 @@ SOURCES += \
     icounter.cpp \
     qprocessmanager.cpp \
     signalhandler.cpp \
-    mllog.cpp
+    mllog.cpp \
+    processorprofile.cpp \
+    prvlocationindex.cpp
 
 INCLUDEPATH += ../include/mda
 VPATH += ../include/mda
 VPATH += mda
-HEADERS += diskreadmda.h diskwritemda.h mda.h mdaio.h remotereadmda.h usagetracking.h
-SOURCES += diskreadmda.cpp diskwritemda.cpp mda.cpp mdaio.cpp remotereadmda.cpp usagetracking.cpp
+HEADERS += diskreadmda.h diskwritemda.h asyncdiskwritemda.h mda.h mdaallocator.h mdaio.h mdatranspose.h remotereadmda.h sharedmemorymda.h templatesimilarity.h usagetracking.h
+SOURCES += diskreadmda.cpp diskwritemda.cpp asyncdiskwritemda.cpp mda.cpp mdaallocator.cpp mdaio.cpp mdatranspose.cpp remotereadmda.cpp sharedmemorymda.cpp templatesimilarity.cpp usagetracking.cpp
 
 INCLUDEPATH += ../include/cachemanager
 VPATH += ../include/cachemanager
@@ -0,0 +1,665 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "mlkernels.h"
+
+#include <atomic>
+#include <math.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MLKERNELS_X86
+#include <immintrin.h>
+#define MLKERNELS_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+
+struct KernelTable {
+    double (*dot)(bigint N, const float* X, const float* Y);
+    double (*centered_dot)(bigint N, const float* X, const float* Y, double mean_x, double mean_y);
+    double (*sum)(bigint N, const float* X);
+    double (*dist_squared)(bigint N, const float* X, const float* Y);
+    void (*axpy)(bigint N, float a, const float* X, float* Y);
+    void (*min_max)(bigint N, const float* X, float& min, float& max);
+    void (*float_to_int16)(bigint N, const float* X, qint16* Y, float factor);
+    void (*int16_to_float)(bigint N, const qint16* X, float* Y, float factor);
+};
+
+///////////////////////////////////////////////////////////////////////////
+// scalar, also used for the ends of the arrays in the other versions
+
+double dot_scalar(bigint N, const float* X, const float* Y)
+{
+    double ret = 0;
+    for (bigint i = 0; i < N; i++)
+        ret += (double)X[i] * (double)Y[i];
+    return ret;
+}
+
+double centered_dot_scalar(bigint N, const float* X, const float* Y, double mean_x, double mean_y)
+{
+    double ret = 0;
+    for (bigint i = 0; i < N; i++)
+        ret += (X[i] - mean_x) * (Y[i] - mean_y);
+    return ret;
+}
+
+double sum_scalar(bigint N, const float* X)
+{
+    double ret = 0;
+    for (bigint i = 0; i < N; i++)
+        ret += X[i];
+    return ret;
+}
+
+double dist_squared_scalar(bigint N, const float* X, const float* Y)
+{
+    double ret = 0;
+    for (bigint i = 0; i < N; i++) {
+        double diff = (double)X[i] - (double)Y[i];
+        ret += diff * diff;
+    }
+    return ret;
+}
+
+void axpy_scalar(bigint N, float a, const float* X, float* Y)
+{
+    for (bigint i = 0; i < N; i++)
+        Y[i] += a * X[i];
+}
+
+void min_max_scalar(bigint N, const float* X, float& min, float& max)
+{
+    for (bigint i = 0; i < N; i++) {
+        if (X[i] < min)
+            min = X[i];
+        if (X[i] > max)
+            max = X[i];
+    }
+}
+
+inline qint16 float_to_int16_1(float val)
+{
+    //the same as the vector versions: clamp (NaN to the minimum) then round to nearest even
+    if (val >= 32767.0f)
+        return 32767;
+    if (val > -32768.0f)
+        return (qint16)lrintf(val);
+    return -32768;
+}
+
+inline qint16 double_to_int16_1(double val)
+{
+    if (val >= 32767.0)
+        return 32767;
+    if (val > -32768.0)
+        return (qint16)lrint(val);
+    return -32768;
+}
+
+void float_to_int16_scalar(bigint N, const float* X, qint16* Y, float factor)
+{
+    for (bigint i = 0; i < N; i++)
+        Y[i] = float_to_int16_1(X[i] * factor);
+}
+
+void int16_to_float_scalar(bigint N, const qint16* X, float* Y, float factor)
+{
+    for (bigint i = 0; i < N; i++)
+        Y[i] = X[i] * factor;
+}
+
+const KernelTable scalar_table = {
+    dot_scalar,
+    centered_dot_scalar,
+    sum_scalar,
+    dist_squared_scalar,
+    axpy_scalar,
+    min_max_scalar,
+    float_to_int16_scalar,
+    int16_to_float_scalar
+};
+
+#ifdef MLKERNELS_X86
+
+///////////////////////////////////////////////////////////////////////////
+// SSE2: two doubles or four floats at a time
+
+MLKERNELS_TARGET("sse2")
+inline double hsum_sse2(__m128d a)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+}
+
+MLKERNELS_TARGET("sse2")
+double dot_sse2(bigint N, const float* X, const float* Y)
+{
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    bigint i = 0;
+    for (; i + 4 <= N; i += 4) {
+        __m128 x = _mm_loadu_ps(X + i), y = _mm_loadu_ps(Y + i);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), _mm_cvtps_pd(_mm_movehl_ps(y, y))));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1)) + dot_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("sse2")
+double centered_dot_sse2(bigint N, const float* X, const float* Y, double mean_x, double mean_y)
+{
+    __m128d mx = _mm_set1_pd(mean_x), my = _mm_set1_pd(mean_y);
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    bigint i = 0;
+    for (; i + 4 <= N; i += 4) {
+        __m128 x = _mm_loadu_ps(X + i), y = _mm_loadu_ps(Y + i);
+        __m128d x0 = _mm_sub_pd(_mm_cvtps_pd(x), mx), y0 = _mm_sub_pd(_mm_cvtps_pd(y), my);
+        __m128d x1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), mx), y1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(y, y)), my);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(x0, y0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(x1, y1));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1)) + centered_dot_scalar(N - i, X + i, Y + i, mean_x, mean_y);
+}
+
+MLKERNELS_TARGET("sse2")
+double sum_sse2(bigint N, const float* X)
+{
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    bigint i = 0;
+    for (; i + 4 <= N; i += 4) {
+        __m128 x = _mm_loadu_ps(X + i);
+        acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(x));
+        acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1)) + sum_scalar(N - i, X + i);
+}
+
+MLKERNELS_TARGET("sse2")
+double dist_squared_sse2(bigint N, const float* X, const float* Y)
+{
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    bigint i = 0;
+    for (; i + 4 <= N; i += 4) {
+        __m128 x = _mm_loadu_ps(X + i), y = _mm_loadu_ps(Y + i);
+        __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y));
+        __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), _mm_cvtps_pd(_mm_movehl_ps(y, y)));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    return hsum_sse2(_mm_add_pd(acc0, acc1)) + dist_squared_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("sse2")
+void axpy_sse2(bigint N, float a, const float* X, float* Y)
+{
+    __m128 aa = _mm_set1_ps(a);
+    bigint i = 0;
+    for (; i + 4 <= N; i += 4) {
+        _mm_storeu_ps(Y + i, _mm_add_ps(_mm_loadu_ps(Y + i), _mm_mul_ps(aa, _mm_loadu_ps(X + i))));
+    }
+    axpy_scalar(N - i, a, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("sse2")
+void min_max_sse2(bigint N, const float* X, float& min, float& max)
+{
+    bigint i = 0;
+    if (N >= 4) {
+        __m128 mn = _mm_set1_ps(min), mx = _mm_set1_ps(max);
+        for (; i + 4 <= N; i += 4) {
+            __m128 x = _mm_loadu_ps(X + i);
+            //min_ps(a,b) is (a<b)?a:b, so with x first a NaN in x is skipped, as in min_max_scalar
+            mn = _mm_min_ps(x, mn);
+            mx = _mm_max_ps(x, mx);
+        }
+        float mns[4], mxs[4];
+        _mm_storeu_ps(mns, mn);
+        _mm_storeu_ps(mxs, mx);
+        min_max_scalar(4, mns, min, max);
+        min_max_scalar(4, mxs, min, max);
+    }
+    min_max_scalar(N - i, X + i, min, max);
+}
+
+MLKERNELS_TARGET("sse2")
+void float_to_int16_sse2(bigint N, const float* X, qint16* Y, float factor)
+{
+    __m128 ff = _mm_set1_ps(factor), lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        //max first, so that NaN becomes the minimum
+        __m128 x0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(X + i), ff), lo), hi);
+        __m128 x1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(X + i + 4), ff), lo), hi);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(x0), _mm_cvtps_epi32(x1));
+        _mm_storeu_si128((__m128i*)(Y + i), packed);
+    }
+    float_to_int16_scalar(N - i, X + i, Y + i, factor);
+}
+
+MLKERNELS_TARGET("sse2")
+void int16_to_float_sse2(bigint N, const qint16* X, float* Y, float factor)
+{
+    __m128 ff = _mm_set1_ps(factor);
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(X + i));
+        //sign-extend by putting each value in the upper half of an int32 and shifting down
+        __m128i x0 = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i x1 = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(Y + i, _mm_mul_ps(_mm_cvtepi32_ps(x0), ff));
+        _mm_storeu_ps(Y + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(x1), ff));
+    }
+    int16_to_float_scalar(N - i, X + i, Y + i, factor);
+}
+
+const KernelTable sse2_table = {
+    dot_sse2,
+    centered_dot_sse2,
+    sum_sse2,
+    dist_squared_sse2,
+    axpy_sse2,
+    min_max_sse2,
+    float_to_int16_sse2,
+    int16_to_float_sse2
+};
+
+///////////////////////////////////////////////////////////////////////////
+// AVX2: four doubles or eight floats at a time
+
+MLKERNELS_TARGET("avx2,fma")
+inline double hsum_avx2(__m256d a)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+MLKERNELS_TARGET("avx2,fma")
+double dot_avx2(bigint N, const float* X, const float* Y)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd(), acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        //the products of floats are exact in double, so fused or not makes no difference
+        acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i)), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i + 4)), acc1);
+        acc2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i + 8)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i + 8)), acc2);
+        acc3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i + 12)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i + 12)), acc3);
+    }
+    for (; i + 4 <= N; i += 4) {
+        acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i)), acc0);
+    }
+    __m256d acc = _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3));
+    return hsum_avx2(acc) + dot_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+double centered_dot_avx2(bigint N, const float* X, const float* Y, double mean_x, double mean_y)
+{
+    __m256d mx = _mm256_set1_pd(mean_x), my = _mm256_set1_pd(mean_y);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        __m256d x0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i)), mx), y0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(Y + i)), my);
+        __m256d x1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i + 4)), mx), y1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(Y + i + 4)), my);
+        acc0 = _mm256_fmadd_pd(x0, y0, acc0);
+        acc1 = _mm256_fmadd_pd(x1, y1, acc1);
+    }
+    return hsum_avx2(_mm256_add_pd(acc0, acc1)) + centered_dot_scalar(N - i, X + i, Y + i, mean_x, mean_y);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+double sum_avx2(bigint N, const float* X)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm_loadu_ps(X + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm_loadu_ps(X + i + 4)));
+    }
+    return hsum_avx2(_mm256_add_pd(acc0, acc1)) + sum_scalar(N - i, X + i);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+double dist_squared_avx2(bigint N, const float* X, const float* Y)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i)));
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(X + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(Y + i + 4)));
+        acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+    }
+    return hsum_avx2(_mm256_add_pd(acc0, acc1)) + dist_squared_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+void axpy_avx2(bigint N, float a, const float* X, float* Y)
+{
+    __m256 aa = _mm256_set1_ps(a);
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        _mm256_storeu_ps(Y + i, _mm256_fmadd_ps(aa, _mm256_loadu_ps(X + i), _mm256_loadu_ps(Y + i)));
+    }
+    axpy_scalar(N - i, a, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+void min_max_avx2(bigint N, const float* X, float& min, float& max)
+{
+    bigint i = 0;
+    if (N >= 8) {
+        __m256 mn = _mm256_set1_ps(min), mx = _mm256_set1_ps(max);
+        for (; i + 8 <= N; i += 8) {
+            __m256 x = _mm256_loadu_ps(X + i);
+            mn = _mm256_min_ps(x, mn); //x first, see min_max_sse2
+            mx = _mm256_max_ps(x, mx);
+        }
+        float mns[8], mxs[8];
+        _mm256_storeu_ps(mns, mn);
+        _mm256_storeu_ps(mxs, mx);
+        min_max_scalar(8, mns, min, max);
+        min_max_scalar(8, mxs, min, max);
+    }
+    min_max_scalar(N - i, X + i, min, max);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+void float_to_int16_avx2(bigint N, const float* X, qint16* Y, float factor)
+{
+    __m256 ff = _mm256_set1_ps(factor), lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        __m256 x0 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(X + i), ff), lo), hi);
+        __m256 x1 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(X + i + 8), ff), lo), hi);
+        //packs works within each 128-bit lane, so the 64-bit quarters are put back in order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(x0), _mm256_cvtps_epi32(x1));
+        _mm256_storeu_si256((__m256i*)(Y + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    float_to_int16_scalar(N - i, X + i, Y + i, factor);
+}
+
+MLKERNELS_TARGET("avx2,fma")
+void int16_to_float_avx2(bigint N, const qint16* X, float* Y, float factor)
+{
+    __m256 ff = _mm256_set1_ps(factor);
+    bigint i = 0;
+    for (; i + 8 <= N; i += 8) {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(X + i)));
+        _mm256_storeu_ps(Y + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), ff));
+    }
+    int16_to_float_scalar(N - i, X + i, Y + i, factor);
+}
+
+const KernelTable avx2_table = {
+    dot_avx2,
+    centered_dot_avx2,
+    sum_avx2,
+    dist_squared_avx2,
+    axpy_avx2,
+    min_max_avx2,
+    float_to_int16_avx2,
+    int16_to_float_avx2
+};
+
+///////////////////////////////////////////////////////////////////////////
+// AVX-512: eight doubles or sixteen floats at a time
+
+MLKERNELS_TARGET("avx512f")
+double dot_avx512(bigint N, const float* X, const float* Y)
+{
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd(), acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+    bigint i = 0;
+    for (; i + 32 <= N; i += 32) {
+        acc0 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i)), acc0);
+        acc1 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i + 8)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i + 8)), acc1);
+        acc2 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i + 16)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i + 16)), acc2);
+        acc3 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i + 24)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i + 24)), acc3);
+    }
+    for (; i + 8 <= N; i += 8) {
+        acc0 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i)), acc0);
+    }
+    __m512d acc = _mm512_add_pd(_mm512_add_pd(acc0, acc1), _mm512_add_pd(acc2, acc3));
+    return _mm512_reduce_add_pd(acc) + dot_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx512f")
+double centered_dot_avx512(bigint N, const float* X, const float* Y, double mean_x, double mean_y)
+{
+    __m512d mx = _mm512_set1_pd(mean_x), my = _mm512_set1_pd(mean_y);
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        __m512d x0 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i)), mx), y0 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(Y + i)), my);
+        __m512d x1 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i + 8)), mx), y1 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(Y + i + 8)), my);
+        acc0 = _mm512_fmadd_pd(x0, y0, acc0);
+        acc1 = _mm512_fmadd_pd(x1, y1, acc1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + centered_dot_scalar(N - i, X + i, Y + i, mean_x, mean_y);
+}
+
+MLKERNELS_TARGET("avx512f")
+double sum_avx512(bigint N, const float* X)
+{
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm256_loadu_ps(X + i)));
+        acc1 = _mm512_add_pd(acc1, _mm512_cvtps_pd(_mm256_loadu_ps(X + i + 8)));
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + sum_scalar(N - i, X + i);
+}
+
+MLKERNELS_TARGET("avx512f")
+double dist_squared_avx512(bigint N, const float* X, const float* Y)
+{
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        __m512d d0 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i)));
+        __m512d d1 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(X + i + 8)), _mm512_cvtps_pd(_mm256_loadu_ps(Y + i + 8)));
+        acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + dist_squared_scalar(N - i, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx512f")
+void axpy_avx512(bigint N, float a, const float* X, float* Y)
+{
+    __m512 aa = _mm512_set1_ps(a);
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        _mm512_storeu_ps(Y + i, _mm512_fmadd_ps(aa, _mm512_loadu_ps(X + i), _mm512_loadu_ps(Y + i)));
+    }
+    axpy_scalar(N - i, a, X + i, Y + i);
+}
+
+MLKERNELS_TARGET("avx512f")
+void min_max_avx512(bigint N, const float* X, float& min, float& max)
+{
+    bigint i = 0;
+    if (N >= 16) {
+        __m512 mn = _mm512_set1_ps(min), mx = _mm512_set1_ps(max);
+        for (; i + 16 <= N; i += 16) {
+            __m512 x = _mm512_loadu_ps(X + i);
+            mn = _mm512_min_ps(x, mn); //x first, see min_max_sse2
+            mx = _mm512_max_ps(x, mx);
+        }
+        float mns[16], mxs[16];
+        _mm512_storeu_ps(mns, mn);
+        _mm512_storeu_ps(mxs, mx);
+        min_max_scalar(16, mns, min, max);
+        min_max_scalar(16, mxs, min, max);
+    }
+    min_max_scalar(N - i, X + i, min, max);
+}
+
+MLKERNELS_TARGET("avx512f")
+void float_to_int16_avx512(bigint N, const float* X, qint16* Y, float factor)
+{
+    __m512 ff = _mm512_set1_ps(factor), lo = _mm512_set1_ps(-32768.0f), hi = _mm512_set1_ps(32767.0f);
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(X + i), ff), lo), hi);
+        _mm256_storeu_si256((__m256i*)(Y + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(x)));
+    }
+    float_to_int16_scalar(N - i, X + i, Y + i, factor);
+}
+
+MLKERNELS_TARGET("avx512f")
+void int16_to_float_avx512(bigint N, const qint16* X, float* Y, float factor)
+{
+    __m512 ff = _mm512_set1_ps(factor);
+    bigint i = 0;
+    for (; i + 16 <= N; i += 16) {
+        __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(X + i)));
+        _mm512_storeu_ps(Y + i, _mm512_mul_ps(_mm512_cvtepi32_ps(x), ff));
+    }
+    int16_to_float_scalar(N - i, X + i, Y + i, factor);
+}
+
+const KernelTable avx512_table = {
+    dot_avx512,
+    centered_dot_avx512,
+    sum_avx512,
+    dist_squared_avx512,
+    axpy_avx512,
+    min_max_avx512,
+    float_to_int16_avx512,
+    int16_to_float_avx512
+};
+
+#endif // MLKERNELS_X86
+
+MLKernels::InstructionSet detect_instruction_set()
+{
+#ifdef MLKERNELS_X86
+    //also checks that the operating system saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return MLKernels::AVX512;
+    if ((__builtin_cpu_supports("avx2")) && (__builtin_cpu_supports("fma")))
+        return MLKernels::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return MLKernels::SSE2;
+#endif
+    return MLKernels::Scalar;
+}
+
+const KernelTable* table_for(MLKernels::InstructionSet set)
+{
+#ifdef MLKERNELS_X86
+    switch (set) {
+    case MLKernels::AVX512:
+        return &avx512_table;
+    case MLKernels::AVX2:
+        return &avx2_table;
+    case MLKernels::SSE2:
+        return &sse2_table;
+    case MLKernels::Scalar:
+        return &scalar_table;
+    }
+#else
+    Q_UNUSED(set)
+#endif
+    return &scalar_table;
+}
+
+std::atomic<int> s_instruction_set(-1);
+std::atomic<const KernelTable*> s_table(nullptr);
+
+inline const KernelTable* kernels()
+{
+    const KernelTable* ret = s_table.load(std::memory_order_acquire);
+    if (ret)
+        return ret;
+    MLKernels::setInstructionSet(MLKernels::supportedInstructionSet());
+    return s_table.load(std::memory_order_acquire);
+}
+}
+
+namespace MLKernels {
+
+InstructionSet instructionSet()
+{
+    kernels();
+    return (InstructionSet)s_instruction_set.load();
+}
+
+void setInstructionSet(InstructionSet set)
+{
+    set = qMin(set, supportedInstructionSet());
+    s_instruction_set.store(set);
+    s_table.store(table_for(set), std::memory_order_release);
+}
+
+InstructionSet supportedInstructionSet()
+{
+    static InstructionSet ret = detect_instruction_set();
+    return ret;
+}
+
+const char* instructionSetName(InstructionSet set)
+{
+    switch (set) {
+    case Scalar:
+        return "scalar";
+    case SSE2:
+        return "SSE2";
+    case AVX2:
+        return "AVX2";
+    case AVX512:
+        return "AVX-512";
+    }
+    return "";
+}
+
+double dot(bigint N, const float* X, const float* Y)
+{
+    return kernels()->dot(N, X, Y);
+}
+
+double centeredDot(bigint N, const float* X, const float* Y, double mean_x, double mean_y)
+{
+    return kernels()->centered_dot(N, X, Y, mean_x, mean_y);
+}
+
+double sum(bigint N, const float* X)
+{
+    return kernels()->sum(N, X);
+}
+
+double distSquared(bigint N, const float* X, const float* Y)
+{
+    return kernels()->dist_squared(N, X, Y);
+}
+
+void axpy(bigint N, float a, const float* X, float* Y)
+{
+    kernels()->axpy(N, a, X, Y);
+}
+
+void minMax(bigint N, const float* X, float& min, float& max)
+{
+    min = max = X[0];
+    kernels()->min_max(N - 1, X + 1, min, max);
+}
+
+void floatToInt16(bigint N, const float* X, qint16* Y, float factor)
+{
+    kernels()->float_to_int16(N, X, Y, factor);
+}
+
+void int16ToFloat(bigint N, const qint16* X, float* Y, float factor)
+{
+    kernels()->int16_to_float(N, X, Y, factor);
+}
+
+void doubleToInt16(bigint N, const double* X, qint16* Y, double factor)
+{
+    for (bigint i = 0; i < N; i++)
+        Y[i] = double_to_int16_1(X[i] * factor);
+}
+}
@@ -10,6 +10,7 @@
 #include <QCoreApplication>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QCryptographicHash>
 
 namespace MLNetwork {
 
@@ -372,61 +373,45 @@ void Downloader::slot_reply_finished()
     this->setFinished();
 }
 
-bool concatenate_files(QStringList file_paths, QString dest_path)
-{
-    /// Witold, this function should be improved by streaming the read/writes
-    foreach (QString str, file_paths) {
-        if (str.isEmpty())
-            return false;
+struct DownloadPart {
+    bigint start_byte = 0;
+    bigint end_byte = 0; //inclusive
+    bigint num_bytes_downloaded = 0;
+    int num_attempts = 0;
+    bool in_progress = false;
+    bool done = false;
+    QString sha1;
+    QCryptographicHash hash{ QCryptographicHash::Sha1 };
+
+    bigint length() const
+    {
+        return end_byte - start_byte + 1;
     }
+};
 
-    QFile f(dest_path);
-    if (!f.open(QIODevice::WriteOnly)) {
-        qWarning() << __FUNCTION__ << "Unable to open file for writing: " + dest_path;
+namespace {
+QString state_file_name(const QString& destination_file_name)
+{
+    return destination_file_name + ".download_state";
+}
+
+bool compute_sha1_of_file_region(QFile& file, bigint start_byte, bigint num_bytes, QString& sha1)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!file.seek(start_byte))
         return false;
-    }
-    foreach (QString str, file_paths) {
-        QFile g(str);
-        if (!g.open(QIODevice::ReadOnly)) {
-            qWarning() << __FUNCTION__ << "Unable to open file for reading: " + str;
-            f.close();
+    bigint num_remaining = num_bytes;
+    while (num_remaining > 0) {
+        QByteArray data = file.read(qMin(num_remaining, (bigint)(4 * 1024 * 1024)));
+        if (data.isEmpty())
             return false;
-        }
-        int chunk_size = 1e5;
-        QTime timer;
-        timer.start();
-        while (!g.atEnd()) {
-            QByteArray data0 = g.read(chunk_size);
-            f.write(data0);
-        }
-        g.close();
+        hash.addData(data);
+        num_remaining -= data.count();
     }
-
-    f.close();
+    sha1 = QString(hash.result().toHex());
     return true;
 }
-
-class ConcatenateThread : public QThread {
-public:
-    QStringList file_names;
-    QString dest_file_name;
-
-    void run()
-    {
-        TaskProgress task("Concatenating files");
-        task.log() << file_names;
-        task.log() << dest_file_name;
-        if (!concatenate_files(file_names, dest_file_name)) {
-            task.error() << "Problem concatenating files";
-            return;
-        }
-        foreach (QString file, file_names) {
-            if (!QFile::remove(file)) {
-                qWarning() << "Problem removing file: " + file;
-            }
-        }
-    }
-};
+}
 
 void PrvParallelDownloader::start()
 {
@@ -434,196 +419,263 @@ void PrvParallelDownloader::start()
 
     m_timer.start();
     m_num_bytes_downloaded = 0;
+    success = true;
 
-    //append the url so it can take some (more) query parameters
-    QString url = source_url;
-    if (!url.contains("?"))
-        url += "?";
-    else
-        url += "&";
-
-    m_task.log() << "size:" << size << "num_threads:" << num_threads;
+    if (size <= 0) {
+        fail("Size must be specified for parallel download");
+        return;
+    }
 
-    //get the start and end bytes
-    QList<int> start_bytes;
-    QList<int> end_bytes;
-    int incr = (int)(1 + size * 1.0 / num_threads);
-    if (incr < 1000)
-        incr = 1000; //let's be a bit reasonable
-    int sum = 0;
-    for (int i = 0; i < num_threads; i++) {
-        if (sum < size) {
-            int val = qMin(incr, size - sum);
-            start_bytes << sum;
-            end_bytes << sum + val - 1;
-            sum += val;
-        }
+    bigint part_size0 = part_size;
+    if (part_size0 <= 0) {
+        part_size0 = 1 + size / qMax(1, num_threads);
+        part_size0 = qMax(part_size0, (bigint)1024 * 1024);
+        part_size0 = qMin(part_size0, (bigint)64 * 1024 * 1024);
+    }
+    for (bigint start_byte = 0; start_byte < size; start_byte += part_size0) {
+        DownloadPart* P = new DownloadPart;
+        P->start_byte = start_byte;
+        P->end_byte = qMin(start_byte + part_size0, size) - 1;
+        m_parts << P;
     }
+    part_size = part_size0;
 
-    m_task.log() << "start_bytes:" << start_bytes;
-    m_task.log() << "end_bytes:" << end_bytes;
+    m_task.log() << "size:" << size << "num_threads:" << num_threads << "part_size:" << part_size << "num_parts:" << m_parts.count();
 
-    for (int i = 0; i < start_bytes.count(); i++) {
-        QString url2 = url + QString("bytes=%1-%2&").arg(start_bytes[i]).arg(end_bytes[i]);
-        m_task.log() << "Starting downloader: " + url2;
-        Downloader* DD = new Downloader;
-        DD->source_url = url2;
-        DD->destination_file_name = CacheManager::globalInstance()->makeLocalFile() + ".PrvParallelDownloader";
-        DD->size = end_bytes[i] - start_bytes[i] + 1;
-        m_downloaders << DD;
-        connect(DD, SIGNAL(progress()), this, SLOT(slot_downloader_progress()));
-        connect(DD, SIGNAL(finished()), this, SLOT(slot_downloader_finished()));
-        m_task.log() << "Starting " + url2;
-        m_task.log() << "";
-        DD->start();
-    }
+    if (!resume_or_preallocate())
+        return;
 
-    /*
-    printf("Using %d downloaders\n", downloaders.count());
-    bool done = false;
-    success = true;
-    while ((!done) && (success)) {
-        done = true;
-        if (MLUtil::threadInterruptRequested()) {
-            task.error("Thread interrupt requested");
-            for (int j = 0; j < downloaders.count(); j++) {
-                downloaders[j]->requestInterruption();
-            }
-            success = false;
-            error = "Thread interrupted";
-        }
-        for (int i = 0; i < downloaders.count(); i++) {
-            if (downloaders[i]->wait(100)) {
-                if (downloaders[i]->success) {
-                    task.log() << "Thread finished: " + downloaders[i]->source_url;
-                }
-                else {
-                    task.error() << "Error in download thread: " + downloaders[i]->source_url + ": " + downloaders[i]->error;
-                    for (int j = 0; j < downloaders.count(); j++) {
-                        downloaders[j]->requestInterruption();
-                    }
-                    success = false;
-                    error = "Error in download thread: " + downloaders[i]->source_url + ": " + downloaders[i]->error;
-                }
-            }
-            else {
-                done = false;
-            }
+    start_next_parts();
+}
+
+bool PrvParallelDownloader::resume_or_preallocate()
+{
+    //resume from a previous attempt if the state file matches this download
+    QJsonObject state = QJsonDocument::fromJson(TextFile::read(state_file_name(destination_file_name)).toUtf8()).object();
+    bool resume = ((QFile::exists(destination_file_name)) && (QFileInfo(destination_file_name).size() == size) && ((bigint)state["size"].toDouble() == size) && ((bigint)state["part_size"].toDouble() == part_size) && (state["source_url"].toString() == source_url));
+    if (!resume) {
+        QFile::remove(state_file_name(destination_file_name));
+        if ((QFile::exists(destination_file_name)) && (!QFile::remove(destination_file_name))) {
+            fail("Unable to remove existing file: " + destination_file_name);
+            return false;
         }
-        int num_bytes = 0;
-        for (int i = 0; i < downloaders.count(); i++) {
-            num_bytes += downloaders[i]->num_bytes_downloaded();
+    }
+
+    m_file = new QFile(destination_file_name);
+    if (!m_file->open(QIODevice::ReadWrite)) {
+        fail("Unable to open file for writing: " + destination_file_name);
+        return false;
+    }
+    if (!resume) {
+        //sparse on most file systems, so this does not write anything
+        if (!m_file->resize(size)) {
+            fail("Unable to preallocate file: " + destination_file_name);
+            return false;
         }
-        if (size)
-            task.setProgress(num_bytes * 1.0 / size);
-        {
-            QMutexLocker locker(&m_mutex);
-            m_num_bytes_downloaded = num_bytes;
+        return true;
+    }
+
+    QJsonObject part_checksums = state["parts"].toObject();
+    bigint num_resumed = 0;
+    foreach (DownloadPart* P, m_parts) {
+        QString sha1 = part_checksums[QString::number(P->start_byte)].toString();
+        if (sha1.isEmpty())
+            continue;
+        QString sha1_on_disk;
+        if ((compute_sha1_of_file_region(*m_file, P->start_byte, P->length(), sha1_on_disk)) && (sha1_on_disk == sha1)) {
+            P->done = true;
+            P->sha1 = sha1;
+            P->num_bytes_downloaded = P->length();
+            m_num_bytes_downloaded += P->length();
+            num_resumed++;
         }
-    }
-    if (!success) {
-        for (int i = 0; i < downloaders.count(); i++) {
-            QFile::remove(downloaders[i]->destination_file_name);
+        else {
+            m_task.log() << "Checksum mismatch, downloading part again:" << P->start_byte << P->end_byte;
         }
-        qDeleteAll(downloaders);
-        return;
     }
+    m_task.log() << QString("Resuming download: %1 of %2 parts already downloaded").arg(num_resumed).arg(m_parts.count());
+    return true;
+}
 
-    QStringList paths;
-    for (int i = 0; i < downloaders.count(); i++) {
-        paths << downloaders[i]->destination_file_name;
-    }
-    qDeleteAll(downloaders);
-
-    if (!concatenate_files(paths, destination_file_name)) {
-        success = false;
-        error = "Problem concatenating files.";
+void PrvParallelDownloader::start_next_parts()
+{
+    if ((isFinished()) || (!success))
+        return;
+    int num_in_progress = 0;
+    bool all_done = true;
+    foreach (DownloadPart* P, m_parts) {
+        if (P->in_progress)
+            num_in_progress++;
+        if (!P->done)
+            all_done = false;
+    }
+    if (all_done) {
+        finish();
+        return;
     }
-
-    //clean up
-    foreach (QString fname, paths) {
-        QFile::remove(fname);
+    foreach (DownloadPart* P, m_parts) {
+        if (num_in_progress >= qMax(1, num_threads))
+            break;
+        if ((!P->done) && (!P->in_progress)) {
+            start_part(P);
+            num_in_progress++;
+        }
     }
-    */
 }
 
-PrvParallelDownloader::~PrvParallelDownloader()
+void PrvParallelDownloader::start_part(DownloadPart* P)
 {
-    qDeleteAll(m_downloaders);
+    //append the url so it can take some (more) query parameters
+    QString url = source_url;
+    if (!url.contains("?"))
+        url += "?";
+    else
+        url += "&";
+    url += QString("bytes=%1-%2&").arg(P->start_byte).arg(P->end_byte);
+
+    P->in_progress = true;
+    P->num_attempts++;
+    P->num_bytes_downloaded = 0;
+    P->hash.reset();
+
+    QNetworkRequest request = QNetworkRequest(QUrl(url));
+    request.setRawHeader("Range", QString("bytes=%1-%2").arg(P->start_byte).arg(P->end_byte).toLatin1());
+    QNetworkReply* reply = manager()->get(request);
+    m_replies << reply;
+    QObject::connect(reply, &QNetworkReply::readyRead, [this, P, reply]() {
+        on_part_ready_read(P, reply);
+    });
+    QObject::connect(reply, &QNetworkReply::finished, [this, P, reply]() {
+        on_part_finished(P, reply);
+    });
 }
 
-double PrvParallelDownloader::elapsed_msec()
+void PrvParallelDownloader::on_part_ready_read(DownloadPart* P, QNetworkReply* reply)
 {
-    return m_timer.elapsed();
+    if ((isFinished()) || (!success))
+        return;
+    if (stopRequested()) {
+        fail("Stop requested.");
+        return;
+    }
+    QByteArray X = reply->readAll();
+    if (P->num_bytes_downloaded + X.count() > P->length()) {
+        //most likely the server ignored the range and is sending the whole file
+        fail(QString("Received more data than requested for bytes %1-%2 of %3").arg(P->start_byte).arg(P->end_byte).arg(source_url));
+        return;
+    }
+    if ((!m_file->seek(P->start_byte + P->num_bytes_downloaded)) || (m_file->write(X) != X.count())) {
+        fail("Problem writing to file: " + destination_file_name);
+        return;
+    }
+    P->hash.addData(X);
+    P->num_bytes_downloaded += X.count();
+    m_num_bytes_downloaded += X.count();
+    m_task.setProgress(m_num_bytes_downloaded * 1.0 / size);
 }
 
-int PrvParallelDownloader::num_bytes_downloaded()
+void PrvParallelDownloader::on_part_finished(DownloadPart* P, QNetworkReply* reply)
 {
-    return m_num_bytes_downloaded;
+    m_replies.removeAll(reply);
+    reply->deleteLater();
+    if ((isFinished()) || (!success))
+        return;
+    P->in_progress = false;
+    if ((reply->error() != QNetworkReply::NoError) || (P->num_bytes_downloaded != P->length())) {
+        QString err = (reply->error() != QNetworkReply::NoError) ? reply->errorString() : QString("Unexpected number of bytes downloaded %1 <> %2").arg(P->num_bytes_downloaded).arg(P->length());
+        m_num_bytes_downloaded -= P->num_bytes_downloaded;
+        if (P->num_attempts >= max_attempts_per_part) {
+            fail(QString("Error downloading bytes %1-%2 of %3: %4").arg(P->start_byte).arg(P->end_byte).arg(source_url).arg(err));
+            return;
+        }
+        m_task.log() << QString("Retrying bytes %1-%2 (attempt %3): %4").arg(P->start_byte).arg(P->end_byte).arg(P->num_attempts + 1).arg(err);
+        start_part(P);
+        return;
+    }
+    P->done = true;
+    P->sha1 = QString(P->hash.result().toHex());
+    write_state();
+    start_next_parts();
 }
 
-void PrvParallelDownloader::slot_downloader_progress()
+void PrvParallelDownloader::write_state()
 {
-    int num_bytes = 0;
-    for (int i = 0; i < m_downloaders.count(); i++) {
-        num_bytes += m_downloaders[i]->num_bytes_downloaded();
+    if (!m_file->flush()) {
+        fail("Problem writing to file: " + destination_file_name);
+        return;
     }
-
-    if (size)
-        m_task.setProgress(num_bytes * 1.0 / size);
-
-    m_num_bytes_downloaded = num_bytes;
+    QJsonObject state;
+    state["source_url"] = source_url;
+    state["size"] = (double)size;
+    state["part_size"] = (double)part_size;
+    QJsonObject part_checksums;
+    foreach (DownloadPart* P, m_parts) {
+        if (P->done)
+            part_checksums[QString::number(P->start_byte)] = P->sha1;
+    }
+    state["parts"] = part_checksums;
+    TextFile::write(state_file_name(destination_file_name), QJsonDocument(state).toJson());
 }
 
-void PrvParallelDownloader::slot_downloader_finished()
+void PrvParallelDownloader::fail(const QString& err)
 {
-    if (this->isFinished())
+    if (isFinished())
         return;
-    bool all_finished = true;
-    for (int i = 0; i < m_downloaders.count(); i++) {
-        if (m_downloaders[i]->isFinished()) {
-            if (!m_downloaders[i]->success) {
-                if (success) {
-                    //record the error on only the first non-success
-                    success = false;
-                    error = m_downloaders[i]->error;
-                }
-                for (int j = 0; j < m_downloaders.count(); j++) {
-                    m_downloaders[j]->requestStop();
-                }
-            }
-        }
-        else {
-            all_finished = false;
-        }
+    success = false;
+    error = err;
+    m_task.error() << error;
+    foreach (QNetworkReply* reply, m_replies) {
+        QObject::disconnect(reply, 0, 0, 0);
+        reply->abort();
+        reply->deleteLater();
     }
-    if (all_finished) {
-        //for the response text, either use the one where concatentated=true, or the one where success!=true
-        QStringList file_names;
-        for (int i = 0; i < m_downloaders.count(); i++) {
-            file_names << m_downloaders[i]->destination_file_name;
-        }
-        m_task.log() << "Concatenating files" << file_names << this->destination_file_name;
-
-        ConcatenateThread* T = new ConcatenateThread;
-        T->file_names = file_names;
-        T->dest_file_name = this->destination_file_name;
-        QObject::connect(T, SIGNAL(finished()), this, SLOT(slot_concatenate_finished()));
-        QObject::connect(T, SIGNAL(finished()), T, SLOT(deleteLater()));
-        T->start();
+    m_replies.clear();
+    if (m_file) {
+        //keep the parts downloaded so far (and the state file) so that the download can be resumed
+        m_file->close();
     }
+    this->setFinished();
 }
 
-void PrvParallelDownloader::slot_concatenate_finished()
+void PrvParallelDownloader::finish()
 {
-    if (!QFile::exists(this->destination_file_name)) {
-        m_task.error() << "Problem concatenating files. File does not exist: " + this->destination_file_name;
-        this->setFinished();
-        return;
+    m_file->close();
+    if (!checksum.isEmpty()) {
+        QString checksum0 = MLUtil::computeSha1SumOfFile(destination_file_name);
+        if (checksum0 != checksum) {
+            //start from scratch next time
+            QFile::remove(destination_file_name);
+            QFile::remove(state_file_name(destination_file_name));
+            fail(QString("Checksum mismatch for downloaded file: %1 <> %2").arg(checksum0).arg(checksum));
+            return;
+        }
     }
+    QFile::remove(state_file_name(destination_file_name));
+    m_task.log() << QString("Downloaded %1 MB in %2 sec").arg(m_num_bytes_downloaded * 1.0 / 1e6).arg(m_timer.elapsed() * 1.0 / 1000);
     this->setFinished();
 }
 
+PrvParallelDownloader::~PrvParallelDownloader()
+{
+    foreach (QNetworkReply* reply, m_replies) {
+        QObject::disconnect(reply, 0, 0, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+    qDeleteAll(m_parts);
+    delete m_file;
+}
+
+double PrvParallelDownloader::elapsed_msec()
+{
+    return m_timer.elapsed();
+}
+
+bigint PrvParallelDownloader::num_bytes_downloaded()
+{
+    return m_num_bytes_downloaded;
+}
+
 PrvParallelUploader::~PrvParallelUploader()
 {
     qDeleteAll(m_uploaders);
@@ -0,0 +1,330 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "processorprofile.h"
+#include "icounter.h"
+#include "objectregistry.h"
+#include "mlcommon.h"
+#include "mdaallocator.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+#include <chrono>
+#include <sys/resource.h>
+
+namespace {
+
+double wall_sec()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double cpu_sec()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+bigint peak_rss_bytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+}
+
+struct ProfileSnapshot {
+    double wall_sec = 0;
+    double cpu_sec = 0;
+    bigint bytes_read = 0;
+    bigint bytes_written = 0;
+    bigint bytes_allocated = 0;
+};
+
+struct ProfilePhaseStats {
+    int count = 0;
+    double wall_sec = 0;
+    double cpu_sec = 0;
+    bigint bytes_read = 0;
+    bigint bytes_written = 0;
+    bigint bytes_allocated = 0;
+};
+
+struct ProfileLockStats {
+    bigint count = 0;
+    double total_sec = 0;
+    double max_sec = 0;
+};
+
+class ProcessorProfilePrivate {
+public:
+    ProcessorProfile* q;
+
+    QString m_processor_name;
+    int m_num_threads = 0;
+    ProfileSnapshot m_start;
+    QStringList m_phase_names; //in order of first appearance
+    QMap<QString, ProfilePhaseStats> m_phases;
+    QMap<QString, ProfileSnapshot> m_open_phases;
+    QMap<QString, ProfileLockStats> m_lock_waits;
+    mutable QMutex m_mutex;
+
+    IIntCounter* m_allocated_counter = 0;
+    IIntCounter* m_bytes_read_counter = 0;
+    IIntCounter* m_bytes_written_counter = 0;
+    bigint m_outstanding_at_start = 0;
+
+    ProfileSnapshot snapshot() const;
+    static QJsonObject phase_to_json(const ProfilePhaseStats& P, int num_threads);
+    static void add_totals(QJsonObject& totals, const QJsonObject& X);
+};
+
+ProcessorProfile::ProcessorProfile()
+{
+    d = new ProcessorProfilePrivate;
+    d->q = this;
+    d->m_num_threads = QThread::idealThreadCount();
+    d->m_start = d->snapshot();
+}
+
+ProcessorProfile::~ProcessorProfile()
+{
+    delete d;
+}
+
+void ProcessorProfile::start(const QString& processor_name)
+{
+    d->m_processor_name = processor_name;
+    ICounterManager* manager = ObjectRegistry::getObject<ICounterManager>();
+    if (manager) {
+        d->m_allocated_counter = static_cast<IIntCounter*>(manager->counter("allocated_bytes"));
+        d->m_bytes_read_counter = static_cast<IIntCounter*>(manager->counter("bytes_read"));
+        d->m_bytes_written_counter = static_cast<IIntCounter*>(manager->counter("bytes_written"));
+    }
+    // the peak is kept by the allocator, so nothing is done per allocation here
+    d->m_outstanding_at_start = MdaAllocator::outstandingBytes();
+    MdaAllocator::resetPeakOutstandingBytes();
+    d->m_start = d->snapshot();
+}
+
+void ProcessorProfile::setNumThreads(int num_threads)
+{
+    d->m_num_threads = num_threads;
+}
+
+void ProcessorProfile::startPhase(const QString& name)
+{
+    ProfileSnapshot S = d->snapshot();
+    QMutexLocker locker(&d->m_mutex);
+    if (!d->m_phases.contains(name)) {
+        d->m_phase_names << name;
+        d->m_phases[name] = ProfilePhaseStats();
+    }
+    d->m_open_phases[name] = S;
+}
+
+void ProcessorProfile::endPhase(const QString& name)
+{
+    ProfileSnapshot S = d->snapshot();
+    QMutexLocker locker(&d->m_mutex);
+    if (!d->m_open_phases.contains(name)) {
+        qWarning() << "Profile phase was not started: " + name;
+        return;
+    }
+    ProfileSnapshot S0 = d->m_open_phases.take(name);
+    ProfilePhaseStats& P = d->m_phases[name];
+    P.count++;
+    P.wall_sec += S.wall_sec - S0.wall_sec;
+    P.cpu_sec += S.cpu_sec - S0.cpu_sec;
+    P.bytes_read += S.bytes_read - S0.bytes_read;
+    P.bytes_written += S.bytes_written - S0.bytes_written;
+    P.bytes_allocated += S.bytes_allocated - S0.bytes_allocated;
+}
+
+void ProcessorProfile::addLockWait(const QString& lock_name, double sec)
+{
+    QMutexLocker locker(&d->m_mutex);
+    ProfileLockStats& L = d->m_lock_waits[lock_name];
+    L.count++;
+    L.total_sec += sec;
+    L.max_sec = qMax(L.max_sec, sec);
+}
+
+QJsonObject ProcessorProfile::toJsonObject() const
+{
+    ProfileSnapshot S = d->snapshot();
+    QMutexLocker locker(&d->m_mutex);
+
+    ProfilePhaseStats total;
+    total.count = 1;
+    total.wall_sec = S.wall_sec - d->m_start.wall_sec;
+    total.cpu_sec = S.cpu_sec - d->m_start.cpu_sec;
+    total.bytes_read = S.bytes_read - d->m_start.bytes_read;
+    total.bytes_written = S.bytes_written - d->m_start.bytes_written;
+    total.bytes_allocated = S.bytes_allocated - d->m_start.bytes_allocated;
+
+    QJsonObject ret = ProcessorProfilePrivate::phase_to_json(total, d->m_num_threads);
+    ret.remove("count");
+    ret["processor_name"] = d->m_processor_name;
+    ret["num_threads"] = d->m_num_threads;
+    ret["peak_allocated_bytes"] = (double)qMax((bigint)0, MdaAllocator::peakOutstandingBytes() - d->m_outstanding_at_start);
+    ret["peak_rss_bytes"] = (double)peak_rss_bytes();
+
+    QJsonArray phases;
+    foreach (QString name, d->m_phase_names) {
+        QJsonObject P = ProcessorProfilePrivate::phase_to_json(d->m_phases[name], d->m_num_threads);
+        P["name"] = name;
+        phases.append(P);
+    }
+    ret["phases"] = phases;
+
+    QJsonArray lock_waits;
+    double lock_wait_sec = 0;
+    QStringList lock_names = d->m_lock_waits.keys();
+    foreach (QString name, lock_names) {
+        ProfileLockStats L = d->m_lock_waits[name];
+        QJsonObject X;
+        X["name"] = name;
+        X["count"] = (double)L.count;
+        X["total_sec"] = L.total_sec;
+        X["max_sec"] = L.max_sec;
+        lock_waits.append(X);
+        lock_wait_sec += L.total_sec;
+    }
+    ret["lock_waits"] = lock_waits;
+    ret["lock_wait_sec"] = lock_wait_sec;
+
+    return ret;
+}
+
+bool ProcessorProfile::write(const QString& path) const
+{
+    QString json = QJsonDocument(toJsonObject()).toJson();
+    if (!TextFile::write(path, json)) {
+        qWarning() << "Unable to write profile: " + path;
+        return false;
+    }
+    return true;
+}
+
+Q_GLOBAL_STATIC(ProcessorProfile, theInstance)
+ProcessorProfile* ProcessorProfile::globalInstance()
+{
+    return theInstance;
+}
+
+QJsonObject ProcessorProfile::aggregate(const QList<QJsonObject>& profiles)
+{
+    QJsonObject processors;
+    QJsonObject total;
+    for (int i = 0; i < profiles.count(); i++) {
+        QJsonObject P = profiles[i];
+        if (P.isEmpty())
+            continue;
+        QString name = P["processor_name"].toString();
+        QJsonObject X = processors[name].toObject();
+        ProcessorProfilePrivate::add_totals(X, P);
+        QJsonObject phases = X["phases"].toObject();
+        QJsonArray phases0 = P["phases"].toArray();
+        for (int j = 0; j < phases0.count(); j++) {
+            QJsonObject ph = phases0[j].toObject();
+            QJsonObject Y = phases[ph["name"].toString()].toObject();
+            ProcessorProfilePrivate::add_totals(Y, ph);
+            phases[ph["name"].toString()] = Y;
+        }
+        X["phases"] = phases;
+        processors[name] = X;
+        ProcessorProfilePrivate::add_totals(total, P);
+    }
+    // the fraction of the total wall time spent in each processor tells where the time goes
+    double total_wall_sec = total["wall_sec"].toDouble();
+    QStringList names = processors.keys();
+    foreach (QString name, names) {
+        QJsonObject X = processors[name].toObject();
+        X["fraction_of_wall"] = total_wall_sec ? X["wall_sec"].toDouble() / total_wall_sec : 0;
+        processors[name] = X;
+    }
+    QJsonObject ret;
+    ret["total"] = total;
+    ret["processors"] = processors;
+    return ret;
+}
+
+ProfileSnapshot ProcessorProfilePrivate::snapshot() const
+{
+    ProfileSnapshot S;
+    S.wall_sec = wall_sec();
+    S.cpu_sec = cpu_sec();
+    if (m_bytes_read_counter)
+        S.bytes_read = m_bytes_read_counter->value();
+    if (m_bytes_written_counter)
+        S.bytes_written = m_bytes_written_counter->value();
+    if (m_allocated_counter)
+        S.bytes_allocated = m_allocated_counter->value();
+    return S;
+}
+
+QJsonObject ProcessorProfilePrivate::phase_to_json(const ProfilePhaseStats& P, int num_threads)
+{
+    QJsonObject ret;
+    ret["count"] = P.count;
+    ret["wall_sec"] = P.wall_sec;
+    ret["cpu_sec"] = P.cpu_sec;
+    // 1 means every thread was busy for the whole phase
+    ret["thread_utilization"] = ((P.wall_sec > 0) && (num_threads > 0)) ? P.cpu_sec / (P.wall_sec * num_threads) : 0;
+    ret["bytes_read"] = (double)P.bytes_read;
+    ret["bytes_written"] = (double)P.bytes_written;
+    ret["bytes_allocated"] = (double)P.bytes_allocated;
+    return ret;
+}
+
+void ProcessorProfilePrivate::add_totals(QJsonObject& totals, const QJsonObject& X)
+{
+    QStringList keys;
+    keys << "wall_sec"
+         << "cpu_sec"
+         << "bytes_read"
+         << "bytes_written"
+         << "bytes_allocated"
+         << "lock_wait_sec";
+    foreach (QString key, keys) {
+        totals[key] = totals[key].toDouble() + X[key].toDouble();
+    }
+    totals["count"] = totals["count"].toDouble() + qMax(1.0, X["count"].toDouble());
+    totals["peak_rss_bytes"] = qMax(totals["peak_rss_bytes"].toDouble(), X["peak_rss_bytes"].toDouble());
+    totals["peak_allocated_bytes"] = qMax(totals["peak_allocated_bytes"].toDouble(), X["peak_allocated_bytes"].toDouble());
+}
+
+ProfilePhase::ProfilePhase(const QString& name)
+    : m_name(name)
+{
+    ProcessorProfile::globalInstance()->startPhase(m_name);
+}
+
+ProfilePhase::~ProfilePhase()
+{
+    ProcessorProfile::globalInstance()->endPhase(m_name);
+}
+
+ProfileLockWait::ProfileLockWait(const char* lock_name)
+    : m_lock_name(lock_name)
+    , m_start_sec(wall_sec())
+{
+}
+
+void ProfileLockWait::acquired()
+{
+    ProcessorProfile::globalInstance()->addLockWait(m_lock_name, wall_sec() - m_start_sec);
+}
@@ -0,0 +1,497 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "prvlocationindex.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMultiHash>
+#include <QMutex>
+#include <QSet>
+
+#define PRV_LOCATION_INDEX_VERSION 1
+#define PRV_LOCATION_INDEX_MIN_RESCAN_INTERVAL_SEC 5
+#define PRV_LOCATION_INDEX_MAX_JOURNAL_RECORDS 1000
+#define EMPTY_STRING_SHA1 "da39a3ee5e6b4b0d3255bfef95601890afd80709"
+
+struct PLIFile {
+    bigint size = 0;
+    qint64 mtime = 0;
+    QString fcs; //head1000 fast checksum, computed lazily
+    QString checksum; //computed lazily
+};
+
+struct PLIDirectory {
+    qint64 mtime = -1;
+    QStringList files;
+    QStringList subdirs;
+};
+
+struct PLIRoot {
+    QString path;
+    QHash<QString, PLIDirectory> directories; //absolute path -> directory
+    QHash<QString, PLIFile> files; //absolute path -> file
+    QMultiHash<bigint, QString> paths_by_size;
+    bool dirty = false; //the index file needs to be rewritten
+    QSet<QString> computed; //files with a new fcs or checksum, to be appended to the journal
+    qint64 num_journal_records = 0;
+    QDateTime last_scan; //by this process
+};
+
+class PrvLocationIndexPrivate {
+public:
+    PrvLocationIndex* q;
+
+    QString m_index_directory;
+    QMap<QString, PLIRoot*> m_roots;
+    QHash<QString, QDateTime> m_misses;
+    QMutex m_mutex;
+
+    PLIRoot* root(const QString& path);
+    QString index_file_path(const QString& root_path);
+    bool load(PLIRoot* R);
+    void load_journal(PLIRoot* R);
+    bool save(PLIRoot* R);
+    bool append_journal(PLIRoot* R);
+    void save_dirty_roots();
+    void scan(PLIRoot* R);
+    void scan_directory(PLIRoot* R, const QString& path, QSet<QString>& visited, QSet<QString>& visited_canonical);
+    void set_file(PLIRoot* R, const QString& path, bigint size, qint64 mtime);
+    void remove_file(PLIRoot* R, const QString& path);
+    bool refresh_file(PLIRoot* R, const QString& path);
+    bool file_matches(PLIRoot* R, const QString& path, bigint size, const QString& checksum, const QString& fcs);
+    PLIRoot* root_containing(const QString& path, const QStringList& search_paths);
+};
+
+PrvLocationIndex::PrvLocationIndex()
+{
+    d = new PrvLocationIndexPrivate;
+    d->q = this;
+}
+
+PrvLocationIndex::~PrvLocationIndex()
+{
+    qDeleteAll(d->m_roots);
+    delete d;
+}
+
+void PrvLocationIndex::setIndexDirectory(const QString& path)
+{
+    QMutexLocker locker(&d->m_mutex);
+    d->m_index_directory = path;
+}
+
+QStringList PrvLocationIndex::locateFiles(bigint size, const QString& checksum, const QString& fcs, const QStringList& search_paths, bool first_only)
+{
+    QMutexLocker locker(&d->m_mutex);
+    QStringList ret;
+    QList<PLIRoot*> roots;
+    foreach (QString search_path, search_paths) {
+        PLIRoot* R = d->root(search_path);
+        if (R)
+            roots << R;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        foreach (PLIRoot* R, roots) {
+            if (pass == 1) {
+                // only rescan (incrementally) when the lookup against the index fails, and not repeatedly
+                if ((R->last_scan.isValid()) && (R->last_scan.secsTo(QDateTime::currentDateTime()) < PRV_LOCATION_INDEX_MIN_RESCAN_INTERVAL_SEC))
+                    continue;
+                d->scan(R);
+            }
+            QList<QString> candidates = R->paths_by_size.values(size);
+            qSort(candidates);
+            foreach (QString path, candidates) {
+                if ((!ret.contains(path)) && (d->file_matches(R, path, size, checksum, fcs))) {
+                    ret << path;
+                    if (first_only)
+                        break;
+                }
+            }
+            if ((first_only) && (!ret.isEmpty()))
+                break;
+        }
+        if (!ret.isEmpty())
+            break;
+    }
+    d->save_dirty_roots();
+    return ret;
+}
+
+QString PrvLocationIndex::checksumOfFile(const QString& path0, const QStringList& search_paths)
+{
+    QMutexLocker locker(&d->m_mutex);
+    QString path = QFileInfo(path0).absoluteFilePath();
+    PLIRoot* R = d->root_containing(path, search_paths);
+    if ((!R) || (!R->files.contains(path))) {
+        locker.unlock();
+        return MLUtil::computeSha1SumOfFile(path);
+    }
+    if (!d->refresh_file(R, path))
+        return "";
+    PLIFile& F = R->files[path];
+    if (F.checksum.isEmpty()) {
+        F.checksum = MLUtil::computeSha1SumOfFile(path);
+        R->computed.insert(path);
+    }
+    QString ret = F.checksum;
+    d->save_dirty_roots();
+    return ret;
+}
+
+void PrvLocationIndex::rescan(const QStringList& search_paths)
+{
+    QMutexLocker locker(&d->m_mutex);
+    foreach (QString search_path, search_paths) {
+        PLIRoot* R = d->root(search_path);
+        if (R)
+            d->scan(R);
+    }
+    d->save_dirty_roots();
+}
+
+void PrvLocationIndex::updateFile(const QString& path0, const QStringList& search_paths)
+{
+    QMutexLocker locker(&d->m_mutex);
+    QString path = QFileInfo(path0).absoluteFilePath();
+    PLIRoot* R = d->root_containing(path, search_paths);
+    if (!R)
+        return;
+    d->refresh_file(R, path);
+    d->m_misses.clear();
+    d->save_dirty_roots();
+}
+
+bool PrvLocationIndex::isRecentMiss(const QString& key)
+{
+    QMutexLocker locker(&d->m_mutex);
+    if (!d->m_misses.contains(key))
+        return false;
+    if (d->m_misses[key].secsTo(QDateTime::currentDateTime()) >= PRV_LOCATION_INDEX_MISS_TTL_SEC) {
+        d->m_misses.remove(key);
+        return false;
+    }
+    return true;
+}
+
+void PrvLocationIndex::recordMiss(const QString& key)
+{
+    QMutexLocker locker(&d->m_mutex);
+    d->m_misses[key] = QDateTime::currentDateTime();
+}
+
+Q_GLOBAL_STATIC(PrvLocationIndex, theInstance)
+PrvLocationIndex* PrvLocationIndex::globalInstance()
+{
+    return theInstance;
+}
+
+PLIRoot* PrvLocationIndexPrivate::root(const QString& path0)
+{
+    QString path = QDir(path0).absolutePath();
+    if (m_roots.contains(path))
+        return m_roots[path];
+    if (!QFileInfo(path).isDir())
+        return 0;
+    PLIRoot* R = new PLIRoot;
+    R->path = path;
+    if (!load(R))
+        scan(R);
+    m_roots[path] = R;
+    return R;
+}
+
+QString PrvLocationIndexPrivate::index_file_path(const QString& root_path)
+{
+    QString dir = m_index_directory;
+    if (dir.isEmpty())
+        dir = MLUtil::tempPath() + "/prv_location_index";
+    MLUtil::mkdirIfNeeded(dir);
+    return dir + "/" + MLUtil::computeSha1SumOfString(root_path) + ".index";
+}
+
+bool PrvLocationIndexPrivate::load(PLIRoot* R)
+{
+    QFile file(index_file_path(R->path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    qint32 version;
+    QString root_path;
+    in >> version >> root_path;
+    if ((version != PRV_LOCATION_INDEX_VERSION) || (root_path != R->path))
+        return false;
+    qint64 num_dirs, num_files;
+    in >> num_dirs;
+    for (qint64 i = 0; (i < num_dirs) && (in.status() == QDataStream::Ok); i++) {
+        QString path;
+        PLIDirectory D;
+        in >> path >> D.mtime >> D.files >> D.subdirs;
+        R->directories[path] = D;
+    }
+    in >> num_files;
+    for (qint64 i = 0; (i < num_files) && (in.status() == QDataStream::Ok); i++) {
+        QString path;
+        PLIFile F;
+        qint64 size;
+        in >> path >> size >> F.mtime >> F.fcs >> F.checksum;
+        F.size = size;
+        R->files[path] = F;
+        R->paths_by_size.insert(F.size, path);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Problem reading prv location index: " + file.fileName();
+        R->directories.clear();
+        R->files.clear();
+        R->paths_by_size.clear();
+        return false;
+    }
+    load_journal(R);
+    return true;
+}
+
+void PrvLocationIndexPrivate::load_journal(PLIRoot* R)
+{
+    QFile file(index_file_path(R->path) + ".journal");
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&file);
+    while (!in.atEnd()) {
+        QString path, fcs, checksum;
+        qint64 size, mtime;
+        in >> path >> size >> mtime >> fcs >> checksum;
+        if (in.status() != QDataStream::Ok)
+            break; //a record cut short by a crash -- the rest is recomputed when needed
+        R->num_journal_records++;
+        // the record only applies to the file as it was when the checksum was computed
+        if ((R->files.contains(path)) && (R->files[path].size == size) && (R->files[path].mtime == mtime)) {
+            PLIFile& F = R->files[path];
+            if (!fcs.isEmpty())
+                F.fcs = fcs;
+            if (!checksum.isEmpty())
+                F.checksum = checksum;
+        }
+    }
+}
+
+bool PrvLocationIndexPrivate::save(PLIRoot* R)
+{
+    QString path = index_file_path(R->path);
+    QString tmp_path = path + "." + MLUtil::makeRandomId(6) + ".tmp";
+    {
+        QFile file(tmp_path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Unable to write prv location index: " + tmp_path;
+            return false;
+        }
+        QDataStream out(&file);
+        out << (qint32)PRV_LOCATION_INDEX_VERSION << R->path;
+        out << (qint64)R->directories.count();
+        for (auto it = R->directories.constBegin(); it != R->directories.constEnd(); ++it) {
+            out << it.key() << it.value().mtime << it.value().files << it.value().subdirs;
+        }
+        out << (qint64)R->files.count();
+        for (auto it = R->files.constBegin(); it != R->files.constEnd(); ++it) {
+            out << it.key() << (qint64)it.value().size << it.value().mtime << it.value().fcs << it.value().checksum;
+        }
+    }
+    // other processes may be reading or writing the same index, so replace it in one step
+    QFile::remove(path);
+    if (!QFile::rename(tmp_path, path)) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    // the index now has everything that was in the journal (records that another process appends
+    // in the meantime are lost, which only means that those checksums are computed again)
+    QFile::remove(path + ".journal");
+    R->num_journal_records = 0;
+    R->computed.clear();
+    R->dirty = false;
+    return true;
+}
+
+bool PrvLocationIndexPrivate::append_journal(PLIRoot* R)
+{
+    QString path = index_file_path(R->path) + ".journal";
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Unable to append to prv location index journal: " + path;
+        return false;
+    }
+    // one write per batch, so that records from concurrent processes do not interleave
+    QByteArray records;
+    {
+        QDataStream out(&records, QIODevice::WriteOnly);
+        foreach (QString fpath, R->computed) {
+            if (!R->files.contains(fpath))
+                continue;
+            const PLIFile& F = R->files[fpath];
+            out << fpath << (qint64)F.size << F.mtime << F.fcs << F.checksum;
+            R->num_journal_records++;
+        }
+    }
+    if (file.write(records) != records.count())
+        return false;
+    R->computed.clear();
+    return true;
+}
+
+void PrvLocationIndexPrivate::save_dirty_roots()
+{
+    foreach (PLIRoot* R, m_roots) {
+        if ((!R->dirty) && (!R->computed.isEmpty())) {
+            append_journal(R);
+            if (R->num_journal_records > PRV_LOCATION_INDEX_MAX_JOURNAL_RECORDS)
+                R->dirty = true; //merge it into the index
+        }
+        if (R->dirty)
+            save(R);
+    }
+}
+
+void PrvLocationIndexPrivate::scan(PLIRoot* R)
+{
+    QSet<QString> visited, visited_canonical;
+    scan_directory(R, R->path, visited, visited_canonical);
+    QStringList dirs = R->directories.keys();
+    foreach (QString dir, dirs) {
+        if (!visited.contains(dir)) {
+            foreach (QString fname, R->directories[dir].files) {
+                remove_file(R, dir + "/" + fname);
+            }
+            R->directories.remove(dir);
+            R->dirty = true;
+        }
+    }
+    R->last_scan = QDateTime::currentDateTime();
+}
+
+void PrvLocationIndexPrivate::scan_directory(PLIRoot* R, const QString& path, QSet<QString>& visited, QSet<QString>& visited_canonical)
+{
+    if (visited.contains(path))
+        return;
+    // a symbolic link may lead back to a directory that was already scanned (or to one of its ancestors)
+    QString canonical = QFileInfo(path).canonicalFilePath();
+    if ((canonical.isEmpty()) || (visited_canonical.contains(canonical)))
+        return;
+    visited.insert(path);
+    visited_canonical.insert(canonical);
+    qint64 mtime = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    PLIDirectory D = R->directories.value(path);
+    if (D.mtime != mtime) {
+        // the listing of this directory changed (or it is new), so re-list it
+        QDir dir(path);
+        QStringList files = dir.entryList(QStringList("*"), QDir::Files, QDir::Name);
+        QSet<QString> files_set = files.toSet();
+        foreach (QString fname, D.files) {
+            if (!files_set.contains(fname))
+                remove_file(R, path + "/" + fname);
+        }
+        foreach (QString fname, files) {
+            QFileInfo info(path + "/" + fname);
+            set_file(R, path + "/" + fname, info.size(), info.lastModified().toMSecsSinceEpoch());
+        }
+        D.mtime = mtime;
+        D.files = files;
+        D.subdirs = dir.entryList(QStringList("*"), QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+        R->directories[path] = D;
+        R->dirty = true;
+        m_misses.clear(); //something may have appeared
+    }
+    foreach (QString subdir, D.subdirs) {
+        scan_directory(R, path + "/" + subdir, visited, visited_canonical);
+    }
+}
+
+void PrvLocationIndexPrivate::set_file(PLIRoot* R, const QString& path, bigint size, qint64 mtime)
+{
+    if (R->files.contains(path)) {
+        PLIFile& F = R->files[path];
+        if ((F.size == size) && (F.mtime == mtime))
+            return;
+        if (F.size != size) {
+            R->paths_by_size.remove(F.size, path);
+            R->paths_by_size.insert(size, path);
+        }
+        F.size = size;
+        F.mtime = mtime;
+        F.fcs.clear();
+        F.checksum.clear();
+    }
+    else {
+        PLIFile F;
+        F.size = size;
+        F.mtime = mtime;
+        R->files[path] = F;
+        R->paths_by_size.insert(size, path);
+    }
+    R->dirty = true;
+}
+
+void PrvLocationIndexPrivate::remove_file(PLIRoot* R, const QString& path)
+{
+    if (!R->files.contains(path))
+        return;
+    R->paths_by_size.remove(R->files[path].size, path);
+    R->files.remove(path);
+    R->dirty = true;
+}
+
+bool PrvLocationIndexPrivate::refresh_file(PLIRoot* R, const QString& path)
+{
+    // lazy verification: the file may have been removed or modified since it was indexed
+    QFileInfo info(path);
+    if (!info.exists()) {
+        remove_file(R, path);
+        return false;
+    }
+    set_file(R, path, info.size(), info.lastModified().toMSecsSinceEpoch());
+    return true;
+}
+
+bool PrvLocationIndexPrivate::file_matches(PLIRoot* R, const QString& path, bigint size, const QString& checksum, const QString& fcs)
+{
+    if (!refresh_file(R, path))
+        return false;
+    PLIFile& F = R->files[path];
+    if (F.size != size)
+        return false;
+    if (!fcs.isEmpty()) {
+        if ((fcs.startsWith("head1000-")) && (fcs != QString("head1000-") + EMPTY_STRING_SHA1)) {
+            if (F.fcs.isEmpty()) {
+                F.fcs = "head1000-" + MLUtil::computeSha1SumOfFileHead(path, 1000);
+                R->computed.insert(path);
+            }
+            if (F.fcs != fcs)
+                return false;
+        }
+        else if (!MLUtil::matchesFastChecksum(path, fcs)) {
+            return false;
+        }
+    }
+    if (F.checksum.isEmpty()) {
+        F.checksum = MLUtil::computeSha1SumOfFile(path);
+        R->computed.insert(path);
+    }
+    return (F.checksum == checksum);
+}
+
+PLIRoot* PrvLocationIndexPrivate::root_containing(const QString& path, const QStringList& search_paths)
+{
+    foreach (QString search_path, search_paths) {
+        QString root_path = QDir(search_path).absolutePath();
+        if (path.startsWith(root_path + "/")) {
+            PLIRoot* R = root(root_path);
+            if (R)
+                return R;
+        }
+    }
+    return 0;
+}
@@ -14,6 +14,11 @@
 #include <QSortFilterProxyModel>
 
 #include <QAtomicInt>
+#include <QSharedPointer>
+#include <QThreadStorage>
+
+#define TASKPROGRESS_FRAME_MSEC 100
+#define TASKPROGRESS_RING_SIZE 1024 // records per thread
 
 Q_DECLARE_METATYPE(QSet<QString>)
 namespace TaskManager {
@@ -58,11 +63,11 @@ public:
     {
     }
 
-    void addTask(int id, TaskInfo info)
+    void addTask(int id, TaskInfo info, const QDateTime& dt = QDateTime::currentDateTime())
     {
         int from = 0;
         beginInsertRows(QModelIndex(), from, from);
-        info.start_time = QDateTime::currentDateTime();
+        info.start_time = dt;
         TaskProgressAgentPrivate* nInfo = new TaskProgressAgentPrivate(id, info);
         m_map.insert(id, nInfo);
         m_data.insert(from, nInfo);
@@ -78,6 +83,8 @@ public:
         TaskProgressAgentPrivate* info = m_data.at(task.row());
         switch (role) {
         case TaskProgressModel::ProgressRole:
+            if (info->m_finished)
+                return; // recorded before the task finished, in another thread
             info->m_info.progress = value.toDouble();
             if (info->m_info.progress >= 1) {
                 completeTask(task);
@@ -353,9 +360,9 @@ namespace ChangeLog {
 
     class AppendLogChange : public Change {
     public:
-        AppendLogChange(const QString& message)
+        AppendLogChange(const QString& message, const QDateTime& time)
             : m_message(message)
-            , m_time(QDateTime::currentDateTime())
+            , m_time(time)
         {
         }
         void exec(TaskProgressModelPrivate* model, const QPersistentModelIndex& index)
@@ -370,9 +377,9 @@ namespace ChangeLog {
 
     class AppendErrorChange : public Change {
     public:
-        AppendErrorChange(const QString& message)
+        AppendErrorChange(const QString& message, const QDateTime& time)
             : m_message(message)
-            , m_time(QDateTime::currentDateTime())
+            , m_time(time)
         {
         }
         void exec(TaskProgressModelPrivate* model, const QPersistentModelIndex& index)
@@ -387,8 +394,8 @@ namespace ChangeLog {
 
     class FinishChange : public Change {
     public:
-        FinishChange()
-            : m_time(QDateTime::currentDateTime())
+        FinishChange(const QDateTime& time)
+            : m_time(time)
         {
         }
         void exec(TaskProgressModelPrivate* model, const QPersistentModelIndex& index)
@@ -448,8 +455,11 @@ namespace ChangeLog {
     };
 }
 
-class TaskProgressEvent : public QEvent {
-public:
+/*!
+ * \class TaskProgressRecord
+ * \brief A call on a TaskProgress, on its way to the model
+ */
+struct TaskProgressRecord {
     enum Command {
         Create,
         SetLabel,
@@ -461,35 +471,96 @@ public:
         SetProgress,
         Finish
     };
-    static QEvent::Type type()
+
+    int id = 0;
+    Command command = Create;
+    QVariant value;
+    qint64 msec = 0; // time of the call, since the epoch
+};
+
+/*!
+ * \class TaskProgressRing
+ * \brief Records from a single thread (the writer) to the gui thread (the reader)
+ *
+ * Neither side takes a lock. When the ring is full (the gui has not drained it
+ * for a while) push() fails; the caller decides what to do with the record.
+ */
+class TaskProgressRing {
+public:
+    bool push(TaskProgressRecord& rec)
     {
-        static QEvent::Type typeVal = static_cast<QEvent::Type>(registerEventType());
-        return typeVal;
+        quint32 head = m_head.load(); // only written by this thread
+        if (head - m_tail.loadAcquire() >= TASKPROGRESS_RING_SIZE)
+            return false;
+        qSwap(m_records[head % TASKPROGRESS_RING_SIZE], rec);
+        m_head.storeRelease(head + 1);
+        return true;
     }
-
-    TaskProgressEvent(int id, Command cmd, const QVariant& value = QVariant())
-        : QEvent(TaskProgressEvent::type())
+    quint32 count() const
     {
-        m_id = id;
-        m_cmd = cmd;
-        m_value = value;
+        return m_head.loadAcquire() - m_tail.load();
+    }
+    bool pop(TaskProgressRecord& rec)
+    {
+        quint32 tail = m_tail.load(); // only written by the gui thread
+        if (tail == m_head.loadAcquire())
+            return false;
+        TaskProgressRecord& slot = m_records[tail % TASKPROGRESS_RING_SIZE];
+        rec = slot;
+        slot = TaskProgressRecord(); // release the value now, not when the slot is reused
+        m_tail.storeRelease(tail + 1);
+        return true;
     }
-    Command command() const { return m_cmd; }
-    const QVariant& value() const { return m_value; }
-    int id() const { return m_id; }
+    QAtomicInt finished; // the thread has exited, so nothing more will be pushed
 
 private:
-    int m_id;
-    Command m_cmd;
-    QVariant m_value;
+    TaskProgressRecord m_records[TASKPROGRESS_RING_SIZE];
+    QAtomicInteger<quint32> m_head;
+    QAtomicInteger<quint32> m_tail;
+};
+
+// owned by the thread storage, so it is deleted when the thread exits
+class TaskProgressRingHandle {
+public:
+    ~TaskProgressRingHandle()
+    {
+        ring->finished.storeRelease(1);
+    }
+    QSharedPointer<TaskProgressRing> ring;
+};
+
+class TaskProgressWakeEvent : public QEvent {
+public:
+    TaskProgressWakeEvent()
+        : QEvent(type())
+    {
+    }
+    static QEvent::Type type()
+    {
+        static QEvent::Type typeVal = static_cast<QEvent::Type>(registerEventType());
+        return typeVal;
+    }
 };
 
+/*!
+ * Calls on TaskProgress objects are recorded where they happen and applied to the
+ * model in the gui thread once per frame (TASKPROGRESS_FRAME_MSEC).
+ *
+ * Logs and progress, which come from hot loops, go to a ring buffer per thread,
+ * written without locks. The rest (creation, labels, tags, errors, finishing) is
+ * rare and goes to a single list under a mutex. When a ring is full, a log goes to
+ * that list instead, and a progress value is dropped (the next one supersedes it). The first record after a frame
+ * posts one event to wake the gui thread; the others cost no signal or event.
+ */
 class TaskProgressMonitorPrivate : public TaskProgressMonitor {
 public:
     TaskProgressMonitorPrivate()
     {
         m_model = new TaskProgressModelPrivate(this);
         qRegisterMetaType<TaskInfo>();
+        // the records are applied in the gui thread, whichever thread gets here first
+        if (QCoreApplication::instance())
+            moveToThread(QCoreApplication::instance()->thread());
     }
 
     ~TaskProgressMonitorPrivate()
@@ -497,9 +568,26 @@ public:
         delete m_model;
     }
 
-    void post(TaskProgressEvent* e)
+    void record(int id, TaskProgressRecord::Command cmd, const QVariant& value = QVariant())
     {
-        QCoreApplication::postEvent(this, e);
+        TaskProgressRecord rec;
+        rec.id = id;
+        rec.command = cmd;
+        rec.value = value;
+        rec.msec = QDateTime::currentMSecsSinceEpoch();
+        bool pushed = false;
+        if ((cmd == TaskProgressRecord::AppendLog) || (cmd == TaskProgressRecord::SetProgress)) {
+            pushed = localRing()->push(rec);
+            if ((!pushed) && (cmd == TaskProgressRecord::SetProgress)) {
+                m_num_dropped.ref();
+                return;
+            }
+        }
+        if (!pushed) {
+            QMutexLocker locker(&m_records_mutex);
+            m_records << rec;
+        }
+        wake();
     }
 
     int count() const override
@@ -533,77 +621,151 @@ public:
     static TaskProgressMonitorPrivate* privateInstance();
 
 protected:
-    void start()
+    TaskProgressRing* localRing()
     {
-        if (m_timerId)
+        if (!m_local_rings.hasLocalData()) {
+            TaskProgressRingHandle* handle = new TaskProgressRingHandle;
+            handle->ring = QSharedPointer<TaskProgressRing>(new TaskProgressRing);
+            m_local_rings.setLocalData(handle);
+            QMutexLocker locker(&m_rings_mutex);
+            m_rings << handle->ring;
+        }
+        return m_local_rings.localData()->ring.data();
+    }
+
+    void wake()
+    {
+        if (m_wake_posted.loadAcquire())
             return;
-        m_timerId = startTimer(500);
+        if (m_wake_posted.testAndSetOrdered(0, 1))
+            QCoreApplication::postEvent(this, new TaskProgressWakeEvent);
     }
-    void stop()
+
+    void customEvent(QEvent* event)
     {
+        if (event->type() != TaskProgressWakeEvent::type()) {
+            event->ignore();
+            return;
+        }
         if (!m_timerId)
+            m_timerId = startTimer(TASKPROGRESS_FRAME_MSEC);
+    }
+
+    void timerEvent(QTimerEvent* event)
+    {
+        if (event->timerId() != m_timerId)
             return;
         killTimer(m_timerId);
         m_timerId = 0;
+        // cleared first, so that a record made during the drain wakes us again
+        m_wake_posted.storeRelease(0);
+        drain();
     }
 
-    void customEvent(QEvent* event)
+    void drain()
     {
-        if (event->type() != TaskProgressEvent::type()) {
-            event->ignore();
-            return;
+        // The rings are read before the list, so that each task they mention has already been
+        // created. Finishing is applied last, after the logs and progress that preceded it.
+        QList<QSharedPointer<TaskProgressRing> > rings;
+        {
+            QMutexLocker locker(&m_rings_mutex);
+            rings = m_rings;
+        }
+        QList<TaskProgressRecord> ring_records;
+        foreach (QSharedPointer<TaskProgressRing> ring, rings) {
+            bool finished = ring->finished.loadAcquire();
+            TaskProgressRecord rec;
+            // only what is there now: a log pushed after this was made after any that overflowed to the list
+            for (quint32 n = ring->count(); (n > 0) && (ring->pop(rec)); n--)
+                ring_records << rec;
+            if (finished) {
+                QMutexLocker locker(&m_rings_mutex);
+                m_rings.removeAll(ring);
+            }
+        }
+        int num_dropped = m_num_dropped.fetchAndStoreRelaxed(0);
+        if (num_dropped)
+            qWarning("TaskProgress: %d progress records were dropped", num_dropped);
+        QList<TaskProgressRecord> records;
+        {
+            QMutexLocker locker(&m_records_mutex);
+            qSwap(records, m_records);
+        }
+
+        // logs in the list overflowed a full ring, so they come after everything in the rings
+        QList<TaskProgressRecord> finish_records;
+        QList<TaskProgressRecord> overflow_records;
+        foreach (const TaskProgressRecord& rec, records) {
+            if (rec.command == TaskProgressRecord::Create)
+                m_model->addTask(rec.id, rec.value.value<TaskInfo>(), QDateTime::fromMSecsSinceEpoch(rec.msec));
+            else if (rec.command == TaskProgressRecord::Finish)
+                finish_records << rec;
+            else if (rec.command == TaskProgressRecord::AppendLog)
+                overflow_records << rec;
+            else
+                add_change(rec);
+        }
+        foreach (const TaskProgressRecord& rec, ring_records) {
+            add_change(rec);
+        }
+        foreach (const TaskProgressRecord& rec, overflow_records) {
+            add_change(rec);
         }
-        start();
-        TaskProgressEvent* tpEvent = static_cast<TaskProgressEvent*>(event);
-        if (tpEvent->command() == TaskProgressEvent::Create) {
-            TaskInfo info = tpEvent->value().value<TaskInfo>();
-            m_model->addTask(tpEvent->id(), info);
+        foreach (const TaskProgressRecord& rec, finish_records) {
+            add_change(rec);
         }
-        const QVariant& value = tpEvent->value();
-        switch (tpEvent->command()) {
-        case TaskProgressEvent::SetLabel:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::LabelChange(value.toString()));
+        m_changeManager.exec(m_model);
+    }
+
+    void add_change(const TaskProgressRecord& rec)
+    {
+        const QVariant& value = rec.value;
+        QDateTime time = QDateTime::fromMSecsSinceEpoch(rec.msec);
+        switch (rec.command) {
+        case TaskProgressRecord::SetLabel:
+            m_changeManager.add(rec.id, new ChangeLog::LabelChange(value.toString()));
             break;
-        case TaskProgressEvent::SetDescription:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::DescriptionChange(value.toString()));
+        case TaskProgressRecord::SetDescription:
+            m_changeManager.add(rec.id, new ChangeLog::DescriptionChange(value.toString()));
             break;
-        case TaskProgressEvent::AddTag:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::AddTagChange(value.toString()));
+        case TaskProgressRecord::AddTag:
+            m_changeManager.add(rec.id, new ChangeLog::AddTagChange(value.toString()));
             break;
-        case TaskProgressEvent::RemoveTag:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::RemoveTagChange(value.toString()));
+        case TaskProgressRecord::RemoveTag:
+            m_changeManager.add(rec.id, new ChangeLog::RemoveTagChange(value.toString()));
             break;
-        case TaskProgressEvent::AppendLog:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::AppendLogChange(value.toString()));
+        case TaskProgressRecord::AppendLog:
+            m_changeManager.add(rec.id, new ChangeLog::AppendLogChange(value.toString(), time));
             break;
-        case TaskProgressEvent::AppendError:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::AppendErrorChange(value.toString()));
+        case TaskProgressRecord::AppendError:
+            m_changeManager.add(rec.id, new ChangeLog::AppendErrorChange(value.toString(), time));
             break;
-        case TaskProgressEvent::SetProgress:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::ProgressChange(value.toDouble()));
+        case TaskProgressRecord::SetProgress:
+            m_changeManager.add(rec.id, new ChangeLog::ProgressChange(value.toDouble()));
             break;
-        case TaskProgressEvent::Finish:
-            m_changeManager.add(tpEvent->id(), new ChangeLog::FinishChange);
+        case TaskProgressRecord::Finish:
+            m_changeManager.add(rec.id, new ChangeLog::FinishChange(time));
             break;
-        case TaskProgressEvent::Create:
-            break; // handled earlier
+        case TaskProgressRecord::Create:
+            break; // handled in drain()
         default:
-            qWarning("Custom event not handled");
+            qWarning("Task progress record not handled");
             break;
         }
     }
-    void timerEvent(QTimerEvent* event)
-    {
-        if (event->timerId() == m_timerId) {
-            m_changeManager.exec(m_model);
-            stop();
-        }
-    }
 
 private:
     TaskProgressModelPrivate* m_model;
     ChangeLog::Manager m_changeManager;
     int m_timerId = 0;
+    QAtomicInt m_wake_posted;
+    QAtomicInt m_num_dropped; //progress records that found their ring full
+
+    QThreadStorage<TaskProgressRingHandle*> m_local_rings;
+    QMutex m_rings_mutex;
+    QList<QSharedPointer<TaskProgressRing> > m_rings;
+    QMutex m_records_mutex;
+    QList<TaskProgressRecord> m_records;
 };
 
 Q_GLOBAL_STATIC(TaskProgressMonitorPrivate, _q_tpm_instance)
@@ -913,9 +1075,7 @@ TaskProgress::TaskProgress()
     : QObject()
     , m_id(TaskProgressValue.fetchAndAddOrdered(1))
 {
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::Create);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::Create);
 }
 
 TaskProgress::TaskProgress(const QString& label)
@@ -923,9 +1083,7 @@ TaskProgress::TaskProgress(const QString& label)
     , m_id(TaskProgressValue.fetchAndAddOrdered(1))
 {
     m_info.label = label;
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::Create, qVariantFromValue(m_info));
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::Create, qVariantFromValue(m_info));
 }
 
 TaskProgress::TaskProgress(StandardCategories tags, const QString& label)
@@ -935,16 +1093,12 @@ TaskProgress::TaskProgress(StandardCategories tags, const QString& label)
     m_info.label = label;
     QStringList tagNames = catsToString(tags);
     m_info.tags = tagNames.toSet();
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::Create, qVariantFromValue(m_info));
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::Create, qVariantFromValue(m_info));
 }
 
 TaskProgress::~TaskProgress()
 {
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::Finish);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::Finish);
 }
 
 QString TaskProgress::label() const
@@ -967,10 +1121,7 @@ void TaskProgress::setLabel(const QString& label)
     if (m_info.label == label)
         return;
     m_info.label = label;
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::SetLabel,
-        label);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::SetLabel, label);
 }
 
 void TaskProgress::setDescription(const QString& description)
@@ -978,10 +1129,7 @@ void TaskProgress::setDescription(const QString& description)
     if (m_info.description == description)
         return;
     m_info.description = description;
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::SetDescription,
-        description);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::SetDescription, description);
 }
 
 void TaskProgress::addTag(TaskProgress::StandardCategory cat)
@@ -995,10 +1143,7 @@ void TaskProgress::addTag(TaskProgress::StandardCategory cat)
 void TaskProgress::addTag(const QString& tag)
 {
     m_info.tags << tag;
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::AddTag,
-        tag);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::AddTag, tag);
 }
 
 void TaskProgress::removeTag(TaskProgress::StandardCategory cat)
@@ -1012,10 +1157,7 @@ void TaskProgress::removeTag(TaskProgress::StandardCategory cat)
 void TaskProgress::removeTag(const QString& tag)
 {
     m_info.tags.remove(tag);
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::RemoveTag,
-        tag);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::RemoveTag, tag);
 }
 
 bool TaskProgress::hasTag(TaskProgress::StandardCategory cat) const
@@ -1048,18 +1190,12 @@ MLDebug TaskProgress::error()
 
 void TaskProgress::log(const QString& log_message)
 {
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::AppendLog,
-        log_message);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::AppendLog, log_message);
 }
 
 void TaskProgress::error(const QString& error_message)
 {
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::AppendError,
-        error_message);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::AppendError, error_message);
 }
 
 void TaskProgress::setProgress(double pct)
@@ -1067,10 +1203,12 @@ void TaskProgress::setProgress(double pct)
     if (m_info.progress == pct)
         return;
     m_info.progress = pct;
-    TaskManager::TaskProgressEvent* event = new TaskManager::TaskProgressEvent(m_id,
-        TaskManager::TaskProgressEvent::SetProgress,
-        pct);
-    TaskManager::TaskProgressMonitorPrivate::privateInstance()->post(event);
+    // only record changes that show, so that calling this on every iteration of a loop is cheap
+    int permille = (int)(pct * 1000);
+    if (permille == m_recorded_permille)
+        return;
+    m_recorded_permille = permille;
+    TaskManager::TaskProgressMonitorPrivate::privateInstance()->record(m_id, TaskManager::TaskProgressRecord::SetProgress, pct);
 }
 
 QStringList TaskProgress::catsToString(StandardCategories cats) const
@@ -80,8 +80,8 @@ SOURCES += affinetransformation.cpp
 
 INCLUDEPATH += ../../mountainview/src
 VPATH += ../../mountainview/src
-HEADERS += mvcontext.h
-SOURCES += mvcontext.cpp
+HEADERS += mvcontext.h mvcomputationcache.h
+SOURCES += mvcontext.cpp mvcomputationcache.cpp
 
 INCLUDEPATH += ../../mountainview/src/multiscaletimeseries
 VPATH += ../../mountainview/src/multiscaletimeseries
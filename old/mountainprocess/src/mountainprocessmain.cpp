@@ -370,6 +370,8 @@ int main(int argc, char* argv[])
         obj["avg_cpu_pct"] = compute_avg_cpu_pct(info.monitor_stats);
         obj["start_time"] = info.start_time.toString("yyyy-MM-dd:hh-mm-ss.zzz");
         obj["finish_time"] = info.finish_time.toString("yyyy-MM-dd:hh-mm-ss.zzz");
+        if (!info.profile.isEmpty())
+            obj["profile"] = info.profile;
         //obj["monitor_stats"]=monitor_stats_to_json_array(info.monitor_stats); -- at some point we can include this in the file. For now we only worry about the computed peak values
         if (!output_fname.isEmpty()) { //The user wants the results to go in this file
             QFile::remove(output_fname); //important -- added 9/9/16
@@ -561,6 +561,8 @@ void ProcessManager::slot_process_finished()
                 QJsonObject obj = d->compute_unique_process_object(processor, parameters, false);
                 QString code = d->compute_unique_object_code(obj);
                 QString fname = MPDaemon::daemonPath() + "/completed_processes/" + code + ".json";
+                if (!d->m_processes[id].info.profile.isEmpty())
+                    obj["profile"] = d->m_processes[id].info.profile; //not part of the unique code
                 QString json = QJsonDocument(obj).toJson();
                 if (QFile::exists(fname))
                     QFile::remove(fname); //shouldn't be needed
@@ -636,6 +638,9 @@ void ProcessManagerPrivate::update_process_info(QString id)
         PP->info.finished = true;
         PP->info.exit_code = qprocess->exitCode();
         PP->info.exit_status = qprocess->exitStatus();
+        if ((PP->info.profile.isEmpty()) && (QFile::exists(PP->tempdir + "/_profile.json"))) {
+            PP->info.profile = QJsonDocument::fromJson(TextFile::read(PP->tempdir + "/_profile.json").toUtf8()).object();
+        }
     }
     PP->info.standard_output += qprocess->readAll();
 }
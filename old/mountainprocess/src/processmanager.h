@@ -56,6 +56,7 @@ struct MLProcessInfo {
     QProcess::ExitStatus exit_status;
     QByteArray standard_output;
     QByteArray standard_error;
+    QJsonObject profile; //written by the processor to <tempdir>/_profile.json, if supported
 };
 
 class ProcessManagerPrivate;
@@ -21,6 +21,7 @@
 #include <unistd.h> //for usleep
 #include "mpdaemon.h"
 #include "mlcommon.h"
+#include "processorprofile.h"
 
 struct PipelineNode2 {
     // A node in the processing pipeline -- representing a single process
@@ -344,6 +345,17 @@ bool ScriptController2::runPipeline()
 
     QDateTime timestamp_finish = QDateTime::currentDateTime();
     d->m_results["total_time_sec"] = timestamp_start.msecsTo(timestamp_finish) * 1.0 / 1000;
+
+    //combine the profiles reported by the processors that were actually run
+    QList<QJsonObject> profiles;
+    QJsonArray PP = d->m_results["processes"].toArray();
+    for (int i = 0; i < PP.count(); i++) {
+        QJsonObject profile = PP[i].toObject()["results"].toObject()["profile"].toObject();
+        if (!profile.isEmpty())
+            profiles << profile;
+    }
+    if (!profiles.isEmpty())
+        d->m_results["profile"] = ProcessorProfile::aggregate(profiles);
     return true;
 }
 
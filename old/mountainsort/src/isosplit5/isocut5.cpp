@@ -10,8 +10,15 @@ double sum(bigint N, float* X);
 bigint find_min_index(bigint N, float* X);
 bigint find_max_index(bigint N, float* X);
 double compute_ks4(bigint N, float* counts1, float* counts2);
-double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigint N, float* counts1, float* counts2, bigint peak_index);
+double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigint N, float* counts1, float* counts2, bigint peak_index, isocut5_workspace& ws);
 void debug_print_array(bigint N, float* X);
+
+float* buffer(std::vector<float>& X, bigint N)
+{
+    if ((bigint)X.size() < N)
+        X.resize(N);
+    return X.data();
+}
 }
 
 void isocut5_mex(double* dipscore, double* cutpoint, int N, double* samples)
@@ -28,13 +35,27 @@ void isocut5_mex(double* dipscore, double* cutpoint, int N, double* samples)
 
 void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* samples, isocut5_opts opts)
 {
-    float* samples_sorted = (float*)malloc(sizeof(float) * N);
+    static thread_local isocut5_workspace ws;
+    isocut5(dipscore_out, cutpoint_out, N, samples, opts, ws);
+}
+
+void isocut5_batch(double* dipscores_out, double* cutpoints_out, bigint num_sample_sets, const bigint* N, float* const* sample_sets, isocut5_opts opts)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (bigint j = 0; j < num_sample_sets; j++) {
+        isocut5(&dipscores_out[j], &cutpoints_out[j], N[j], sample_sets[j], opts);
+    }
+}
+
+void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* samples, isocut5_opts opts, isocut5_workspace& ws)
+{
+    float* samples_sorted = ns_isocut5::buffer(ws.samples_sorted, N);
 
     // sort the samples if needed
     if (opts.already_sorted)
         ns_isocut5::copy_samples(N, samples_sorted, samples);
     else
-        jisotonic5_sort(N, samples_sorted, samples);
+        jisotonic5_sort(N, samples_sorted, samples, ws.jisotonic);
 
     float num_bins_factor = 1;
     bigint num_bins = ceil(sqrt(N * 1.0 / 2) * num_bins_factor);
@@ -42,7 +63,7 @@ void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* sample
     bigint num_bins_1 = ceil(num_bins / 2);
     bigint num_bins_2 = num_bins - num_bins_1;
     bigint num_intervals = num_bins_1 + num_bins_2;
-    float* intervals = (float*)malloc(sizeof(float) * num_intervals);
+    float* intervals = ns_isocut5::buffer(ws.intervals, num_intervals);
     for (bigint i = 0; i < num_bins_1; i++)
         intervals[i] = i + 1;
     for (bigint i = 0; i < num_bins_2; i++)
@@ -51,60 +72,46 @@ void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* sample
     for (bigint i = 0; i < num_intervals; i++)
         intervals[i] *= alpha;
     bigint N_sub = num_intervals + 1;
-    float* inds = (float*)malloc(sizeof(float) * N_sub);
+    float* inds = ns_isocut5::buffer(ws.inds, N_sub);
     inds[0] = 0;
     for (bigint i = 0; i < num_intervals; i++)
         inds[i + 1] = inds[i] + intervals[i];
-    float* X_sub = (float*)malloc(sizeof(float) * N_sub);
+    float* X_sub = ns_isocut5::buffer(ws.X_sub, N_sub);
     for (bigint i = 0; i < N_sub; i++)
         X_sub[i] = samples_sorted[(bigint)inds[i]];
-    float* densities = (float*)malloc(sizeof(float) * (N_sub - 1));
-    float* spacings = (float*)malloc(sizeof(float) * (N_sub - 1));
-    float* multiplicities = (float*)malloc(sizeof(float) * (N_sub - 1));
+    float* densities = ns_isocut5::buffer(ws.densities, N_sub - 1);
+    float* spacings = ns_isocut5::buffer(ws.spacings, N_sub - 1);
+    float* multiplicities = ns_isocut5::buffer(ws.multiplicities, N_sub - 1);
     for (bigint i = 0; i < N_sub - 1; i++) {
         spacings[i] = X_sub[i + 1] - X_sub[i];
         multiplicities[i] = ((bigint)inds[i + 1]) - ((bigint)inds[i]);
         densities[i] = multiplicities[i] / spacings[i];
     }
 
-    float* densities_unimodal_fit = (float*)malloc(sizeof(float) * (N_sub - 1));
-    float* densities_resid = (float*)malloc(sizeof(float) * (N_sub - 1));
-    float* densities_unimodal_fit_times_spacings = (float*)malloc(sizeof(float) * (N_sub - 1));
-    jisotonic5_updown(N_sub - 1, densities_unimodal_fit, densities, multiplicities);
+    float* densities_unimodal_fit = ns_isocut5::buffer(ws.densities_unimodal_fit, N_sub - 1);
+    float* densities_resid = ns_isocut5::buffer(ws.densities_resid, N_sub - 1);
+    float* densities_unimodal_fit_times_spacings = ns_isocut5::buffer(ws.densities_unimodal_fit_times_spacings, N_sub - 1);
+    jisotonic5_updown(N_sub - 1, densities_unimodal_fit, densities, multiplicities, ws.jisotonic);
     for (bigint i = 0; i < N_sub - 1; i++)
         densities_resid[i] = densities[i] - densities_unimodal_fit[i];
     for (bigint i = 0; i < N_sub - 1; i++)
         densities_unimodal_fit_times_spacings[i] = densities_unimodal_fit[i] * spacings[i];
     bigint critical_range_min, critical_range_max;
     bigint peak_index = ns_isocut5::find_max_index(N_sub - 1, densities_unimodal_fit);
-    *dipscore_out = ns_isocut5::compute_ks5(&critical_range_min, &critical_range_max, N_sub - 1, multiplicities, densities_unimodal_fit_times_spacings, peak_index);
+    *dipscore_out = ns_isocut5::compute_ks5(&critical_range_min, &critical_range_max, N_sub - 1, multiplicities, densities_unimodal_fit_times_spacings, peak_index, ws);
     bigint critical_range_length = critical_range_max - critical_range_min + 1;
 
-    float* densities_resid_on_critical_range = (float*)malloc(sizeof(float) * (critical_range_length));
-    float* densities_resid_fit_on_critical_range = (float*)malloc(sizeof(float) * (critical_range_length));
-    float* weights_for_downup = (float*)malloc(sizeof(float) * (critical_range_length));
+    float* densities_resid_on_critical_range = ns_isocut5::buffer(ws.densities_resid_on_critical_range, critical_range_length);
+    float* densities_resid_fit_on_critical_range = ns_isocut5::buffer(ws.densities_resid_fit_on_critical_range, critical_range_length);
+    float* weights_for_downup = ns_isocut5::buffer(ws.weights_for_downup, critical_range_length);
     for (bigint i = 0; i < critical_range_length; i++) {
         densities_resid_on_critical_range[i] = densities_resid[critical_range_min + i];
         weights_for_downup[i] = spacings[critical_range_min + i];
     }
-    jisotonic5_downup(critical_range_length, densities_resid_fit_on_critical_range, densities_resid_on_critical_range, weights_for_downup);
+    jisotonic5_downup(critical_range_length, densities_resid_fit_on_critical_range, densities_resid_on_critical_range, weights_for_downup, ws.jisotonic);
 
     bigint cutpoint_index = ns_isocut5::find_min_index(critical_range_length, densities_resid_fit_on_critical_range);
     *cutpoint_out = (X_sub[critical_range_min + cutpoint_index] + X_sub[critical_range_min + cutpoint_index + 1]) / 2;
-
-    free(samples_sorted);
-    free(densities_unimodal_fit);
-    free(densities_resid);
-    free(weights_for_downup);
-    free(intervals);
-    free(inds);
-    free(X_sub);
-    free(multiplicities);
-    free(spacings);
-    free(densities);
-    free(densities_unimodal_fit_times_spacings);
-    free(densities_resid_on_critical_range);
-    free(densities_resid_fit_on_critical_range);
 }
 
 void isocut5_old(double* dipscore_out, double* cutpoint_out, bigint N, float* samples, isocut5_opts opts)
@@ -238,7 +245,7 @@ double compute_ks4(bigint N, float* counts1, float* counts2)
     return max_diff * sqrt((sum_counts1 + sum_counts2) / 2);
 }
 
-double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigint N, float* counts1, float* counts2, bigint peak_index)
+double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigint N, float* counts1, float* counts2, bigint peak_index, isocut5_workspace& ws)
 {
     *critical_range_min = 0;
     *critical_range_max = N - 1; //should get over-written!
@@ -246,8 +253,8 @@ double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigin
 
     // from the left
     {
-        float* counts1_left = (float*)malloc(sizeof(float) * (peak_index + 1));
-        float* counts2_left = (float*)malloc(sizeof(float) * (peak_index + 1));
+        float* counts1_left = buffer(ws.counts1_tmp, peak_index + 1);
+        float* counts2_left = buffer(ws.counts2_tmp, peak_index + 1);
         for (bigint i = 0; i <= peak_index; i++) {
             counts1_left[i] = counts1[i];
             counts2_left[i] = counts2[i];
@@ -266,8 +273,8 @@ double compute_ks5(bigint* critical_range_min, bigint* critical_range_max, bigin
 
     // from the right
     {
-        float* counts1_right = (float*)malloc(sizeof(float) * (N - peak_index));
-        float* counts2_right = (float*)malloc(sizeof(float) * (N - peak_index));
+        float* counts1_right = buffer(ws.counts1_tmp, N - peak_index);
+        float* counts2_right = buffer(ws.counts2_tmp, N - peak_index);
         for (bigint i = 0; i < N - peak_index; i++) {
             counts1_right[i] = counts1[N - 1 - i];
             counts2_right[i] = counts2[N - 1 - i];
@@ -3,6 +3,7 @@
 
 //#include "mlcommon.h"
 #include <stdlib.h>
+#include "jisotonic5.h"
 
 typedef int64_t bigint;
 
@@ -10,7 +11,21 @@ struct isocut5_opts {
     bool already_sorted = false;
 };
 
+// Scratch buffers for isocut5, which grow as needed and are reused from call to call.
+// The overload without a workspace uses one per thread.
+struct isocut5_workspace {
+    std::vector<float> samples_sorted, intervals, inds, X_sub, densities, spacings, multiplicities;
+    std::vector<float> densities_unimodal_fit, densities_resid, densities_unimodal_fit_times_spacings;
+    std::vector<float> densities_resid_on_critical_range, densities_resid_fit_on_critical_range, weights_for_downup;
+    std::vector<float> counts1_tmp, counts2_tmp;
+    jisotonic5_workspace jisotonic;
+};
+
 void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* samples, isocut5_opts opts);
+void isocut5(double* dipscore_out, double* cutpoint_out, bigint N, float* samples, isocut5_opts opts, isocut5_workspace& ws);
+
+// Runs isocut5 on many 1-D sample sets in parallel (sample set j has N[j] entries)
+void isocut5_batch(double* dipscores_out, double* cutpoints_out, bigint num_sample_sets, const bigint* N, float* const* sample_sets, isocut5_opts opts);
 
 /*
  * MCWRAP [ dipscore[1,1], cutpoint[1,1] ] = isocut5_mex(samples[1,N])
@@ -1,9 +1,11 @@
 #include "isosplit5.h"
 #include <stdlib.h>
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include <math.h>
 #include "isocut5.h"
+#include "kmeans5.h"
 
 typedef std::vector<std::vector<bigint> > intarray2d;
 void alloc(intarray2d& X, bigint N1, bigint N2)
@@ -15,19 +17,24 @@ void alloc(intarray2d& X, bigint N1, bigint N2)
 }
 
 namespace ns_isosplit5 {
-struct kmeans_opts {
-    bigint num_iterations = 0;
-};
-
 bigint compute_max(bigint N, int* labels);
 bigint compute_max(bigint N, bigint* inds);
 void kmeans_multistep(int* labels, bigint M, bigint N, float* X, bigint K1, bigint K2, bigint K3, kmeans_opts opts);
 void kmeans_maxsize(int* labels, bigint M, bigint N, float* X, bigint maxsize, kmeans_opts opts);
 void compare_clusters(double* dip_score, std::vector<bigint>* new_labels1, std::vector<bigint>* new_labels2, bigint M, bigint N1, bigint N2, float* X1, float* X2, float* centroid1, float* centroid2);
-void compute_centroids(float* centroids, bigint M, bigint N, bigint Kmax, float* X, int* labels, std::vector<bigint>& clusters_to_compute_vec);
-void compute_covmats(float* covmats, bigint M, bigint N, bigint Kmax, float* X, int* labels, float* centroids, std::vector<bigint>& clusters_to_compute_vec);
+// The members of a cluster together with running sums from which its centroid and covariance matrix are obtained.
+// The sums are taken relative to a reference point near the cluster (so that the covariance does not suffer from cancellation)
+// and are updated by the points that move, so that an iteration costs O(points moved) rather than O(N)
+struct cluster_stats {
+    std::vector<bigint> indices; //sorted
+    std::vector<double> offset; //reference point (M)
+    std::vector<double> sum; //sum of (x-offset) (M)
+    std::vector<double> sumsqr; //sum of (x-offset)*(x-offset)' (MxM)
+};
+void init_cluster_stats(std::vector<cluster_stats>& clusters, float* centroids, float* covmats, bigint M, bigint N, bigint Kmax, float* X, int* labels);
+void update_cluster_stats(std::vector<cluster_stats>& clusters, float* centroids, float* covmats, bigint M, float* X, int* labels, const std::vector<bigint>& moved_inds, const std::vector<int>& moved_from);
 void get_pairs_to_compare(std::vector<bigint>* inds1, std::vector<bigint>* inds2, bigint M, bigint K, float* active_centroids, const intarray2d& active_comparisons_made);
-void compare_pairs(std::vector<bigint>* clusters_changed, bigint* total_num_label_changes, bigint M, bigint N, float* X, int* labels, const std::vector<bigint>& inds1, const std::vector<bigint>& inds2, const isosplit5_opts& opts, float* centroids, float* covmats); //the labels are updated
+void compare_pairs(std::vector<bigint>* clusters_changed, std::vector<bigint>* moved_inds, std::vector<int>* moved_from, bigint M, float* X, int* labels, const std::vector<cluster_stats>& clusters, const std::vector<bigint>& inds1, const std::vector<bigint>& inds2, const isosplit5_opts& opts, float* centroids, float* covmats); //the labels are updated
 }
 
 namespace smi {
@@ -202,7 +209,7 @@ void parcelate2(int* labels, bigint M, bigint N, float* X, bigint target_parcel_
                             double val = X[m + M * inds[iii[j]]] - X[m + M * inds[i]];
                             dist += val * val;
                         }
-                        dist = sqrt(dist);
+                        //squared distance is enough for the comparison
                         if ((best_pt < 0) || (dist < best_dist)) {
                             best_dist = dist;
                             best_pt = j;
@@ -266,16 +273,10 @@ void isosplit5(int* labels, bigint M, bigint N, float* X, isosplit5_opts opts)
 
     float* centroids = (float*)malloc(sizeof(float) * M * Kmax);
     float* covmats = (float*)malloc(sizeof(float) * M * M * Kmax);
-    std::vector<bigint> clusters_to_compute_vec;
-    for (bigint k = 0; k < Kmax; k++)
-        clusters_to_compute_vec.push_back(1);
-    ns_isosplit5::compute_centroids(centroids, M, N, Kmax, X, labels, clusters_to_compute_vec);
-    ns_isosplit5::compute_covmats(covmats, M, N, Kmax, X, labels, centroids, clusters_to_compute_vec);
+    std::vector<ns_isosplit5::cluster_stats> clusters;
+    ns_isosplit5::init_cluster_stats(clusters, centroids, covmats, M, N, Kmax, X, labels);
 
     // The active labels are those that are still being used -- for now, everything is active
-    int active_labels_vec[Kmax];
-    for (bigint i = 0; i < Kmax; i++)
-        active_labels_vec[i] = 1;
     std::vector<int> active_labels;
     for (bigint i = 0; i < Kmax; i++)
         active_labels.push_back(i + 1);
@@ -295,10 +296,6 @@ void isosplit5(int* labels, bigint M, bigint N, float* X, isosplit5_opts opts)
         bigint iteration_number = 0;
         while (true) { //iterations
 
-            std::vector<bigint> clusters_changed_vec_in_iteration(Kmax); //Keep track of the clusters that have changed in this iteration so that we can update centroids and covmats
-            for (bigint i = 0; i < Kmax; i++)
-                clusters_changed_vec_in_iteration[i] = 0;
-
             iteration_number++;
             if (iteration_number > opts.max_iterations_per_pass) {
                 printf("Warning: max iterations per pass exceeded.\n");
@@ -339,11 +336,11 @@ void isosplit5(int* labels, bigint M, bigint N, float* X, isosplit5_opts opts)
 
                 // Actually compare the pairs -- in principle this operation could be parallelized
                 std::vector<bigint> clusters_changed;
-                bigint total_num_label_changes = 0;
-                ns_isosplit5::compare_pairs(&clusters_changed, &total_num_label_changes, M, N, X, labels, inds1b, inds2b, opts, centroids, covmats); //the labels are updated
+                std::vector<bigint> moved_inds;
+                std::vector<int> moved_from;
+                ns_isosplit5::compare_pairs(&clusters_changed, &moved_inds, &moved_from, M, X, labels, clusters, inds1b, inds2b, opts, centroids, covmats); //the labels are updated
                 for (bigint i = 0; i < (bigint)clusters_changed.size(); i++) {
                     clusters_changed_vec_in_pass[clusters_changed[i] - 1] = 1;
-                    clusters_changed_vec_in_iteration[clusters_changed[i] - 1] = 1;
                 }
 
                 // Update which comparisons have been made
@@ -352,21 +349,16 @@ void isosplit5(int* labels, bigint M, bigint N, float* X, isosplit5_opts opts)
                     comparisons_made[inds2b[j] - 1][inds1b[j] - 1] = 1;
                 }
 
-                // Recompute the centers for those that have changed in this iteration
-                ns_isosplit5::compute_centroids(centroids, M, N, Kmax, X, labels, clusters_changed_vec_in_iteration);
-                ns_isosplit5::compute_covmats(covmats, M, N, Kmax, X, labels, centroids, clusters_changed_vec_in_iteration);
+                // Update the members, centers and covariance matrices of those that have changed in this iteration
+                ns_isosplit5::update_cluster_stats(clusters, centroids, covmats, M, X, labels, moved_inds, moved_from);
 
                 // For diagnostics
-                //printf ("total num label changes = %d\n",total_num_label_changes);
+                //printf ("total num label changes = %d\n",moved_inds.size());
 
                 // Determine whether something has merged and update the active labels
-                for (bigint i = 0; i < Kmax; i++)
-                    active_labels_vec[i] = 0;
-                for (bigint i = 0; i < N; i++)
-                    active_labels_vec[labels[i] - 1] = 1;
                 std::vector<int> new_active_labels;
                 for (bigint i = 0; i < Kmax; i++)
-                    if (active_labels_vec[i])
+                    if (!clusters[i].indices.empty())
                         new_active_labels.push_back(i + 1);
                 if (new_active_labels.size() < active_labels.size())
                     something_merged = true;
@@ -551,7 +543,7 @@ bigint compute_max(bigint N, bigint* inds)
 }
 */
 
-void kmeans_initialize(double* centroids, bigint M, bigint N, bigint K, float* X)
+void kmeans_initialize(float* centroids, bigint M, bigint N, bigint K, float* X)
 {
     std::vector<bigint> used(N);
     for (bigint i = 0; i < N; i++)
@@ -575,72 +567,26 @@ void kmeans_initialize(double* centroids, bigint M, bigint N, bigint K, float* X
         }
     }
 }
-double compute_dist(bigint M, float* X, double* Y)
-{
-    double sumsqr = 0;
-    for (bigint m = 0; m < M; m++) {
-        double val = X[m] - Y[m];
-        sumsqr += val * val;
-    }
-    return sqrt(sumsqr);
-}
-
-bigint kmeans_assign2(bigint M, bigint K, float* X0, double* centroids)
-{
-    bigint ret = 0;
-    double best_dist = 0;
-    for (bigint k = 1; k <= K; k++) {
-        double dist = compute_dist(M, X0, &centroids[M * (k - 1)]);
-        if ((ret == 0) || (dist < best_dist)) {
-            best_dist = dist;
-            ret = k;
-        }
-    }
-    return ret;
-}
-void kmeans_assign(int* labels, bigint M, bigint N, bigint K, float* X, double* centroids)
-{
-    for (bigint i = 0; i < N; i++) {
-        labels[i] = kmeans_assign2(M, K, &X[M * i], centroids);
-    }
-}
-void kmeans_centroids(double* centroids, bigint M, bigint N, bigint K, float* X, int* labels)
-{
-    std::vector<bigint> counts(K);
-    for (bigint k = 1; k <= K; k++) {
-        counts[k - 1] = 0;
-        for (bigint m = 0; m < M; m++) {
-            centroids[m + (k - 1) * M] = 0;
-        }
-    }
-    for (bigint i = 0; i < N; i++) {
-        bigint k = labels[i];
-        for (bigint m = 0; m < M; m++) {
-            centroids[m + (k - 1) * M] += X[m + i * M];
-        }
-        counts[k - 1]++;
-    }
-    for (bigint k = 1; k <= K; k++) {
-        if (counts[k - 1]) {
-            for (bigint m = 0; m < M; m++) {
-                centroids[m + (k - 1) * M] /= counts[k - 1];
-            }
-        }
-    }
-}
 
 void kmeans(int* labels, bigint M, bigint N, float* X, bigint K, kmeans_opts opts)
 {
     if (K > N)
         K = N;
-    double* centroids = (double*)malloc(sizeof(double) * M * K);
-    kmeans_initialize(centroids, M, N, K, X);
-    for (bigint it = 1; it <= opts.num_iterations; it++) {
-        kmeans_assign(labels, M, N, K, X, centroids);
-        kmeans_centroids(centroids, M, N, K, X, labels);
+    if (K <= 0)
+        return;
+    std::vector<float> centroids(M * K);
+    kmeans5_opts oo;
+    oo.max_iterations = opts.num_iterations;
+    if (opts.kmeans_plus_plus) {
+        oo.seeding = kmeans5_seed_plusplus;
+        oo.seed = rand();
     }
-    kmeans_assign(labels, M, N, K, X, centroids);
-    free(centroids);
+    else {
+        //same seeds as before, so that the labels do not change
+        kmeans_initialize(centroids.data(), M, N, K, X);
+        oo.seeding = kmeans5_seed_given;
+    }
+    kmeans5(labels, centroids.data(), M, N, X, K, oo);
 }
 
 void extract_subarray(float* X_sub, bigint M, float* X, const std::vector<bigint>& inds)
@@ -775,78 +721,123 @@ void compare_clusters(double* dip_score, std::vector<bigint>* new_labels1, std::
     free(V);
 }
 
-void compute_centroids(float* centroids, bigint M, bigint N, bigint Kmax, float* X, int* labels, std::vector<bigint>& cluster_to_compute_vec)
+void recompute_cluster_stats(cluster_stats& C, bigint M, float* X)
 {
-    std::vector<double> C(M * Kmax);
-    for (bigint jj = 0; jj < M * Kmax; jj++)
-        C[jj] = 0;
-    std::vector<double> counts(Kmax);
-    for (bigint k = 0; k < Kmax; k++)
-        counts[k] = 0;
-    for (bigint i = 0; i < N; i++) {
-        bigint k0 = labels[i];
-        bigint i0 = k0 - 1;
-        if (cluster_to_compute_vec[i0]) {
-            for (bigint m = 0; m < M; m++) {
-                C[m + M * i0] += X[m + M * i];
-            }
-            counts[i0]++;
-        }
+    bigint n = C.indices.size();
+    C.offset.assign(M, 0);
+    C.sum.assign(M, 0);
+    C.sumsqr.assign(M * M, 0);
+    if (!n)
+        return;
+    for (bigint i = 0; i < n; i++) {
+        for (bigint m = 0; m < M; m++)
+            C.offset[m] += X[m + M * C.indices[i]];
     }
-    for (bigint k = 0; k < Kmax; k++) {
-        if (cluster_to_compute_vec[k]) {
-            if (counts[k]) {
-                for (bigint m = 0; m < M; m++) {
-                    C[m + M * k] /= counts[k];
-                }
+    for (bigint m = 0; m < M; m++)
+        C.offset[m] /= n;
+    std::vector<double> y(M);
+    for (bigint i = 0; i < n; i++) {
+        for (bigint m = 0; m < M; m++) {
+            y[m] = X[m + M * C.indices[i]] - C.offset[m];
+            C.sum[m] += y[m];
+        }
+        for (bigint m2 = 0; m2 < M; m2++) {
+            for (bigint m1 = 0; m1 < M; m1++) {
+                C.sumsqr[m1 + M * m2] += y[m1] * y[m2];
             }
         }
     }
-    for (bigint k = 0; k < Kmax; k++) {
-        if (cluster_to_compute_vec[k]) {
-            for (bigint m = 0; m < M; m++) {
-                centroids[m + k * M] = C[m + k * M];
-            }
+}
+
+void add_to_cluster_stats(cluster_stats& C, bigint M, float* X0, double sign)
+{
+    std::vector<double> y(M);
+    for (bigint m = 0; m < M; m++) {
+        y[m] = X0[m] - C.offset[m];
+        C.sum[m] += sign * y[m];
+    }
+    for (bigint m2 = 0; m2 < M; m2++) {
+        for (bigint m1 = 0; m1 < M; m1++) {
+            C.sumsqr[m1 + M * m2] += sign * y[m1] * y[m2];
         }
     }
 }
 
-void compute_covmats(float* covmats, bigint M, bigint N, bigint Kmax, float* X, int* labels, float* centroids, std::vector<bigint>& clusters_to_compute_vec)
+void get_centroid_and_covmat(float* centroid, float* covmat, const cluster_stats& C, bigint M)
 {
-    std::vector<double> C(M * M * Kmax);
-    for (bigint jj = 0; jj < M * M * Kmax; jj++)
-        C[jj] = 0;
-    std::vector<double> counts(Kmax);
-    for (bigint k = 0; k < Kmax; k++)
-        counts[k] = 0;
-    for (bigint i = 0; i < N; i++) {
-        bigint i0 = labels[i] - 1;
-        if (clusters_to_compute_vec[i0]) {
-            for (bigint m1 = 0; m1 < M; m1++) {
-                for (bigint m2 = 0; m2 < M; m2++) {
-                    C[m1 + M * m2 + M * M * i0] += (X[m1 + M * i] - centroids[m1 + i0 * M]) * (X[m2 + M * i] - centroids[m2 + i0 * M]);
-                }
-            }
-            counts[i0]++;
+    bigint n = C.indices.size();
+    if (!n) {
+        for (bigint m = 0; m < M; m++)
+            centroid[m] = 0;
+        for (bigint mm = 0; mm < M * M; mm++)
+            covmat[mm] = 0;
+        return;
+    }
+    std::vector<double> mu(M);
+    for (bigint m = 0; m < M; m++) {
+        mu[m] = C.sum[m] / n;
+        centroid[m] = C.offset[m] + mu[m];
+    }
+    for (bigint m2 = 0; m2 < M; m2++) {
+        for (bigint m1 = 0; m1 < M; m1++) {
+            covmat[m1 + M * m2] = C.sumsqr[m1 + M * m2] / n - mu[m1] * mu[m2];
         }
     }
+}
+
+void init_cluster_stats(std::vector<cluster_stats>& clusters, float* centroids, float* covmats, bigint M, bigint N, bigint Kmax, float* X, int* labels)
+{
+    clusters.clear();
+    clusters.resize(Kmax);
+    for (bigint i = 0; i < N; i++)
+        clusters[labels[i] - 1].indices.push_back(i);
     for (bigint k = 0; k < Kmax; k++) {
-        if (clusters_to_compute_vec[k]) {
-            if (counts[k]) {
-                for (bigint m1 = 0; m1 < M; m1++) {
-                    for (bigint m2 = 0; m2 < M; m2++) {
-                        C[m1 + m2 * M + M * M * k] /= counts[k];
-                    }
-                }
-            }
-        }
+        recompute_cluster_stats(clusters[k], M, X);
+        get_centroid_and_covmat(&centroids[M * k], &covmats[M * M * k], clusters[k], M);
+    }
+}
+
+void update_cluster_stats(std::vector<cluster_stats>& clusters, float* centroids, float* covmats, bigint M, float* X, int* labels, const std::vector<bigint>& moved_inds, const std::vector<int>& moved_from)
+{
+    bigint Kmax = clusters.size();
+    std::vector<bigint> num_moved(Kmax, 0);
+    std::vector<std::vector<bigint> > incoming(Kmax);
+    for (bigint j = 0; j < (bigint)moved_inds.size(); j++) {
+        bigint i = moved_inds[j];
+        num_moved[moved_from[j] - 1]++;
+        num_moved[labels[i] - 1]++;
+        incoming[labels[i] - 1].push_back(i);
     }
     for (bigint k = 0; k < Kmax; k++) {
-        if (clusters_to_compute_vec[k]) {
-            for (bigint mm = 0; mm < M * M; mm++) {
-                covmats[mm + k * M * M] = C[mm + k * M * M];
-            }
+        if (!num_moved[k])
+            continue;
+        cluster_stats& C = clusters[k];
+        // update the member list: drop the points that left and merge in the (sorted) points that arrived
+        std::vector<bigint> staying;
+        staying.reserve(C.indices.size());
+        for (bigint a = 0; a < (bigint)C.indices.size(); a++) {
+            if (labels[C.indices[a]] == k + 1)
+                staying.push_back(C.indices[a]);
         }
+        std::sort(incoming[k].begin(), incoming[k].end());
+        C.indices.resize(staying.size() + incoming[k].size());
+        std::merge(staying.begin(), staying.end(), incoming[k].begin(), incoming[k].end(), C.indices.begin());
+        if (2 * num_moved[k] > (bigint)C.indices.size()) {
+            // most of the cluster changed (e.g., a merge) -- start over with a reference point at the new centroid
+            recompute_cluster_stats(C, M, X);
+        }
+    }
+    for (bigint j = 0; j < (bigint)moved_inds.size(); j++) {
+        bigint i = moved_inds[j];
+        bigint k1 = moved_from[j] - 1, k2 = labels[i] - 1;
+        if (2 * num_moved[k1] <= (bigint)clusters[k1].indices.size())
+            add_to_cluster_stats(clusters[k1], M, &X[M * i], -1);
+        if (2 * num_moved[k2] <= (bigint)clusters[k2].indices.size())
+            add_to_cluster_stats(clusters[k2], M, &X[M * i], 1);
+    }
+    for (bigint k = 0; k < Kmax; k++) {
+        if (num_moved[k])
+            get_centroid_and_covmat(&centroids[M * k], &covmats[M * M * k], clusters[k], M);
     }
 }
 
@@ -1057,36 +1048,19 @@ bool merge_test(std::vector<bigint>* L12, bigint M, bigint N1, bigint N2, float*
     return do_merge;
 }
 
-void compare_pairs(std::vector<bigint>* clusters_changed, bigint* total_num_label_changes, bigint M, bigint N, float* X, int* labels, const std::vector<bigint>& k1s, const std::vector<bigint>& k2s, const isosplit5_opts& opts, float* centroids, float* covmats)
+void compare_pairs(std::vector<bigint>* clusters_changed, std::vector<bigint>* moved_inds, std::vector<int>* moved_from, bigint M, float* X, int* labels, const std::vector<cluster_stats>& clusters, const std::vector<bigint>& k1s, const std::vector<bigint>& k2s, const isosplit5_opts& opts, float* centroids, float* covmats)
 {
-    bigint Kmax = ns_isosplit5::compute_max(N, labels);
-    std::vector<bigint> clusters_changed_vec(Kmax);
-    for (bigint i = 0; i < Kmax; i++)
-        clusters_changed_vec[i] = 0;
-    int* new_labels = (int*)malloc(sizeof(bigint) * N);
-    *total_num_label_changes = 0;
-    for (bigint i = 0; i < N; i++)
-        new_labels[i] = labels[i];
+    //the pairs are disjoint, so the labels can be updated in place
+    clusters_changed->clear();
+    moved_inds->clear();
+    moved_from->clear();
     for (bigint i1 = 0; i1 < (bigint)k1s.size(); i1++) {
         int k1 = k1s[i1];
         int k2 = k2s[i1];
-        std::vector<bigint> inds1, inds2;
-        for (bigint i = 0; i < N; i++) {
-            if (labels[i] == k1)
-                inds1.push_back(i);
-            if (labels[i] == k2)
-                inds2.push_back(i);
-        }
+        const std::vector<bigint>& inds1 = clusters[k1 - 1].indices;
+        const std::vector<bigint>& inds2 = clusters[k2 - 1].indices;
         if ((inds1.size() > 0) && (inds2.size() > 0)) {
-            std::vector<bigint> inds12;
-            inds12.insert(inds12.end(), inds1.begin(), inds1.end());
-            inds12.insert(inds12.end(), inds2.begin(), inds2.end());
-            std::vector<bigint> L12_old(inds12.size());
-            for (bigint i = 0; i < (bigint)inds1.size(); i++)
-                L12_old[i] = 1;
-            for (bigint i = 0; i < (bigint)inds2.size(); i++)
-                L12_old[inds1.size() + i] = 2;
-            std::vector<bigint> L12(inds12.size());
+            std::vector<bigint> L12(inds1.size() + inds2.size());
 
             bool do_merge;
             if (((bigint)inds1.size() < opts.min_cluster_size) || ((bigint)inds2.size() < opts.min_cluster_size)) {
@@ -1101,45 +1075,38 @@ void compare_pairs(std::vector<bigint>* clusters_changed, bigint* total_num_labe
                 free(X1);
                 free(X2);
             }
+            bigint num_moved_before = moved_inds->size();
             if (do_merge) {
                 for (bigint i = 0; i < (bigint)inds2.size(); i++) {
-                    new_labels[inds2[i]] = k1;
+                    moved_inds->push_back(inds2[i]);
+                    moved_from->push_back(k2);
                 }
-                *total_num_label_changes += inds2.size();
-                clusters_changed_vec[k1 - 1] = 1;
-                clusters_changed_vec[k2 - 1] = 1;
             }
             else {
                 //redistribute
-                bool something_was_redistributed = false;
                 for (bigint i = 0; i < (bigint)inds1.size(); i++) {
                     if (L12[i] == 2) {
-                        new_labels[inds1[i]] = k2;
-                        (*total_num_label_changes)++;
-                        something_was_redistributed = true;
+                        moved_inds->push_back(inds1[i]);
+                        moved_from->push_back(k1);
                     }
                 }
                 for (bigint i = 0; i < (bigint)inds2.size(); i++) {
                     if (L12[inds1.size() + i] == 1) {
-                        new_labels[inds2[i]] = k1;
-                        (*total_num_label_changes)++;
-                        something_was_redistributed = true;
+                        moved_inds->push_back(inds2[i]);
+                        moved_from->push_back(k2);
                     }
                 }
-                if (something_was_redistributed) {
-                    clusters_changed_vec[k1 - 1] = 1;
-                    clusters_changed_vec[k2 - 1] = 1;
-                }
+            }
+            for (bigint j = num_moved_before; j < (bigint)moved_inds->size(); j++) {
+                labels[(*moved_inds)[j]] = ((*moved_from)[j] == k1) ? k2 : k1;
+            }
+            if ((bigint)moved_inds->size() > num_moved_before) {
+                clusters_changed->push_back(k1);
+                clusters_changed->push_back(k2);
             }
         }
     }
-    clusters_changed->clear();
-    for (int k = 0; k < Kmax; k++)
-        if (clusters_changed_vec[k])
-            clusters_changed->push_back(k + 1);
-    for (bigint i = 0; i < N; i++)
-        labels[i] = new_labels[i];
-    free(new_labels);
+    std::sort(clusters_changed->begin(), clusters_changed->end());
 }
 }
 
@@ -14,12 +14,21 @@ struct isosplit5_opts {
 
 void isosplit5(int* labels_out, bigint M, bigint N, float* X, isosplit5_opts opts);
 
+//the k-means used for the initial parcelation, exposed for benchmarking
+namespace ns_isosplit5 {
+struct kmeans_opts {
+    bigint num_iterations = 0;
+    bool kmeans_plus_plus = false; //k-means++ seeding rather than K random data points
+};
+void kmeans(int* labels, bigint M, bigint N, float* X, bigint K, kmeans_opts opts);
+}
+
 /*
  * MCWRAP [ labels_out[1,N] ] = isosplit5_mex(X[M,N])
  * SET_INPUT M = size(X,1)
  * SET_INPUT N = size(X,2)
- * SOURCES isosplit5.cpp isocut5.cpp jisotonic5.cpp
- * HEADERS isosplit5.h isocut5.h jisotonic5.h
+ * SOURCES isosplit5.cpp isocut5.cpp jisotonic5.cpp kmeans5.cpp
+ * HEADERS isosplit5.h isocut5.h jisotonic5.h kmeans5.h
  */
 void isosplit5_mex(double* labels_out, int M, int N, double* X);
 
@@ -11,12 +11,20 @@ CONFIG -= app_bundle
 
 TEMPLATE = app
 
+#OPENMP
+!macx {
+  QMAKE_LFLAGS += -fopenmp
+  QMAKE_CXXFLAGS += -fopenmp
+}
+
 SOURCES += main.cpp \
     isocut5.cpp \
     jisotonic5.cpp \
-    isosplit5.cpp
+    isosplit5.cpp \
+    kmeans5.cpp
 
 HEADERS += \
     isocut5.h \
     jisotonic5.h \
-    isosplit5.h
+    isosplit5.h \
+    kmeans5.h
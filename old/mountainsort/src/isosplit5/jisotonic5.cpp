@@ -2,17 +2,54 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 
+namespace ns_jisotonic5 {
+jisotonic5_workspace& thread_workspace()
+{
+    static thread_local jisotonic5_workspace ws;
+    return ws;
+}
+
+template <typename T>
+T* buffer(std::vector<T>& X, bigint N)
+{
+    if ((bigint)X.size() < N)
+        X.resize(N);
+    return X.data();
+}
+}
+
 void jisotonic5(bigint N, float* BB, float* MSE, float* AA, float* WW)
+{
+    jisotonic5(N, BB, MSE, AA, WW, ns_jisotonic5::thread_workspace());
+}
+
+void jisotonic5_updown(bigint N, float* out, float* in, float* weights)
+{
+    jisotonic5_updown(N, out, in, weights, ns_jisotonic5::thread_workspace());
+}
+
+void jisotonic5_downup(bigint N, float* out, float* in, float* weights)
+{
+    jisotonic5_downup(N, out, in, weights, ns_jisotonic5::thread_workspace());
+}
+
+void jisotonic5_sort(bigint N, float* out, const float* in)
+{
+    jisotonic5_sort(N, out, in, ns_jisotonic5::thread_workspace());
+}
+
+void jisotonic5(bigint N, float* BB, float* MSE, float* AA, float* WW, jisotonic5_workspace& ws)
 {
     if (N < 1)
         return;
 
-    float* unweightedcount = (float*)malloc(sizeof(float) * N);
-    float* count = (float*)malloc(sizeof(float) * N);
-    float* sum = (float*)malloc(sizeof(float) * N);
-    float* sumsqr = (float*)malloc(sizeof(float) * N);
+    float* unweightedcount = ns_jisotonic5::buffer(ws.unweightedcount, N);
+    float* count = ns_jisotonic5::buffer(ws.count, N);
+    float* sum = ns_jisotonic5::buffer(ws.sum, N);
+    float* sumsqr = ns_jisotonic5::buffer(ws.sumsqr, N);
     bigint last_index = -1;
 
     last_index++;
@@ -62,33 +99,30 @@ void jisotonic5(bigint N, float* BB, float* MSE, float* AA, float* WW)
         }
         ii += unweightedcount[k];
     }
-
-    free(unweightedcount);
-    free(count);
-    free(sum);
-    free(sumsqr);
 }
 
-void jisotonic5_updown(bigint N, float* out, float* in, float* weights)
+void jisotonic5_updown(bigint N, float* out, float* in, float* weights, jisotonic5_workspace& ws)
 {
-    float* B1 = (float*)malloc(sizeof(float) * N);
-    float* MSE1 = (float*)malloc(sizeof(float) * N);
-    float* B2 = (float*)malloc(sizeof(float) * N);
-    float* MSE2 = (float*)malloc(sizeof(float) * N);
-    float* in_reversed = (float*)malloc(sizeof(float) * N);
+    if (N < 1)
+        return;
+    float* B1 = ns_jisotonic5::buffer(ws.B1, N);
+    float* MSE1 = ns_jisotonic5::buffer(ws.MSE1, N);
+    float* B2 = ns_jisotonic5::buffer(ws.B2, N);
+    float* MSE2 = ns_jisotonic5::buffer(ws.MSE2, N);
+    float* in_reversed = ns_jisotonic5::buffer(ws.in_reversed, N);
     float* weights_reversed = 0;
 
     for (bigint j = 0; j < N; j++) {
         in_reversed[j] = in[N - 1 - j];
     }
     if (weights) {
-        weights_reversed = (float*)malloc(sizeof(float) * N);
+        weights_reversed = ns_jisotonic5::buffer(ws.weights_reversed, N);
         for (bigint j = 0; j < N; j++) {
             weights_reversed[j] = weights[N - 1 - j];
         }
     }
-    jisotonic5(N, B1, MSE1, in, weights);
-    jisotonic5(N, B2, MSE2, in_reversed, weights_reversed);
+    jisotonic5(N, B1, MSE1, in, weights, ws);
+    jisotonic5(N, B2, MSE2, in_reversed, weights_reversed, ws);
     for (bigint j = 0; j < N; j++)
         MSE1[j] += MSE2[N - 1 - j];
     float bestval = MSE1[0];
@@ -99,42 +133,68 @@ void jisotonic5_updown(bigint N, float* out, float* in, float* weights)
             best_ind = j;
         }
     }
-    jisotonic5(best_ind + 1, B1, MSE1, in, weights);
-    jisotonic5(N - best_ind, B2, MSE2, in_reversed, weights_reversed);
+    jisotonic5(best_ind + 1, B1, MSE1, in, weights, ws);
+    jisotonic5(N - best_ind, B2, MSE2, in_reversed, weights_reversed, ws);
     for (bigint j = 0; j <= best_ind; j++)
         out[j] = B1[j];
     for (bigint j = 0; j < N - best_ind - 1; j++)
         out[N - 1 - j] = B2[j];
-
-    free(B1);
-    free(MSE1);
-    free(B2);
-    free(MSE2);
-    free(in_reversed);
-    if (weights_reversed)
-        free(weights_reversed);
 }
 
-void jisotonic5_downup(bigint N, float* out, float* in, float* weights)
+void jisotonic5_downup(bigint N, float* out, float* in, float* weights, jisotonic5_workspace& ws)
 {
-    float* in_neg = (float*)malloc(sizeof(float) * N);
+    // the negated input is kept in its own buffer since updown uses the others
+    float* in_neg = ns_jisotonic5::buffer(ws.in_neg, N);
 
     for (bigint j = 0; j < N; j++)
         in_neg[j] = -in[j];
-    jisotonic5_updown(N, out, in_neg, weights);
+    jisotonic5_updown(N, out, in_neg, weights, ws);
     for (bigint j = 0; j < N; j++)
         out[j] = -out[j];
-
-    free(in_neg);
 }
 
-void jisotonic5_sort(bigint N, float* out, const float* in)
+void jisotonic5_sort(bigint N, float* out, const float* in, jisotonic5_workspace& ws)
 {
-    std::copy(in, in + N, out);
-    std::sort(out, out + N);
+    if (N < 1024) {
+        std::copy(in, in + N, out);
+        std::sort(out, out + N);
+        return;
+    }
 
-    //	QVector<float> in0(N);
-    //	for (bigint j=0; j<N; j++) in0[j]=in[j];
-    //	qSort(in0);
-    //	for (bigint j=0; j<N; j++) out[j]=in0[j];
+    // LSD radix sort, 3 passes of 11 bits, on the bit patterns mapped so that unsigned order is float order.
+    // -0 is first made +0: the mapping would order it before +0, whereas they compare equal for std::sort
+    uint32_t* keys = ns_jisotonic5::buffer(ws.sort_keys, N);
+    uint32_t* tmp = ns_jisotonic5::buffer(ws.sort_keys_tmp, N);
+    memcpy(keys, in, sizeof(float) * N);
+    for (bigint i = 0; i < N; i++) {
+        if (keys[i] == 0x80000000)
+            keys[i] = 0;
+        uint32_t mask = (keys[i] & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+        keys[i] ^= mask;
+    }
+    bigint hist[3][2048];
+    memset(hist, 0, sizeof(hist));
+    for (bigint i = 0; i < N; i++) {
+        hist[0][keys[i] & 0x7FF]++;
+        hist[1][(keys[i] >> 11) & 0x7FF]++;
+        hist[2][keys[i] >> 22]++;
+    }
+    for (int pass = 0; pass < 3; pass++) {
+        bigint offset = 0;
+        for (int b = 0; b < 2048; b++) {
+            bigint ct = hist[pass][b];
+            hist[pass][b] = offset;
+            offset += ct;
+        }
+        int shift = 11 * pass;
+        for (bigint i = 0; i < N; i++) {
+            tmp[hist[pass][(keys[i] >> shift) & 0x7FF]++] = keys[i];
+        }
+        std::swap(keys, tmp);
+    }
+    for (bigint i = 0; i < N; i++) {
+        uint32_t mask = (keys[i] & 0x80000000) ? 0x80000000 : 0xFFFFFFFF;
+        keys[i] ^= mask;
+    }
+    memcpy(out, keys, sizeof(float) * N);
 }
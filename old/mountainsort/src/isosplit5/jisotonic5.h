@@ -7,12 +7,27 @@
 #define jisotonic5_h
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <vector>
 
 typedef int64_t bigint;
 
+// Scratch buffers for the functions below, which grow as needed and are reused from call to call.
+// The overloads without a workspace use one per thread.
+struct jisotonic5_workspace {
+    std::vector<float> unweightedcount, count, sum, sumsqr;
+    std::vector<float> B1, MSE1, B2, MSE2, in_reversed, weights_reversed, in_neg;
+    std::vector<uint32_t> sort_keys, sort_keys_tmp;
+};
+
 void jisotonic5(bigint N, float* BB, float* MSE, float* AA, float* WW);
 void jisotonic5_updown(bigint N, float* out, float* in, float* weights);
 void jisotonic5_downup(bigint N, float* out, float* in, float* weights);
 void jisotonic5_sort(bigint N, float* out, const float* in);
 
+void jisotonic5(bigint N, float* BB, float* MSE, float* AA, float* WW, jisotonic5_workspace& ws);
+void jisotonic5_updown(bigint N, float* out, float* in, float* weights, jisotonic5_workspace& ws);
+void jisotonic5_downup(bigint N, float* out, float* in, float* weights, jisotonic5_workspace& ws);
+void jisotonic5_sort(bigint N, float* out, const float* in, jisotonic5_workspace& ws); //radix sort for large N
+
 #endif
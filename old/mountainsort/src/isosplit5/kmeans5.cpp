@@ -0,0 +1,215 @@
+#include "kmeans5.h"
+#include <vector>
+#include <random>
+#include <math.h>
+#include <string.h>
+
+namespace ns_kmeans5 {
+
+// written so that the compiler can vectorize it (the reduction order is allowed to change)
+inline float distsqr(bigint M, const float* X, const float* Y)
+{
+    float sum = 0;
+#pragma omp simd reduction(+ : sum)
+    for (bigint m = 0; m < M; m++) {
+        float diff = X[m] - Y[m];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+void seed_random(float* centroids, bigint M, bigint N, const float* X, bigint K, std::mt19937& generator);
+void seed_plusplus(float* centroids, bigint M, bigint N, const float* X, bigint K, std::mt19937& generator);
+void full_assign(int* label, double* upper, double* lower, bigint M, const float* X0, bigint K, const float* centroids);
+}
+
+bigint kmeans5(int* labels, float* centroids_inout, bigint M, bigint N, const float* X, bigint K, kmeans5_opts opts)
+{
+    if (K > N)
+        K = N;
+    if ((K <= 0) || (M <= 0))
+        return 0;
+
+    std::vector<float> centroids(M * K);
+    if (opts.seeding == kmeans5_seed_given) {
+        memcpy(centroids.data(), centroids_inout, sizeof(float) * M * K);
+    }
+    else {
+        std::mt19937 generator(opts.seed);
+        if (opts.seeding == kmeans5_seed_plusplus)
+            ns_kmeans5::seed_plusplus(centroids.data(), M, N, X, K, generator);
+        else
+            ns_kmeans5::seed_random(centroids.data(), M, N, X, K, generator);
+    }
+
+    // Hamerly's bounds: upper[i] >= distance to the assigned centroid, lower[i] <= distance to every other centroid
+    std::vector<double> upper(N), lower(N);
+    std::vector<int> old_labels(N);
+    std::vector<double> sums(M * K, 0);
+    std::vector<bigint> counts(K, 0);
+    std::vector<double> half_sep(K), drift(K);
+
+#pragma omp parallel for
+    for (bigint i = 0; i < N; i++) {
+        ns_kmeans5::full_assign(&labels[i], &upper[i], &lower[i], M, &X[M * i], K, centroids.data());
+    }
+    for (bigint i = 0; i < N; i++) {
+        bigint k = labels[i] - 1;
+        for (bigint m = 0; m < M; m++)
+            sums[m + M * k] += X[m + M * i];
+        counts[k]++;
+    }
+
+    bigint it = 0;
+    while (it < opts.max_iterations) {
+        it++;
+
+        // centroid update (an empty cluster keeps its centroid)
+        for (bigint k = 0; k < K; k++) {
+            float* c = &centroids[M * k];
+            double dd = 0;
+            if (counts[k]) {
+                for (bigint m = 0; m < M; m++) {
+                    float val = sums[m + M * k] / counts[k];
+                    dd += (val - c[m]) * (val - c[m]);
+                    c[m] = val;
+                }
+            }
+            drift[k] = sqrt(dd);
+        }
+        bigint r1 = 0, r2 = -1; // the two largest drifts
+        for (bigint k = 1; k < K; k++) {
+            if (drift[k] > drift[r1]) {
+                r2 = r1;
+                r1 = k;
+            }
+            else if ((r2 < 0) || (drift[k] > drift[r2])) {
+                r2 = k;
+            }
+        }
+        for (bigint k = 0; k < K; k++) {
+            double best = -1;
+            for (bigint k2 = 0; k2 < K; k2++) {
+                if (k2 == k)
+                    continue;
+                double d0 = ns_kmeans5::distsqr(M, &centroids[M * k], &centroids[M * k2]);
+                if ((best < 0) || (d0 < best))
+                    best = d0;
+            }
+            half_sep[k] = (best < 0) ? 0 : sqrt(best) / 2;
+        }
+
+        // reassignment, skipping the points whose bounds show that their label cannot change
+        bigint num_changed = 0;
+#pragma omp parallel for reduction(+ : num_changed)
+        for (bigint i = 0; i < N; i++) {
+            bigint k = labels[i] - 1;
+            old_labels[i] = labels[i];
+            upper[i] += drift[k];
+            lower[i] -= (k == r1) ? ((r2 >= 0) ? drift[r2] : 0) : drift[r1];
+            double z = (half_sep[k] > lower[i]) ? half_sep[k] : lower[i];
+            if (upper[i] <= z)
+                continue;
+            upper[i] = sqrt(ns_kmeans5::distsqr(M, &X[M * i], &centroids[M * k]));
+            if (upper[i] <= z)
+                continue;
+            ns_kmeans5::full_assign(&labels[i], &upper[i], &lower[i], M, &X[M * i], K, centroids.data());
+            if (labels[i] != old_labels[i])
+                num_changed++;
+        }
+        if (!num_changed)
+            break; // the centroids would not move again
+        for (bigint i = 0; i < N; i++) {
+            if (labels[i] != old_labels[i]) {
+                bigint k1 = old_labels[i] - 1, k2 = labels[i] - 1;
+                for (bigint m = 0; m < M; m++) {
+                    sums[m + M * k1] -= X[m + M * i];
+                    sums[m + M * k2] += X[m + M * i];
+                }
+                counts[k1]--;
+                counts[k2]++;
+            }
+        }
+    }
+
+    if (centroids_inout)
+        memcpy(centroids_inout, centroids.data(), sizeof(float) * M * K);
+    return it;
+}
+
+namespace ns_kmeans5 {
+
+void seed_random(float* centroids, bigint M, bigint N, const float* X, bigint K, std::mt19937& generator)
+{
+    // partial Fisher-Yates shuffle
+    std::vector<bigint> inds(N);
+    for (bigint i = 0; i < N; i++)
+        inds[i] = i;
+    for (bigint k = 0; k < K; k++) {
+        std::uniform_int_distribution<bigint> dist(k, N - 1);
+        std::swap(inds[k], inds[dist(generator)]);
+        memcpy(&centroids[M * k], &X[M * inds[k]], sizeof(float) * M);
+    }
+}
+
+void seed_plusplus(float* centroids, bigint M, bigint N, const float* X, bigint K, std::mt19937& generator)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<float> D(N);
+    bigint i0 = std::uniform_int_distribution<bigint>(0, N - 1)(generator);
+    memcpy(&centroids[0], &X[M * i0], sizeof(float) * M);
+#pragma omp parallel for
+    for (bigint i = 0; i < N; i++) {
+        D[i] = distsqr(M, &X[M * i], &centroids[0]);
+    }
+    for (bigint k = 1; k < K; k++) {
+        double total = 0;
+        for (bigint i = 0; i < N; i++)
+            total += D[i];
+        bigint ii = N - 1;
+        if (total > 0) {
+            double r = uniform(generator) * total;
+            double cumsum = 0;
+            for (bigint i = 0; i < N; i++) {
+                cumsum += D[i];
+                if ((cumsum >= r) && (D[i] > 0)) {
+                    ii = i;
+                    break;
+                }
+            }
+        }
+        else {
+            ii = std::uniform_int_distribution<bigint>(0, N - 1)(generator); //all points coincide with the seeds
+        }
+        float* c = &centroids[M * k];
+        memcpy(c, &X[M * ii], sizeof(float) * M);
+#pragma omp parallel for
+        for (bigint i = 0; i < N; i++) {
+            float d0 = distsqr(M, &X[M * i], c);
+            if (d0 < D[i])
+                D[i] = d0;
+        }
+    }
+}
+
+void full_assign(int* label, double* upper, double* lower, bigint M, const float* X0, bigint K, const float* centroids)
+{
+    // nearest and second nearest centroid (ties go to the lower label)
+    float best = -1, second = -1;
+    bigint best_k = 0;
+    for (bigint k = 0; k < K; k++) {
+        float d0 = distsqr(M, X0, &centroids[M * k]);
+        if ((best < 0) || (d0 < best)) {
+            second = best;
+            best = d0;
+            best_k = k;
+        }
+        else if ((second < 0) || (d0 < second)) {
+            second = d0;
+        }
+    }
+    *label = best_k + 1;
+    *upper = sqrt(best);
+    *lower = (second < 0) ? HUGE_VAL : sqrt(second);
+}
+}
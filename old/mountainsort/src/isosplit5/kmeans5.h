@@ -0,0 +1,33 @@
+#ifndef KMEANS5_H
+#define KMEANS5_H
+
+//#include "mlcommon.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef int64_t bigint;
+
+enum kmeans5_seeding {
+    kmeans5_seed_random, // K distinct data points chosen uniformly at random
+    kmeans5_seed_plusplus, // k-means++: each new seed is chosen with probability proportional to its squared distance to the nearest seed
+    kmeans5_seed_given // start from the centroids passed in
+};
+
+struct kmeans5_opts {
+    bigint max_iterations = 100; // number of centroid updates (stops earlier when the labels no longer change)
+    kmeans5_seeding seeding = kmeans5_seed_plusplus;
+    unsigned int seed = 1;
+};
+
+/*
+ * Lloyd's k-means using Hamerly's bounds to skip most of the distance computations
+ * once the clusters have started to settle. The results are the same as for the
+ * brute-force iteration (assign, then alternately update centroids and reassign).
+ *
+ * X is MxN, centroids is MxK (input when seeding is kmeans5_seed_given, otherwise output, may be 0)
+ * labels are 1..K
+ * Returns the number of centroid updates performed.
+ */
+bigint kmeans5(int* labels, float* centroids, bigint M, bigint N, const float* X, bigint K, kmeans5_opts opts);
+
+#endif // KMEANS5_H
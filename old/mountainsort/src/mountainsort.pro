@@ -51,6 +51,7 @@ HEADERS += \
     isosplit5/isosplit5.h \
     isosplit5/isocut5.h \
     isosplit5/jisotonic5.h \
+    isosplit5/kmeans5.h \
     processors/extract_clips.h \
     processors/extract_clips_aa.h \
     processors/link_firings_files_aa.h \
@@ -240,6 +241,7 @@ SOURCES += \
     isosplit5/isosplit5.cpp \
     isosplit5/isocut5.cpp \
     isosplit5/jisotonic5.cpp \
+    isosplit5/kmeans5.cpp \
     processors/concat_mda_processor.cpp \
     processors/split_timeseries_processor.cpp \
     processors/extract_geom_processor.cpp
@@ -271,8 +273,8 @@ SOURCES += utils/get_sort_indices.cpp \
     utils/compute_templates_0.cpp \
     utils/msmisc.cpp
 
-HEADERS += utils/svm.h
-SOURCES += utils/svm.cpp
+HEADERS += utils/linearclassifier.h
+SOURCES += utils/linearclassifier.cpp
 
 DEFINES += USE_SSE2
 
@@ -13,12 +13,11 @@
 #include "synthesize1.h" //for randn
 #include "msmisc.h"
 #include "compute_templates_0.h"
-#include "jsvm.h"
+#include "linearclassifier.h"
+#include "templatesimilarity.h"
 
 namespace ClusterScores {
 QVector<double> compute_cluster_scores(const DiskReadMda32& timeseries, const Mda32& clips, cluster_scores_opts opts);
-double compute_distance(int N, float* ptr1, float* ptr2);
-bool is_zero(const Mda& X);
 
 bool cluster_scores(QString timeseries, QString firings, QString cluster_scores_path, QString cluster_pair_scores_path, cluster_scores_opts opts)
 {
@@ -169,21 +168,6 @@ QVector<double> compute_cluster_scores(const DiskReadMda32& timeseries, const Md
     return ret;
 }
 
-double compute_distance(int N, float* ptr1, float* ptr2)
-{
-    double sumsqr = 0;
-    for (int i = 0; i < N; i++) {
-        double tmp = ptr1[i] - ptr2[i];
-        sumsqr += tmp * tmp;
-    }
-    return sqrt(sumsqr);
-}
-
-bool is_zero(const Mda32& X)
-{
-    return ((X.minimum() == 0) && (X.maximum() == 0));
-}
-
 void find_pairs_to_compare(QList<int>& k1s, QList<int>& k2s, const DiskReadMda32& timeseries, const DiskReadMda& firings, cluster_scores_opts opts)
 {
     k1s.clear();
@@ -200,32 +184,34 @@ void find_pairs_to_compare(QList<int>& k1s, QList<int>& k2s, const DiskReadMda32
     int T = templates.N2();
     int K = templates.N3();
 
+    Mda distances = TemplateSimilarity::distances(templates);
+    QVector<bool> is_zero(K);
+    for (int k = 0; k < K; k++) {
+        is_zero[k] = (MLCompute::norm(M * T, templates.constDataPtr() + M * T * k) == 0);
+    }
+
     for (int k1 = 1; k1 <= K; k1++) {
         if ((opts.cluster_numbers.isEmpty()) || (opts.cluster_numbers.contains(k1))) {
             QVector<double> dists;
 
-            Mda32 template1;
-            templates.getChunk(template1, 0, 0, k1 - 1, M, T, 1);
-
             QList<int> k2s_considered;
             for (int k2 = k1 + 1; k2 <= K; k2++) {
                 if ((opts.cluster_numbers.isEmpty()) || (opts.cluster_numbers.contains(k2))) {
-                    Mda32 template2;
-                    templates.getChunk(template1, 0, 0, k2 - 1, M, T, 1);
-                    double dist = compute_distance(M * T, template1.dataPtr(), template2.dataPtr());
-                    if ((is_zero(template1)) || (is_zero(template2))) {
+                    if ((is_zero[k1 - 1]) || (is_zero[k2 - 1])) {
                         dists << 0;
                     }
                     else {
-                        dists << dist;
+                        dists << distances.value(k1 - 1, k2 - 1);
                     }
                     k2s_considered << k2;
                 }
             }
+            if ((dists.isEmpty()) || (opts.max_comparisons_per_cluster <= 0))
+                continue;
 
             QVector<double> dists_sorted = dists;
             qSort(dists_sorted);
-            int num = qMax(opts.max_comparisons_per_cluster - 1, dists_sorted.count() - 1);
+            int num = qMin(opts.max_comparisons_per_cluster - 1, dists_sorted.count() - 1);
             double cutoff = dists_sorted[num];
             int ct = 0;
             for (int i2 = 0; i2 < dists.count(); i2++) {
@@ -249,77 +235,37 @@ QVector<double> compute_cluster_pair_scores(DiskReadMda32 timeseries, const Mda3
     int M = clips1.N1();
     int T = clips1.N2();
 
-    Mda32 clips1_noise = add_self_noise_to_clips(timeseries, clips1, opts.add_noise_level);
-    Mda32 clips2_noise = add_self_noise_to_clips(timeseries, clips2, opts.add_noise_level);
-
-    Mda32 X(M * T, L1 + L2);
-    QVector<int> labels;
-    for (int i = 0; i < L1; i++) {
-        for (int t = 0; t < T; t++) {
-            for (int m = 0; m < M; m++) {
-                X.setValue(clips1.value(m, t, i), m + M * t, i);
-            }
-        }
-        labels << 1;
-    }
-    for (int i = 0; i < L2; i++) {
-        for (int t = 0; t < T; t++) {
-            for (int m = 0; m < M; m++) {
-                X.setValue(clips2.value(m, t, i), m + M * t, i + L1);
-            }
-        }
-        labels << 2;
+    Mda32 clips1_noise, clips2_noise;
+#pragma omp critical(cluster_scores_timeseries)
+    {
+        clips1_noise = add_self_noise_to_clips(timeseries, clips1, opts.add_noise_level);
+        clips2_noise = add_self_noise_to_clips(timeseries, clips2, opts.add_noise_level);
     }
 
+    //the clips are columns of M*T values, used in place
+    bigint MT = M * T;
     double cutoff_00;
     QVector<double> direction_00;
-    get_svm_discrim_direction(cutoff_00, direction_00, X, labels);
+    LinearClassifier::train(cutoff_00, direction_00, MT, LinearClassifier::columns(clips1.constDataPtr(), MT, L1), LinearClassifier::columns(clips2.constDataPtr(), MT, L2));
+    QVector<float> direction(MT);
+    for (bigint i = 0; i < MT; i++)
+        direction[i] = direction_00[i];
 
     int num_err = 0;
     for (int i = 0; i < L1; i++) {
-        {
-            QVector<double> tmp;
-            for (int t = 0; t < T; t++) {
-                for (int m = 0; m < M; m++) {
-                    tmp << clips1_noise.value(m, t, i);
-                }
-            }
-            double val = MLCompute::dotProduct(direction_00, tmp);
-            if (val < cutoff_00)
-                num_err++;
-        }
+        double val = LinearClassifier::dot(MT, direction.data(), clips1_noise.constDataPtr() + MT * i);
+        if (val < cutoff_00)
+            num_err++;
         if (out_proj_data1) {
-            QVector<double> out_tmp;
-            for (int t = 0; t < T; t++) {
-                for (int m = 0; m < M; m++) {
-                    out_tmp << clips1.value(m, t, i);
-                }
-            }
-            double val = MLCompute::dotProduct(direction_00, out_tmp);
-            *out_proj_data1 << val;
+            *out_proj_data1 << LinearClassifier::dot(MT, direction.data(), clips1.constDataPtr() + MT * i);
         }
     }
     for (int i = 0; i < L2; i++) {
-        {
-            QVector<double> tmp;
-            for (int t = 0; t < T; t++) {
-                for (int m = 0; m < M; m++) {
-                    tmp << clips2_noise.value(m, t, i);
-                }
-            }
-            double val = MLCompute::dotProduct(direction_00, tmp);
-            if (val > cutoff_00)
-                num_err++;
-        }
+        double val = LinearClassifier::dot(MT, direction.data(), clips2_noise.constDataPtr() + MT * i);
+        if (val > cutoff_00)
+            num_err++;
         if (out_proj_data2) {
-            QVector<double> out_tmp;
-            for (int t = 0; t < T; t++) {
-                for (int m = 0; m < M; m++) {
-                    out_tmp << clips2.value(m, t, i);
-                }
-            }
-            double val = MLCompute::dotProduct(direction_00, out_tmp);
-            *out_proj_data2 << val;
+            *out_proj_data2 << LinearClassifier::dot(MT, direction.data(), clips2.constDataPtr() + MT * i);
         }
     }
 
@@ -1,12 +1,13 @@
 #include "compute_amplitudes.h"
 
 #include "compute_templates_0.h"
-#include "extract_clips.h"
+#include "get_sort_indices.h"
 #include "mlcommon.h"
 
 #include <QFile>
 
-QVector<int> find_label_inds_00(const QVector<int>& labels, int k);
+#define AMPLITUDE_CHUNK_SIZE 100000 //timepoints
+
 double compute_max_amp_of_template(int* max_amp_index, const Mda32& template0);
 
 bool compute_amplitudes(QString timeseries_path, QString firings_path, QString firings_out_path, compute_amplitudes_opts opts)
@@ -29,47 +30,48 @@ bool compute_amplitudes(QString timeseries_path, QString firings_path, QString f
         }
         firings_out.setValue(0, 3, i);
     }
+    //the peak of each template (channel and timepoint, as an index into the template)
+    QVector<int> max_amp_indices(K);
+    QVector<double> max_amps(K);
     for (int k = 1; k <= K; k++) {
-        QVector<int> inds_k = find_label_inds_00(labels, k);
-        QVector<double> times_k(inds_k.count());
-        for (int i = 0; i < inds_k.count(); i++) {
-            times_k[i] = times[inds_k[i]];
-        }
         Mda32 template0;
         templates.getChunk(template0, 0, 0, k - 1, templates.N1(), templates.N2(), 1);
-        int max_amp_index;
-        double max_amp = compute_max_amp_of_template(&max_amp_index, template0);
-        //double template_norm=MLCompute::norm(template0.totalSize(),template0.constDataPtr());
-        if (max_amp) {
-            Mda32 clips_k = extract_clips(X, times_k, opts.clip_size);
-            for (int i = 0; i < inds_k.count(); i++) {
-                Mda32 clip0;
-                clips_k.getChunk(clip0, 0, 0, i, clips_k.N1(), clips_k.N2(), 1);
-                /*
-                //this was the tricky way to do it, but the simpler way is much better
-                double tmp = MLCompute::dotProduct(clip0.N1() * clip0.N2(), clip0.dataPtr(), template0.dataPtr());
-                double amp0=tmp/(template_norm*template_norm)*max_amp;
-                */
-                /// TODO: This involves a lot of extra unnecessary computations
-                double amp0 = clip0.value(max_amp_index);
-                firings_out.setValue(amp0, 3, inds_k[i]);
-            }
+        max_amps[k - 1] = compute_max_amp_of_template(&max_amp_indices[k - 1], template0);
+    }
+
+    //the value of each event at the peak of its template, visiting the events in time order
+    //over chunks of the timeseries (rather than extracting all the clips of each cluster)
+    int M = X.N1();
+    bigint N = X.N2();
+    int T = opts.clip_size;
+    int Tmid = (int)((T + 1) / 2) - 1;
+    bigint L = times.count();
+    QList<bigint> inds = get_sort_indices_bigint(times);
+    Mda32 chunk;
+    bigint ii = 0;
+    while (ii < L) {
+        bigint chunk_t1 = (bigint)times[inds[ii]] - Tmid;
+        if (!X.readChunk(chunk, 0, chunk_t1, M, AMPLITUDE_CHUNK_SIZE + T)) {
+            qWarning() << "Problem reading chunk of timeseries in compute_amplitudes" << chunk_t1;
+            return false;
+        }
+        for (; (ii < L) && ((bigint)times[inds[ii]] - Tmid < chunk_t1 + AMPLITUDE_CHUNK_SIZE); ii++) {
+            bigint i = inds[ii];
+            int k = labels[i];
+            if ((k < 1) || (!max_amps[k - 1]))
+                continue;
+            bigint t1 = (bigint)times[i] - Tmid;
+            if ((t1 < 0) || (t1 + T - 1 >= N))
+                continue; //as extract_clips, which leaves those clips zero
+            int m = max_amp_indices[k - 1] % M;
+            int t = max_amp_indices[k - 1] / M;
+            firings_out.setValue(chunk.get(m, t1 - chunk_t1 + t), 3, i);
         }
     }
 
     return firings_out.write64(firings_out_path);
 }
 
-QVector<int> find_label_inds_00(const QVector<int>& labels, int k)
-{
-    QVector<int> ret;
-    for (int i = 0; i < labels.count(); i++) {
-        if (labels[i] == k)
-            ret << i;
-    }
-    return ret;
-}
-
 double compute_max_amp_of_template(int* max_amp_index, const Mda32& template0)
 {
     int N = template0.totalSize();
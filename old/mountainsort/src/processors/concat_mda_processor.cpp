@@ -71,7 +71,18 @@ bool concat_mda_Processor::run(const QMap<QString, QVariant>& params)
     }
 
     printf("OUTPUT:  %d x %d x %d\n", DIMS[1], DIMS[2], DIMS[3]);
-    DiskWriteMda Y(X0.mdaioHeader().data_type, output_path, DIMS[1], DIMS[2], DIMS[3]);
+    //the chunks are read with the scale of each input applied, so the output can only stay scaled int16 if they all agree
+    int data_type = X0.mdaioHeader().data_type;
+    double scale = X0.scale();
+    for (int i = 1; i < input_paths.count(); i++) {
+        DiskReadMda X1(input_paths[i]);
+        if ((X1.mdaioHeader().data_type != data_type) || (X1.scale() != scale)) {
+            data_type = MDAIO_TYPE_FLOAT32;
+            scale = 1;
+        }
+    }
+    DiskWriteMda Y(data_type, output_path, DIMS[1], DIMS[2], DIMS[3]);
+    Y.setScale(scale);
     int offset = 0;
     for (int i = 0; i < input_paths.count(); i++) {
         QString path1 = input_paths[i];
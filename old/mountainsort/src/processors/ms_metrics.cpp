@@ -18,6 +18,7 @@
 #include "jsvm.h"
 #include "noise_nearest.h"
 #include "get_sort_indices.h"
+#include "templatesimilarity.h"
 
 namespace MSMetrics {
 
@@ -489,16 +490,6 @@ QVector<int> find_label_inds(const QVector<int>& labels, int k)
     return ret;
 }
 
-double distsqr_between_templates(const Mda32& X, const Mda32& Y)
-{
-    double ret = 0;
-    for (int i = 0; i < X.totalSize(); i++) {
-        double tmp = X.get(i) - Y.get(i);
-        ret += tmp * tmp;
-    }
-    return ret;
-}
-
 QSet<QString> get_pairs_to_compare(const DiskReadMda32& X, const DiskReadMda& F, int num_comparisons_per_cluster, ms_metrics_opts opts)
 {
     QSet<QString> ret;
@@ -521,20 +512,22 @@ QSet<QString> get_pairs_to_compare(const DiskReadMda32& X, const DiskReadMda& F,
 
     Mda32 templates0 = compute_templates_0(X, times, labels, opts.clip_size);
 
-    for (int i1 = 0; i1 < opts.cluster_numbers.count(); i1++) {
+    int M = templates0.N1();
+    int T = templates0.N2();
+    int num_clusters = opts.cluster_numbers.count();
+    Mda32 templates(M, T, num_clusters);
+    for (int i = 0; i < num_clusters; i++) {
+        Mda32 template0;
+        templates0.getChunk(template0, 0, 0, opts.cluster_numbers[i] - 1, M, T, 1);
+        templates.setChunk(template0, 0, 0, i);
+    }
+    Mda dists = TemplateSimilarity::distances(templates);
+    QList<QVector<int> > neighbors = TemplateSimilarity::nearestNeighbors(dists, num_comparisons_per_cluster);
+
+    for (int i1 = 0; i1 < num_clusters; i1++) {
         int k1 = opts.cluster_numbers[i1];
-        Mda32 template1;
-        templates0.getChunk(template1, 0, 0, k1 - 1, template1.N1(), template1.N2(), 1);
-        QVector<double> dists;
-        for (int i2 = 0; i2 < opts.cluster_numbers.count(); i2++) {
-            Mda32 template2;
-            int k2 = opts.cluster_numbers[i2];
-            templates0.getChunk(template2, 0, 0, k2 - 1, template2.N1(), template2.N2(), 1);
-            dists << distsqr_between_templates(template1, template2);
-        }
-        QList<int> inds = get_sort_indices(dists);
-        for (int a = 0; (a < inds.count()) && (a < num_comparisons_per_cluster); a++) {
-            ret.insert(QString("%1-%2").arg(k1).arg(opts.cluster_numbers[inds[a]]));
+        for (int a = 0; a < neighbors[i1].count(); a++) {
+            ret.insert(QString("%1-%2").arg(k1).arg(opts.cluster_numbers[neighbors[i1][a]]));
         }
     }
 
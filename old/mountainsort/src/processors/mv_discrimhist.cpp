@@ -4,7 +4,10 @@
 #include "extract_clips.h"
 #include "mlcommon.h"
 #include "msmisc.h"
-#include "jsvm.h"
+#include "linearclassifier.h"
+#include "mlkernels.h"
+#include <QSet>
+#include <math.h>
 
 struct discrimhist_data {
     int k1, k2;
@@ -12,27 +15,57 @@ struct discrimhist_data {
     QVector<double> data2;
 };
 
-/// TODO parallelize mv_distrimhist
 bool mv_discrimhist(QString timeseries_path, QString firings_path, QString output_path, mv_discrimhist_opts opts)
 {
     DiskReadMda32 timeseries(timeseries_path);
     DiskReadMda firings(firings_path);
 
-    QList<discrimhist_data> datas;
+    //extract the clips of all the clusters at once, and share them between the pairs
+    QSet<int> clusters_set = opts.clusters.toList().toSet();
+    Mda firings0;
+    if (!firings.readChunk(firings0, 0, 0, firings.N1(), firings.N2())) {
+        qWarning() << "Unable to read firings" << firings_path;
+        return false;
+    }
+    QVector<double> times;
+    QVector<int> labels;
+    for (bigint i = 0; i < firings0.N2(); i++) {
+        int label = (int)firings0.value(2, i);
+        if (clusters_set.contains(label)) {
+            times << firings0.value(1, i);
+            labels << label;
+        }
+    }
+    Mda32 clips = extract_clips(timeseries, times, opts.clip_size);
+    bigint MT = clips.N1() * clips.N2();
+    QMap<int, QVector<const float*> > cluster_clips;
+    for (bigint j = 0; j < labels.count(); j++) {
+        cluster_clips[labels[j]] << clips.constDataPtr() + MT * j;
+    }
+
+    QVector<discrimhist_data> datas;
     for (int i1 = 0; i1 < opts.clusters.count(); i1++) {
         for (int i2 = i1 + 1; i2 < opts.clusters.count(); i2++) {
-            int k1 = opts.clusters[i1];
-            int k2 = opts.clusters[i2];
             discrimhist_data DD;
-            DD.k1 = k1;
-            DD.k2 = k2;
-            if (!get_discrimhist_data(DD.data1, DD.data2, timeseries, firings, k1, k2, opts.clip_size, opts.method)) {
-                return false;
-            }
+            DD.k1 = opts.clusters[i1];
+            DD.k2 = opts.clusters[i2];
             datas << DD;
         }
     }
 
+    bool ok = true;
+    discrimhist_data* datas_ptr = datas.data();
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < datas.count(); i++) {
+        discrimhist_data* DD = &datas_ptr[i];
+        if (!get_discrimhist_data(DD->data1, DD->data2, MT, cluster_clips.value(DD->k1), cluster_clips.value(DD->k2), opts.method)) {
+#pragma omp critical
+            ok = false;
+        }
+    }
+    if (!ok)
+        return false;
+
     int total_count = 0;
     for (int i = 0; i < datas.count(); i++) {
         total_count += datas[i].data1.count();
@@ -66,14 +99,6 @@ bool mv_discrimhist(QString timeseries_path, QString firings_path, QString outpu
     return true;
 }
 
-double compute_dot_product(int N, float* v1, float* v2)
-{
-    double ip = 0;
-    for (int m = 0; m < N; m++)
-        ip += v1[m] * v2[m];
-    return ip;
-}
-
 bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, const DiskReadMda32& timeseries, const DiskReadMda& firings, int k1, int k2, int clip_size, QString method)
 {
     //Assemble the times where neuron k1 fires (times1) and where neuron k2 fires (times2)
@@ -91,58 +116,33 @@ bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, const Di
     //extract the clips
     Mda32 clips1 = extract_clips(timeseries, times1, clip_size);
     Mda32 clips2 = extract_clips(timeseries, times2, clip_size);
-    float* ptr_clips1 = clips1.dataPtr();
-    float* ptr_clips2 = clips2.dataPtr();
+    bigint MT = clips1.N1() * clips1.N2();
 
+    return get_discrimhist_data(ret1, ret2, MT, LinearClassifier::columns(clips1.constDataPtr(), MT, clips1.N3()), LinearClassifier::columns(clips2.constDataPtr(), MT, clips2.N3()), method);
+}
+
+bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, bigint MT, const QVector<const float*>& clips1, const QVector<const float*>& clips2, QString method)
+{
     //the direction to project onto and the cutoff to separate the two clusters
-    Mda32 discrim_direction;
+    QVector<double> direction(MT, 0);
     double cutoff = 0;
 
-    //compute the centroids
-    Mda32 centroid1 = compute_mean_clip(clips1);
-    Mda32 centroid2 = compute_mean_clip(clips2);
-    int M = centroid1.N1();
-    int T = centroid1.N2();
-    int MT = M * T;
-    int L1 = clips1.N3();
-    int L2 = clips2.N3();
-
-    //allocate the discrim direction
-    discrim_direction.allocate(centroid1.N1(), centroid1.N2());
-    float* ptr_dd = discrim_direction.dataPtr();
-
     if (method == "centroid") {
         //the direction will be the vector connecting the two centroids
-        for (int t = 0; t < T; t++) {
-            for (int m = 0; m < M; m++) {
-                discrim_direction.setValue(centroid2.value(m, t) - centroid1.value(m, t), m, t);
-            }
+        for (int j = 0; j < clips1.count(); j++) {
+            for (bigint i = 0; i < MT; i++)
+                direction[i] -= clips1[j][i] / clips1.count();
+        }
+        for (int j = 0; j < clips2.count(); j++) {
+            for (bigint i = 0; i < MT; i++)
+                direction[i] += clips2[j][i] / clips2.count();
         }
     }
     else if (method == "svm") {
-        //the direction and cutoff are determined using support vector machine
-        QVector<double> direction0;
-        Mda32 X0(MT, L1 + L2); //concatenation (and reshaped) of clips1 and clips2
-        QVector<int> labels0;
-        for (int j = 0; j < L1; j++) {
-            Mda32 tmp;
-            clips1.getChunk(tmp, 0, 0, j, M, T, 1);
-            for (int k = 0; k < MT; k++) {
-                X0.setValue(tmp.value(k), k, j);
-            }
-            labels0 << 1;
-        }
-        for (int j = 0; j < L2; j++) {
-            Mda32 tmp;
-            clips2.getChunk(tmp, 0, 0, j, M, T, 1);
-            for (int k = 0; k < MT; k++) {
-                X0.setValue(tmp.value(k), k, L2 + j);
-            }
-            labels0 << 2;
-        }
-        get_svm_discrim_direction(cutoff, direction0, X0, labels0);
-        for (int i = 0; i < MT; i++) {
-            discrim_direction.setValue(direction0[i], i);
+        //the direction and cutoff are determined using a linear support vector machine
+        if ((!clips1.isEmpty()) && (!clips2.isEmpty())) {
+            if (!LinearClassifier::train(cutoff, direction, MT, clips1, clips2))
+                return false;
         }
     }
     else {
@@ -151,17 +151,20 @@ bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, const Di
     }
 
     //normalize the discrim direction
-    double norm0 = MLCompute::norm(MT, ptr_dd);
+    QVector<float> discrim_direction(MT);
+    for (bigint i = 0; i < MT; i++)
+        discrim_direction[i] = direction[i];
+    double norm0 = sqrt(MLKernels::dot(MT, discrim_direction.data(), discrim_direction.data()));
     if (!norm0)
         norm0 = 1;
 
-    ret1.clear();
-    for (int i = 0; i < clips1.N3(); i++) {
-        ret1 << (compute_dot_product(MT, ptr_dd, &ptr_clips1[MT * i]) - cutoff) / (norm0 * norm0);
+    ret1.resize(clips1.count());
+    for (int i = 0; i < clips1.count(); i++) {
+        ret1[i] = (MLKernels::dot(MT, discrim_direction.data(), clips1[i]) - cutoff) / (norm0 * norm0);
     }
-    ret2.clear();
-    for (int i = 0; i < clips2.N3(); i++) {
-        ret2 << (compute_dot_product(MT, ptr_dd, &ptr_clips2[MT * i]) - cutoff) / (norm0 * norm0);
+    ret2.resize(clips2.count());
+    for (int i = 0; i < clips2.count(); i++) {
+        ret2[i] = (MLKernels::dot(MT, discrim_direction.data(), clips2[i]) - cutoff) / (norm0 * norm0);
     }
 
     return true;
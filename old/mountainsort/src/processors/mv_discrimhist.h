@@ -17,5 +17,7 @@ struct mv_discrimhist_opts {
 
 bool mv_discrimhist(QString timeseries_path, QString firings_path, QString output_path, mv_discrimhist_opts opts);
 bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, const DiskReadMda32& timeseries, const DiskReadMda& firings, int k1, int k2, int clip_size, QString method);
+//the same, for clips (of MT values) that have already been extracted; safe to call from several threads at once
+bool get_discrimhist_data(QVector<double>& ret1, QVector<double>& ret2, bigint MT, const QVector<const float*>& clips1, const QVector<const float*>& clips2, QString method);
 
 #endif // MV_DISCRIMHIST_H
@@ -6,6 +6,7 @@
 #include "compute_templates_0.h"
 #include "msmisc.h"
 #include "mv_discrimhist.h"
+#include "templatesimilarity.h"
 
 struct discrimhist_guide_data {
     int k1 = 0, k2 = 0;
@@ -132,21 +133,6 @@ void get_discrimhist_guide_data(QVector<double>& ret1, QVector<double>& ret2, co
 }
 */
 
-double compute_distance(int N, float* ptr1, float* ptr2)
-{
-    double sumsqr = 0;
-    for (int i = 0; i < N; i++) {
-        double tmp = ptr1[i] - ptr2[i];
-        sumsqr += tmp * tmp;
-    }
-    return sqrt(sumsqr);
-}
-
-bool is_zero(const Mda32& X)
-{
-    return ((X.minimum() == 0) && (X.maximum() == 0));
-}
-
 Mda compute_distance_matrix(DiskReadMda32 timeseries, DiskReadMda firings, mv_discrimhist_guide_opts opts)
 {
     QVector<double> times;
@@ -160,19 +146,13 @@ Mda compute_distance_matrix(DiskReadMda32 timeseries, DiskReadMda firings, mv_di
     int T = X.N2();
     int K = X.N3();
 
-    Mda ret(K, K);
-    for (int k1 = 0; k1 < K; k1++) {
-        Mda32 tmp1;
-        X.getChunk(tmp1, 0, 0, k1, M, T, 1);
-        for (int k2 = 0; k2 < K; k2++) {
-            Mda32 tmp2;
-            X.getChunk(tmp2, 0, 0, k2, M, T, 1);
-            double dist = compute_distance(M * T, tmp1.dataPtr(), tmp2.dataPtr());
-            if ((is_zero(tmp1)) || (is_zero(tmp2))) {
-                ret.setValue(0, k1, k2);
-            }
-            else {
-                ret.setValue(dist, k1, k2);
+    Mda ret = TemplateSimilarity::distances(X);
+    //a cluster without events has a zero template, and is not compared
+    for (int k = 0; k < K; k++) {
+        if (MLCompute::norm(M * T, X.constDataPtr() + M * T * k) == 0) {
+            for (int k2 = 0; k2 < K; k2++) {
+                ret.setValue(0, k, k2);
+                ret.setValue(0, k2, k);
             }
         }
     }
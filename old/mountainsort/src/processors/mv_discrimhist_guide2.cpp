@@ -7,6 +7,7 @@
 #include "msmisc.h"
 #include "mv_discrimhist.h"
 #include "cluster_scores.h"
+#include <QSet>
 
 struct discrimhist_guide2_data {
     int k1 = 0, k2 = 0;
@@ -22,7 +23,6 @@ struct discrimhist_guide2_data_comparer {
     }
 };
 
-/// TODO parallelize
 bool mv_discrimhist_guide2(QString timeseries_path, QString firings_path, QString output_path, mv_discrimhist_guide2_opts opts)
 {
     DiskReadMda32 X(timeseries_path);
@@ -58,32 +58,40 @@ bool mv_discrimhist_guide2(QString timeseries_path, QString firings_path, QStrin
     opts00.detect_threshold = 0;
     opts00.max_comparisons_per_cluster = opts.max_comparisons_per_cluster;
     ClusterScores::find_pairs_to_compare(k1s, k2s, X, F, opts00);
+
+    //extract the clips of each cluster once, rather than for each pair it is in
+    QMap<int, Mda32> cluster_clips;
+    {
+        QSet<int> clusters_to_extract = (k1s + k2s).toSet();
+        QMap<int, QVector<double> > cluster_times;
+        for (int j = 0; j < labels.count(); j++) {
+            if (clusters_to_extract.contains(labels[j]))
+                cluster_times[labels[j]] << times[j];
+        }
+        foreach (int k, clusters_to_extract) {
+            cluster_clips[k] = extract_clips(X, cluster_times.value(k), opts.clip_size);
+        }
+    }
+
+    //train and project all the pairs in parallel
+    QVector<discrimhist_guide2_data> pair_datas(k1s.count());
+#pragma omp parallel for schedule(dynamic)
     for (int ii = 0; ii < k1s.count(); ii++) {
         int k1 = k1s[ii];
         int k2 = k2s[ii];
+#pragma omp critical(discrimhist_guide2)
         printf("k1/k2 = %d/%d\n", k1, k2);
 
         discrimhist_guide2_data DD;
         DD.k1 = k1;
         DD.k2 = k2;
-
-        QVector<double> times_k1;
-        for (int j = 0; j < labels.count(); j++) {
-            if (labels[j] == k1)
-                times_k1 << times[j];
-        }
-        Mda32 clips_k1 = extract_clips(X, times_k1, opts.clip_size);
-
-        QVector<double> times_k2;
-        for (int j = 0; j < labels.count(); j++) {
-            if (labels[j] == k2)
-                times_k2 << times[j];
-        }
-        Mda32 clips_k2 = extract_clips(X, times_k2, opts.clip_size);
-
-        QVector<double> scores_k1_k2 = ClusterScores::compute_cluster_pair_scores(X, clips_k1, clips_k2, opts00, &DD.data1, &DD.data2);
+        QVector<double> scores_k1_k2 = ClusterScores::compute_cluster_pair_scores(X, cluster_clips.value(k1), cluster_clips.value(k2), opts00, &DD.data1, &DD.data2);
         DD.overlap_score = scores_k1_k2.value(0);
-        datas << DD;
+#pragma omp critical(discrimhist_guide2)
+        pair_datas[ii] = DD;
+    }
+    for (int ii = 0; ii < pair_datas.count(); ii++) {
+        datas << pair_datas[ii];
     }
 
     qSort(datas.begin(), datas.end(), discrimhist_guide2_data_comparer());
@@ -13,7 +13,7 @@ mv_discrimhist_guide2_Processor::mv_discrimhist_guide2_Processor()
     d->q = this;
 
     this->setName("mv_discrimhist_guide2");
-    this->setVersion("0.19");
+    this->setVersion("0.20");
     this->setInputFileParameters("timeseries", "firings");
     this->setOutputFileParameters("output");
     this->setRequiredParameters("clip_size");
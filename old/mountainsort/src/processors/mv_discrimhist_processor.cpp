@@ -12,7 +12,7 @@ mv_discrimhist_Processor::mv_discrimhist_Processor()
     d->q = this;
 
     this->setName("mv_discrimhist");
-    this->setVersion("0.23");
+    this->setVersion("0.24");
     this->setInputFileParameters("timeseries", "firings");
     this->setOutputFileParameters("output");
     this->setRequiredParameters("clusters");
@@ -6,9 +6,9 @@
 #include "compute_templates_0.h"
 #include <math.h>
 #include "mlcommon.h"
-#include "mlcommon.h"
+#include "templatesimilarity.h"
 
-bool probably_the_same(Mda& templates, int ch1, int k1, int ch2, int k2, const remove_duplicate_clusters_Opts& opts);
+bool probably_the_same(Mda& templates, int ch1, int k1, int ch2, int k2, int best_shift, const remove_duplicate_clusters_Opts& opts);
 
 typedef QList<int> IntList;
 bool remove_duplicate_clusters(const QString& timeseries_path, const QString& firings_path, const QString& firings_out_path, const remove_duplicate_clusters_Opts& opts)
@@ -47,13 +47,23 @@ bool remove_duplicate_clusters(const QString& timeseries_path, const QString& fi
     printf("Computing templates...\n");
     Mda templates = compute_templates_0(X, F, opts.clip_size);
     printf("Comparing templates...\n");
+    //the alignment of every pair at once (over all channels)
+    Mda32 templates32(templates.N1(), templates.N2(), templates.N3());
+    for (bigint i = 0; i < templates.totalSize(); i++) {
+        templates32.set(templates.get(i), i);
+    }
+    Mda best_shifts;
+    Mda best_inner_products = TemplateSimilarity::bestLagInnerProducts(best_shifts, templates32, T / 2);
     for (int k1 = 0; k1 < K; k1++) {
         for (int k2 = 0; k2 < K; k2++) {
             if ((clusters_to_use[k1]) && (clusters_to_use[k2])) {
                 int ch1 = cluster_channels[k1];
                 int ch2 = cluster_channels[k2];
                 if (ch1 != ch2) {
-                    if (probably_the_same(templates, ch1 - 1, k1, ch2 - 1, k2, opts)) {
+                    int best_shift = 0;
+                    if (best_inner_products.value(k1, k2) > 0)
+                        best_shift = (int)best_shifts.value(k1, k2);
+                    if (probably_the_same(templates, ch1 - 1, k1, ch2 - 1, k2, best_shift, opts)) {
                         if (fabs(templates.value(ch1, Tmid, k1)) > fabs(templates.value(ch2, Tmid, k2))) {
                             clusters_to_use[k2] = 0;
                         }
@@ -111,13 +121,11 @@ bool remove_duplicate_clusters(const QString& timeseries_path, const QString& fi
     return true;
 }
 
-bool probably_the_same(Mda& templates, int ch1, int k1, int ch2, int k2, const remove_duplicate_clusters_Opts& opts)
+bool probably_the_same(Mda& templates, int ch1, int k1, int ch2, int k2, int best_shift, const remove_duplicate_clusters_Opts& opts)
 {
     Q_UNUSED(opts)
     int M = templates.N1();
     int T = templates.N2();
-    int best_shift = 0;
-    double best_ip = 0;
     double max11 = 0, max12 = 0;
     double max21 = 0, max22 = 0;
     for (int t = 0; t < T; t++) {
@@ -136,17 +144,6 @@ bool probably_the_same(Mda& templates, int ch1, int k1, int ch2, int k2, const r
         return false;
     if (max21 < max22 * 0.5)
         return false;
-    for (int shift = -T / 2; shift <= T / 2; shift++) {
-        double ip = 0;
-        for (int t = 0; t < T; t++) {
-            ip += templates.value(ch1, t, k1) * templates.value(ch1, t - shift, k2);
-            ip += templates.value(ch2, t, k1) * templates.value(ch2, t - shift, k2);
-        }
-        if (ip > best_ip) {
-            best_ip = ip;
-            best_shift = shift;
-        }
-    }
     Mda resid(M, T);
     double* resid_ptr = resid.dataPtr();
     double* ptr1 = templates.dataPtr(0, 0, k1);
@@ -12,7 +12,7 @@ remove_duplicate_clusters_Processor::remove_duplicate_clusters_Processor()
     d->q = this;
 
     this->setName("remove_duplicate_clusters");
-    this->setVersion("0.1");
+    this->setVersion("0.11");
     this->setInputFileParameters("timeseries", "firings");
     this->setOutputFileParameters("firings_out");
     this->setRequiredParameters("clip_size");
@@ -57,7 +57,9 @@ bool concat_timeseries_Processor::run(const QMap<QString, QVariant>& params)
         N += X1.N2();
     }
 
-    DiskWriteMda Y(X0.mdaioHeader().data_type, timeseries_concat, M, N);
+    DiskReadMda32 X(2, timeseries); //for the data type and scale of the output
+    DiskWriteMda Y(X.mdaioHeader().data_type, timeseries_concat, M, N);
+    Y.setScale(X.scale());
 
     int N_offset = 0;
     for (int i = 0; i < timeseries.count(); i++) {
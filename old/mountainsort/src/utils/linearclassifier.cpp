@@ -0,0 +1,159 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "linearclassifier.h"
+
+#include <QDebug>
+#include <mda32.h>
+#include <mlkernels.h>
+
+namespace LinearClassifier {
+
+bool train(double& cutoff, QVector<double>& direction, bigint D, const QVector<const float*>& points1, const QVector<const float*>& points2, Options opts)
+{
+    bigint L1 = points1.count();
+    bigint L = L1 + points2.count();
+    cutoff = 0;
+    direction.fill(0, D);
+    if ((!L1) || (L1 == L)) {
+        qWarning() << "LinearClassifier::train needs points on both sides" << L1 << L - L1;
+        return false;
+    }
+
+    QVector<const float*> points = points1 + points2;
+
+    //The points are centered (on the mean mu of all of them), which makes the problem much better
+    //conditioned when they share a large offset, and keeps w (a weighted sum of the centered points) free of
+    //the cancellation that a sum of the uncentered points followed by the subtraction of s*mu would have.
+    QVector<double> mu(D, 0);
+    for (bigint i = 0; i < L; i++) {
+        for (bigint d = 0; d < D; d++)
+            mu[d] += points[i][d];
+    }
+    for (bigint d = 0; d < D; d++)
+        mu[d] /= L;
+    Mda32 X(D, L); //the centered points
+    for (bigint i = 0; i < L; i++) {
+        float* x = X.dataPtr() + D * i;
+        for (bigint d = 0; d < D; d++)
+            x[d] = points[i][d] - mu[d];
+    }
+    QVector<double> Q(L); //the diagonal of the dual problem, |x_i-mu|^2 plus 1 for the constant feature
+    for (bigint i = 0; i < L; i++) {
+        const float* x = X.constDataPtr() + D * i;
+        Q[i] = MLKernels::dot(D, x, x) + 1;
+    }
+
+    QVector<float> w(D, 0);
+    double b = 0; //the weight of the constant feature
+    QVector<double> alpha(L, 0);
+
+    //the indices of the points still being optimized, which shrinks as points settle at a bound
+    QVector<bigint> active(L);
+    for (bigint i = 0; i < L; i++)
+        active[i] = i;
+    bigint num_active = L;
+    quint32 seed = 1;
+    double PG_max_old = 1e100, PG_min_old = -1e100;
+    bool converged = false;
+
+    for (int pass = 0; pass < opts.max_passes; pass++) {
+        //visit the points in a random order each pass
+        for (bigint i = num_active - 1; i > 0; i--) {
+            seed = seed * 1664525 + 1013904223;
+            bigint j = (seed >> 8) % (i + 1);
+            qSwap(active[i], active[j]);
+        }
+        double PG_max = -1e100, PG_min = 1e100;
+        for (bigint ii = 0; ii < num_active; ii++) {
+            bigint i = active[ii];
+            const float* x = X.constDataPtr() + D * i;
+            double y = (i < L1) ? 1 : -1;
+            double val = MLKernels::dot(D, w.data(), x) + b;
+            double G = y * val - 1;
+            //the gradient projected onto the box 0<=alpha<=C, and shrinking of the points that are
+            //at a bound and were outside the range of the last pass
+            double PG = 0;
+            if (alpha[i] <= 0) {
+                if (G > PG_max_old) {
+                    num_active--;
+                    qSwap(active[ii], active[num_active]);
+                    ii--;
+                    continue;
+                }
+                if (G < 0)
+                    PG = G;
+            }
+            else if (alpha[i] >= opts.C) {
+                if (G < PG_min_old) {
+                    num_active--;
+                    qSwap(active[ii], active[num_active]);
+                    ii--;
+                    continue;
+                }
+                if (G > 0)
+                    PG = G;
+            }
+            else
+                PG = G;
+            PG_max = qMax(PG_max, PG);
+            PG_min = qMin(PG_min, PG);
+            if (qAbs(PG) > 1e-12) {
+                double alpha_old = alpha[i];
+                alpha[i] = qMin(qMax(alpha[i] - G / Q[i], 0.0), opts.C);
+                double delta = (alpha[i] - alpha_old) * y;
+                MLKernels::axpy(D, delta, x, w.data());
+                b += delta;
+            }
+        }
+        if (PG_max - PG_min <= opts.tolerance) {
+            if (num_active == L) {
+                converged = true;
+                break;
+            }
+            //check all the points once more before stopping
+            num_active = L;
+            PG_max_old = 1e100;
+            PG_min_old = -1e100;
+            continue;
+        }
+        PG_max_old = (PG_max <= 0) ? 1e100 : PG_max;
+        PG_min_old = (PG_min >= 0) ? -1e100 : PG_min;
+    }
+
+    if (!converged) {
+        //the direction is still usable, but not optimal
+        qWarning() << "LinearClassifier::train did not converge in" << opts.max_passes << "passes" << L1 << L - L1;
+    }
+
+    //dot(w,x-mu)+b = dot(w,x)-cutoff
+    double w_mu = 0;
+    for (bigint d = 0; d < D; d++) {
+        direction[d] = w[d];
+        w_mu += direction[d] * mu[d];
+    }
+    cutoff = w_mu - b;
+    return true;
+}
+
+bool train(double& cutoff, QVector<double>& direction, const Mda32& X1, const Mda32& X2, Options opts)
+{
+    bigint D = X1.N1();
+    if (X2.N1() != D) {
+        qWarning() << "LinearClassifier::train: points of different sizes" << D << X2.N1();
+        return false;
+    }
+    return train(cutoff, direction, D, columns(X1.constDataPtr(), D, X1.N2()), columns(X2.constDataPtr(), D, X2.N2()), opts);
+}
+
+QVector<const float*> columns(const float* X, bigint D, bigint N)
+{
+    QVector<const float*> ret(N);
+    for (bigint i = 0; i < N; i++) {
+        ret[i] = X + D * i;
+    }
+    return ret;
+}
+}
@@ -0,0 +1,43 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef LINEARCLASSIFIER_H
+#define LINEARCLASSIFIER_H
+
+#include <QVector>
+#include "mlcommon.h"
+
+class Mda32;
+
+/*
+ * A linear support vector machine (hinge loss, penalty C) for separating two sets of points, such as the
+ * clips of two clusters. It is trained by coordinate descent on the dual problem, one point at a time,
+ * which costs a couple of dot products per point and pass (no kernel matrix). The offset is learned as the
+ * weight of an extra constant feature, with the points centered on their mean (in a copy, so that the weights
+ * are sums of centered points).
+ *
+ * The points are float vectors of length D, given by pointers so that they can be columns of arrays that
+ * are shared between several trainings (for example all the clips of several clusters).
+ *
+ * The result is a direction and a cutoff such that dot(direction,x)-cutoff is positive on the side of the
+ * first set.
+ */
+namespace LinearClassifier {
+
+struct Options {
+    double C = 1;
+    double tolerance = 0.1; //on the spread of the projected gradient, to stop
+    int max_passes = 1000;
+};
+
+bool train(double& cutoff, QVector<double>& direction, bigint D, const QVector<const float*>& points1, const QVector<const float*>& points2, Options opts = Options());
+
+//the points are the columns of X1 and X2 (for MxTxL clips, use columns(clips.constDataPtr(), M*T, L))
+bool train(double& cutoff, QVector<double>& direction, const Mda32& X1, const Mda32& X2, Options opts = Options());
+
+//pointers to the columns (of length D) of an array
+QVector<const float*> columns(const float* X, bigint D, bigint N);
+}
+
+#endif // LINEARCLASSIFIER_H
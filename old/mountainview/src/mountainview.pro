@@ -79,8 +79,8 @@ SOURCES += mountainviewmain.cpp \
     views/mvtemplatesview2panel.cpp \
 
 
-HEADERS += mvcontext.h
-SOURCES += mvcontext.cpp
+HEADERS += mvcontext.h mvcomputationcache.h
+SOURCES += mvcontext.cpp mvcomputationcache.cpp
 
 INCLUDEPATH += multiscaletimeseries
 VPATH += multiscaletimeseries
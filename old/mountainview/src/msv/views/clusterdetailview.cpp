@@ -65,6 +65,7 @@ public:
     DiskReadMda firings;
     int clip_size;
     QSet<int> clusters_to_force_show;
+    MVComputationCache* cache;
 
     //output
     QList<ClusterData> cluster_data;
@@ -285,6 +286,7 @@ void ClusterDetailView::prepareCalculation()
     d->m_calculator.firings = c->firings();
     d->m_calculator.clip_size = c->option("clip_size", 100).toInt();
     d->m_calculator.clusters_to_force_show = c->clustersToForceShow().toSet();
+    d->m_calculator.cache = c->computationCache();
     update();
 }
 
@@ -1440,32 +1442,31 @@ DiskReadMda mp_compute_templates(const QString& mlproxy_url, const QString& time
     return ret;
 }
 
-void mp_compute_templates_stdevs(DiskReadMda32& templates_out, DiskReadMda32& stdevs_out, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size)
+bool mp_compute_templates_stdevs(DiskReadMda32& templates_out, DiskReadMda32& stdevs_out, MVComputationCache* cache, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size)
 {
     TaskProgress task(TaskProgress::Calculate, "mp_compute_templates_stdevs");
     task.log("mlproxy_url: " + mlproxy_url);
-    MountainProcessRunner X;
-    QString processor_name = "mv_compute_templates";
-    X.setProcessorName(processor_name);
 
     QMap<QString, QVariant> params;
     params["timeseries"] = timeseries;
     params["firings"] = firings;
     params["clip_size"] = clip_size;
-    X.setInputParameters(params);
-    X.setMLProxyUrl(mlproxy_url);
-
-    QString templates_fname = X.makeOutputFilePath("templates");
-    QString stdevs_fname = X.makeOutputFilePath("stdevs");
-
-    task.log("X.compute()");
-    X.runProcess();
-    task.log("Returning DiskReadMda: " + templates_fname + " " + stdevs_fname);
-    templates_out.setPath(templates_fname);
-    stdevs_out.setPath(stdevs_fname);
+    QStringList output_names;
+    output_names << "templates"
+                 << "stdevs";
+
+    task.log("runProcess()");
+    //shared with the templates view, which runs the same process
+    QMap<QString, QString> outputs = cache->runProcess("mv_compute_templates", params, output_names, mlproxy_url);
+    if (outputs.isEmpty())
+        return false;
+    task.log("Returning DiskReadMda: " + outputs["templates"] + " " + outputs["stdevs"]);
+    templates_out.setPath(outputs["templates"]);
+    stdevs_out.setPath(outputs["stdevs"]);
 
     //templates_out.setRemoteDataType("float32_q8");
     //stdevs_out.setRemoteDataType("float32_q8");
+    return true;
 }
 
 void ClusterDetailViewCalculator::compute()
@@ -1482,21 +1483,17 @@ void ClusterDetailViewCalculator::compute()
 
     int M = timeseries.N1();
     //int N = timeseries.N2();
-    int L = firings.N2();
     int T = clip_size;
 
-    QVector<double> times;
-    QVector<int> channels, labels;
-    QVector<double> peaks;
-
-    task.log("Setting up times/channels/labels/peaks");
+    task.log("Setting up labels");
     task.setProgress(0.2);
-    for (int i = 0; i < L; i++) {
-        times << firings.value(1, i) - 1; //convert to 0-based indexing
-        channels << (int)firings.value(0, i) - 1; //convert to 0-based indexing
-        labels << (int)firings.value(2, i);
-        peaks << firings.value(3, i);
+    QSharedPointer<const MVFiringsColumns> F = cache->firingsColumns(firings.makePath());
+    if (!F) {
+        task.error("Unable to read firings");
+        return;
     }
+    const QVector<int>& labels = F->labels;
+    int L = labels.count();
 
     if (MLUtil::threadInterruptRequested()) {
         task.error("Halted *");
@@ -1507,10 +1504,7 @@ void ClusterDetailViewCalculator::compute()
 
     task.setLabel("Computing templates");
     task.setProgress(0.4);
-    int K = 0;
-    for (int i = 0; i < L; i++)
-        if (labels[i] > K)
-            K = labels[i];
+    int K = F->K;
 
     QString timeseries_path = timeseries.makePath();
     QString firings_path = firings.makePath();
@@ -1523,8 +1517,7 @@ void ClusterDetailViewCalculator::compute()
     task.setProgress(0.6);
     //DiskReadMda templates0 = mp_compute_templates(mlproxy_url, timeseries_path, firings_path, T);
     DiskReadMda32 templates0, stdevs0;
-    mp_compute_templates_stdevs(templates0, stdevs0, mlproxy_url, timeseries_path, firings_path, T);
-    if (MLUtil::threadInterruptRequested()) {
+    if (!mp_compute_templates_stdevs(templates0, stdevs0, cache, mlproxy_url, timeseries_path, firings_path, T)) {
         task.error("Halted **");
         return;
     }
@@ -0,0 +1,261 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "mvcomputationcache.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QWaitCondition>
+#include <diskreadmda.h>
+#include <mountainprocessrunner.h>
+#include <taskprogress.h>
+
+#define DEFAULT_MEMORY_BUDGET (512LL * 1024 * 1024)
+#define PROCESS_OUTPUTS_NOMINAL_BYTES 4096 //the entry itself, on top of the paths
+
+class MVProcessOutputs : public MVCachedValue {
+public:
+    QMap<QString, QString> paths;
+
+    bigint numBytes() const Q_DECL_OVERRIDE
+    {
+        //small, but not free, so that a long session does not collect them without bound
+        bigint ret = PROCESS_OUTPUTS_NOMINAL_BYTES;
+        for (auto it = paths.constBegin(); it != paths.constEnd(); ++it) {
+            ret += (it.key().count() + it.value().count()) * sizeof(QChar);
+        }
+        return ret;
+    }
+};
+
+struct MVComputationCacheEntry {
+    bool computing = true;
+    QSharedPointer<const MVCachedValue> value;
+    bigint num_bytes = 0;
+    bigint last_access = 0;
+};
+
+class MVComputationCachePrivate {
+public:
+    MVComputationCache* q;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_finished; //an entry was computed, or its computation was abandoned
+    QMap<QString, MVComputationCacheEntry> m_entries;
+    bigint m_memory_budget = DEFAULT_MEMORY_BUDGET;
+    bigint m_memory_used = 0;
+    bigint m_access_count = 0;
+
+    void remove(const QString& key);
+    void evict_to_budget(const QString& key_to_keep);
+};
+
+bigint MVFiringsColumns::numBytes() const
+{
+    return channels.count() * sizeof(int) + times.count() * sizeof(double) + labels.count() * sizeof(int) + amplitudes.count() * sizeof(double);
+}
+
+MVComputationCache::MVComputationCache()
+{
+    d = new MVComputationCachePrivate;
+    d->q = this;
+}
+
+MVComputationCache::~MVComputationCache()
+{
+    delete d;
+}
+
+void MVComputationCache::setMemoryBudget(bigint num_bytes)
+{
+    QMutexLocker locker(&d->m_mutex);
+    d->m_memory_budget = num_bytes;
+    d->evict_to_budget("");
+}
+
+bigint MVComputationCache::memoryBudget() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_memory_budget;
+}
+
+bigint MVComputationCache::memoryUsed() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_memory_used;
+}
+
+void MVComputationCache::clear()
+{
+    QMutexLocker locker(&d->m_mutex);
+    //entries being computed stay, so that their threads can finish them
+    QStringList keys = d->m_entries.keys();
+    foreach (QString key, keys) {
+        if (!d->m_entries[key].computing)
+            d->remove(key);
+    }
+}
+
+static bool outputs_exist(const QMap<QString, QString>& paths)
+{
+    foreach (QString path, paths) {
+        if ((!path.startsWith("http")) && (!QFile::exists(path)))
+            return false;
+    }
+    return true;
+}
+
+QMap<QString, QString> MVComputationCache::runProcess(const QString& processor_name, const QMap<QString, QVariant>& params, const QStringList& output_names, const QString& mlproxy_url)
+{
+    QString key = "process:" + processor_name + ":" + mlproxy_url + ":";
+    QStringList param_names = params.keys(); //sorted
+    foreach (QString name, param_names) {
+        key += name + "=" + inputSignature(params[name].toString()) + "&";
+    }
+    key += ":" + output_names.join(",");
+
+    for (int pass = 0; pass < 2; pass++) {
+        QSharedPointer<const MVCachedValue> V = value(key, [&]() -> MVCachedValue* {
+            MountainProcessRunner MPR;
+            MPR.setProcessorName(processor_name);
+            MPR.setInputParameters(params);
+            MPR.setMLProxyUrl(mlproxy_url);
+            MVProcessOutputs* ret = new MVProcessOutputs;
+            foreach (QString name, output_names) {
+                ret->paths[name] = MPR.makeOutputFilePath(name);
+            }
+            MPR.runProcess();
+            if ((MLUtil::threadInterruptRequested()) || (!outputs_exist(ret->paths))) {
+                delete ret;
+                return 0;
+            }
+            return ret;
+        });
+        QSharedPointer<const MVProcessOutputs> P = qSharedPointerDynamicCast<const MVProcessOutputs>(V);
+        if (!P)
+            return QMap<QString, QString>();
+        if (outputs_exist(P->paths))
+            return P->paths;
+        //the outputs were removed (for example from the temporary directory) since the process ran
+        QMutexLocker locker(&d->m_mutex);
+        if ((d->m_entries.contains(key)) && (!d->m_entries[key].computing))
+            d->remove(key);
+    }
+    return QMap<QString, QString>();
+}
+
+QSharedPointer<const MVFiringsColumns> MVComputationCache::firingsColumns(const QString& firings_path)
+{
+    QString key = "firings_columns:" + inputSignature(firings_path);
+    QSharedPointer<const MVCachedValue> V = value(key, [&]() -> MVCachedValue* {
+        TaskProgress task(TaskProgress::Calculate, "Reading firings");
+        DiskReadMda F(firings_path);
+        Mda X;
+        if (!F.readChunk(X, 0, 0, F.N1(), F.N2())) {
+            task.error("Unable to read firings: " + firings_path);
+            return 0;
+        }
+        if (MLUtil::threadInterruptRequested())
+            return 0;
+        bigint L = X.N2();
+        MVFiringsColumns* ret = new MVFiringsColumns;
+        ret->channels.resize(L);
+        ret->times.resize(L);
+        ret->labels.resize(L);
+        ret->amplitudes.fill(0, L);
+        for (bigint i = 0; i < L; i++) {
+            ret->channels[i] = (int)X.value(0, i);
+            ret->times[i] = X.value(1, i);
+            ret->labels[i] = (int)X.value(2, i);
+            if (X.N1() > 3)
+                ret->amplitudes[i] = X.value(3, i);
+            if (ret->labels[i] > ret->K)
+                ret->K = ret->labels[i];
+        }
+        return ret;
+    });
+    return qSharedPointerDynamicCast<const MVFiringsColumns>(V);
+}
+
+QSharedPointer<const MVCachedValue> MVComputationCache::value(const QString& key, std::function<MVCachedValue*()> compute)
+{
+    QMutexLocker locker(&d->m_mutex);
+    while (d->m_entries.contains(key)) {
+        MVComputationCacheEntry& E = d->m_entries[key];
+        if (!E.computing) {
+            E.last_access = ++d->m_access_count;
+            return E.value;
+        }
+        //another thread is computing it; check for our own interruption now and then while waiting
+        if (MLUtil::threadInterruptRequested())
+            return QSharedPointer<const MVCachedValue>();
+        d->m_finished.wait(&d->m_mutex, 100);
+    }
+    d->m_entries[key] = MVComputationCacheEntry();
+    locker.unlock();
+
+    MVCachedValue* val = compute();
+    if ((val) && (MLUtil::threadInterruptRequested())) {
+        //possibly incomplete
+        delete val;
+        val = 0;
+    }
+
+    locker.relock();
+    QSharedPointer<const MVCachedValue> ret(val);
+    if (!val) {
+        d->m_entries.remove(key);
+    }
+    else {
+        MVComputationCacheEntry& E = d->m_entries[key];
+        E.computing = false;
+        E.value = ret;
+        E.num_bytes = val->numBytes();
+        E.last_access = ++d->m_access_count;
+        d->m_memory_used += E.num_bytes;
+        d->evict_to_budget(key);
+    }
+    d->m_finished.wakeAll();
+    return ret;
+}
+
+QString MVComputationCache::inputSignature(const QString& path)
+{
+    if (path.isEmpty() || path.startsWith("http"))
+        return path;
+    QFileInfo info(path);
+    if (!info.isFile())
+        return path;
+    return QString("%1(%2,%3)").arg(path).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+}
+
+void MVComputationCachePrivate::remove(const QString& key)
+{
+    m_memory_used -= m_entries[key].num_bytes;
+    m_entries.remove(key);
+}
+
+void MVComputationCachePrivate::evict_to_budget(const QString& key_to_keep)
+{
+    while (m_memory_used > m_memory_budget) {
+        QString oldest_key;
+        bigint oldest_access = 0;
+        QStringList keys = m_entries.keys();
+        foreach (QString key, keys) {
+            const MVComputationCacheEntry& E = m_entries[key];
+            if ((E.computing) || (!E.num_bytes) || (key == key_to_keep))
+                continue;
+            if ((oldest_key.isEmpty()) || (E.last_access < oldest_access)) {
+                oldest_key = key;
+                oldest_access = E.last_access;
+            }
+        }
+        if (oldest_key.isEmpty())
+            return;
+        remove(oldest_key);
+    }
+}
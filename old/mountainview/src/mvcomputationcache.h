@@ -0,0 +1,79 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef MVCOMPUTATIONCACHE_H
+#define MVCOMPUTATIONCACHE_H
+
+#include <QMap>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <functional>
+#include "mlcommon.h"
+
+/*
+ * The results of the calculations behind the views, shared by all the views of a context
+ * (MVContext::computationCache()), so that opening several views on a dataset does each calculation once.
+ *
+ * Entries are keyed by the operation, its inputs and its parameters. Input files are identified by path,
+ * size and modification time, so an entry stays valid for as long as its inputs are unchanged (in particular
+ * across merging and cluster visibility changes, which do not touch the firings). A request for an entry
+ * that another thread is computing waits for that thread rather than repeating the work.
+ *
+ * In-memory values are dropped, least recently used first, when together they exceed the memory budget.
+ * Processor runs only hold the paths of their outputs. They count against the budget at a small nominal
+ * size, and they are also forgotten when those files disappear.
+ *
+ * The requests block, so they are made from runCalculation() (not from the gui thread). A computation
+ * that is halted or fails is not cached.
+ */
+
+class MVCachedValue {
+public:
+    virtual ~MVCachedValue() {}
+    virtual bigint numBytes() const = 0;
+};
+
+//the rows of a firings file
+class MVFiringsColumns : public MVCachedValue {
+public:
+    QVector<int> channels;
+    QVector<double> times;
+    QVector<int> labels;
+    QVector<double> amplitudes; //zeros when the firings have no fourth row
+    int K = 0;
+
+    bigint numBytes() const Q_DECL_OVERRIDE;
+};
+
+class MVComputationCachePrivate;
+class MVComputationCache {
+public:
+    friend class MVComputationCachePrivate;
+    MVComputationCache();
+    virtual ~MVComputationCache();
+
+    void setMemoryBudget(bigint num_bytes);
+    bigint memoryBudget() const;
+    bigint memoryUsed() const;
+    void clear();
+
+    //Runs the processor through MountainProcessRunner, unless it has already run with these parameters, and
+    //returns the paths of the requested outputs by name. Empty when halted or failed.
+    QMap<QString, QString> runProcess(const QString& processor_name, const QMap<QString, QVariant>& params, const QStringList& output_names, const QString& mlproxy_url);
+
+    QSharedPointer<const MVFiringsColumns> firingsColumns(const QString& firings_path);
+
+    //The value for the key, calling compute (in this thread) when it is not cached. compute returns 0 when
+    //halted or failed. Use inputSignature() for the files that the value is computed from.
+    QSharedPointer<const MVCachedValue> value(const QString& key, std::function<MVCachedValue*()> compute);
+
+    static QString inputSignature(const QString& path);
+
+private:
+    MVComputationCachePrivate* d;
+};
+
+#endif // MVCOMPUTATIONCACHE_H
@@ -53,6 +53,7 @@ public:
     QList<double> m_cluster_order_scores;
     QString m_cluster_order_scores_name;
     QSet<int> m_clusters_to_force_show;
+    MVComputationCache m_computation_cache;
 
     void update_current_and_selected_clusters_according_to_merged();
     void set_default_options();
@@ -485,6 +486,11 @@ int MVContext::K()
     return d->m_K;
 }
 
+MVComputationCache* MVContext::computationCache() const
+{
+    return &d->m_computation_cache;
+}
+
 void MVContext::setSampleRate(double sample_rate)
 {
     /*
@@ -69,6 +69,7 @@ struct ElectrodeGeometry {
 
 #include "mvabstractcontext.h"
 #include "mvmisc.h"
+#include "mvcomputationcache.h"
 
 class MVContextPrivate;
 class MVContext : public MVAbstractContext {
@@ -190,6 +191,10 @@ public:
     QString mlProxyUrl() const;
     void setMLProxyUrl(QString url);
 
+    /////////////////////////////////////////////////
+    //shared by the calculations of all the views
+    MVComputationCache* computationCache() const;
+
     /////////////////////////////////////////////////
     void copySettingsFrom(MVContext* other);
 
@@ -9,7 +9,6 @@
 #include <QSpinBox>
 #include <QVBoxLayout>
 #include <diskreadmda32.h>
-#include <mountainprocessrunner.h>
 #include <mvcontext.h>
 #include <taskprogress.h>
 
@@ -25,6 +24,7 @@ public:
     QString firings;
     QString timeseries;
     MVAmpHistView3::AmplitudeMode amplitude_mode;
+    MVComputationCache* cache;
 
     //output
     QList<AmpHistogram3> histograms;
@@ -121,6 +121,7 @@ void MVAmpHistView3::prepareCalculation()
     d->m_computer.firings = c->firings().makePath();
     d->m_computer.timeseries = c->currentTimeseries().makePath();
     d->m_computer.amplitude_mode = d->m_amplitude_mode;
+    d->m_computer.cache = c->computationCache();
 }
 
 void MVAmpHistView3::runCalculation()
@@ -254,23 +255,12 @@ void MVAmpHistView3::slot_current_cluster_changed()
     }
 }
 
-DiskReadMda compute_amplitudes(QString timeseries, QString firings, QString mlproxy_url)
+QString compute_amplitudes(MVComputationCache* cache, QString timeseries, QString firings, QString mlproxy_url)
 {
-    MountainProcessRunner X;
-    QString processor_name = "compute_amplitudes";
-    X.setProcessorName(processor_name);
-
     QMap<QString, QVariant> params;
     params["timeseries"] = timeseries;
     params["firings"] = firings;
-    X.setInputParameters(params);
-    X.setMLProxyUrl(mlproxy_url);
-
-    QString firings_out_fname = X.makeOutputFilePath("firings_out");
-
-    X.runProcess();
-    DiskReadMda ret(firings_out_fname);
-    return ret;
+    return cache->runProcess("compute_amplitudes", params, QStringList("firings_out"), mlproxy_url).value("firings_out");
 }
 
 void MVAmpHistView3Computer::compute()
@@ -279,24 +269,21 @@ void MVAmpHistView3Computer::compute()
 
     histograms.clear();
 
-    DiskReadMda firings2;
+    QString firings2 = firings;
     if (amplitude_mode == MVAmpHistView3::ComputeAmplitudes) {
-        firings2 = compute_amplitudes(timeseries, firings, mlproxy_url);
+        firings2 = compute_amplitudes(cache, timeseries, firings, mlproxy_url);
+        if (firings2.isEmpty())
+            return;
     }
-    else {
-        firings2 = DiskReadMda(firings);
-    }
-
-    QVector<int> labels;
-    //QVector<double> amplitudes;
-    int L = firings2.N2();
 
     task.setProgress(0.2);
-    for (int n = 0; n < L; n++) {
-        labels << (int)firings2.value(2, n);
-    }
+    QSharedPointer<const MVFiringsColumns> F = cache->firingsColumns(firings2);
+    if (!F)
+        return;
+    const QVector<int>& labels = F->labels;
+    int L = labels.count();
 
-    int K = MLCompute::max<int>(labels);
+    int K = F->K;
 
     //assemble the histograms index 0 <--> k=1
     for (int k = 1; k <= K; k++) {
@@ -305,10 +292,9 @@ void MVAmpHistView3Computer::compute()
         this->histograms << HH;
     }
 
-    int row = 3; //for amplitudes
     for (int n = 0; n < L; n++) {
-        int label0 = (int)firings2.value(2, n);
-        double amp0 = firings2.value(row, n);
+        int label0 = labels[n];
+        double amp0 = F->amplitudes[n];
         if ((label0 >= 1) && (label0 <= K)) {
             this->histograms[label0 - 1].data << amp0;
         }
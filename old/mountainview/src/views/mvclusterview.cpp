@@ -13,6 +13,7 @@
 #include "mlcommon.h"
 #include "mvcontext.h"
 #include <QMenu>
+#include <algorithm>
 
 class MVClusterViewPrivate : public QObject {
     Q_OBJECT
@@ -21,6 +22,7 @@ public:
     Mda m_data;
     Mda m_data_proj;
     bool m_data_proj_needed;
+    double m_max_abs_val; //computed along with m_data_proj
     Mda m_data_trans;
     bool m_data_trans_needed;
     int m_current_event_index;
@@ -86,6 +88,7 @@ MVClusterView::MVClusterView(MVAbstractContext* context, QWidget* parent)
     d->m_grid_N1 = d->m_grid_N2 = 300;
     d->m_grid_update_needed = false;
     d->m_data_proj_needed = true;
+    d->m_max_abs_val = 0;
     d->m_data_trans_needed = true;
     d->m_anchor_point = QPointF(-1, -1);
     d->m_last_mouse_release_point = QPointF(-1, -1);
@@ -418,6 +421,13 @@ void MVClusterViewPrivate::slot_emit_transformation_changed()
 
 void MVClusterViewPrivate::compute_data_proj()
 {
+    m_max_abs_val = 0;
+    int NN = m_data.totalSize();
+    for (int i = 0; i < NN; i++) {
+        const double cur_abs_val = fabs(m_data.get(i));
+        if (cur_abs_val > m_max_abs_val)
+            m_max_abs_val = cur_abs_val;
+    }
     if (m_data.N2() <= 1)
         return;
     m_data_proj.allocate(3, m_data.N2());
@@ -438,12 +448,49 @@ void MVClusterViewPrivate::compute_data_trans()
     double* BB = m_data_trans.dataPtr();
     double MM[16];
     m_transformation.getMatrixData(MM);
-    int aaa = 0;
+#pragma omp parallel for
     for (int i = 0; i < N2; i++) {
+        int aaa = 3 * i;
         BB[aaa + 0] = AA[aaa + 0] * MM[0] + AA[aaa + 1] * MM[1] + AA[aaa + 2] * MM[2] + MM[3];
         BB[aaa + 1] = AA[aaa + 0] * MM[4] + AA[aaa + 1] * MM[5] + AA[aaa + 2] * MM[6] + MM[7];
         BB[aaa + 2] = AA[aaa + 0] * MM[8] + AA[aaa + 1] * MM[9] + AA[aaa + 2] * MM[10] + MM[11];
-        aaa += 3;
+    }
+}
+
+/*
+ * Gaussian blur of an N1xN2 grid, with the kernel truncated at radius rad. The kernel is separable,
+ * so this is done as two 1D passes (each row in parallel).
+ */
+void separable_gaussian_blur(double* out, const double* in, int N1, int N2, int rad, double tau)
+{
+    QVector<double> kernel(2 * rad + 1);
+    for (int dd = -rad; dd <= rad; dd++)
+        kernel[dd + rad] = exp(-0.5 * (dd * dd) / (tau * tau));
+    QVector<double> tmp(N1 * N2);
+    double* tmp_ptr = tmp.data();
+#pragma omp parallel for
+    for (int i2 = 0; i2 < N2; i2++) {
+        const double* row = &in[N1 * i2];
+        for (int i1 = 0; i1 < N1; i1++) {
+            int dd1 = qMax(-rad, -i1), dd2 = qMin(rad, N1 - 1 - i1);
+            double sum = 0;
+            for (int dd = dd1; dd <= dd2; dd++)
+                sum += row[i1 + dd] * kernel[dd + rad];
+            tmp_ptr[i1 + N1 * i2] = sum;
+        }
+    }
+#pragma omp parallel for
+    for (int i2 = 0; i2 < N2; i2++) {
+        double* row = &out[N1 * i2];
+        for (int i1 = 0; i1 < N1; i1++)
+            row[i1] = 0;
+        int dd1 = qMax(-rad, -i2), dd2 = qMin(rad, N2 - 1 - i2);
+        for (int dd = dd1; dd <= dd2; dd++) {
+            const double* row2 = &tmp_ptr[N1 * (i2 + dd)];
+            double kk = kernel[dd + rad];
+            for (int i1 = 0; i1 < N1; i1++)
+                row[i1] += row2[i1] * kk;
+        }
     }
 }
 
@@ -479,34 +526,20 @@ void MVClusterViewPrivate::update_grid()
     }
     int kernel_rad = 10;
     double kernel_tau = 3;
-    double kernel[(kernel_rad * 2 + 1) * (kernel_rad * 2 + 1)];
-    {
-        int aa = 0;
-        for (int dy = -kernel_rad; dy <= kernel_rad; dy++) {
-            for (int dx = -kernel_rad; dx <= kernel_rad; dx++) {
-                kernel[aa] = exp(-0.5 * (dx * dx + dy * dy) / (kernel_tau * kernel_tau));
-                aa++;
-            }
-        }
-    }
     int N1 = m_grid_N1, N2 = m_grid_N2;
 
     m_point_grid.allocate(N1, N2);
-    for (int i = 0; i < N1 * N2; i++)
-        m_point_grid.set(-1, i);
     double* m_point_grid_ptr = m_point_grid.dataPtr();
+    std::fill(m_point_grid_ptr, m_point_grid_ptr + N1 * N2, -1);
 
     if (m_mode == MVCV_MODE_TIME_COLORS) {
         m_time_grid.allocate(N1, N2);
-        for (int i = 0; i < N1 * N2; i++)
-            m_time_grid.set(-1, i);
+        std::fill(m_time_grid.dataPtr(), m_time_grid.dataPtr() + N1 * N2, -1);
     }
     double* m_time_grid_ptr = m_time_grid.dataPtr();
 
     if (m_mode == MVCV_MODE_AMPLITUDE_COLORS) {
         m_amplitude_grid.allocate(N1, N2);
-        for (int i = 0; i < N1 * N2; i++)
-            m_amplitude_grid.set(0, i);
     }
     double* m_amplitude_grid_ptr = m_amplitude_grid.dataPtr();
 
@@ -521,19 +554,34 @@ void MVClusterViewPrivate::update_grid()
     }
     double* z_grid_ptr = z_grid.dataPtr();
 
-    double max_abs_val = 0;
-    int NN = m_data.totalSize();
-    for (int i = 0; i < NN; i++) {
-        const double cur_abs_val = fabs(m_data.get(i));
-        if (cur_abs_val > max_abs_val)
-            max_abs_val = cur_abs_val;
+    double max_abs_val = m_max_abs_val;
+
+    if (m_mode == MVCV_MODE_HEAT_DENSITY) {
+        // Bin the points and blur the histogram, which is the same as adding the gaussian kernel at every point
+        // but costs O(grid size) rather than O(number of points * kernel size)
+        Mda histogram(N1, N2);
+        double* histogram_ptr = histogram.dataPtr();
+        const double* BB = m_data_trans.constDataPtr();
+        for (int j = 0; j < m_data_trans.N2(); j++) {
+            if (active_cluster_numbers.contains(m_labels.value(j))) {
+                double i1, i2;
+                coord2gridindex(BB[3 * j], BB[3 * j + 1], i1, i2);
+                int ii1 = (int)(i1 + 0.5);
+                int ii2 = (int)(i2 + 0.5);
+                if ((ii1 - kernel_rad >= 0) && (ii1 + kernel_rad < N1) && (ii2 - kernel_rad >= 0) && (ii2 + kernel_rad < N2)) {
+                    histogram_ptr[ii1 + N1 * ii2]++;
+                    m_point_grid_ptr[ii1 + N1 * ii2] = 1;
+                }
+            }
+        }
+        separable_gaussian_blur(m_heat_map_grid_ptr, histogram_ptr, N1, N2, kernel_rad, kernel_tau);
     }
 
     QVector<double> x0s, y0s, z0s;
     QVector<int> label0s;
     QVector<double> time0s;
     QVector<double> amp0s;
-    for (int j = 0; j < m_data_trans.N2(); j++) {
+    for (int j = 0; (m_mode != MVCV_MODE_HEAT_DENSITY) && (j < m_data_trans.N2()); j++) {
         int label0 = m_labels.value(j);
         if (active_cluster_numbers.contains(label0)) {
             double x0 = m_data_trans.value(0, j);
@@ -591,10 +639,6 @@ void MVClusterViewPrivate::update_grid()
         int label0 = label0s[i];
         double time0 = time0s[i];
         double amp0 = amp0s[i];
-        double factor = 1;
-        //if (m_data_trans.value(2,j)>0) {
-        //factor=0.2;
-        //}
         double i1, i2;
         coord2gridindex(x0, y0, i1, i2);
         int ii1 = (int)(i1 + 0.5);
@@ -628,29 +672,6 @@ void MVClusterViewPrivate::update_grid()
                     z_grid_ptr[iiii] = z0;
                 }
             }
-            else {
-                m_point_grid_ptr[iiii] = 1;
-                /*
-                if (m_mode == MVCV_MODE_TIME_COLORS) {
-                    m_time_grid_ptr[iiii] = time0;
-                }
-                if (m_mode == MVCV_MODE_AMPLITUDE_COLORS) {
-                    m_amplitude_grid_ptr[iiii] = amp0;
-                }
-                */
-            }
-
-            if (m_mode == MVCV_MODE_HEAT_DENSITY) {
-                int aa = 0;
-                for (int dy = -kernel_rad; dy <= kernel_rad; dy++) {
-                    int ii2b = ii2 + dy;
-                    for (int dx = -kernel_rad; dx <= kernel_rad; dx++) {
-                        int ii1b = ii1 + dx;
-                        m_heat_map_grid_ptr[ii1b + N1 * ii2b] += kernel[aa] * factor;
-                        aa++;
-                    }
-                }
-            }
         }
     }
 
@@ -14,7 +14,6 @@
 #include <QThread>
 #include <math.h>
 #include <mvcontext.h>
-#include "mountainprocessrunner.h"
 #include <QDir>
 #include <QFileDialog>
 
@@ -30,6 +29,7 @@ public:
     QList<int> labels_to_use;
     QString features_mode; //"pca" or "channels"
     QVector<int> channels; //in case of feature_mode=="channels"
+    MVComputationCache* cache;
 
     //output
     Mda data;
@@ -236,6 +236,7 @@ void MVClusterWidget::prepareCalculation()
     d->m_computer.labels_to_use = d->m_labels_to_use;
     d->m_computer.features_mode = d->m_feature_mode;
     d->m_computer.channels = d->m_channels;
+    d->m_computer.cache = c->computationCache();
 }
 
 void MVClusterWidget::runCalculation()
@@ -495,57 +496,33 @@ void MVClusterWidgetComputer::compute()
             labels_str += QString("%1").arg(x);
         }
 
-        MountainProcessRunner MT;
-        QString processor_name = "mv_subfirings";
-        MT.setProcessorName(processor_name);
-
         task.log(QString("firings = %1").arg(firings.makePath()));
 
         QMap<QString, QVariant> params;
         params["firings"] = firings.makePath();
         params["labels"] = labels_str;
-        MT.setInputParameters(params);
-        //MT.setMscmdServerUrl(mscmdserver_url);
-        MT.setMLProxyUrl(mlproxy_url);
-
-        firings_out_path = MT.makeOutputFilePath("firings_out");
-
-        MT.runProcess();
+        firings_out_path = cache->runProcess("mv_subfirings", params, QStringList("firings_out"), mlproxy_url).value("firings_out");
     }
 
-    if (MLUtil::threadInterruptRequested()) {
+    if ((MLUtil::threadInterruptRequested()) || (firings_out_path.isEmpty())) {
         return;
     }
 
     QString features_path;
     if (features_mode == "pca") {
-        MountainProcessRunner MT;
-        QString processor_name = "extract_clips_features";
-        MT.setProcessorName(processor_name);
-
         QMap<QString, QVariant> params;
         params["timeseries"] = timeseries.makePath();
         params["firings"] = firings_out_path;
         params["clip_size"] = clip_size;
         params["num_features"] = 3;
         params["subtract_mean"] = 1;
-        MT.setInputParameters(params);
-        //MT.setMscmdServerUrl(mscmdserver_url);
-        MT.setMLProxyUrl(mlproxy_url);
-
-        features_path = MT.makeOutputFilePath("features");
+        features_path = cache->runProcess("extract_clips_features", params, QStringList("features"), mlproxy_url).value("features");
 
-        MT.runProcess();
-
-        if (MLUtil::threadInterruptRequested()) {
+        if ((MLUtil::threadInterruptRequested()) || (features_path.isEmpty())) {
             return;
         }
     }
     else if (features_mode == "channels") {
-        MountainProcessRunner MT;
-        QString processor_name = "extract_channel_values";
-        MT.setProcessorName(processor_name);
-
         QStringList channels_strlist;
         foreach (int ch, channels) {
             channels_strlist << QString("%1").arg(ch);
@@ -555,14 +532,9 @@ void MVClusterWidgetComputer::compute()
         params["timeseries"] = timeseries.makePath();
         params["firings"] = firings_out_path;
         params["channels"] = channels_strlist.join(",");
-        MT.setInputParameters(params);
-        MT.setMLProxyUrl(mlproxy_url);
-
-        features_path = MT.makeOutputFilePath("values");
+        features_path = cache->runProcess("extract_channel_values", params, QStringList("values"), mlproxy_url).value("values");
 
-        MT.runProcess();
-
-        if (MLUtil::threadInterruptRequested()) {
+        if ((MLUtil::threadInterruptRequested()) || (features_path.isEmpty())) {
             return;
         }
     }
@@ -571,16 +543,13 @@ void MVClusterWidgetComputer::compute()
         err.error("Unrecognized features mode: " + features_mode);
         return;
     }
-    DiskReadMda F(firings_out_path);
+    QSharedPointer<const MVFiringsColumns> F = cache->firingsColumns(firings_out_path);
+    if (!F)
+        return;
 
-    times.clear();
-    labels.clear();
-    amplitudes.clear();
-    for (int j = 0; j < F.N2(); j++) {
-        times << F.value(1, j);
-        labels << (int)F.value(2, j);
-        amplitudes << F.value(3, j);
-    }
+    times = F->times;
+    labels = F->labels;
+    amplitudes = F->amplitudes;
 
     if (MLUtil::threadInterruptRequested()) {
         return;
@@ -1,4 +1,3 @@
-#include "mountainprocessrunner.h"
 #include "mvdiscrimhistview.h"
 
 #include <QGridLayout>
@@ -22,6 +21,7 @@ public:
     DiskReadMda firings;
     QList<int> cluster_numbers;
     QString method;
+    MVComputationCache* cache;
 
     //output
     QList<DiscrimHistogram> histograms;
@@ -87,6 +87,7 @@ void MVDiscrimHistView::prepareCalculation()
     d->m_computer.firings = c->firings();
     d->m_computer.cluster_numbers = d->m_cluster_numbers;
     d->m_computer.method = c->option("discrim_hist_method").toString();
+    d->m_computer.cache = c->computationCache();
 }
 
 void MVDiscrimHistView::runCalculation()
@@ -144,10 +145,6 @@ void MVDiscrimHistViewComputer::compute()
 
     histograms.clear();
 
-    MountainProcessRunner MPR;
-    MPR.setMLProxyUrl(mlproxy_url);
-    MPR.setProcessorName("mv_discrimhist");
-
     QStringList clusters_strlist;
     foreach (int cluster, cluster_numbers) {
         clusters_strlist << QString("%1").arg(cluster);
@@ -158,11 +155,9 @@ void MVDiscrimHistViewComputer::compute()
     params["firings"] = firings.makePath();
     params["clusters"] = clusters_strlist.join(",");
     params["method"] = method;
-    MPR.setInputParameters(params);
-
-    QString output_path = MPR.makeOutputFilePath("output");
-
-    MPR.runProcess();
+    QString output_path = cache->runProcess("mv_discrimhist", params, QStringList("output"), mlproxy_url).value("output");
+    if (output_path.isEmpty())
+        return;
 
     DiskReadMda output(output_path);
     //output.setRemoteDataType("float32");
@@ -1,4 +1,3 @@
-#include "mountainprocessrunner.h"
 #include "mvdiscrimhistview_guide.h"
 
 #include <QGridLayout>
@@ -24,6 +23,7 @@ public:
     QSet<int> clusters_to_exclude; //old version
     QList<int> cluster_numbers;
     QString method; //old version
+    MVComputationCache* cache;
 
     //output
     QList<DiscrimHistogram> histograms;
@@ -90,6 +90,7 @@ void MVDiscrimHistViewGuide::prepareCalculation()
     d->m_computer.clusters_to_exclude = d->get_clusters_to_exclude();
     d->m_computer.cluster_numbers = c->selectedClusters();
     d->m_computer.method = c->option("discrim_hist_method").toString();
+    d->m_computer.cache = c->computationCache();
 }
 
 void MVDiscrimHistViewGuide::runCalculation()
@@ -138,9 +139,6 @@ void MVDiscrimHistViewGuideComputer::compute()
 
     histograms.clear();
 
-    MountainProcessRunner MPR;
-    MPR.setMLProxyUrl(mlproxy_url);
-
     /*
     MPR.setProcessorName("mv_discrimhist_guide");
     QMap<QString, QVariant> params;
@@ -151,7 +149,6 @@ void MVDiscrimHistViewGuideComputer::compute()
     params["method"]=method;
     */
 
-    MPR.setProcessorName("mv_discrimhist_guide2");
     QMap<QString, QVariant> params;
     params["timeseries"] = timeseries.makePath();
     params["firings"] = firings.makePath();
@@ -160,11 +157,9 @@ void MVDiscrimHistViewGuideComputer::compute()
     params["cluster_numbers"] = MLUtil::intListToStringList(cluster_numbers).join(",");
     params["max_comparisons_per_cluster"] = 5;
 
-    MPR.setInputParameters(params);
-
-    QString output_path = MPR.makeOutputFilePath("output");
-
-    MPR.runProcess();
+    QString output_path = cache->runProcess("mv_discrimhist_guide2", params, QStringList("output"), mlproxy_url).value("output");
+    if (output_path.isEmpty())
+        return;
 
     DiskReadMda output(output_path);
     //output.setRemoteDataType("float32");
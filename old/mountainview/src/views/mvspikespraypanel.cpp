@@ -1,6 +1,7 @@
 #include "mvspikespraypanel.h"
 
 #include <QList>
+#include <QMap>
 #include <QMutex>
 #include <QPainter>
 #include <QPen>
@@ -9,6 +10,7 @@
 #include <QTimer>
 #include "mda.h"
 #include "mlcommon.h"
+#include <math.h>
 
 /*!
  * \class MVSpikeSprayPanelControl
@@ -52,6 +54,11 @@
  * \class MVSSRenderer
  * \brief The MVSSRenderer class represents an object used to perform rendering of a spike spray
  *        panel, likely in a separate thread.
+ *
+ * Rather than painting the clips one by one, the renderer accumulates the stroke coverage of
+ * all clips of a group (label) into a float density buffer and converts the buffers into an
+ * image in a single tone-mapping pass. Changing the colors or opacities (brightness, weight)
+ * only requires the tone mapping to be redone.
  */
 
 /*!
@@ -101,12 +108,16 @@ public:
     QList<QColor> labelColors;
     Mda* clipsToRender = nullptr;
     QVector<int> renderLabels;
+    QVector<int> groupLabels; // the label of each renderer group
+    QVector<int> labelCounts; // number of rendered clips of each label
     bool needsRerender = true;
     QThread* renderThread;
     MVSSRenderer* renderer = nullptr;
     QImage render;
     int progress = 0;
     int allocProgress = 0;
+
+    MVSSRenderer::ToneMap compute_tone_map() const;
 };
 
 class MVSpikeSprayPanelPrivate {
@@ -227,81 +238,187 @@ void MVSSRenderer::render()
     image.fill(Qt::transparent); // and make it transparent
     replaceImage(image); // replace the current image
     emit imageUpdated(0); // and report we've just begun
-    QPainter painter(&image);
-    painter.setRenderHint(QPainter::Antialiasing);
     // the algorithm is performing lazy memory allocation. This is the last spot we can
     // do the actual allocation (and copy). Bail out if interruption is requested.
     clips = allocator.allocate([this]() { return isInterruptionRequested(); });
 
     const int L = clips.N3();
-    if (L != colors.count()) {
-        qWarning() << "Unexpected sizes: " << colors.count() << L;
+    if (L != clip_groups.count()) {
+        qWarning() << "Unexpected sizes: " << clip_groups.count() << L;
         return;
     }
+    densities.clear();
+    for (int k = 0; k < num_groups; k++)
+        densities << QVector<float>(W * H, 0);
     QTime timer;
     timer.start();
-    for (int i = 0; i < L; i++) {
+    const int batch_size = 1000;
+    for (int i = 0; i < L; i += batch_size) {
+        if (isInterruptionRequested()) {
+            return;
+        }
+        rasterize_clips(i, qMin(L, i + batch_size)); // render one step
         if (timer.elapsed() > 300) { // each 300ms report an intermediate result
-            replaceImage(image);
+            replaceImage(toneMappedImage());
             emit imageUpdated(100 * i / L);
             timer.restart();
         }
-        if (isInterruptionRequested()) {
-            return;
-        }
-        render_clip(&painter, i); // render one step
     }
-    replaceImage(image); // we're done, expose the result
+    replaceImage(toneMappedImage()); // we're done, expose the result
+    emit imageUpdated(100);
+}
+
+/*!
+ * \brief MVSSRenderer::retone recomputes the image from the accumulated densities using the current tone map.
+ */
+void MVSSRenderer::retone()
+{
+    if ((densities.isEmpty()) || (isInterruptionRequested()))
+        return;
+    replaceImage(toneMappedImage());
     emit imageUpdated(100);
 }
 
+namespace {
 /*!
- * \brief MVSSRenderer::render_clip performs rendering of a single clip
+ * \brief Adds the coverage of the vertical span [y0, y1] (at least one pixel high) to a column of a density buffer
+ */
+void add_vertical_span(float* col, int H, double y0, double y1)
+{
+    if (y0 > y1)
+        std::swap(y0, y1);
+    if (y1 - y0 < 1) {
+        double center = (y0 + y1) / 2;
+        y0 = center - 0.5;
+        y1 = center + 0.5;
+    }
+    if ((y1 <= 0) || (y0 >= H))
+        return;
+    int r0 = (int)floor(y0);
+    int r1 = (int)floor(y1);
+    if (r0 >= 0)
+        col[r0] += r0 + 1 - y0;
+    if (r1 < H)
+        col[r1] += y1 - r1;
+    int a = qMax(r0 + 1, 0);
+    int b = qMin(r1, H);
+#pragma omp simd
+    for (int r = a; r < b; r++)
+        col[r] += 1;
+}
+}
+
+/*!
+ * \brief MVSSRenderer::rasterize_clips adds the strokes of clips i1 to i2-1 to the density buffers
  *
+ * Each segment between consecutive timepoints is rasterized column by column. The columns covered
+ * by one segment are not covered by any other, so the segments are handled in parallel.
  */
-void MVSSRenderer::render_clip(QPainter* painter, int i) const
+void MVSSRenderer::rasterize_clips(int i1, int i2)
 {
-    QColor col = colors[i];
     const int M = clips.N1();
     const int T = clips.N2();
-    const double* ptr = clips.constDataPtr() + (M * T * i);
-    QPen pen = painter->pen();
-    pen.setColor(col); // set proper color
-    painter->setPen(pen);
-    for (int m = 0; m < M; m++) {
-        QPainterPath path; // we're setting up a painter path
-        for (int t = 0; t < T; t++) {
-            double val = ptr[m + M * t];
-            QPointF pt = coord2pix(m, t, val);
-            if (t == 0) {
-                path.moveTo(pt);
-            }
-            else {
-                path.lineTo(pt); // plotting a curve
+    if ((T < 2) || (W <= 0) || (H <= 0))
+        return;
+    QRectF rect = plotRect();
+    const double* X = clips.constDataPtr();
+    QVector<float*> buffers;
+    for (int k = 0; k < densities.count(); k++)
+        buffers << densities[k].data();
+    QVector<double> y_offsets(M);
+    for (int m = 0; m < M; m++)
+        y_offsets[m] = rect.top() + (m + 0.5) / M * rect.height();
+    double y_scale = -amplitude_factor / M * rect.height();
+
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < T - 1; t++) {
+        double xa = rect.left() + (t + 0.5) / T * rect.width();
+        double xb = rect.left() + (t + 1.5) / T * rect.width();
+        // the columns whose centers lie in [xa,xb)
+        int x1 = qMax(0, (int)ceil(xa - 0.5));
+        int x2 = qMin(W, (int)ceil(xb - 0.5));
+        for (int i = i1; i < i2; i++) {
+            float* D = buffers[clip_groups[i]];
+            const double* ptr = X + (M * T * (bigint)i);
+            for (int m = 0; m < M; m++) {
+                double ya = y_offsets[m] + ptr[m + M * t] * y_scale;
+                double yb = y_offsets[m] + ptr[m + M * (t + 1)] * y_scale;
+                double slope = (yb - ya) / (xb - xa);
+                for (int x = x1; x < x2; x++) {
+                    double y0 = ya + (qMax((double)x, xa) - xa) * slope;
+                    double y1 = ya + (qMin(x + 1.0, xb) - xa) * slope;
+                    add_vertical_span(&D[x * H], H, y0, y1);
+                }
             }
         }
-        painter->drawPath(path); // render the complete painter path
     }
 }
 
-QPointF MVSSRenderer::coord2pix(int m, double t, double val) const
+QRectF MVSSRenderer::plotRect() const
 {
-    int M = clips.N1();
-    int clip_size = clips.N2();
     double margin_left = 20, margin_right = 20;
     double margin_top = 20, margin_bottom = 20;
-    /*
-    double max_width = 300;
-    if (q->width() - margin_left - margin_right > max_width) {
-        double diff = (q->width() - margin_left - margin_right) - max_width;
-        margin_left += diff / 2;
-        margin_right += diff / 2;
+    return QRectF(margin_left, margin_top, W - margin_left - margin_right, H - margin_top - margin_bottom);
+}
+
+void MVSSRenderer::setToneMap(const MVSSRenderer::ToneMap& tm)
+{
+    QMutexLocker locker(&tone_map_mutex);
+    tone_map = tm;
+}
+
+MVSSRenderer::ToneMap MVSSRenderer::toneMap() const
+{
+    QMutexLocker locker(&tone_map_mutex);
+    return tone_map;
+}
+
+/*!
+ * \brief MVSSRenderer::toneMappedImage converts the density buffers into an image
+ *
+ * A pixel covered n times by strokes of opacity a has opacity 1-(1-a)^n, as when the strokes are
+ * painted one over the other. The colors of the groups are mixed in proportion to their opacities.
+ */
+QImage MVSSRenderer::toneMappedImage() const
+{
+    ToneMap tm = toneMap();
+    QImage image(W, H, QImage::Format_ARGB32);
+    image.fill(Qt::transparent);
+    const int G = densities.count();
+    if ((tm.colors.count() != G) || (tm.alphas.count() != G))
+        return image;
+    QVector<const float*> buffers(G);
+    QVector<double> log_transmittance(G), reds(G), greens(G), blues(G);
+    for (int k = 0; k < G; k++) {
+        buffers[k] = densities[k].constData();
+        log_transmittance[k] = log(1 - qBound(0.0, tm.alphas[k], 0.999));
+        reds[k] = tm.colors[k].red();
+        greens[k] = tm.colors[k].green();
+        blues[k] = tm.colors[k].blue();
     }
-    */
-    QRectF rect(margin_left, margin_top, W - margin_left - margin_right, H - margin_top - margin_bottom);
-    double pctx = (t + 0.5) / clip_size;
-    double pcty = (m + 0.5) / M - val / M * amplitude_factor;
-    return QPointF(rect.left() + pctx * rect.width(), rect.top() + pcty * rect.height());
+    uchar* bits = image.bits();
+    const int bytes_per_line = image.bytesPerLine();
+#pragma omp parallel for
+    for (int y = 0; y < H; y++) {
+        QRgb* line = (QRgb*)(bits + y * bytes_per_line);
+        for (int x = 0; x < W; x++) {
+            double transmittance = 1, r = 0, g = 0, b = 0, wsum = 0;
+            for (int k = 0; k < G; k++) {
+                float dens = buffers[k][x * H + y];
+                if (dens <= 0)
+                    continue;
+                double opacity = 1 - exp(dens * log_transmittance[k]);
+                transmittance *= 1 - opacity;
+                r += opacity * reds[k];
+                g += opacity * greens[k];
+                b += opacity * blues[k];
+                wsum += opacity;
+            }
+            if (wsum > 0)
+                line[x] = qRgba((int)(r / wsum), (int)(g / wsum), (int)(b / wsum), (int)((1 - transmittance) * 255));
+        }
+    }
+    return image;
 }
 
 MVSpikeSprayPanelControl::MVSpikeSprayPanelControl(QObject* parent)
@@ -351,7 +468,7 @@ void MVSpikeSprayPanelControl::setBrightness(double brightness)
         return;
     d->brightness = brightness;
     emit brightnessChanged(brightness);
-    updateRender();
+    updateToneMap();
 }
 
 double MVSpikeSprayPanelControl::weight() const
@@ -365,7 +482,7 @@ void MVSpikeSprayPanelControl::setWeight(double weight)
         return;
     d->weight = weight;
     emit weightChanged(weight);
-    updateRender();
+    updateToneMap();
 }
 
 bool MVSpikeSprayPanelControl::legendVisible() const
@@ -502,7 +619,7 @@ void MVSpikeSprayPanelControl::setLabelColors(const QList<QColor>& labelColors)
         return;
     d->labelColors = labelColors;
     emit labelColorsChanged(labelColors);
-    update();
+    updateToneMap();
 }
 
 /*!
@@ -531,6 +648,19 @@ void MVSpikeSprayPanelControl::updateRender()
     update();
 }
 
+/*!
+ * \brief The updateToneMap method recolors the current render, without rasterizing the clips again.
+ */
+void MVSpikeSprayPanelControl::updateToneMap()
+{
+    if ((!d->renderer) || (d->needsRerender)) {
+        update();
+        return;
+    }
+    d->renderer->setToneMap(d->compute_tone_map());
+    QMetaObject::invokeMethod(d->renderer, "retone", Qt::QueuedConnection);
+}
+
 void MVSpikeSprayPanelControl::rerender()
 {
     d->needsRerender = false;
@@ -564,15 +694,7 @@ void MVSpikeSprayPanelControl::rerender()
             }
         }
     }
-    QVector<int> alphas(K + 1);
-    for (int k = 0; k <= K; k++) {
-        if ((counts[k]) && (weight())) {
-            alphas[k] = (int)(255.0 / counts[k] * 2 * weight());
-            alphas[k] = qBound(10, alphas[k], 255);
-        }
-        else
-            alphas[k] = 255;
-    }
+    d->labelCounts = counts;
 
     if (d->renderer) { // since we're chainging the conditions
         d->renderer->requestInterruption(); // stop the old rendering
@@ -592,16 +714,20 @@ void MVSpikeSprayPanelControl::rerender()
         emit d->renderer->allocateProgress(progress);
     };
 
-    d->renderer->colors.clear();
+    // one group (density buffer) per label
+    QMap<int, int> group_of_label;
+    d->groupLabels.clear();
+    d->renderer->clip_groups.clear();
     for (int j = 0; j < inds.count(); j++) {
         int label0 = d->renderLabels[inds[j]];
-        QColor col = d->labelColors[label0];
-        col = brighten(col, brightness());
-        if (label0 >= 0) {
-            col.setAlpha(alphas[label0]);
+        if (!group_of_label.contains(label0)) {
+            group_of_label[label0] = d->groupLabels.count();
+            d->groupLabels << label0;
         }
-        d->renderer->colors << col;
+        d->renderer->clip_groups << group_of_label[label0];
     }
+    d->renderer->num_groups = d->groupLabels.count();
+    d->renderer->setToneMap(d->compute_tone_map());
 
     d->renderer->amplitude_factor = amplitude();
     d->renderer->W = T * 4;
@@ -613,6 +739,24 @@ void MVSpikeSprayPanelControl::rerender()
     QMetaObject::invokeMethod(d->renderer, "render", Qt::QueuedConnection);
 }
 
+MVSSRenderer::ToneMap MVSpikeSprayPanelControlPrivate::compute_tone_map() const
+{
+    MVSSRenderer::ToneMap tm;
+    for (int j = 0; j < groupLabels.count(); j++) {
+        int label0 = groupLabels[j];
+        QColor col = (label0 < labelColors.count()) ? labelColors[label0] : QColor(Qt::white);
+        tm.colors << brighten(col, brightness);
+        // the densities are accumulated in floating point, so unlike 8-bit alpha blending there is
+        // no need for a lower bound of 10/255 on the opacity of a stroke
+        double alpha = 1;
+        int count = (label0 < labelCounts.count()) ? labelCounts[label0] : 0;
+        if ((count) && (weight))
+            alpha = qBound(0.0005, 2 * weight / count, 1.0);
+        tm.alphas << alpha;
+    }
+    return tm;
+}
+
 void MVSpikeSprayPanelControl::updateAllocProgress(int progress)
 {
     if (d->allocProgress == progress)
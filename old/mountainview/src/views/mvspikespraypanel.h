@@ -62,6 +62,7 @@ signals:
 
 protected:
     void updateRender();
+    void updateToneMap();
     void rerender();
 private slots:
     void updateAllocProgress(int);
@@ -95,13 +96,20 @@ private:
 class MVSSRenderer : public QObject {
     Q_OBJECT
 public:
+    // how the accumulated densities are turned into colors -- can change without re-rasterizing
+    struct ToneMap {
+        QList<QColor> colors; // one per group
+        QVector<double> alphas; // opacity of a single stroke, one per group
+    };
+
     Mda clips;
-    QList<QColor> colors;
+    QVector<int> clip_groups; // group (color) index of each clip
+    int num_groups = 0;
     double amplitude_factor;
     int W;
     int H;
-    QPointF coord2pix(int m, double t, double val) const;
-    void render_clip(QPainter* painter, int i) const;
+    QRectF plotRect() const;
+    void rasterize_clips(int i1, int i2);
 
     class ClipsAllocator {
     public:
@@ -116,6 +124,9 @@ public:
     };
 
     ClipsAllocator allocator;
+    void setToneMap(const ToneMap& tm);
+    ToneMap toneMap() const;
+    QImage toneMappedImage() const;
     void replaceImage(const QImage& img);
     QImage resultImage() const;
     void requestInterruption() { m_int = 1; }
@@ -125,11 +136,15 @@ public:
     void release();
 public slots:
     void render();
+    void retone();
 signals:
     void imageUpdated(int progress);
     void allocateProgress(int progress);
 
 private:
+    QList<QVector<float> > densities; // one W x H buffer per group, column-major so that vertical spans are contiguous
+    ToneMap tone_map;
+    mutable QMutex tone_map_mutex;
     QImage image_in_progress;
     mutable QMutex image_in_progress_mutex;
     QAtomicInteger<bool> m_int = 0;
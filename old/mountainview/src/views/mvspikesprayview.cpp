@@ -24,7 +24,6 @@
 #include <QSpinBox>
 
 /// TODO: (MEDIUM) spike spray should respond to mouse wheel and show current position with marker
-/// TODO: (MEDIUM) much more responsive rendering of spike spray
 /// TODO: (HIGH) Implement the panels as layers, make a layer stack, and handle zoom/pan without using a scroll widget
 /// TODO: (HIGH) GUI option to set max. number of spikespray spikes to render
 
@@ -183,7 +182,7 @@ MVSpikeSprayView::MVSpikeSprayView(MVAbstractContext* context)
 
     {
         QSpinBox* SB = new QSpinBox;
-        SB->setRange(1, 10000);
+        SB->setRange(1, 1000000);
         SB->setValue(d->m_max_spikes_per_label);
         QObject::connect(SB, SIGNAL(valueChanged(int)), this, SLOT(slot_set_max_spikes_per_label(int)));
         this->addToolbarControl(new QLabel("Max. #spikes:"));
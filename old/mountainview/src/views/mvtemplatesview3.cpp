@@ -10,7 +10,6 @@
 #include <QLabel>
 #include <QSpinBox>
 #include <QVBoxLayout>
-#include <mountainprocessrunner.h>
 #include <taskprogress.h>
 #include "actionfactory.h"
 
@@ -32,6 +31,7 @@ public:
     DiskReadMda32 timeseries;
     DiskReadMda firings;
     int clip_size;
+    MVComputationCache* cache;
 
     //output
     QList<ClusterData2> cluster_data;
@@ -41,7 +41,7 @@ public:
     bool loaded_from_static_output = false;
     QJsonObject exportStaticOutput();
     void loadStaticOutput(const QJsonObject& X);
-    static void mv_compute_templates_stdevs(DiskReadMda& templates_out, DiskReadMda& stdevs_out, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size);
+    static bool mv_compute_templates_stdevs(DiskReadMda& templates_out, DiskReadMda& stdevs_out, MVComputationCache* cache, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size);
 };
 
 class MVTemplatesView3Private {
@@ -122,6 +122,7 @@ void MVTemplatesView3::prepareCalculation()
     d->m_calculator.timeseries = c->currentTimeseries();
     d->m_calculator.firings = c->firings();
     d->m_calculator.clip_size = c->option("clip_size", 100).toInt();
+    d->m_calculator.cache = c->computationCache();
     d->m_calculator.cluster_data.clear();
     update();
 }
@@ -257,32 +258,31 @@ void MVTemplatesView3::slot_set_num_rows(int num_rows)
 }
 */
 
-void MVTemplatesView3Calculator::mv_compute_templates_stdevs(DiskReadMda& templates_out, DiskReadMda& stdevs_out, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size)
+bool MVTemplatesView3Calculator::mv_compute_templates_stdevs(DiskReadMda& templates_out, DiskReadMda& stdevs_out, MVComputationCache* cache, const QString& mlproxy_url, const QString& timeseries, const QString& firings, int clip_size)
 {
     TaskProgress task(TaskProgress::Calculate, "mv_compute_templates_stdevs");
     task.log("mlproxy_url: " + mlproxy_url);
-    MountainProcessRunner X;
-    QString processor_name = "mv_compute_templates";
-    X.setProcessorName(processor_name);
 
     QMap<QString, QVariant> params;
     params["timeseries"] = timeseries;
     params["firings"] = firings;
     params["clip_size"] = clip_size;
-    X.setInputParameters(params);
-    X.setMLProxyUrl(mlproxy_url);
 
-    QString templates_fname = X.makeOutputFilePath("templates");
-    QString stdevs_fname = X.makeOutputFilePath("stdevs");
+    QStringList output_names;
+    output_names << "templates"
+                 << "stdevs";
 
-    task.log("X.compute()");
-    X.runProcess();
-    task.log("Returning DiskReadMda: " + templates_fname + " " + stdevs_fname);
-    templates_out.setPath(templates_fname);
-    stdevs_out.setPath(stdevs_fname);
+    task.log("runProcess()");
+    QMap<QString, QString> outputs = cache->runProcess("mv_compute_templates", params, output_names, mlproxy_url);
+    if (outputs.isEmpty())
+        return false;
+    task.log("Returning DiskReadMda: " + outputs["templates"] + " " + outputs["stdevs"]);
+    templates_out.setPath(outputs["templates"]);
+    stdevs_out.setPath(outputs["stdevs"]);
 
     //templates_out.setRemoteDataType("float32_q8");
     //stdevs_out.setRemoteDataType("float32_q8");
+    return true;
 }
 
 void MVTemplatesView3Calculator::compute()
@@ -299,16 +299,17 @@ void MVTemplatesView3Calculator::compute()
 
     int M = timeseries.N1();
     //int N = timeseries.N2();
-    int L = firings.N2();
     int T = clip_size;
 
-    QVector<int> labels;
-
     task.log("Setting up labels");
     task.setProgress(0.2);
-    for (int i = 0; i < L; i++) {
-        labels << (int)firings.value(2, i);
+    QSharedPointer<const MVFiringsColumns> F = cache->firingsColumns(firings.makePath());
+    if (!F) {
+        task.error("Unable to read firings");
+        return;
     }
+    const QVector<int>& labels = F->labels;
+    int L = labels.count();
 
     if (MLUtil::threadInterruptRequested()) {
         task.error("Halted *");
@@ -319,7 +320,7 @@ void MVTemplatesView3Calculator::compute()
 
     task.setLabel("Computing templates");
     task.setProgress(0.4);
-    int K = MLCompute::max(labels);
+    int K = F->K;
 
     QString timeseries_path = timeseries.makePath();
     QString firings_path = firings.makePath();
@@ -327,8 +328,7 @@ void MVTemplatesView3Calculator::compute()
     task.log("mp_compute_templates_stdevs: " + mlproxy_url + " timeseries_path=" + timeseries_path + " firings_path=" + firings_path);
     task.setProgress(0.6);
     DiskReadMda templates0, stdevs0;
-    mv_compute_templates_stdevs(templates0, stdevs0, mlproxy_url, timeseries_path, firings_path, T);
-    if (MLUtil::threadInterruptRequested()) {
+    if (!mv_compute_templates_stdevs(templates0, stdevs0, cache, mlproxy_url, timeseries_path, firings_path, T)) {
         task.error("Halted **");
         return;
     }
@@ -38,6 +38,7 @@ public:
 private slots:
     void slot_brightness_slider_changed(int val);
     void slot_export_csv();
+    void slot_refresh_output();
 
 private:
     SpectrogramViewPrivate* d;
@@ -1,3 +0,0 @@
-function writemda16i(X,fname)
-writemda(X,fname,'int16');
-end
\ No newline at end of file
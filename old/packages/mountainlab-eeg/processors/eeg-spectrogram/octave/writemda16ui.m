@@ -1,3 +0,0 @@
-function writemda16ui(X,fname)
-writemda(X,fname,'uint16');
-end
\ No newline at end of file
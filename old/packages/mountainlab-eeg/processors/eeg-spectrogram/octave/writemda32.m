@@ -1,3 +0,0 @@
-function writemda32(X,fname)
-writemda(X,fname,'float32');
-end
\ No newline at end of file
@@ -1,3 +0,0 @@
-function writemda32ui(X,fname)
-writemda(X,fname,'uint32');
-end
\ No newline at end of file
@@ -1,3 +0,0 @@
-function writemda64(X,fname)
-writemda(X,fname,'float64');
-end
\ No newline at end of file
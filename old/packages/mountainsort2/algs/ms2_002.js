@@ -25,6 +25,7 @@ exports.spec=function() {
 	spec0.parameters=[];
 	spec0.parameters.push({name:"samplerate",description:"sample rate for timeseries",optional:false});
 	spec0.parameters.push({name:'segment_duration_sec',optional:true,default_value:3600});
+	spec0.parameters.push({name:'clustering_block_duration_sec',optional:true,default_value:0}); //0 means cluster all events at once
 	spec0.parameters.push({name:'num_threads',optional:true,default_value:0});
 	spec0.parameters.push({name:"central_channel",optional:true,default_value:0});
 	spec0.parameters.push({name:"clip_size_msec",optional:true,default_value:2});
@@ -438,10 +439,11 @@ exports.run=function(opts,callback) {
 
 	function STEP_sort_clips(sort_clips_callback) {
 		console.log ('-------------------- SORTING CLIPS -------------------');
+		var time_block_size=Math.ceil((opts.clustering_block_duration_sec||0)*opts.samplerate);
 		common.mp_exec_process('mountainsort.sort_clips',
-			{clips:clips},
+			{clips:clips,event_times:event_times},
 			{labels_out:labels},
-			{_request_num_threads:opts.num_threads},
+			{time_block_size:time_block_size,_request_num_threads:opts.num_threads},
 			sort_clips_callback
 		);	
 	}
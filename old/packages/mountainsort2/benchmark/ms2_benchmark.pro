@@ -0,0 +1,63 @@
+QT += core
+QT -= gui
+CONFIG -= app_bundle #Please apple, don't make a bundle today :)
+
+CONFIG += c++11
+
+include(../../../mlcommon/mlcommon.pri)
+include(../../../mlcommon/mda.pri)
+
+DESTDIR = ../bin
+OBJECTS_DIR = ../build_benchmark
+MOC_DIR=../build_benchmark
+TARGET = ms2_benchmark
+TEMPLATE = app
+
+#FFTW
+LIBS += -fopenmp -lfftw3 -lfftw3_threads
+
+#OPENMP
+!macx {
+  QMAKE_LFLAGS += -fopenmp
+  QMAKE_CXXFLAGS += -fopenmp
+}
+
+SOURCES += ms2_benchmark_main.cpp
+DEFINES += MS2_BENCHMARK_DIR=\\\"$$PWD/\\\"
+OTHER_FILES += baseline.json
+
+# the processors being benchmarked are compiled in directly
+INCLUDEPATH += ../src
+VPATH += ../src
+SOURCES += \
+    p_bandpass_filter.cpp \
+    p_whiten.cpp \
+    p_detect_events.cpp \
+    p_compute_amplitudes.cpp \
+    p_extract_clips.cpp \
+    p_sort_clips.cpp \
+    p_create_firings.cpp \
+    p_fit_stage.cpp \
+    p_isolation_metrics.cpp \
+    kdtree.cpp
+HEADERS += \
+    p_bandpass_filter.h \
+    p_whiten.h \
+    p_detect_events.h \
+    p_compute_amplitudes.h \
+    p_extract_clips.h \
+    p_sort_clips.h \
+    p_create_firings.h \
+    p_fit_stage.h \
+    p_isolation_metrics.h \
+    kdtree.h
+
+INCLUDEPATH += ../../../mountainsort/src/isosplit5
+VPATH += ../../../mountainsort/src/isosplit5
+HEADERS += isosplit5.h isocut5.h jisotonic5.h kmeans5.h
+SOURCES += isosplit5.cpp isocut5.cpp jisotonic5.cpp kmeans5.cpp
+
+INCLUDEPATH += ../../../mountainsort/src/utils
+VPATH += ../../../mountainsort/src/utils
+HEADERS += pca.h get_sort_indices.h compute_templates_0.h
+SOURCES += pca.cpp get_sort_indices.cpp compute_templates_0.cpp
@@ -0,0 +1,562 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+/*
+ * Benchmarks for the mountainsort2 processors
+ *
+ * Usage:
+ *   ms2_benchmark [--M=4] [--N=3e6] [--K=10] [--firing_rate=5] [--samplerate=30000] [--seed=1]
+ *                 [--stages=all|macro|micro] [--repeats=1]
+ *                 [--json_out=results.json] [--machine="description"]
+ *                 [--baseline=baseline.json|none] [--tolerance=0.2]
+ *
+ * A synthetic recording (M channels, N timepoints, K units firing at firing_rate Hz)
+ * is generated in a temporary directory and each stage of the pipeline is run on it
+ * (macro), followed by the inner kernels (micro). Throughput and peak RSS are reported
+ * as JSON. The peak RSS of a benchmark is measured from a reset of the high-water mark
+ * (/proc/self/clear_refs) just before it, and is also given as the growth above the RSS
+ * at its start.
+ *
+ * The results are compared to a baseline (by default the baseline.json next to this file,
+ * or a previous json_out), and any benchmark whose throughput dropped by more than the
+ * tolerance is reported and the exit code is nonzero. The tolerance is the one stored in
+ * the baseline unless given on the command line. Benchmarks that the baseline has no
+ * number for are reported but not checked.
+ *
+ * The numbers only mean something on the machine they were measured on (stored as
+ * "machine" in the baseline). To regenerate the committed baseline on a reference machine:
+ *
+ *   ms2_benchmark --repeats=5 --baseline=none --machine="<cpu, cores, compiler, os>" --json_out=run1.json
+ *
+ * a few times (the machine otherwise idle), take the median items_per_sec of each
+ * benchmark, and set "tolerance" to cover the spread between the runs. The committed
+ * baseline.json says which machine and which benchmarks it was measured for.
+ */
+
+#include "mlcommon.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTime>
+#include <mda.h>
+#include <mda32.h>
+#include <diskwritemda.h>
+#include <mdaallocator.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <random>
+#include <functional>
+#include <cmath>
+#include "omp.h"
+
+#include "p_bandpass_filter.h"
+#include "p_whiten.h"
+#include "p_detect_events.h"
+#include "p_extract_clips.h"
+#include "p_sort_clips.h"
+#include "p_create_firings.h"
+#include "p_fit_stage.h"
+#include "p_isolation_metrics.h"
+#include "isosplit5.h"
+#include "isocut5.h"
+#include "jisotonic5.h"
+#include "pca.h"
+#include "kdtree.h"
+
+namespace MS2Benchmark {
+
+struct Synth_opts {
+    bigint M = 4;
+    bigint N = 3e6;
+    int K = 10;
+    double firing_rate = 5; //Hz
+    double samplerate = 30000;
+    int seed = 1;
+};
+
+struct Result {
+    QString name;
+    double elapsed_sec = 0;
+    double num_items = 0; //samples (macro) or kernel items (micro)
+    double peak_rss_mb = 0;
+    double peak_rss_delta_mb = 0; //above the RSS at the start of the benchmark
+};
+
+bool synthesize_recording(QString timeseries_out, Synth_opts opts);
+bool reset_peak_rss();
+double current_rss_mb();
+double peak_rss_mb();
+QJsonObject to_json(const Result& R);
+Result time_it(QString name, double num_items, std::function<bool()> func, int repeats);
+bool run_macro(QList<Result>& results, QString dir, Synth_opts sopts, int repeats);
+bool run_micro(QList<Result>& results, int seed, int repeats);
+int compare_to_baseline(const QList<Result>& results, QString baseline_path, double tolerance);
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    CLParams CLP(argc, argv);
+
+    MS2Benchmark::Synth_opts sopts;
+    sopts.M = CLP.named_parameters.value("M", sopts.M).toDouble();
+    sopts.N = CLP.named_parameters.value("N", sopts.N).toDouble();
+    sopts.K = CLP.named_parameters.value("K", sopts.K).toInt();
+    sopts.firing_rate = CLP.named_parameters.value("firing_rate", sopts.firing_rate).toDouble();
+    sopts.samplerate = CLP.named_parameters.value("samplerate", sopts.samplerate).toDouble();
+    sopts.seed = CLP.named_parameters.value("seed", sopts.seed).toInt();
+    QString stages = CLP.named_parameters.value("stages", "all").toString();
+    int repeats = qMax(1, CLP.named_parameters.value("repeats", 1).toInt());
+    QString json_out = CLP.named_parameters.value("json_out").toString();
+    QString machine = CLP.named_parameters.value("machine").toString();
+    QString baseline = CLP.named_parameters.value("baseline", QString(MS2_BENCHMARK_DIR) + "baseline.json").toString();
+    double tolerance = CLP.named_parameters.value("tolerance", -1).toDouble(); //from the baseline when not given
+
+    QList<MS2Benchmark::Result> results;
+
+    if ((stages == "all") || (stages == "macro")) {
+        QString dir = MLUtil::tempPath() + QString("/ms2_benchmark_%1").arg(MLUtil::makeRandomId(6));
+        QDir().mkpath(dir);
+        bool ok = MS2Benchmark::run_macro(results, dir, sopts, repeats);
+        QDir(dir).removeRecursively();
+        if (!ok) {
+            qWarning() << "Problem running macro benchmarks";
+            return -1;
+        }
+    }
+    if ((stages == "all") || (stages == "micro")) {
+        if (!MS2Benchmark::run_micro(results, sopts.seed, repeats)) {
+            qWarning() << "Problem running micro benchmarks";
+            return -1;
+        }
+    }
+
+    QJsonObject obj;
+    if (!machine.isEmpty())
+        obj["machine"] = machine;
+    QJsonObject params;
+    params["M"] = (double)sopts.M;
+    params["N"] = (double)sopts.N;
+    params["K"] = sopts.K;
+    params["firing_rate"] = sopts.firing_rate;
+    params["samplerate"] = sopts.samplerate;
+    params["seed"] = sopts.seed;
+    params["num_threads"] = omp_get_max_threads();
+    obj["params"] = params;
+    QJsonArray benchmarks;
+    foreach (MS2Benchmark::Result R, results) {
+        benchmarks.push_back(MS2Benchmark::to_json(R));
+    }
+    obj["benchmarks"] = benchmarks;
+    double overall_peak_rss_mb = 0;
+    foreach (MS2Benchmark::Result R, results) {
+        overall_peak_rss_mb = qMax(overall_peak_rss_mb, R.peak_rss_mb);
+    }
+    obj["peak_rss_mb"] = overall_peak_rss_mb;
+
+    QString json = QJsonDocument(obj).toJson(QJsonDocument::Indented);
+    printf("%s\n", json.toUtf8().data());
+    if (!json_out.isEmpty()) {
+        if (!TextFile::write(json_out, json)) {
+            qWarning() << "Unable to write file: " + json_out;
+            return -1;
+        }
+    }
+
+    if ((!baseline.isEmpty()) && (baseline != "none")) {
+        return MS2Benchmark::compare_to_baseline(results, baseline, tolerance);
+    }
+
+    return 0;
+}
+
+namespace MS2Benchmark {
+
+double read_proc_status_mb(QString key)
+{
+    QStringList lines = TextFile::read("/proc/self/status").split("\n");
+    foreach (QString line, lines) {
+        if (line.startsWith(key + ":")) {
+            //e.g. "VmHWM:     12345 kB"
+            return line.mid(key.count() + 1).trimmed().split(" ").value(0).toDouble() / 1024;
+        }
+    }
+    return -1;
+}
+
+bool reset_peak_rss()
+{
+    //writing 5 to clear_refs resets the high-water mark (VmHWM) of the RSS (linux 4.0 and later)
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+        return false;
+    bool ret = (fputs("5", f) >= 0);
+    if (fclose(f) != 0)
+        ret = false;
+    return ret;
+}
+
+double current_rss_mb()
+{
+    double ret = read_proc_status_mb("VmRSS");
+    return (ret >= 0) ? ret : 0;
+}
+
+double peak_rss_mb()
+{
+    double ret = read_proc_status_mb("VmHWM");
+    if (ret >= 0)
+        return ret;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss * 1.0 / 1024; //ru_maxrss is in kilobytes on linux
+}
+
+QJsonObject to_json(const Result& R)
+{
+    QJsonObject ret;
+    ret["name"] = R.name;
+    ret["elapsed_sec"] = R.elapsed_sec;
+    ret["num_items"] = R.num_items;
+    ret["items_per_sec"] = R.elapsed_sec ? R.num_items / R.elapsed_sec : 0;
+    ret["peak_rss_mb"] = R.peak_rss_mb;
+    ret["peak_rss_delta_mb"] = R.peak_rss_delta_mb;
+    return ret;
+}
+
+Result time_it(QString name, double num_items, std::function<bool()> func, int repeats)
+{
+    Result R;
+    R.name = name;
+    R.num_items = num_items;
+    R.elapsed_sec = -1;
+    if (!reset_peak_rss()) {
+        static bool warned = false;
+        if (!warned)
+            qWarning() << "Unable to reset the peak RSS, so it is reported for the whole process so far";
+        warned = true;
+    }
+    double rss0 = current_rss_mb();
+    for (int r = 0; r < repeats; r++) {
+        QTime timer;
+        timer.start();
+        if (!func()) {
+            qWarning() << "Problem in benchmark" << name;
+            R.elapsed_sec = -1;
+            return R;
+        }
+        double sec = timer.elapsed() * 1.0 / 1000;
+        if ((R.elapsed_sec < 0) || (sec < R.elapsed_sec))
+            R.elapsed_sec = sec; //best of the repeats
+    }
+    R.peak_rss_mb = peak_rss_mb();
+    R.peak_rss_delta_mb = qMax(0.0, R.peak_rss_mb - rss0);
+    MdaAllocator::trimAll(); //so that the free lists of one benchmark do not count for the next
+    qDebug().noquote() << QString("%1: %2 sec").arg(name).arg(R.elapsed_sec);
+    return R;
+}
+
+bool synthesize_recording(QString timeseries_out, Synth_opts opts)
+{
+    // K units, each with a fixed waveform peaking on one channel and decaying spatially,
+    // firing as Poisson processes on top of unit-variance gaussian noise
+    std::mt19937 generator(opts.seed);
+    std::normal_distribution<float> noise(0, 1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    bigint M = opts.M;
+    bigint N = opts.N;
+    bigint T = 60;
+    Mda32 waveforms(M, T, opts.K);
+    for (int k = 0; k < opts.K; k++) {
+        double peak_channel = uniform(generator) * M;
+        double amplitude = 8 + 12 * uniform(generator);
+        double width = 2 + 2 * uniform(generator);
+        for (bigint m = 0; m < M; m++) {
+            double spatial = exp(-(m - peak_channel) * (m - peak_channel) / 2);
+            for (bigint t = 0; t < T; t++) {
+                double tt = (t - T / 2) / width;
+                double val = -amplitude * spatial * (1 - tt * tt) * exp(-tt * tt / 2); //mexican hat
+                waveforms.set(val, m, t, k);
+            }
+        }
+    }
+
+    DiskWriteMda Y(MDAIO_TYPE_FLOAT32, timeseries_out, M, N);
+    bigint chunk_size = 1e6;
+    double prob = opts.firing_rate / opts.samplerate;
+    Mda32 carry(M, T); //the tails of the spikes that run past the end of the previous chunk
+    for (bigint t0 = 0; t0 < N; t0 += chunk_size) {
+        bigint N0 = qMin(chunk_size, N - t0);
+        Mda32 chunk(M, N0 + T); //the last T columns are only for the tails
+        float* ptr = chunk.dataPtr();
+        for (bigint i = 0; i < M * N0; i++) {
+            ptr[i] = noise(generator);
+        }
+        for (bigint i = 0; i < M * qMin(T, N0); i++) {
+            ptr[i] += carry.get(i);
+        }
+        for (bigint t = 0; t < N0; t++) {
+            for (int k = 0; k < opts.K; k++) {
+                if (uniform(generator) < prob) {
+                    for (bigint tt = 0; tt < T; tt++) {
+                        for (bigint m = 0; m < M; m++) {
+                            ptr[m + M * (t + tt)] += waveforms.get(m, tt, k);
+                        }
+                    }
+                }
+            }
+        }
+        Mda32 chunk2;
+        chunk.getChunk(chunk2, 0, 0, M, N0);
+        if (!Y.writeChunk(chunk2, 0, t0))
+            return false;
+        chunk.getChunk(carry, 0, N0, M, T);
+    }
+    Y.close();
+    return true;
+}
+
+bool run_macro(QList<Result>& results, QString dir, Synth_opts sopts, int repeats)
+{
+    QString raw = dir + "/raw.mda";
+    QString filt = dir + "/filt.mda";
+    QString pre = dir + "/pre.mda";
+    QString event_times = dir + "/event_times.mda";
+    QString clips = dir + "/clips.mda";
+    QString labels = dir + "/labels.mda";
+    QString firings = dir + "/firings.mda";
+    QString firings_fit = dir + "/firings_fit.mda";
+    QString metrics = dir + "/metrics.json";
+
+    qDebug().noquote() << QString("Synthesizing recording M=%1, N=%2, K=%3...").arg(sopts.M).arg(sopts.N).arg(sopts.K);
+    if (!synthesize_recording(raw, sopts))
+        return false;
+
+    double num_samples = sopts.M * sopts.N;
+    bool ok = true;
+
+    results << time_it("bandpass_filter", num_samples, [&]() {
+        Bandpass_filter_opts opts;
+        opts.samplerate = sopts.samplerate;
+        opts.freq_min = 300;
+        opts.freq_max = 6000;
+        opts.freq_wid = 1000;
+        return p_bandpass_filter(raw, filt, opts);
+    },
+        repeats);
+    results << time_it("whiten", num_samples, [&]() {
+        Whiten_opts opts;
+        return p_whiten(filt, pre, opts);
+    },
+        repeats);
+    results << time_it("detect_events", num_samples, [&]() {
+        P_detect_events_opts opts;
+        opts.detect_threshold = 3;
+        opts.detect_interval = 10;
+        opts.sign = -1;
+        return p_detect_events(pre, event_times, "", opts);
+    },
+        repeats);
+    results << time_it("extract_clips", num_samples, [&]() {
+        QVariantMap params;
+        params["clip_size"] = 50;
+        return p_extract_clips(QStringList(pre), event_times, QList<int>(), clips, params);
+    },
+        repeats);
+    results << time_it("sort_clips", num_samples, [&]() {
+        Sort_clips_opts opts;
+        return p_sort_clips(clips, "", labels, opts); //no event times: clustered in one block
+    },
+        repeats);
+    if (!p_create_firings(event_times, labels, "", firings, 0)) {
+        qWarning() << "Problem in p_create_firings";
+        return false;
+    }
+    results << time_it("fit_stage", num_samples, [&]() {
+        Fit_stage_opts opts;
+        return p_fit_stage(pre, firings, firings_fit, opts);
+    },
+        repeats);
+    results << time_it("isolation_metrics", num_samples, [&]() {
+        P_isolation_metrics_opts opts;
+        return p_isolation_metrics(QStringList(pre), firings_fit, metrics, "", opts);
+    },
+        repeats);
+
+    foreach (Result R, results) {
+        if (R.elapsed_sec < 0)
+            ok = false;
+    }
+    return ok;
+}
+
+bool run_micro(QList<Result>& results, int seed, int repeats)
+{
+    std::mt19937 generator(seed);
+    std::normal_distribution<float> noise(0, 1);
+
+    {
+        // isocut5 on a bimodal 1-D sample
+        bigint N = 10000;
+        int num_calls = 200;
+        QVector<float> samples(N);
+        for (bigint i = 0; i < N; i++) {
+            samples[i] = noise(generator) + ((i % 3 == 0) ? 5 : 0);
+        }
+        results << time_it("isocut5", N * num_calls, [&]() {
+            for (int j = 0; j < num_calls; j++) {
+                double dipscore, cutpoint;
+                isocut5_opts opts;
+                isocut5(&dipscore, &cutpoint, N, samples.data(), opts);
+            }
+            return true;
+        },
+            repeats);
+        results << time_it("isocut5_batch", N * num_calls, [&]() {
+            QVector<double> dipscores(num_calls), cutpoints(num_calls);
+            QVector<bigint> sizes(num_calls, N);
+            QVector<float*> sample_sets(num_calls, samples.data());
+            isocut5_opts opts;
+            isocut5_batch(dipscores.data(), cutpoints.data(), num_calls, sizes.data(), sample_sets.data(), opts);
+            return true;
+        },
+            repeats);
+    }
+    {
+        // many small calls, as for the cluster pairs in late isosplit5 iterations, where allocation used to dominate
+        bigint N = 300;
+        int num_calls = 20000;
+        QVector<float> samples(N);
+        for (bigint i = 0; i < N; i++) {
+            samples[i] = noise(generator) + ((i % 3 == 0) ? 5 : 0);
+        }
+        results << time_it("isocut5_small", N * num_calls, [&]() {
+            isocut5_workspace ws;
+            for (int j = 0; j < num_calls; j++) {
+                double dipscore, cutpoint;
+                isocut5_opts opts;
+                isocut5(&dipscore, &cutpoint, N, samples.data(), opts, ws);
+            }
+            return true;
+        },
+            repeats);
+    }
+    {
+        bigint N = 10000;
+        int num_calls = 200;
+        QVector<float> in(N), out(N), weights(N, 1);
+        for (bigint i = 0; i < N; i++) {
+            in[i] = noise(generator) + sin(i * 6.0 / N);
+        }
+        results << time_it("jisotonic5_updown", N * num_calls, [&]() {
+            for (int j = 0; j < num_calls; j++) {
+                jisotonic5_updown(N, out.data(), in.data(), weights.data());
+            }
+            return true;
+        },
+            repeats);
+    }
+    {
+        bigint M = 10, N = 20000, K = 50;
+        QVector<float> X(M * N);
+        for (bigint i = 0; i < M * N; i++) {
+            X[i] = noise(generator) + ((i / M) % 7) * 2;
+        }
+        QVector<int> labels(N);
+        results << time_it("kmeans", N, [&]() {
+            ns_isosplit5::kmeans_opts opts;
+            opts.num_iterations = 10;
+            ns_isosplit5::kmeans(labels.data(), M, N, X.data(), K, opts);
+            return true;
+        },
+            repeats);
+        results << time_it("kmeans_plusplus", N, [&]() {
+            ns_isosplit5::kmeans_opts opts;
+            opts.num_iterations = 10;
+            opts.kmeans_plus_plus = true;
+            ns_isosplit5::kmeans(labels.data(), M, N, X.data(), K, opts);
+            return true;
+        },
+            repeats);
+    }
+    {
+        bigint M = 200, N = 20000;
+        Mda32 X(M, N);
+        for (bigint i = 0; i < M * N; i++) {
+            X.set(noise(generator), i);
+        }
+        results << time_it("pca", M * N, [&]() {
+            Mda32 components, features, sigma;
+            pca_subsampled(components, features, sigma, X, 10, false, 10000);
+            return true;
+        },
+            repeats);
+    }
+    {
+        bigint M = 10, N = 50000;
+        int num_queries = 2000;
+        Mda32 X(M, N);
+        for (bigint i = 0; i < M * N; i++) {
+            X.set(noise(generator), i);
+        }
+        results << time_it("kdtree", N + num_queries, [&]() {
+            KdTree tree;
+            tree.create(X);
+            QVector<float> p(M);
+            for (int j = 0; j < num_queries; j++) {
+                for (bigint m = 0; m < M; m++)
+                    p[m] = X.get(m, j);
+                tree.findApproxKNearestNeighbors(X, p, 6, 100);
+            }
+            return true;
+        },
+            repeats);
+    }
+
+    return true;
+}
+
+int compare_to_baseline(const QList<Result>& results, QString baseline_path, double tolerance)
+{
+    QJsonObject baseline = QJsonDocument::fromJson(TextFile::read(baseline_path).toUtf8()).object();
+    if (baseline.isEmpty()) {
+        qWarning() << "Unable to read baseline: " + baseline_path;
+        return -1;
+    }
+    if (tolerance < 0)
+        tolerance = baseline["tolerance"].toDouble(0.2);
+    printf("Baseline %s (machine: %s), tolerance %g\n", baseline_path.toUtf8().data(), baseline["machine"].toString("unknown").toUtf8().data(), tolerance);
+    QMap<QString, double> baseline_rates;
+    QJsonArray benchmarks = baseline["benchmarks"].toArray();
+    for (int i = 0; i < benchmarks.count(); i++) {
+        QJsonObject B = benchmarks[i].toObject();
+        baseline_rates[B["name"].toString()] = B["items_per_sec"].toDouble();
+    }
+    int num_regressions = 0;
+    foreach (Result R, results) {
+        if (!baseline_rates.contains(R.name)) {
+            printf("not in baseline %s\n", R.name.toUtf8().data());
+            continue;
+        }
+        double rate = R.elapsed_sec ? R.num_items / R.elapsed_sec : 0;
+        double rate0 = baseline_rates[R.name];
+        if ((rate0 > 0) && (rate < rate0 * (1 - tolerance))) {
+            printf("REGRESSION %s: %g items/sec (baseline %g, %.1f%% slower)\n", R.name.toUtf8().data(), rate, rate0, (1 - rate / rate0) * 100);
+            num_regressions++;
+        }
+        else {
+            printf("ok %s: %g items/sec (baseline %g)\n", R.name.toUtf8().data(), rate, rate0);
+        }
+    }
+    return num_regressions ? 1 : 0;
+}
+}
@@ -1,5 +1,6 @@
 #include "kdtree.h"
 #include "mlcommon.h"
+#include "mlkernels.h"
 #include "get_sort_indices.h"
 
 class KdTreePrivate {
@@ -177,9 +178,5 @@ QVector<float> KdTreePrivate::get_projection_direction(const Mda32& X)
 }
 double KdTreePrivate::compute_distsqr(int M, const float* x, const float* y)
 {
-    double ret = 0;
-    for (int i = 0; i < M; i++) {
-        ret += (x[i] - y[i]) * (x[i] - y[i]);
-    }
-    return ret;
+    return MLKernels::distSquared(M, x, y);
 }
@@ -14,7 +14,7 @@ TARGET = mountainsort2.mp
 TEMPLATE = app
 
 #FFTW
-LIBS += -fopenmp -lfftw3 -lfftw3_threads
+LIBS += -fopenmp -lfftw3 -lfftw3_threads -lfftw3f
 
 #OPENMP
 !macx {
@@ -46,11 +46,14 @@ SOURCES += \
     p_load_test.cpp \
     p_compute_amplitudes.cpp \
     p_extract_time_interval.cpp \
+    p_transpose_array.cpp \
     p_isolation_metrics.cpp \
     kdtree.cpp \
     p_confusion_matrix.cpp \
     hungarian.cpp \
-    p_generate_background_dataset.cpp
+    p_generate_background_dataset.cpp \
+    p_track_drift.cpp \
+    p_spectrogram.cpp
 
 HEADERS += \
     p_extract_clips.h \
@@ -75,16 +78,19 @@ HEADERS += \
     p_load_test.h \
     p_compute_amplitudes.h \
     p_extract_time_interval.h \
+    p_transpose_array.h \
     p_isolation_metrics.h \
     kdtree.h \
     p_confusion_matrix.h \
     hungarian.h \
-    p_generate_background_dataset.h
+    p_generate_background_dataset.h \
+    p_track_drift.h \
+    p_spectrogram.h
 
 INCLUDEPATH += ../../../mountainsort/src/isosplit5
 VPATH += ../../../mountainsort/src/isosplit5
-HEADERS += isosplit5.h isocut5.h jisotonic5.h
-SOURCES += isosplit5.cpp isocut5.cpp jisotonic5.cpp
+HEADERS += isosplit5.h isocut5.h jisotonic5.h kmeans5.h
+SOURCES += isosplit5.cpp isocut5.cpp jisotonic5.cpp kmeans5.cpp
 
 INCLUDEPATH += ../../../mountainsort/src/utils
 VPATH += ../../../mountainsort/src/utils
@@ -31,11 +31,17 @@
 #include "p_load_test.h"
 #include "p_compute_amplitudes.h"
 #include "p_extract_time_interval.h"
+#include "p_transpose_array.h"
 #include "p_isolation_metrics.h"
 #include "p_generate_background_dataset.h"
+#include "p_track_drift.h"
+#include "p_spectrogram.h"
 
 #include "omp.h"
 #include "p_confusion_matrix.h"
+#include "objectregistry.h"
+#include "icounter.h"
+#include "processorprofile.h"
 
 QJsonObject get_spec()
 {
@@ -71,7 +77,7 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.bandpass_filter", "0.18");
+        ProcessorSpec X("mountainsort.bandpass_filter", "0.19");
         X.addInputs("timeseries");
         X.addOutputs("timeseries_out");
         X.addRequiredParameters("samplerate", "freq_min", "freq_max");
@@ -81,7 +87,7 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.whiten", "0.1");
+        ProcessorSpec X("mountainsort.whiten", "0.11");
         X.addInputs("timeseries");
         X.addOutputs("timeseries_out");
         //X.addRequiredParameters();
@@ -97,7 +103,7 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.whiten_clips", "0.1");
+        ProcessorSpec X("mountainsort.whiten_clips", "0.11");
         X.addInputs("clips", "whitening_matrix");
         X.addOutputs("clips_out");
         //X.addRequiredParameters();
@@ -105,7 +111,7 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.apply_whitening_matrix", "0.1");
+        ProcessorSpec X("mountainsort.apply_whitening_matrix", "0.11");
         X.addInputs("timeseries", "whitening_matrix");
         X.addOutputs("timeseries_out");
         //X.addRequiredParameters();
@@ -113,9 +119,10 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.detect_events", "0.13");
+        ProcessorSpec X("mountainsort.detect_events", "0.15");
         X.addInputs("timeseries");
         X.addOutputs("event_times_out");
+        X.addOptionalOutputs("firings_out");
         X.addRequiredParameters("central_channel", "detect_threshold", "detect_interval", "sign");
         X.addOptionalParameter("subsample_factor", "", 1);
         processors.push_back(X.get_spec());
@@ -137,10 +144,12 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.sort_clips", "0.11a");
+        ProcessorSpec X("mountainsort.sort_clips", "0.13");
         X.addInputs("clips");
+        X.addOptionalInputs("event_times");
         X.addOutputs("labels_out");
-        //X.addRequiredParameters();
+        X.addOptionalParameter("time_block_size", "Cluster overlapping time blocks of this many timepoints in parallel (requires event_times). 0 means all at once", 0);
+        X.addOptionalParameter("time_block_overlap", "Fraction of the time block size shared with each neighboring block", 0.1);
         processors.push_back(X.get_spec());
     }
     {
@@ -204,7 +213,7 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.isolation_metrics", "0.15j");
+        ProcessorSpec X("mountainsort.isolation_metrics", "0.15k");
         X.addInputs("timeseries", "firings");
         X.addOutputs("metrics_out");
         X.addOptionalOutputs("pair_metrics_out");
@@ -267,10 +276,13 @@ QJsonObject get_spec()
         processors.push_back(X.get_spec());
     }
     {
-        ProcessorSpec X("mountainsort.compute_amplitudes", "0.1");
+        ProcessorSpec X("mountainsort.compute_amplitudes", "0.12");
         X.addInputs("timeseries", "event_times");
         X.addOutputs("amplitudes_out");
+        X.addOptionalOutputs("firings_out");
         X.addRequiredParameters("central_channel");
+        X.addOptionalParameter("refine_radius", "Move each event to the peak within this many timepoints", 0);
+        X.addOptionalParameter("sign", "Peaks are positive for 1, negative for -1, either for 0", 0);
         processors.push_back(X.get_spec());
     }
     {
@@ -280,6 +292,13 @@ QJsonObject get_spec()
         X.addRequiredParameters("t1", "t2");
         processors.push_back(X.get_spec());
     }
+    {
+        ProcessorSpec X("mountainsort.transpose_array", "0.1");
+        X.addInputs("input");
+        X.addOutputs("output");
+        X.addOptionalParameter("max_memory_mb", "Memory budget for the tiles (the array itself can be much larger)", 512);
+        processors.push_back(X.get_spec());
+    }
     {
         ProcessorSpec X("mountainsort.confusion_matrix", "0.17");
         X.addInputs("firings1", "firings2");
@@ -295,6 +314,30 @@ QJsonObject get_spec()
         X.addOutputs("timeseries_out");
         processors.push_back(X.get_spec());
     }
+    {
+        ProcessorSpec X("mountainsort.track_drift", "0.1");
+        X.addInputs("timeseries", "event_times");
+        X.addOptionalInputs("templates", "template_info");
+        X.addOutputs("firings_out", "templates_out", "template_info_out");
+        X.addOptionalParameter("clip_size", "", 50);
+        X.addOptionalParameter("timestamp_offset", "Time of the first sample of this segment within the whole recording", 0);
+        X.addOptionalParameter("window_duration", "Timescale (in samples) over which the running templates forget old events", 30000 * 60 * 10);
+        X.addOptionalParameter("match_threshold", "", 0.5);
+        X.addOptionalParameter("num_candidate_channels", "", 3);
+        X.addOptionalParameter("min_cluster_size", "", 10);
+        processors.push_back(X.get_spec());
+    }
+
+    {
+        ProcessorSpec X("mountainsort.spectrogram", "0.1");
+        X.addInputs("timeseries");
+        X.addOutputs("spectrogram_out");
+        X.addOptionalOutputs("pyramid_out");
+        X.addRequiredParameters("time_resolution");
+        X.addOptionalParameter("samplerate", "", 128);
+        X.addOptionalParameter("pyramid_factor", "Decimation in time from each level of the pyramid to the next", 4);
+        processors.push_back(X.get_spec());
+    }
 
     QJsonObject ret;
     ret["processors"] = processors;
@@ -326,6 +369,19 @@ int main(int argc, char* argv[])
         }
     }
 
+    // counters for the processor profile
+    ObjectRegistry registry;
+    CounterManager* counterManager = new CounterManager;
+    registry.addAutoReleasedObject(counterManager);
+    ObjectRegistry::addAutoReleasedObject(new IIntCounter("allocated_bytes"));
+    ObjectRegistry::addAutoReleasedObject(new IIntCounter("freed_bytes"));
+    ObjectRegistry::addAutoReleasedObject(new IIntCounter("bytes_read"));
+    ObjectRegistry::addAutoReleasedObject(new IIntCounter("bytes_written"));
+    counterManager->setCounters(ObjectRegistry::getObjects<ICounterBase>());
+
+    ProcessorProfile::globalInstance()->setNumThreads(omp_get_max_threads());
+    ProcessorProfile::globalInstance()->start(arg1);
+
     if (arg1 == "mountainsort.extract_neighborhood_timeseries") {
         QString timeseries = CLP.named_parameters["timeseries"].toString();
         QString timeseries_out = CLP.named_parameters["timeseries_out"].toString();
@@ -407,13 +463,14 @@ int main(int argc, char* argv[])
     else if (arg1 == "mountainsort.detect_events") {
         QString timeseries = CLP.named_parameters["timeseries"].toString();
         QString event_times_out = CLP.named_parameters["event_times_out"].toString();
+        QString firings_out = CLP.named_parameters.value("firings_out").toString();
         P_detect_events_opts opts;
         opts.central_channel = CLP.named_parameters["central_channel"].toInt();
         opts.detect_threshold = CLP.named_parameters["detect_threshold"].toDouble();
         opts.detect_interval = CLP.named_parameters["detect_interval"].toDouble();
         opts.sign = CLP.named_parameters["sign"].toInt();
         opts.subsample_factor = CLP.named_parameters["subsample_factor"].toDouble();
-        ret = p_detect_events(timeseries, event_times_out, opts);
+        ret = p_detect_events(timeseries, event_times_out, firings_out, opts);
     }
     else if (arg1 == "mountainsort.extract_clips") {
         QStringList timeseries_list = MLUtil::toStringList(CLP.named_parameters["timeseries"]);
@@ -433,9 +490,12 @@ int main(int argc, char* argv[])
     }
     else if (arg1 == "mountainsort.sort_clips") {
         QString clips = CLP.named_parameters["clips"].toString();
+        QString event_times = CLP.named_parameters["event_times"].toString();
         QString labels_out = CLP.named_parameters["labels_out"].toString();
         Sort_clips_opts opts;
-        ret = p_sort_clips(clips, labels_out, opts);
+        opts.time_block_size = CLP.named_parameters.value("time_block_size", 0).toDouble();
+        opts.time_block_overlap = CLP.named_parameters.value("time_block_overlap", 0.1).toDouble();
+        ret = p_sort_clips(clips, event_times, labels_out, opts);
     }
     else if (arg1 == "mountainsort.reorder_labels") {
         QString templates = CLP.named_parameters["templates"].toString();
@@ -566,8 +626,11 @@ int main(int argc, char* argv[])
         QString timeseries = CLP.named_parameters["timeseries"].toString();
         QString event_times = CLP.named_parameters["event_times"].toString();
         opts.central_channel = CLP.named_parameters["central_channel"].toInt();
+        opts.refine_radius = CLP.named_parameters.value("refine_radius", 0).toInt();
+        opts.sign = CLP.named_parameters.value("sign", 0).toInt();
         QString amplitudes_out = CLP.named_parameters["amplitudes_out"].toString();
-        ret = p_compute_amplitudes(timeseries, event_times, amplitudes_out, opts);
+        QString firings_out = CLP.named_parameters.value("firings_out").toString();
+        ret = p_compute_amplitudes(timeseries, event_times, amplitudes_out, firings_out, opts);
     }
     else if (arg1 == "mountainsort.extract_time_interval") {
         P_compute_amplitudes_opts opts;
@@ -579,6 +642,13 @@ int main(int argc, char* argv[])
         bigint t2 = CLP.named_parameters["t2"].toDouble();
         ret = p_extract_time_interval(timeseries_list, firings, timeseries_out, firings_out, t1, t2);
     }
+    else if (arg1 == "mountainsort.transpose_array") {
+        P_transpose_array_opts opts;
+        QString input = CLP.named_parameters["input"].toString();
+        QString output = CLP.named_parameters["output"].toString();
+        opts.max_memory_mb = CLP.named_parameters.value("max_memory_mb", 512).toDouble();
+        ret = p_transpose_array(input, output, opts);
+    }
     else if (arg1 == "mountainsort.confusion_matrix") {
         P_confusion_matrix_opts opts;
         QString firings1 = CLP.named_parameters["firings1"].toString();
@@ -601,6 +671,33 @@ int main(int argc, char* argv[])
         P_generate_background_dataset_opts opts;
         ret = p_generate_background_dataset(timeseries, event_times, timeseries_out, opts);
     }
+    else if (arg1 == "mountainsort.track_drift") {
+        QString timeseries = CLP.named_parameters["timeseries"].toString();
+        QString event_times = CLP.named_parameters["event_times"].toString();
+        QString templates = CLP.named_parameters["templates"].toString();
+        QString template_info = CLP.named_parameters["template_info"].toString();
+        QString firings_out = CLP.named_parameters["firings_out"].toString();
+        QString templates_out = CLP.named_parameters["templates_out"].toString();
+        QString template_info_out = CLP.named_parameters["template_info_out"].toString();
+        P_track_drift_opts opts;
+        opts.clip_size = CLP.named_parameters.value("clip_size", opts.clip_size).toInt();
+        opts.timestamp_offset = CLP.named_parameters.value("timestamp_offset", opts.timestamp_offset).toDouble();
+        opts.window_duration = CLP.named_parameters.value("window_duration", opts.window_duration).toDouble();
+        opts.match_threshold = CLP.named_parameters.value("match_threshold", opts.match_threshold).toDouble();
+        opts.num_candidate_channels = CLP.named_parameters.value("num_candidate_channels", opts.num_candidate_channels).toInt();
+        opts.min_cluster_size = CLP.named_parameters.value("min_cluster_size", opts.min_cluster_size).toInt();
+        ret = p_track_drift(timeseries, event_times, templates, template_info, firings_out, templates_out, template_info_out, opts);
+    }
+    else if (arg1 == "mountainsort.spectrogram") {
+        QString timeseries = CLP.named_parameters["timeseries"].toString();
+        QString spectrogram_out = CLP.named_parameters["spectrogram_out"].toString();
+        QString pyramid_out = CLP.named_parameters.value("pyramid_out").toString();
+        P_spectrogram_opts opts;
+        opts.time_resolution = CLP.named_parameters["time_resolution"].toInt();
+        opts.samplerate = CLP.named_parameters.value("samplerate", opts.samplerate).toDouble();
+        opts.pyramid_factor = CLP.named_parameters.value("pyramid_factor", opts.pyramid_factor).toInt();
+        ret = p_spectrogram(timeseries, spectrogram_out, pyramid_out, opts);
+    }
     else {
         qWarning() << "Unexpected processor name: " + arg1;
         return -1;
@@ -609,6 +706,11 @@ int main(int argc, char* argv[])
     if (!ret)
         return -1;
 
+    QString tempdir = CLP.named_parameters.value("_tempdir").toString();
+    if (!tempdir.isEmpty()) {
+        ProcessorProfile::globalInstance()->write(tempdir + "/_profile.json"); //picked up by the process manager
+    }
+
     return 0;
 }
 
@@ -2,7 +2,8 @@
 
 #include <QTime>
 #include <diskreadmda32.h>
-#include <diskwritemda.h>
+#include <asyncdiskwritemda.h>
+#include <processorprofile.h>
 #include "omp.h"
 #include "fftw3.h"
 #include <QFile>
@@ -110,11 +111,17 @@ bool p_bandpass_filter(QString timeseries, QString timeseries_out, Bandpass_filt
     const bigint M = X.N1();
     const bigint N = X.N2();
 
-    bigint dtype = MDAIO_TYPE_FLOAT32;
+    AsyncDiskWriteMda Y;
+    int dtype = MDAIO_TYPE_FLOAT32;
     if (opts.quantization_unit) {
+        //stored as scaled int16, which the readers convert back
         dtype = MDAIO_TYPE_INT16;
+        Y.setScale(opts.quantization_unit);
+    }
+    if (!Y.open(dtype, timeseries_out, M, N)) {
+        qWarning() << "Unable to open output file for writing: " + timeseries_out;
+        return false;
     }
-    DiskWriteMda Y(dtype, timeseries_out, M, N);
 
     QTime timer_status;
     timer_status.start();
@@ -132,6 +139,8 @@ bool p_bandpass_filter(QString timeseries, QString timeseries_out, Bandpass_filt
     qDebug().noquote() << "samplerate/freq_min/freq_max/freq_wid:" << opts.samplerate << opts.freq_min << opts.freq_max << opts.freq_wid;
 
     bool ret = true;
+    bigint num_timepoints_handled = 0;
+    ProcessorProfile::globalInstance()->startPhase("filter");
 #pragma omp parallel
     {
         // one kernel runner for each parallel thread so they don't intersect
@@ -140,17 +149,22 @@ bool p_bandpass_filter(QString timeseries, QString timeseries_out, Bandpass_filt
         {
             KR.init(M, chunk_size + 2 * overlap_size, opts.samplerate, opts.freq_min, opts.freq_max, opts.freq_wid);
         }
-        bigint num_timepoints_handled = 0;
-#pragma omp for
+#pragma omp for schedule(dynamic)
         for (bigint timepoint = 0; timepoint < N; timepoint += chunk_size) {
             Mda32 chunk;
+            bool read_ok = true;
+            ProfileLockWait lock_wait("lock1");
 #pragma omp critical(lock1)
             {
+                lock_wait.acquired();
                 if (!X.readChunk(chunk, 0, timepoint - overlap_size, M, chunk_size + 2 * overlap_size)) {
                     qWarning() << "Error reading chunk";
                     ret = false;
+                    read_ok = false;
                 }
             }
+            if (!read_ok)
+                continue;
             if (!opts.testcode.split(",").contains("nokernel")) {
                 QTime kernel_timer;
                 kernel_timer.start();
@@ -158,23 +172,17 @@ bool p_bandpass_filter(QString timeseries, QString timeseries_out, Bandpass_filt
                 //chunk = P_bandpass_filter::bandpass_filter_kernel(chunk, opts.samplerate, opts.freq_min, opts.freq_max, opts.freq_wid);
                 //qDebug().noquote() << "Kernel timer elapsed: " << kernel_timer.elapsed() << " for chunk at " << timepoint << " of " << N;
             }
-            Mda32 chunk2;
-            {
-                chunk.getChunk(chunk2, 0, overlap_size, M, chunk_size);
+            if (do_write) {
+                // quantization and type conversion happen here in the worker thread; the disk write itself is queued
+                // only the middle of the chunk (without the overlaps) is written
+                if (!Y.writeChunk(chunk.columnsView(overlap_size, chunk_size), 0, timepoint)) {
+                    qWarning() << "Error writing chunk";
+#pragma omp critical(lock1)
+                    ret = false;
+                }
             }
 #pragma omp critical(lock1)
             {
-                {
-                    if (do_write) {
-                        if (opts.quantization_unit) {
-                            P_bandpass_filter::multiply_by_factor(chunk2.totalSize(), chunk2.dataPtr(), 1.0 / opts.quantization_unit);
-                        }
-                        if (!Y.writeChunk(chunk2, 0, timepoint)) {
-                            qWarning() << "Error writing chunk";
-                            ret = false;
-                        }
-                    }
-                }
                 num_timepoints_handled += qMin((bigint)chunk_size, N - timepoint);
                 if ((timer_status.elapsed() > 5000) || (num_timepoints_handled == N) || (timepoint == 0)) {
                     printf("%ld/%ld (%d%%) -- using %d threads.\n",
@@ -186,6 +194,14 @@ bool p_bandpass_filter(QString timeseries, QString timeseries_out, Bandpass_filt
             }
         }
     }
+    ProcessorProfile::globalInstance()->endPhase("filter");
+    {
+        ProfilePhase phase("flush_output");
+        if (!Y.close()) {
+            qWarning() << "Error closing output file";
+            ret = false;
+        }
+    }
 
     return ret;
 }
@@ -4,35 +4,123 @@
 #include <mda.h>
 #include <mda32.h>
 #include "mlcommon.h"
+#include "get_sort_indices.h"
+#include <limits>
+
+#define AMPLITUDE_CHUNK_SIZE 100000 //timepoints
 
 namespace P_compute_amplitudes {
+//the value to maximize: positive peaks for sign>0, negative peaks for sign<0, either for sign=0
+float peak_score(float val, int sign)
+{
+    if (sign > 0)
+        return val;
+    if (sign < 0)
+        return -val;
+    return qAbs(val);
+}
 }
 
-bool p_compute_amplitudes(QString timeseries, QString event_times, QString amplitudes_out, P_compute_amplitudes_opts opts)
+bool p_compute_amplitudes(QString timeseries, QString event_times, QString amplitudes_out, QString firings_out, P_compute_amplitudes_opts opts)
 {
     DiskReadMda32 X(timeseries);
     Mda ET(event_times);
     bigint L = ET.totalSize();
+    QVector<double> times(L);
+    for (bigint i = 0; i < L; i++) {
+        times[i] = ET.value(i);
+    }
+    QVector<double> amplitudes;
+    QVector<int> channels;
+    if (!compute_event_amplitudes(X, times, amplitudes, channels, opts))
+        return false;
+
     Mda32 A(1, L);
     for (bigint i = 0; i < L; i++) {
-        double amp = 0;
-        bigint time0 = ET.value(i);
-        if (opts.central_channel) {
-            amp = X.value(opts.central_channel - 1, time0);
+        A.setValue(amplitudes[i], i);
+    }
+    if (!A.write32(amplitudes_out))
+        return false;
+    if (!firings_out.isEmpty()) {
+        if (!write_event_firings(firings_out, times, channels, amplitudes))
+            return false;
+    }
+    return true;
+}
+
+bool compute_event_amplitudes(const DiskReadMda32& X, QVector<double>& times, QVector<double>& amplitudes, QVector<int>& channels, P_compute_amplitudes_opts opts)
+{
+    bigint M = X.N1();
+    bigint L = times.count();
+    bigint r = qMax(opts.refine_radius, 0);
+    if (opts.central_channel - 1 >= M) {
+        qWarning() << "Central channel is out of range:" << opts.central_channel << M;
+        return false;
+    }
+    amplitudes.fill(0, L);
+    channels.fill(0, L);
+
+    QList<bigint> inds = get_sort_indices_bigint(times);
+    Mda32 chunk;
+    bigint ii = 0;
+    while (ii < L) {
+        //the chunk covers AMPLITUDE_CHUNK_SIZE timepoints from the next event, plus the refinement radius on both sides
+        bigint t_first = (bigint)times[inds[ii]];
+        bigint t1 = t_first - r;
+        if (!X.readChunk(chunk, 0, t1, M, AMPLITUDE_CHUNK_SIZE + 2 * r)) {
+            qWarning() << "Problem reading chunk in compute_event_amplitudes";
+            return false;
         }
-        else {
-            double maxval = 0;
-            for (bigint m = 0; m < X.N1(); m++) {
-                double val = X.value(m, time0);
-                if (qAbs(val) > qAbs(maxval))
-                    maxval = val;
+        const float* ptr = chunk.constDataPtr();
+        for (; (ii < L) && ((bigint)times[inds[ii]] < t_first + AMPLITUDE_CHUNK_SIZE); ii++) {
+            bigint i = inds[ii];
+            bigint t0 = (bigint)times[i];
+            bigint best_t = t0;
+            bigint best_m = 0;
+            float best_val = 0;
+            float best_score = -std::numeric_limits<float>::infinity();
+            //t0 first, so that another time is only chosen when its value is strictly larger
+            for (bigint k = -1; k <= 2 * r; k++) {
+                bigint t = (k < 0) ? t0 : t0 - r + k;
+                const float* col = ptr + M * (t - t1);
+                if (opts.central_channel > 0) {
+                    float val = col[opts.central_channel - 1];
+                    float score = P_compute_amplitudes::peak_score(val, opts.sign);
+                    if ((k < 0) || (score > best_score)) {
+                        best_val = val;
+                        best_score = score;
+                        best_t = t;
+                        best_m = opts.central_channel - 1;
+                    }
+                }
+                else {
+                    for (bigint m = 0; m < M; m++) {
+                        float score = P_compute_amplitudes::peak_score(col[m], opts.sign);
+                        if (score > best_score) {
+                            best_val = col[m];
+                            best_score = score;
+                            best_t = t;
+                            best_m = m;
+                        }
+                    }
+                }
             }
-            amp = maxval;
+            amplitudes[i] = best_val;
+            channels[i] = best_m + 1;
+            times[i] = best_t;
         }
-        A.setValue(amp, i);
     }
-    return A.write32(amplitudes_out);
+    return true;
 }
 
-namespace P_consolidate_clusters {
+bool write_event_firings(QString path, const QVector<double>& times, const QVector<int>& channels, const QVector<double>& amplitudes)
+{
+    bigint L = times.count();
+    Mda F(4, L);
+    for (bigint i = 0; i < L; i++) {
+        F.setValue(channels[i], 0, i);
+        F.setValue(times[i], 1, i);
+        F.setValue(amplitudes[i], 3, i);
+    }
+    return F.write64(path);
 }
@@ -4,10 +4,22 @@
 #include <QString>
 #include "mlcommon.h"
 
+class DiskReadMda32;
+
 struct P_compute_amplitudes_opts {
     int central_channel = 0;
+    int refine_radius = 0; //move each event to the peak within this many timepoints
+    int sign = 0; //peaks are the largest values for 1, the most negative for -1, the largest absolute values for 0
 };
 
-bool p_compute_amplitudes(QString timeseries, QString event_times, QString amplitudes_out, P_compute_amplitudes_opts opts);
+// firings_out (optional) has the firings layout with label zero: rows channel (1-based), time, 0, amplitude
+bool p_compute_amplitudes(QString timeseries, QString event_times, QString amplitudes_out, QString firings_out, P_compute_amplitudes_opts opts);
+
+// The amplitude of each event is the value at the peak channel (the central channel, or the peak of the given sign).
+// Events are visited in time order over chunks of the timeseries, so each part of it is read once.
+// With refine_radius, times are moved to the peak. The results are in the original order of the events.
+bool compute_event_amplitudes(const DiskReadMda32& X, QVector<double>& times, QVector<double>& amplitudes, QVector<int>& channels, P_compute_amplitudes_opts opts);
+
+bool write_event_firings(QString path, const QVector<double>& times, const QVector<int>& channels, const QVector<double>& amplitudes);
 
 #endif // P_COMPUTE_AMPLITUDES_H
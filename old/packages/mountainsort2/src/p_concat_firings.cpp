@@ -24,7 +24,9 @@ bool p_concat_firings(QStringList timeseries_list, QStringList firings_list, QSt
 
     DiskWriteMda Y;
     if (!timeseries_out.isEmpty()) {
-        Y.open(X0.mdaioHeader().data_type, timeseries_out, M, NN);
+        DiskReadMda32 X(2, timeseries_list); //for the data type and scale of the output
+        Y.open(X.mdaioHeader().data_type, timeseries_out, M, NN);
+        Y.setScale(X.scale());
     }
     Mda G(R, LL);
     bigint n0 = 0;
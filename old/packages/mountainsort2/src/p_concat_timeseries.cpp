@@ -20,7 +20,9 @@ bool p_concat_timeseries(QStringList timeseries_list, QString timeseries_out)
         NN += X1.N2();
     }
 
-    DiskWriteMda Y(X0.mdaioHeader().data_type, timeseries_out, M, NN);
+    DiskReadMda32 X(2, timeseries_list); //for the data type and scale of the output
+    DiskWriteMda Y(X.mdaioHeader().data_type, timeseries_out, M, NN);
+    Y.setScale(X.scale());
     bigint n0 = 0;
     for (bigint i = 0; i < timeseries_list.count(); i++) {
         DiskReadMda32 X1(timeseries_list.value(i));
@@ -3,19 +3,23 @@
 #include <diskreadmda32.h>
 #include <mda.h>
 #include "mlcommon.h"
+#include "p_compute_amplitudes.h"
+
+#define DETECT_CHUNK_SIZE 100000 //timepoints
 
 namespace P_detect_events {
 QVector<double> detect_events(const QVector<double>& X, double detect_threshold, double detect_interval, int sign);
 QVector<double> subsample_events(const QVector<double>& X, double subsample_factor);
 }
 
-bool p_detect_events(QString timeseries, QString event_times_out, P_detect_events_opts opts)
+bool p_detect_events(QString timeseries, QString event_times_out, QString firings_out, P_detect_events_opts opts)
 {
     DiskReadMda32 X(timeseries);
     bigint M = X.N1();
     bigint N = X.N2();
 
     QVector<double> data(N);
+    QVector<int> peak_channels; //for firings_out
     printf("Collecting data vector...\n");
     if (opts.detect_rms_window > 0) {
         printf("Collecting data vector & computing RMS...\n");
@@ -33,31 +37,45 @@ bool p_detect_events(QString timeseries, QString event_times_out, P_detect_event
         }
     }
     else {
-        if (opts.central_channel > 0) {
-            if (opts.central_channel - 1 >= M) {
-                qWarning() << "Central channel is out of range:" << opts.central_channel << M;
+        if (opts.central_channel - 1 >= M) {
+            qWarning() << "Central channel is out of range:" << opts.central_channel << M;
+            return false;
+        }
+        if ((!firings_out.isEmpty()) && (opts.central_channel <= 0))
+            peak_channels.resize(N);
+        for (bigint t1 = 0; t1 < N; t1 += DETECT_CHUNK_SIZE) {
+            bigint n = qMin((bigint)DETECT_CHUNK_SIZE, N - t1);
+            Mda32 chunk;
+            if (!X.readChunk(chunk, 0, t1, M, n)) {
+                qWarning() << "Problem reading chunk in detect_events";
                 return false;
             }
-            for (bigint i = 0; i < N; i++) {
-                data[i] = X.value(opts.central_channel - 1, i);
+            const float* ptr = chunk.constDataPtr();
+            if (opts.central_channel > 0) {
+                for (bigint i = 0; i < n; i++) {
+                    data[t1 + i] = ptr[opts.central_channel - 1 + M * i];
+                }
             }
-        }
-        else {
-            for (bigint i = 0; i < N; i++) {
-                double best_value = 0;
-                bigint best_m = 0;
-                for (bigint m = 0; m < M; m++) {
-                    double val = X.value(m, i);
-                    if (opts.sign < 0)
-                        val = -val;
-                    if (opts.sign == 0)
-                        val = fabs(val);
-                    if (val > best_value) {
-                        best_value = val;
-                        best_m = m;
+            else {
+                for (bigint i = 0; i < n; i++) {
+                    const float* col = ptr + M * i;
+                    double best_value = 0;
+                    bigint best_m = 0;
+                    for (bigint m = 0; m < M; m++) {
+                        double val = col[m];
+                        if (opts.sign < 0)
+                            val = -val;
+                        if (opts.sign == 0)
+                            val = fabs(val);
+                        if (val > best_value) {
+                            best_value = val;
+                            best_m = m;
+                        }
                     }
+                    data[t1 + i] = col[best_m];
+                    if (!peak_channels.isEmpty())
+                        peak_channels[t1 + i] = best_m + 1;
                 }
-                data[i] = X.value(best_m, i);
             }
         }
     }
@@ -78,7 +96,33 @@ bool p_detect_events(QString timeseries, QString event_times_out, P_detect_event
         ret.setValue(event_times[j], j);
     }
     printf("Writing result...\n");
-    return ret.write64(event_times_out);
+    if (!ret.write64(event_times_out))
+        return false;
+
+    if (!firings_out.isEmpty()) {
+        bigint L = event_times.count();
+        QVector<double> amplitudes(L);
+        QVector<int> channels(L);
+        if (opts.detect_rms_window > 0) {
+            //data holds the rms, so this takes another look at the events
+            P_compute_amplitudes_opts amp_opts;
+            amp_opts.central_channel = opts.central_channel;
+            amp_opts.sign = opts.sign;
+            if (!compute_event_amplitudes(X, event_times, amplitudes, channels, amp_opts))
+                return false;
+        }
+        else {
+            for (bigint j = 0; j < L; j++) {
+                bigint t = (bigint)event_times[j];
+                amplitudes[j] = data[t];
+                channels[j] = (opts.central_channel > 0) ? opts.central_channel : peak_channels[t];
+            }
+        }
+        printf("Writing firings...\n");
+        if (!write_event_firings(firings_out, event_times, channels, amplitudes))
+            return false;
+    }
+    return true;
 }
 
 namespace P_detect_events {
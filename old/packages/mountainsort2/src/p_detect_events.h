@@ -13,6 +13,8 @@ struct P_detect_events_opts {
     double subsample_factor = 1;
 };
 
-bool p_detect_events(QString timeseries, QString event_times_out, P_detect_events_opts opts);
+// firings_out (optional): the events with their peak channels and amplitudes, taken from the same pass
+// over the timeseries (see p_compute_amplitudes)
+bool p_detect_events(QString timeseries, QString event_times_out, QString firings_out, P_detect_events_opts opts);
 
 #endif // P_DETECT_EVENTS_H
@@ -22,6 +22,7 @@ bool p_extract_neighborhood_timeseries(QString timeseries, QString timeseries_ou
 
     DiskWriteMda Y;
     Y.open(X.mdaioHeader().data_type, timeseries_out, M2, N);
+    Y.setScale(X.scale()); //the chunks are read with the scale applied
 
     // TODO: don't load the whole thing into memory
     Mda32 chunk;
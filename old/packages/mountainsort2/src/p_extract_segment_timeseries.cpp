@@ -8,6 +8,7 @@
 
 #include <diskreadmda32.h>
 #include <diskwritemda.h>
+#include <asyncdiskwritemda.h>
 #include <mda32.h>
 
 namespace P_extract_segment_timeseries {
@@ -30,8 +31,13 @@ bool p_extract_segment_timeseries(QString timeseries, QString timeseries_out, bi
     }
 
     //do it this way so we can specify the datatype
-    DiskWriteMda Y;
-    Y.open(X.mdaioHeader().data_type, timeseries_out, M2, N2);
+    //written asynchronously so that reading the next chunk overlaps with writing the previous one
+    AsyncDiskWriteMda Y;
+    if (!Y.open(X.mdaioHeader().data_type, timeseries_out, M2, N2)) {
+        qWarning() << "Error opening file for writing: " << timeseries_out << M2 << N2;
+        return false;
+    }
+    Y.setScale(X.scale()); //the chunks are read with the scale applied
 
     //conserve memory as of 3/1/17 -- jfm
     bigint chunk_size = 10000; //conserve memory!
@@ -52,14 +58,17 @@ bool p_extract_segment_timeseries(QString timeseries, QString timeseries_out, bi
             return false;
         }
     }
+    if (!Y.close()) {
+        qWarning() << "Problem closing output file.";
+        return false;
+    }
 
     return true;
 }
 
 bool p_extract_segment_timeseries_from_concat_list(QStringList timeseries_list, QString timeseries_out, bigint t1, bigint t2, const QList<int>& channels)
 {
-    QString ts0 = timeseries_list.value(0);
-    DiskReadMda32 X(ts0);
+    DiskReadMda32 X(2, timeseries_list); //for the data type and scale of the output
     bigint M = X.N1();
     if (!channels.isEmpty()) {
         M = channels.count();
@@ -129,6 +138,7 @@ bool p_extract_segment_timeseries_from_concat_list(QStringList timeseries_list,
         qWarning() << "Error opening file for writing: " << timeseries_out << M << t2 - t1 + 1;
         return false;
     }
+    Y.setScale(X.scale());
     if (!Y.writeChunk(out, 0, 0)) {
         qWarning() << "Problem writing chunk in extract_segment_timeseries";
         return false;
@@ -31,6 +31,7 @@ bool p_extract_time_interval(QStringList timeseries_list, QString firings, QStri
 
     DiskReadMda32 X(2, timeseries_list);
     DiskWriteMda Y(X.mdaioHeader().data_type, timeseries_out, X.N1(), t2 - t1 + 1);
+    Y.setScale(X.scale()); //the chunks are read with the scale applied
     Mda32 chunk;
     if (!X.readChunk(chunk, 0, t1, X.N1(), t2 - t1 + 1)) {
         qWarning() << "Problem reading chunk.";
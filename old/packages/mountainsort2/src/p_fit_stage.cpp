@@ -13,7 +13,7 @@ typedef QList<bigint> IntList;
 namespace P_fit_stage {
 Mda sort_firings_by_time(const Mda& firings);
 void compute_templates(Mda32& templates_out, Mda32& templates_stdevs_out, const DiskReadMda32& X, const QVector<double>& times, const QVector<bigint>& labels, bigint clip_size);
-QVector<bigint> fit_stage_kernel(Mda32& X, Mda32& templates, QVector<double>& times, QVector<bigint>& labels, const Fit_stage_opts& opts, const QList<IntList>& time_channel_mask);
+QVector<bigint> fit_stage_kernel(Mda32& X, const Mda32& templates, QVector<double>& times, QVector<bigint>& labels, const Fit_stage_opts& opts, const QList<IntList>& time_channel_mask);
 QList<bigint> get_time_channel_mask(const Mda32& template0, const Mda32& template0_stdev, double thresh);
 }
 
@@ -82,7 +82,7 @@ bool p_fit_stage(QString timeseries_path, QString firings_path, QString firings_
             //for (bigint timepoint = 0; timepoint < N; timepoint += N) { //for debugging
             //QMap<QString, bigint> elapsed_times_local;
             Mda32 chunk; //this will be the chunk we are working on
-            Mda32 local_templates; //just a local copy of the templates
+            Mda32 local_templates; //the templates, shared (not copied) since the kernel only reads them
             QVector<double> local_times; //the times that fall in this time range
             QVector<bigint> local_labels; //the corresponding labels
             QList<bigint> local_inds; //the corresponding event indices
@@ -267,7 +267,7 @@ double compute_score(bigint N, float* X, float* template0)
 }
 */
 
-double compute_score(bigint M, bigint T, float* X_ptr, float* template0, const QList<bigint>& tchmask)
+double compute_score(bigint M, bigint T, float* X_ptr, const float* template0, const QList<bigint>& tchmask)
 {
     (void)M;
     (void)T;
@@ -299,7 +299,7 @@ void subtract_scaled_template(bigint N, double* X, double* template0, double sca
     }
 }
 
-void subtract_scaled_template(bigint M, bigint T, float* X_ptr, float* dirty_ptr, float* template0, const QList<bigint>& tchmask, double scale_min, double scale_max)
+void subtract_scaled_template(bigint M, bigint T, float* X_ptr, float* dirty_ptr, const float* template0, const QList<bigint>& tchmask, double scale_min, double scale_max)
 {
     (void)M;
     (void)T;
@@ -354,7 +354,7 @@ QVector<bigint> find_events_to_use(const QVector<double>& times, const QVector<d
     return to_use;
 }
 
-QVector<bigint> fit_stage_kernel(Mda32& X, Mda32& templates, QVector<double>& times, QVector<bigint>& labels, const Fit_stage_opts& opts, const QList<IntList>& time_channel_mask)
+QVector<bigint> fit_stage_kernel(Mda32& X, const Mda32& templates, QVector<double>& times, QVector<bigint>& labels, const Fit_stage_opts& opts, const QList<IntList>& time_channel_mask)
 {
     bigint M = X.N1(); //the number of dimensions
     bigint T = opts.clip_size; //the clip size
@@ -362,11 +362,14 @@ QVector<bigint> fit_stage_kernel(Mda32& X, Mda32& templates, QVector<double>& ti
     bigint L = times.count(); //number of events we are looking at
     bigint K = MLCompute::max<bigint>(labels); //the maximum label number
 
+    //read only, so the templates (shared with the other threads) are not copied
+    const float* templates_ptr = templates.constDataPtr();
+
     //compute the L2-norms of the templates ahead of time
     QVector<double> template_norms;
     template_norms << 0;
     for (bigint k = 1; k <= K; k++) {
-        template_norms << MLCompute::norm(M * T, templates.dataPtr(0, 0, k - 1));
+        template_norms << MLCompute::norm(M * T, templates_ptr + M * T * (k - 1));
     }
 
     //keep passing through the data until nothing changes anymore
@@ -415,7 +418,7 @@ QVector<bigint> fit_stage_kernel(Mda32& X, Mda32& templates, QVector<double>& ti
                         //we do need to recompute it.
 
                         //The score will be how much something like the L2-norm is decreased
-                        score0 = compute_score(M, T, X.dataPtr(0, tt), templates.dataPtr(0, 0, k0 - 1), tchmask);
+                        score0 = compute_score(M, T, X.dataPtr(0, tt), templates_ptr + M * T * (k0 - 1), tchmask);
                         num_score_computes++;
                         /*
                         if (score0 < template_norms[k0] * template_norms[k0] * 0.1)
@@ -460,7 +463,7 @@ QVector<bigint> fit_stage_kernel(Mda32& X, Mda32& templates, QVector<double>& ti
                 something_changed = true;
                 num_added++;
                 bigint tt = (bigint)(times_to_try[aa] - Tmid + 0.5);
-                subtract_scaled_template(M, T, X.dataPtr(0, tt), dirty.dataPtr(0, tt), templates.dataPtr(0, 0, labels_to_try[aa] - 1), tchmask, scale_min, scale_max);
+                subtract_scaled_template(M, T, X.dataPtr(0, tt), dirty.dataPtr(0, tt), templates_ptr + M * T * (labels_to_try[aa] - 1), tchmask, scale_min, scale_max);
                 event_inds_to_use << inds_to_try[aa];
                 num_to_use++;
             }
@@ -13,6 +13,7 @@
 #include "pca.h"
 #include "kdtree.h"
 #include "compute_templates_0.h"
+#include "templatesimilarity.h"
 
 namespace P_isolation_metrics {
 Mda32 extract_clips(const DiskReadMda32& X, const QVector<double>& times, int clip_size);
@@ -452,21 +453,6 @@ QVector<bigint> find_label_inds(const QVector<bigint>& labels, bigint k)
     return ret;
 }
 
-double distsqr_between_templates(const Mda32& X, const Mda32& Y)
-{
-    double ret = 0;
-    for (bigint i = 0; i < X.totalSize(); i++) {
-        double tmp = X.get(i) - Y.get(i);
-        ret += tmp * tmp;
-    }
-    return ret;
-}
-
-double correlation_between_templates(Mda32& X, Mda32& Y)
-{
-    return MLCompute::correlation(X.totalSize(), X.dataPtr(), Y.dataPtr());
-}
-
 QSet<QString> get_pairs_to_compare(const Mda32& templates0, bigint num_comparisons_per_cluster, const QList<int>& cluster_numbers, P_isolation_metrics_opts opts)
 {
     (void)opts;
@@ -474,28 +460,27 @@ QSet<QString> get_pairs_to_compare(const Mda32& templates0, bigint num_compariso
 
     int min_num_comparisons_per_cluster = 3;
 
-    for (bigint i1 = 0; i1 < cluster_numbers.count(); i1++) {
+    bigint M = templates0.N1();
+    bigint T = templates0.N2();
+    bigint num_clusters = cluster_numbers.count();
+    Mda32 templates(M, T, num_clusters);
+    for (bigint i = 0; i < num_clusters; i++) {
+        Mda32 template0;
+        templates0.getChunk(template0, 0, 0, cluster_numbers[i] - 1, M, T, 1);
+        templates.setChunk(template0, 0, 0, i);
+    }
+    Mda dists = TemplateSimilarity::distances(templates);
+    Mda correlations = TemplateSimilarity::correlations(templates);
+    QList<QVector<int> > neighbors = TemplateSimilarity::nearestNeighbors(dists, num_clusters - 1);
+
+    for (bigint i1 = 0; i1 < num_clusters; i1++) {
         bigint k1 = cluster_numbers[i1];
-        Mda32 template1;
-        templates0.getChunk(template1, 0, 0, k1 - 1, template1.N1(), template1.N2(), 1);
-        QVector<double> dists;
-        QVector<double> correlations;
-        for (bigint i2 = 0; i2 < cluster_numbers.count(); i2++) {
-            Mda32 template2;
-            bigint k2 = cluster_numbers[i2];
-            templates0.getChunk(template2, 0, 0, k2 - 1, template2.N1(), template2.N2(), 1);
-            dists << distsqr_between_templates(template1, template2);
-            correlations << correlation_between_templates(template1, template2);
-        }
-        QList<bigint> inds = get_sort_indices_bigint(dists);
         int num0 = 0;
-        for (bigint a = 0; (a < inds.count()) && (num0 < num_comparisons_per_cluster); a++) {
-            if ((a < min_num_comparisons_per_cluster) || (correlations[a] >= 0.8)) {
-                int k2 = cluster_numbers[inds[a]];
-                if (k2 != k1) {
-                    ret.insert(QString("%1-%2").arg(k1).arg(k2));
-                    num0++;
-                }
+        for (bigint a = 0; (a < neighbors[i1].count()) && (num0 < num_comparisons_per_cluster); a++) {
+            bigint i2 = neighbors[i1][a];
+            if ((a < min_num_comparisons_per_cluster) || (correlations.value(i1, i2) >= 0.8)) {
+                ret.insert(QString("%1-%2").arg(k1).arg(cluster_numbers[i2]));
+                num0++;
             }
         }
     }
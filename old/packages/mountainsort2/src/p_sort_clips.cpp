@@ -2,25 +2,64 @@
 
 #include <QTime>
 #include <mda32.h>
+#include <diskreadmda32.h>
+#include <diskreadmda.h>
+#include <processorprofile.h>
 #include "pca.h"
 #include "isosplit5.h"
 #include "mlcommon.h"
 #include <QCoreApplication>
+#include <cstring>
 
 namespace P_sort_clips {
-QVector<int> sort_clips_subset(const Mda32& clips, const QVector<bigint>& indices, Sort_clips_opts opts);
-Mda32 dimension_reduce_clips(Mda32& clips, bigint num_features_per_channel, bigint max_samples);
+QVector<int> sort_clips_subset(const Mda32& features, const QVector<bigint>& indices, Sort_clips_opts opts);
+QVector<int> sort_clips_in_time_blocks(const Mda32& features, const QVector<double>& times, Sort_clips_opts opts);
+bool dimension_reduce_clips(Mda32& ret, const DiskReadMda32& clips, bigint num_features_per_channel, bigint max_samples);
 Mda32 compute_templates(Mda32& clips, const QVector<int>& labels);
 }
 
-bool p_sort_clips(QString clips_path, QString labels_out, Sort_clips_opts opts)
+bool p_sort_clips(QString clips_path, QString event_times_path, QString labels_out, Sort_clips_opts opts)
 {
     qDebug().noquote() << "p_sort_clips";
-    Mda32 clips(clips_path);
+    QVector<double> times;
+    if (!event_times_path.isEmpty()) {
+        DiskReadMda ET(event_times_path);
+        times.resize(ET.totalSize());
+        for (bigint i = 0; i < times.count(); i++) {
+            times[i] = ET.value(i);
+        }
+    }
+    QVector<int> labels;
+    if (!sort_clips(labels, DiskReadMda32(clips_path), opts, times))
+        return false;
+    bigint L = labels.count();
+
+    Mda ret(1, L);
+    for (bigint i = 0; i < L; i++) {
+        ret.setValue(labels[i], i);
+    }
+
+    return ret.write64(labels_out);
+}
+
+bool sort_clips(QVector<int>& labels, const DiskReadMda32& clips0, Sort_clips_opts opts, const QVector<double>& times)
+{
+    if ((!times.isEmpty()) && (times.count() != clips0.N3())) {
+        qWarning() << "Inconsistent number of event times and clips" << times.count() << clips0.N3();
+        return false;
+    }
+
+    // The clips are streamed from disk (they may not fit in memory). Only the per-channel features are kept,
+    // and everything below (including outlier removal) operates on those.
+    Mda32 clips;
     {
+        ProfilePhase phase("dimension_reduce_clips");
         QTime timer;
         timer.start();
-        clips = P_sort_clips::dimension_reduce_clips(clips, opts.num_features, opts.max_samples);
+        if (!P_sort_clips::dimension_reduce_clips(clips, clips0, opts.num_features, opts.max_samples)) {
+            qWarning() << "Problem in dimension reduction of clips";
+            return false;
+        }
         qDebug().noquote() << QString("Time elapsed for dimension reduction per channel (%1x%2x%3): %4 sec").arg(clips.N1()).arg(clips.N2()).arg(clips.N3()).arg(timer.elapsed() * 1.0 / 1000);
     }
     bigint M = clips.N1();
@@ -33,7 +72,14 @@ bool p_sort_clips(QString clips_path, QString labels_out, Sort_clips_opts opts)
     }
 
     qDebug().noquote() << "Sorting clips...";
-    QVector<int> labels = P_sort_clips::sort_clips_subset(clips, indices, opts);
+    if ((opts.time_block_size > 0) && (!times.isEmpty())) {
+        ProfilePhase phase("sort_clips_in_time_blocks");
+        labels = P_sort_clips::sort_clips_in_time_blocks(clips, times, opts);
+    }
+    else {
+        ProfilePhase phase("sort_clips_subset");
+        labels = P_sort_clips::sort_clips_subset(clips, indices, opts);
+    }
 
     if (opts.remove_outliers) {
         qDebug().noquote() << "Computing templates...";
@@ -78,63 +124,93 @@ bool p_sort_clips(QString clips_path, QString labels_out, Sort_clips_opts opts)
         qDebug().noquote() << QString("Removed %1 outliers out of %2 (%3%)").arg(num_outliers_removed).arg(L).arg(num_outliers_removed * 100.0 / L);
     }
 
-    Mda ret(1, L);
-    for (bigint i = 0; i < L; i++) {
-        ret.setValue(labels[i], i);
-    }
-
-    return ret.write64(labels_out);
+    return true;
 }
 
 namespace P_sort_clips {
 
-Mda32 dimension_reduce_clips(Mda32& clips, bigint num_features_per_channel, bigint max_samples)
+bool dimension_reduce_clips(Mda32& ret, const DiskReadMda32& clips, bigint num_features_per_channel, bigint max_samples)
 {
     bigint M = clips.N1();
     bigint T = clips.N2();
     bigint L = clips.N3();
-    float* clips_ptr = clips.dataPtr();
+    bigint F = num_features_per_channel;
 
     qDebug().noquote() << QString("Dimension reduce clips %1x%2x%3").arg(M).arg(T).arg(L);
 
-    Mda32 ret(M, num_features_per_channel, L);
-    float* retptr = ret.dataPtr();
+    // Fit the per-channel components on a subsample of the clips (same subsampling as pca_subsampled)
+    QVector<bigint> sample_indices;
+    if (L <= max_samples) {
+        for (bigint i = 0; i < L; i++)
+            sample_indices << i;
+    }
+    else {
+        double increment = L * 1.0 / max_samples;
+        for (double i = 0; i < L; i += increment) {
+            sample_indices << (bigint)i;
+        }
+    }
+    bigint L_sample = sample_indices.count();
+    QVector<Mda32> reshaped_samples(M);
     for (bigint m = 0; m < M; m++) {
-        Mda32 reshaped(T, L);
-        float* reshaped_ptr = reshaped.dataPtr();
-        bigint aa = 0;
-        bigint bb = m;
-        for (bigint i = 0; i < L; i++) {
+        reshaped_samples[m].allocate(T, L_sample);
+    }
+    for (bigint j = 0; j < L_sample; j++) {
+        Mda32 clip;
+        if (!clips.readChunk(clip, 0, 0, sample_indices[j], M, T, 1)) {
+            qWarning() << "Problem reading clip" << sample_indices[j];
+            return false;
+        }
+        const float* clip_ptr = clip.constDataPtr();
+        for (bigint m = 0; m < M; m++) {
+            float* reshaped_ptr = reshaped_samples[m].dataPtr(0, j);
             for (bigint t = 0; t < T; t++) {
-                //reshaped.set(clips.get(bb),aa);
-                reshaped_ptr[aa] = clips_ptr[bb];
-                aa++;
-                bb += M;
-                //reshaped.setValue(clips.value(m, t, i), t, i);
+                reshaped_ptr[t] = clip_ptr[m + M * t];
             }
         }
-        Mda32 CC, FF, sigma;
-        pca_subsampled(CC, FF, sigma, reshaped, num_features_per_channel, false, max_samples);
-        float* FF_ptr = FF.dataPtr();
-        aa = 0;
-        bb = m;
-        for (bigint i = 0; i < L; i++) {
-            for (bigint a = 0; a < num_features_per_channel; a++) {
-                //ret.setValue(FF.value(a, i), m, a, i);
-                //ret.set(FF.get(aa),bb);
-                retptr[bb] = FF_ptr[aa];
-                aa++;
-                bb += M;
+    }
+    QVector<Mda32> components(M); // each is TxF
+    for (bigint m = 0; m < M; m++) {
+        Mda32 FF, sigma;
+        pca(components[m], FF, sigma, reshaped_samples[m], F, false);
+        reshaped_samples[m] = Mda32(); //release memory
+    }
+
+    // Project all the clips, one chunk at a time, so that only the features are resident
+    ret.allocate(M, F, L);
+    float* retptr = ret.dataPtr();
+    bigint chunk_size = 10000; // number of clips per chunk
+    for (bigint i0 = 0; i0 < L; i0 += chunk_size) {
+        bigint L0 = qMin(chunk_size, L - i0);
+        Mda32 chunk;
+        if (!clips.readChunk(chunk, 0, 0, i0, M, T, L0)) {
+            qWarning() << "Problem reading chunk of clips" << i0 << L0;
+            return false;
+        }
+        const float* chunk_ptr = chunk.constDataPtr();
+#pragma omp parallel for
+        for (bigint i = 0; i < L0; i++) {
+            const float* clip_ptr = &chunk_ptr[M * T * i];
+            float* features_ptr = &retptr[M * F * (i0 + i)];
+            for (bigint m = 0; m < M; m++) {
+                const float* CC_ptr = components[m].constDataPtr();
+                for (bigint a = 0; a < F; a++) {
+                    double val = 0;
+                    for (bigint t = 0; t < T; t++) {
+                        val += CC_ptr[t + T * a] * clip_ptr[m + M * t];
+                    }
+                    features_ptr[m + M * a] = val;
+                }
             }
         }
     }
-    return ret;
+    return true;
 }
 
-QVector<int> sort_clips_subset(const Mda32& clips, const QVector<bigint>& indices, Sort_clips_opts opts)
+QVector<int> sort_clips_subset(const Mda32& features, const QVector<bigint>& indices, Sort_clips_opts opts)
 {
-    bigint M = clips.N1();
-    bigint T = clips.N2();
+    bigint M = features.N1();
+    bigint T = features.N2();
     bigint L0 = indices.count();
 
     qDebug().noquote() << QString("Sorting clips %1x%2x%3").arg(M).arg(T).arg(L0);
@@ -142,21 +218,18 @@ QVector<int> sort_clips_subset(const Mda32& clips, const QVector<bigint>& indice
     Mda32 FF;
     {
         // do this inside a code block so memory gets released
-        Mda32 clips_reshaped(M * T, L0);
-        bigint iii = 0;
+        // each feature vector is contiguous, so the subset is gathered one column at a time
+        Mda32 features_subset(M * T, L0);
+        const float* features_ptr = features.constDataPtr();
+        float* subset_ptr = features_subset.dataPtr();
         for (bigint ii = 0; ii < L0; ii++) {
-            for (bigint t = 0; t < T; t++) {
-                for (bigint m = 0; m < M; m++) {
-                    clips_reshaped.set(clips.value(m, t, indices[ii]), iii);
-                    iii++;
-                }
-            }
+            std::memcpy(&subset_ptr[M * T * ii], &features_ptr[M * T * indices[ii]], sizeof(float) * M * T);
         }
 
         Mda32 CC, sigma;
         QTime timer;
         timer.start();
-        pca_subsampled(CC, FF, sigma, clips_reshaped, opts.num_features, false, opts.max_samples); //should we subtract the mean?
+        pca_subsampled(CC, FF, sigma, features_subset, opts.num_features, false, opts.max_samples); //should we subtract the mean?
         qDebug().noquote() << QString("Time elapsed for pca (%1x%2x%3): %4 sec").arg(M).arg(T).arg(L0).arg(timer.elapsed() * 1.0 / 1000);
     }
 
@@ -190,7 +263,7 @@ QVector<int> sort_clips_subset(const Mda32& clips, const QVector<bigint>& indice
                 }
             }
             if (indices2.count() > 0) {
-                QVector<int> labels2 = sort_clips_subset(clips, indices2, opts);
+                QVector<int> labels2 = sort_clips_subset(features, indices2, opts);
                 bigint K2 = MLCompute::max(labels2);
                 for (bigint bb = 0; bb < indices2.count(); bb++) {
                     labels_new[indices2b[bb]] = k_offset + labels2[bb];
@@ -202,6 +275,139 @@ QVector<int> sort_clips_subset(const Mda32& clips, const QVector<bigint>& indice
         return labels_new;
     }
 }
+bool should_link(const Mda& CM, const QVector<bigint>& counts1, const QVector<bigint>& counts2, bigint i1, bigint i2, double link_threshold)
+{
+    // same criterion as in p_link_segments: a mutual best match that accounts for most of the shared events of both
+    bigint best_i1 = 0;
+    for (bigint j1 = 0; j1 < CM.N1(); j1++) {
+        if (CM.value(j1, i2) > CM.value(best_i1, i2))
+            best_i1 = j1;
+    }
+    bigint best_i2 = 0;
+    for (bigint j2 = 0; j2 < CM.N2(); j2++) {
+        if (CM.value(i1, j2) > CM.value(i1, best_i2))
+            best_i2 = j2;
+    }
+    if ((best_i1 != i1) || (best_i2 != i2))
+        return false;
+    if (CM.value(i1, i2) < link_threshold * counts1[i1])
+        return false;
+    if (CM.value(i1, i2) < link_threshold * counts2[i2])
+        return false;
+    return true;
+}
+
+QVector<int> sort_clips_in_time_blocks(const Mda32& features, const QVector<double>& times, Sort_clips_opts opts)
+{
+    // The events are split into time blocks which are clustered independently (in parallel), each together with
+    // the events within the overlap on either side. Each block's labels are then linked to those of the previous
+    // block using the events that the two blocks share, and each event takes its label from the block it belongs to.
+    double link_threshold = 0.7;
+
+    bigint L = times.count();
+    double tmin = MLCompute::min(times);
+    double tmax = MLCompute::max(times);
+    double block_size = opts.time_block_size;
+    double overlap = block_size * qBound(0.0, opts.time_block_overlap, 0.5);
+    bigint num_blocks = qMax((bigint)1, (bigint)((tmax - tmin) / block_size) + 1);
+
+    QVector<QVector<bigint>> block_indices(num_blocks); //ascending
+    QVector<bigint> home_blocks(L), home_positions(L); //the block each event belongs to, and its position there
+    for (bigint i = 0; i < L; i++) {
+        bigint b0 = qMin(num_blocks - 1, (bigint)((times[i] - tmin) / block_size));
+        home_blocks[i] = b0;
+        for (bigint b = qMax((bigint)0, b0 - 1); b <= qMin(num_blocks - 1, b0 + 1); b++) {
+            double t1 = tmin + b * block_size - overlap;
+            double t2 = tmin + (b + 1) * block_size + overlap;
+            if ((b == b0) || ((t1 <= times[i]) && (times[i] < t2))) {
+                if (b == b0)
+                    home_positions[i] = block_indices[b].count();
+                block_indices[b] << i;
+            }
+        }
+    }
+
+    qDebug().noquote() << QString("Sorting %1 clips in %2 time blocks").arg(L).arg(num_blocks);
+    QVector<QVector<int>> block_labels(num_blocks);
+    QVector<int>* block_labels_ptr = block_labels.data();
+#pragma omp parallel for schedule(dynamic)
+    for (bigint b = 0; b < num_blocks; b++) {
+        if (!block_indices[b].isEmpty())
+            block_labels_ptr[b] = sort_clips_subset(features, block_indices[b], opts);
+    }
+
+    QVector<int> block_K(num_blocks);
+    for (bigint b = 0; b < num_blocks; b++) {
+        block_K[b] = block_labels[b].isEmpty() ? 0 : MLCompute::max(block_labels[b]);
+    }
+
+    // label_maps[b][k-1] is the global label of label k of block b
+    QVector<QVector<int>> label_maps(num_blocks);
+    int num_global_labels = 0;
+    for (bigint b = 0; b < num_blocks; b++) {
+        int K2 = block_K[b];
+        label_maps[b].fill(0, K2);
+        int K1 = (b > 0) ? block_K[b - 1] : 0;
+        if ((K1 > 0) && (K2 > 0)) {
+            const QVector<bigint>& inds1 = block_indices[b - 1];
+            const QVector<bigint>& inds2 = block_indices[b];
+            Mda CM(K1, K2);
+            QVector<bigint> counts1(K1), counts2(K2);
+            bigint j1 = 0, j2 = 0;
+            while ((j1 < inds1.count()) && (j2 < inds2.count())) {
+                if (inds1[j1] < inds2[j2])
+                    j1++;
+                else if (inds1[j1] > inds2[j2])
+                    j2++;
+                else {
+                    int k1 = block_labels[b - 1][j1], k2 = block_labels[b][j2];
+                    if ((k1 > 0) && (k2 > 0)) {
+                        CM.setValue(CM.value(k1 - 1, k2 - 1) + 1, k1 - 1, k2 - 1);
+                        counts1[k1 - 1]++;
+                        counts2[k2 - 1]++;
+                    }
+                    j1++;
+                    j2++;
+                }
+            }
+            for (int i1 = 0; i1 < K1; i1++) {
+                for (int i2 = 0; i2 < K2; i2++) {
+                    if ((counts1[i1]) && (should_link(CM, counts1, counts2, i1, i2, link_threshold)))
+                        label_maps[b][i2] = label_maps[b - 1][i1];
+                }
+            }
+        }
+        for (int k = 0; k < K2; k++) {
+            if (!label_maps[b][k]) {
+                num_global_labels++;
+                label_maps[b][k] = num_global_labels;
+            }
+        }
+    }
+
+    QVector<int> labels(L);
+    QVector<bigint> counts(num_global_labels + 1);
+    for (bigint i = 0; i < L; i++) {
+        int k = block_labels[home_blocks[i]][home_positions[i]];
+        labels[i] = k > 0 ? label_maps[home_blocks[i]][k - 1] : 0;
+        counts[labels[i]]++;
+    }
+
+    // labels that only occurred in the overlaps are dropped, so make them consecutive again
+    QVector<int> condensed(num_global_labels + 1);
+    int K = 0;
+    for (int k = 1; k <= num_global_labels; k++) {
+        if (counts[k])
+            condensed[k] = ++K;
+    }
+    for (bigint i = 0; i < L; i++) {
+        labels[i] = condensed[labels[i]];
+    }
+    qDebug().noquote() << QString("Linked the time blocks into %1 clusters").arg(K);
+
+    return labels;
+}
+
 Mda32 compute_templates(Mda32& clips, const QVector<int>& labels)
 {
     int M = clips.N1();
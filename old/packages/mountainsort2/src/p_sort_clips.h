@@ -3,6 +3,7 @@
 
 #include <QString>
 #include "mlcommon.h"
+#include <diskreadmda32.h>
 
 struct Sort_clips_opts {
     int num_features = 10;
@@ -10,9 +11,12 @@ struct Sort_clips_opts {
     double K_init = 200;
     bigint max_samples = 10000; //for subsampled pca
     bool remove_outliers = false;
+    double time_block_size = 0; //timepoints. If positive (and event times are given), the events are clustered in overlapping time blocks in parallel
+    double time_block_overlap = 0.1; //fraction of the block size shared with each neighboring block (at most 0.5)
 };
 
-bool p_sort_clips(QString clips, QString firings_out, Sort_clips_opts opts);
+bool p_sort_clips(QString clips, QString event_times, QString labels_out, Sort_clips_opts opts); //event_times is optional (empty)
+bool sort_clips(QVector<int>& labels, const DiskReadMda32& clips, Sort_clips_opts opts, const QVector<double>& times = QVector<double>()); //labels are 1-based (0 for outliers)
 bool p_reorder_labels(QString templates, QString firings, QString firings_out);
 
 #endif // P_SORT_CLIPS_H
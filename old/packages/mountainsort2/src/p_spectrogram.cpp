@@ -0,0 +1,342 @@
+#include "p_spectrogram.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTime>
+#include <diskreadmda32.h>
+#include <asyncdiskwritemda.h>
+#include <processorprofile.h>
+#include "omp.h"
+#include "fftw3.h"
+#include <math.h>
+#include <string.h>
+
+#define MIN_PYRAMID_LEVEL_SIZE 512
+#define MAX_CHUNK_ENTRIES (1 << 22) //per thread, for the input timepoints and for the output bins
+
+namespace P_spectrogram {
+struct Window_runner {
+    Window_runner()
+    {
+    }
+
+    ~Window_runner()
+    {
+        fftwf_free(data_in);
+        fftwf_free(data_out);
+    }
+    //fftw planning is not thread-safe, so init() and cleanup() are called in a critical section
+    void init(bigint W_in)
+    {
+        W = W_in;
+        F = W / 2;
+        data_in = (float*)fftwf_malloc(sizeof(float) * W);
+        data_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (W / 2 + 1));
+        plan = fftwf_plan_dft_r2c_1d(W, data_in, data_out, FFTW_ESTIMATE);
+        window.resize(W);
+        double sum = 0;
+        for (bigint i = 0; i < W; i++) {
+            window[i] = 0.5 * (1 - cos(2 * M_PI * i / W));
+            sum += window[i];
+        }
+        //a sinusoid of amplitude A, at one of the frequencies, gives A
+        factor = 2 / sum;
+    }
+    void cleanup()
+    {
+        fftwf_destroy_plan(plan);
+    }
+    //amplitudes at 1..F Hz of the window of channel m of X starting at timepoint t0, maxed into amps
+    void apply(float* amps, const Mda32& X, bigint m, bigint t0)
+    {
+        bigint M = X.N1();
+        const float* ptr = X.constDataPtr() + m + M * t0;
+        for (bigint i = 0; i < W; i++) {
+            data_in[i] = ptr[M * i] * window[i];
+        }
+        fftwf_execute(plan);
+        for (bigint f = 1; f <= F; f++) {
+            float re = data_out[f][0], im = data_out[f][1];
+            float val = sqrt(re * re + im * im) * factor;
+            if (val > amps[f - 1])
+                amps[f - 1] = val;
+        }
+    }
+
+    bigint W, F;
+    float* data_in;
+    fftwf_complex* data_out;
+    fftwf_plan plan;
+    QVector<float> window;
+    float factor;
+};
+
+Mda32 decimate(const Mda32& X, int factor);
+bool write_level(AsyncDiskWriteMda& Y, const Mda32& S, bigint offset);
+bool write_progress(QString progress_path, AsyncDiskWriteMda& Y, AsyncDiskWriteMda* P, bigint num_bins_done, int num_levels, int num_chunk_levels, bigint factor);
+}
+
+QList<bigint> spectrogram_pyramid_level_sizes(bigint N3, int pyramid_factor)
+{
+    QList<bigint> ret;
+    bigint n = N3;
+    do {
+        n = (n + pyramid_factor - 1) / pyramid_factor;
+        ret << n;
+    } while (n > MIN_PYRAMID_LEVEL_SIZE);
+    return ret;
+}
+
+bool p_spectrogram(QString timeseries, QString spectrogram_out, QString pyramid_out, P_spectrogram_opts opts)
+{
+    DiskReadMda32 X(timeseries);
+    const bigint M = X.N1();
+    const bigint N = X.N2();
+    const bigint tres = opts.time_resolution;
+    const bigint W = (bigint)(opts.samplerate + 0.5); //one second, so that the frequencies are whole numbers of Hz
+    const bigint F = W / 2;
+    const bigint factor = opts.pyramid_factor;
+    if (tres <= 0) {
+        qWarning() << "Invalid time_resolution" << tres;
+        return false;
+    }
+    if (F < 1) {
+        qWarning() << "Invalid samplerate" << opts.samplerate;
+        return false;
+    }
+    if ((factor < 2) || (factor > 64)) {
+        qWarning() << "Invalid pyramid_factor" << factor;
+        return false;
+    }
+    const bigint N3 = (N + tres - 1) / tres;
+
+    //several windows per bin when the bins are long, so that nothing falls between them
+    const bigint hop = qMin(tres, qMax((bigint)1, W / 4));
+    const bigint num_windows_per_bin = (tres + hop - 1) / hop;
+
+    bool do_pyramid = !pyramid_out.isEmpty();
+    QList<bigint> level_sizes, level_offsets;
+    if (do_pyramid) {
+        level_sizes = spectrogram_pyramid_level_sizes(N3, factor);
+        bigint offset = 0;
+        foreach (bigint size, level_sizes) {
+            level_offsets << offset;
+            offset += size;
+        }
+    }
+    const int num_levels = level_sizes.count();
+
+    //a chunk is a power of pyramid_factor bins, so it covers a whole number of bins of the first levels of the
+    //pyramid (all of them when possible), which are decimated in the worker threads; the rest are made at the
+    //end from the coarsest of those
+    int chunk_exponent = 1;
+    while (pow(factor, chunk_exponent + 1) * qMax(tres, F) * M <= MAX_CHUNK_ENTRIES)
+        chunk_exponent++;
+    const bigint chunk_size = (bigint)pow(factor, chunk_exponent); //in bins
+    const bigint num_chunks = (N3 + chunk_size - 1) / chunk_size;
+    const int num_chunk_levels = qMin(chunk_exponent, num_levels);
+
+    Mda32 kept_level; //the coarsest level made in the chunks, when there are more levels to make from it
+    if (num_chunk_levels < num_levels) {
+        kept_level.allocate(M, level_sizes[num_chunk_levels - 1], F);
+    }
+
+    //the viewers show the outputs while they are written (to <path>.tmp), but only the bins that are listed
+    //in this file as being on disk; it is removed when the outputs are complete
+    QString progress_path = spectrogram_out + ".progress";
+    QFile::remove(progress_path);
+
+    AsyncDiskWriteMda Y;
+    if (!Y.open(MDAIO_TYPE_FLOAT32, spectrogram_out, M, N3, F)) {
+        qWarning() << "Unable to open output file for writing: " + spectrogram_out;
+        return false;
+    }
+    AsyncDiskWriteMda P;
+    if (do_pyramid) {
+        if (!P.open(MDAIO_TYPE_FLOAT32, pyramid_out, M, level_offsets.last() + level_sizes.last(), F))
+            return false;
+    }
+    QVector<char> chunk_done(num_chunks, 0);
+    bigint num_chunks_done = 0; //all the chunks before this one are done
+    bigint num_chunks_published = 0; //in the progress file
+    QTime timer_progress;
+    timer_progress.start();
+
+    QTime timer_status;
+    timer_status.start();
+    printf("Spectrogram of %ldx%ld: %ld bins of %ld frequencies, %d pyramid levels, chunks of %ld bins (num threads=%d)\n", M, N, N3, F, num_levels, chunk_size, omp_get_max_threads());
+
+    bool ret = true;
+    bigint num_bins_handled = 0;
+    ProcessorProfile::globalInstance()->startPhase("spectrogram");
+#pragma omp parallel
+    {
+        P_spectrogram::Window_runner WR;
+#pragma omp critical(fftw_planner)
+        {
+            WR.init(W);
+        }
+#pragma omp for schedule(dynamic)
+        for (bigint ichunk = 0; ichunk < num_chunks; ichunk++) {
+            bigint b0 = ichunk * chunk_size;
+            bigint nb = qMin(chunk_size, N3 - b0);
+            //the first window of bin b0 starts at b0*tres+hop/2-W/2
+            bigint t0 = b0 * tres + hop / 2 - W / 2;
+            Mda32 chunk;
+            bool read_ok = true;
+            ProfileLockWait lock_wait("lock1");
+#pragma omp critical(lock1)
+            {
+                lock_wait.acquired();
+                if (!X.readChunk(chunk, 0, t0, M, nb * tres + W)) {
+                    qWarning() << "Error reading chunk";
+                    ret = false;
+                    read_ok = false;
+                }
+            }
+            if (!read_ok)
+                continue;
+            Mda32 S(M, nb, F);
+            QVector<float> amps(F);
+            for (bigint j = 0; j < nb; j++) {
+                for (bigint m = 0; m < M; m++) {
+                    amps.fill(0);
+                    for (bigint k = 0; k < num_windows_per_bin; k++) {
+                        WR.apply(amps.data(), chunk, m, j * tres + k * hop);
+                    }
+                    for (bigint f = 0; f < F; f++) {
+                        S.set(amps[f], m, j, f);
+                    }
+                }
+            }
+            if (!P_spectrogram::write_level(Y, S, b0)) {
+#pragma omp critical(lock1)
+                ret = false;
+            }
+            bigint decimation = 1;
+            for (int level = 0; level < num_chunk_levels; level++) {
+                S = P_spectrogram::decimate(S, factor);
+                decimation *= factor;
+                if (!P_spectrogram::write_level(P, S, level_offsets[level] + b0 / decimation)) {
+#pragma omp critical(lock1)
+                    ret = false;
+                }
+            }
+            if (num_chunk_levels < num_levels) {
+                //separate columns for each chunk
+                for (bigint f = 0; f < F; f++) {
+                    for (bigint j = 0; j < S.N2(); j++) {
+                        for (bigint m = 0; m < M; m++) {
+                            kept_level.set(S.get(m, j, f), m, b0 / decimation + j, f);
+                        }
+                    }
+                }
+            }
+#pragma omp critical(lock1)
+            {
+                num_bins_handled += nb;
+                chunk_done[ichunk] = 1;
+                while ((num_chunks_done < num_chunks) && (chunk_done[num_chunks_done]))
+                    num_chunks_done++;
+                if ((num_chunks_done > num_chunks_published) && (timer_progress.elapsed() > 1000)) {
+                    bigint num_bins_done = qMin(num_chunks_done * chunk_size, N3);
+                    if (!P_spectrogram::write_progress(progress_path, Y, do_pyramid ? &P : 0, num_bins_done, num_levels, num_chunk_levels, factor))
+                        qWarning() << "Unable to write progress file" << progress_path;
+                    num_chunks_published = num_chunks_done;
+                    timer_progress.restart();
+                }
+                if ((timer_status.elapsed() > 5000) || (num_bins_handled == N3) || (b0 == 0)) {
+                    printf("%ld/%ld (%d%%) -- using %d threads.\n",
+                        num_bins_handled, N3,
+                        (int)(num_bins_handled * 1.0 / N3 * 100),
+                        omp_get_num_threads());
+                    timer_status.restart();
+                }
+            }
+        }
+#pragma omp critical(fftw_planner)
+        {
+            WR.cleanup();
+        }
+    }
+    ProcessorProfile::globalInstance()->endPhase("spectrogram");
+
+    for (int level = num_chunk_levels; level < num_levels; level++) {
+        kept_level = P_spectrogram::decimate(kept_level, factor);
+        if (!P_spectrogram::write_level(P, kept_level, level_offsets[level]))
+            ret = false;
+    }
+
+    {
+        ProfilePhase phase("flush_output");
+        if (!Y.close()) {
+            qWarning() << "Error closing output file";
+            ret = false;
+        }
+        if ((do_pyramid) && (!P.close())) {
+            qWarning() << "Error closing pyramid output file";
+            ret = false;
+        }
+        QFile::remove(progress_path);
+    }
+
+    return ret;
+}
+
+namespace P_spectrogram {
+
+Mda32 decimate(const Mda32& X, int factor)
+{
+    bigint M = X.N1();
+    bigint N2 = (X.N2() + factor - 1) / factor;
+    bigint F = X.N3();
+    Mda32 ret(M, N2, F);
+    for (bigint f = 0; f < F; f++) {
+        for (bigint j = 0; j < X.N2(); j++) {
+            for (bigint m = 0; m < M; m++) {
+                float val = X.get(m, j, f);
+                if (val > ret.get(m, j / factor, f))
+                    ret.set(val, m, j / factor, f);
+            }
+        }
+    }
+    return ret;
+}
+
+bool write_progress(QString progress_path, AsyncDiskWriteMda& Y, AsyncDiskWriteMda* P, bigint num_bins_done, int num_levels, int num_chunk_levels, bigint factor)
+{
+    //what was queued for those bins has to be in the files before they are listed
+    if ((!Y.flush()) || ((P) && (!P->flush())))
+        return false;
+    //the bins done of level 0 (the spectrogram) and of the levels of the pyramid; the levels that are not
+    //made in the chunks are only made at the end
+    QJsonArray num_bins;
+    num_bins << (double)num_bins_done;
+    bigint n = num_bins_done;
+    for (int level = 0; level < num_levels; level++) {
+        n = (n + factor - 1) / factor;
+        num_bins << (double)((level < num_chunk_levels) ? n : 0);
+    }
+    QJsonObject obj;
+    obj["num_bins"] = num_bins;
+    return TextFile::write(progress_path, QJsonDocument(obj).toJson());
+}
+
+bool write_level(AsyncDiskWriteMda& Y, const Mda32& S, bigint offset)
+{
+    //one contiguous run per frequency
+    bigint M = S.N1();
+    bigint nb = S.N2();
+    Mda32 slice(M, nb);
+    for (bigint f = 0; f < S.N3(); f++) {
+        memcpy(slice.dataPtr(), S.constDataPtr() + M * nb * f, sizeof(float) * M * nb);
+        if (!Y.writeChunk(slice, M * (offset + Y.N2() * f))) {
+            qWarning() << "Error writing chunk";
+            return false;
+        }
+    }
+    return true;
+}
+}
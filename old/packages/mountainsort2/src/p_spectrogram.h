@@ -0,0 +1,29 @@
+#ifndef P_SPECTROGRAM_H
+#define P_SPECTROGRAM_H
+
+#include <QString>
+#include <QList>
+#include "mlcommon.h"
+
+struct P_spectrogram_opts {
+    double samplerate = 128;
+    int time_resolution = 32; //number of timepoints per time bin of the output
+    int pyramid_factor = 4;
+};
+
+/*
+ * Short-time Fourier spectrogram of an MxN timeseries, computed chunk by chunk over all threads.
+ *
+ * spectrogram_out is MxN3xF (channel, time bin, frequency) with N3=ceil(N/time_resolution) and F=floor(samplerate/2):
+ * entry (m,n,f-1) is the amplitude at f Hz, as the largest over the one-second Hann windows centered within time bin n.
+ *
+ * pyramid_out (optional) is MxPxF: the coarser levels concatenated along the second dimension. Level l has
+ * ceil(size(l-1)/pyramid_factor) bins, each the max over the bins of level l-1 that it covers, and levels are
+ * added until one has at most 512 bins (see spectrogram_pyramid_level_sizes).
+ */
+bool p_spectrogram(QString timeseries, QString spectrogram_out, QString pyramid_out, P_spectrogram_opts opts);
+
+//the number of bins of levels 1,2,... of the pyramid, for a spectrogram with N3 time bins
+QList<bigint> spectrogram_pyramid_level_sizes(bigint N3, int pyramid_factor);
+
+#endif // P_SPECTROGRAM_H
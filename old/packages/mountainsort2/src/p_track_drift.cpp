@@ -0,0 +1,320 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+
+#include "p_track_drift.h"
+#include "p_sort_clips.h"
+#include "get_sort_indices.h"
+
+#include <QFile>
+#include <QTime>
+#include <mda.h>
+#include <mda32.h>
+#include <diskreadmda32.h>
+#include <cmath>
+
+namespace P_track_drift {
+
+struct Cluster {
+    int label = 0;
+    Mda32 template0; //MxT
+    double weight = 0;
+    double last_time = 0;
+    int peak_channel = 0; //0-based
+};
+
+bool read_state(QList<Cluster>& clusters, QString templates_path, QString template_info_path);
+bool write_state(const QList<Cluster>& clusters, bigint M, bigint T, QString templates_path, QString template_info_path);
+Mda32 extract_clips(const DiskReadMda32& X, const QVector<double>& times, bigint T);
+int compute_peak_channel(const Mda32& template0);
+QVector<int> get_top_channels(const float* clip, bigint M, bigint T, int num);
+double compute_distsqr(bigint N, const float* X, const float* Y);
+}
+
+bool p_track_drift(QString timeseries, QString event_times, QString templates, QString template_info,
+    QString firings_out, QString templates_out, QString template_info_out, P_track_drift_opts opts)
+{
+    DiskReadMda32 X(timeseries);
+    Mda ET(event_times);
+    bigint M = X.N1();
+    bigint T = opts.clip_size;
+    bigint L = ET.totalSize();
+    bigint MT = M * T;
+
+    QList<P_track_drift::Cluster> clusters;
+    if (!templates.isEmpty()) {
+        if (!P_track_drift::read_state(clusters, templates, template_info))
+            return false;
+    }
+    for (int k = 0; k < clusters.count(); k++) {
+        if ((clusters[k].template0.N1() != M) || (clusters[k].template0.N2() != T)) {
+            qWarning() << "Unexpected template dimensions" << clusters[k].template0.N1() << clusters[k].template0.N2() << M << T;
+            return false;
+        }
+    }
+    int next_label = 1;
+    for (int k = 0; k < clusters.count(); k++) {
+        next_label = qMax(next_label, clusters[k].label + 1);
+    }
+    qDebug().noquote() << QString("Tracking drift: M=%1, T=%2, L=%3, K=%4").arg(M).arg(T).arg(L).arg(clusters.count());
+
+    QVector<double> times(L);
+    for (bigint i = 0; i < L; i++) {
+        times[i] = ET.value(i);
+    }
+    Mda32 clips = P_track_drift::extract_clips(X, times, T);
+    if ((L > 0) && (clips.N3() != L))
+        return false;
+    const float* clips_ptr = clips.constDataPtr();
+
+    // spatial index: the clusters whose templates peak on each channel
+    QVector<QVector<int> > clusters_by_channel(M);
+    for (int k = 0; k < clusters.count(); k++) {
+        clusters_by_channel[clusters[k].peak_channel] << k;
+    }
+
+    // classify each event against the small set of candidate templates
+    QVector<int> assignments(L, -1);
+    {
+        QTime timer;
+        timer.start();
+#pragma omp parallel for
+        for (bigint i = 0; i < L; i++) {
+            const float* clip = &clips_ptr[MT * i];
+            double clip_normsqr = MLCompute::dotProduct(MT, clip, clip);
+            QVector<int> top_channels = P_track_drift::get_top_channels(clip, M, T, opts.num_candidate_channels);
+            double best_distsqr = opts.match_threshold * clip_normsqr;
+            int best_k = -1;
+            foreach (int m, top_channels) {
+                foreach (int k, clusters_by_channel.at(m)) {
+                    double distsqr = P_track_drift::compute_distsqr(MT, clip, clusters.at(k).template0.constDataPtr());
+                    if (distsqr <= best_distsqr) {
+                        best_distsqr = distsqr;
+                        best_k = k;
+                    }
+                }
+            }
+            assignments[i] = best_k;
+        }
+        qDebug().noquote() << QString("Time elapsed for classifying %1 events against %2 templates: %3 sec").arg(L).arg(clusters.count()).arg(timer.elapsed() * 1.0 / 1000);
+    }
+
+    // cluster only the residual (unmatched) events
+    QVector<bigint> residual_inds;
+    for (bigint i = 0; i < L; i++) {
+        if (assignments[i] < 0)
+            residual_inds << i;
+    }
+    qDebug().noquote() << QString("%1 of %2 events matched existing templates").arg(L - residual_inds.count()).arg(L);
+    if (!residual_inds.isEmpty()) {
+        bigint L2 = residual_inds.count();
+        Mda32 residual_clips(M, T, L2);
+        float* rptr = residual_clips.dataPtr();
+        for (bigint j = 0; j < L2; j++) {
+            std::copy(&clips_ptr[MT * residual_inds[j]], &clips_ptr[MT * (residual_inds[j] + 1)], &rptr[MT * j]);
+        }
+        QVector<int> labels2;
+        Sort_clips_opts sort_opts;
+        if (!sort_clips(labels2, DiskReadMda32(residual_clips), sort_opts))
+            return false;
+        int K2 = MLCompute::max(labels2);
+        QVector<bigint> counts(K2 + 1, 0);
+        for (bigint j = 0; j < L2; j++) {
+            counts[labels2[j]]++;
+        }
+        QVector<int> new_cluster_index(K2 + 1, -1);
+        for (int k2 = 1; k2 <= K2; k2++) {
+            if (counts[k2] >= opts.min_cluster_size) {
+                P_track_drift::Cluster C;
+                C.label = next_label;
+                C.template0.allocate(M, T);
+                new_cluster_index[k2] = clusters.count();
+                clusters << C;
+                next_label++;
+            }
+        }
+        for (bigint j = 0; j < L2; j++) {
+            assignments[residual_inds[j]] = new_cluster_index[labels2[j]];
+        }
+    }
+
+    // update the running templates with the events of this segment
+    bigint K = clusters.count();
+    QVector<Mda> sums(K);
+    QVector<bigint> counts(K, 0);
+    QVector<double> last_times(K, 0);
+    for (bigint i = 0; i < L; i++) {
+        int k = assignments[i];
+        if (k < 0)
+            continue;
+        if (!counts[k])
+            sums[k].allocate(M, T);
+        double* sptr = sums[k].dataPtr();
+        const float* clip = &clips_ptr[MT * i];
+        for (bigint j = 0; j < MT; j++) {
+            sptr[j] += clip[j];
+        }
+        counts[k]++;
+        last_times[k] = qMax(last_times[k], opts.timestamp_offset + times[i]);
+    }
+    for (bigint k = 0; k < K; k++) {
+        if (!counts[k])
+            continue;
+        P_track_drift::Cluster& C = clusters[k];
+        double old_weight = 0;
+        if (C.weight > 0)
+            old_weight = C.weight * exp(-(last_times[k] - C.last_time) / opts.window_duration);
+        double new_weight = old_weight + counts[k];
+        float* tptr = C.template0.dataPtr();
+        const double* sptr = sums[k].constDataPtr();
+        for (bigint j = 0; j < MT; j++) {
+            tptr[j] = (tptr[j] * old_weight + sptr[j]) / new_weight;
+        }
+        C.weight = new_weight;
+        C.last_time = last_times[k];
+        C.peak_channel = P_track_drift::compute_peak_channel(C.template0);
+    }
+
+    Mda firings(3, L);
+    for (bigint i = 0; i < L; i++) {
+        int k = assignments[i];
+        if (k >= 0) {
+            firings.setValue(clusters[k].peak_channel + 1, 0, i);
+            firings.setValue(clusters[k].label, 2, i);
+        }
+        firings.setValue(times[i], 1, i);
+    }
+    if (!firings.write64(firings_out))
+        return false;
+
+    return P_track_drift::write_state(clusters, M, T, templates_out, template_info_out);
+}
+
+namespace P_track_drift {
+
+bool read_state(QList<Cluster>& clusters, QString templates_path, QString template_info_path)
+{
+    Mda32 templates;
+    Mda info;
+    if (!templates.read(templates_path)) {
+        qWarning() << "Unable to read templates" << templates_path;
+        return false;
+    }
+    if (!info.read(template_info_path)) {
+        qWarning() << "Unable to read template info" << template_info_path;
+        return false;
+    }
+    bigint M = templates.N1();
+    bigint T = templates.N2();
+    bigint K = templates.N3();
+    if (info.N2() != K) {
+        qWarning() << "Inconsistent number of templates in template info" << info.N2() << K;
+        return false;
+    }
+    for (bigint k = 0; k < K; k++) {
+        Cluster C;
+        C.label = info.value(0, k);
+        C.weight = info.value(1, k);
+        C.last_time = info.value(2, k);
+        templates.getChunk(C.template0, 0, 0, k, M, T, 1);
+        C.template0.reshape(M, T);
+        C.peak_channel = compute_peak_channel(C.template0);
+        clusters << C;
+    }
+    return true;
+}
+
+bool write_state(const QList<Cluster>& clusters, bigint M, bigint T, QString templates_path, QString template_info_path)
+{
+    bigint K = clusters.count();
+    Mda32 templates(M, T, K);
+    Mda info(3, K);
+    for (bigint k = 0; k < K; k++) {
+        const Cluster& C = clusters[k];
+        std::copy(C.template0.constDataPtr(), C.template0.constDataPtr() + M * T, templates.dataPtr(0, 0, k));
+        info.setValue(C.label, 0, k);
+        info.setValue(C.weight, 1, k);
+        info.setValue(C.last_time, 2, k);
+    }
+    if (!templates.write32(templates_path))
+        return false;
+    return info.write64(template_info_path);
+}
+
+Mda32 extract_clips(const DiskReadMda32& X, const QVector<double>& times, bigint T)
+{
+    // visit the events in time order and read the timeseries in large blocks, rather than one read per clip
+    bigint M = X.N1();
+    bigint L = times.count();
+    bigint Tmid = (bigint)((T + 1) / 2) - 1;
+    bigint block_size = 100000;
+    Mda32 clips(M, T, L);
+    QList<bigint> sort_inds = get_sort_indices_bigint(times);
+    bigint jj = 0;
+    while (jj < L) {
+        bigint t1 = (bigint)times[sort_inds[jj]] - Tmid;
+        bigint jj2 = jj;
+        while ((jj2 + 1 < L) && ((bigint)times[sort_inds[jj2 + 1]] - Tmid + T <= t1 + block_size))
+            jj2++;
+        bigint t2 = (bigint)times[sort_inds[jj2]] - Tmid + T;
+        Mda32 block;
+        if (!X.readChunk(block, 0, t1, M, t2 - t1)) {
+            qWarning() << "Problem reading chunk in extract_clips" << t1 << t2;
+            return Mda32();
+        }
+        const float* bptr = block.constDataPtr();
+        for (bigint j = jj; j <= jj2; j++) {
+            bigint i = sort_inds[j];
+            bigint offset = (bigint)times[i] - Tmid - t1;
+            std::copy(&bptr[M * offset], &bptr[M * (offset + T)], clips.dataPtr(0, 0, i));
+        }
+        jj = jj2 + 1;
+    }
+    return clips;
+}
+
+int compute_peak_channel(const Mda32& template0)
+{
+    bigint M = template0.N1();
+    bigint T = template0.N2();
+    int ret = 0;
+    double best_val = 0;
+    for (bigint t = 0; t < T; t++) {
+        for (bigint m = 0; m < M; m++) {
+            double val = fabs(template0.get(m, t));
+            if (val > best_val) {
+                best_val = val;
+                ret = m;
+            }
+        }
+    }
+    return ret;
+}
+
+QVector<int> get_top_channels(const float* clip, bigint M, bigint T, int num)
+{
+    QVector<double> peaks(M, 0);
+    for (bigint t = 0; t < T; t++) {
+        for (bigint m = 0; m < M; m++) {
+            peaks[m] = qMax(peaks[m], (double)fabs(clip[m + M * t]));
+        }
+    }
+    QList<int> inds = get_sort_indices(peaks);
+    QVector<int> ret;
+    for (int j = inds.count() - 1; (j >= 0) && (ret.count() < num); j--) {
+        ret << inds[j];
+    }
+    return ret;
+}
+
+double compute_distsqr(bigint N, const float* X, const float* Y)
+{
+    double ret = 0;
+    for (bigint i = 0; i < N; i++) {
+        double diff = X[i] - Y[i];
+        ret += diff * diff;
+    }
+    return ret;
+}
+}
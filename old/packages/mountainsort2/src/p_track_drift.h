@@ -0,0 +1,34 @@
+/******************************************************
+** See the accompanying README and LICENSE files
+** Author(s): Jeremy Magland
+*******************************************************/
+#ifndef P_TRACK_DRIFT_H
+#define P_TRACK_DRIFT_H
+
+#include <QString>
+#include "mlcommon.h"
+
+struct P_track_drift_opts {
+    int clip_size = 50;
+    double timestamp_offset = 0; //time of the first sample of this segment within the whole recording
+    double window_duration = 30000 * 60 * 10; //timescale (in samples) over which the running templates forget old events
+    double match_threshold = 0.5; //an event matches a template when |clip-template|^2 <= match_threshold*|clip|^2
+    int num_candidate_channels = 3; //only compare with templates peaking on one of the event's top channels
+    int min_cluster_size = 10; //residual clusters smaller than this are left unlabeled
+};
+
+/*
+ * Incremental, drift-aware sorting of one time segment of a long recording.
+ *
+ * templates/template_info hold the state carried over from the previous segment
+ * (empty for the first segment). Each event is classified against the running templates,
+ * only the unmatched events are clustered, and the templates are updated and written out for
+ * the next segment. Firings times are relative to the segment (as for the other segment processors).
+ *
+ * templates: MxTxK running templates
+ * template_info: 3xK -- label, weight, time of last update
+ */
+bool p_track_drift(QString timeseries, QString event_times, QString templates, QString template_info,
+    QString firings_out, QString templates_out, QString template_info_out, P_track_drift_opts opts);
+
+#endif // P_TRACK_DRIFT_H
@@ -0,0 +1,12 @@
+#include "p_transpose_array.h"
+#include <mdatranspose.h>
+
+bool p_transpose_array(QString input, QString output, P_transpose_array_opts opts)
+{
+    bigint max_memory = (bigint)(opts.max_memory_mb * 1024 * 1024);
+    if (max_memory <= 0) {
+        qWarning() << "Invalid max_memory_mb" << opts.max_memory_mb;
+        return false;
+    }
+    return mda_transpose_file(input, output, max_memory);
+}
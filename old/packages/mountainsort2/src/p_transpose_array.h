@@ -0,0 +1,14 @@
+#ifndef P_TRANSPOSE_ARRAY_H
+#define P_TRANSPOSE_ARRAY_H
+
+#include <QString>
+#include "mlcommon.h"
+
+struct P_transpose_array_opts {
+    double max_memory_mb = 512;
+};
+
+// out-of-core transpose of a two-dimensional array, e.g. a channel-major (TxM) recording to MxT
+bool p_transpose_array(QString input, QString output, P_transpose_array_opts opts);
+
+#endif // P_TRANSPOSE_ARRAY_H
@@ -3,14 +3,14 @@
 #include <QTime>
 #include <diskreadmda32.h>
 #include <diskwritemda.h>
+#include <asyncdiskwritemda.h>
+#include <processorprofile.h>
 #include <mda.h>
 #include "pca.h"
 #include "omp.h"
 
 namespace P_whiten {
 
-void scale_for_quantization(Mda32& X, double quantization_unit);
-
 double quantize(float X, double unit)
 {
     return (floor(X / unit + 0.5)) * unit;
@@ -43,14 +43,17 @@ bool p_whiten(QString timeseries, QString timeseries_out, Whiten_opts opts)
     }
 
     {
+        ProfilePhase phase("compute_covariance");
         QTime timer;
         timer.start();
         bigint num_timepoints_handled = 0;
 #pragma omp parallel for
         for (bigint timepoint = 0; timepoint < N; timepoint += chunk_size) {
             Mda32 chunk;
+            ProfileLockWait lock_wait("lock1");
 #pragma omp critical(lock1)
             {
+                lock_wait.acquired();
                 if (!X.readChunk(chunk, 0, timepoint, M, qMin(chunk_size, N - timepoint))) {
                     qWarning() << "Problem reading chunk in whiten (1)";
                 }
@@ -68,8 +71,10 @@ bool p_whiten(QString timeseries, QString timeseries_out, Whiten_opts opts)
                     }
                 }
             }
+            ProfileLockWait lock_wait2("lock2");
 #pragma omp critical(lock2)
             {
+                lock_wait2.acquired();
                 bigint bb = 0;
                 for (bigint m1 = 0; m1 < M; m1++) {
                     for (bigint m2 = 0; m2 < M; m2++) {
@@ -96,20 +101,26 @@ bool p_whiten(QString timeseries, QString timeseries_out, Whiten_opts opts)
     whitening_matrix_from_XXt(WW, XXt); // the result is symmetric (assumed below)
     double* WWptr = WW.dataPtr();
 
-    DiskWriteMda Y;
+    AsyncDiskWriteMda Y;
     int dtype = MDAIO_TYPE_FLOAT32;
-    if (opts.quantization_unit > 0)
+    if (opts.quantization_unit > 0) {
+        //stored as scaled int16, which the readers convert back
         dtype = MDAIO_TYPE_INT16;
+        Y.setScale(opts.quantization_unit);
+    }
     Y.open(dtype, timeseries_out, M, N);
     {
+        ProfilePhase phase("apply_whitening");
         QTime timer;
         timer.start();
         bigint num_timepoints_handled = 0;
-#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic)
         for (bigint timepoint = 0; timepoint < N; timepoint += chunk_size) {
             Mda32 chunk_in;
+            ProfileLockWait lock_wait("lock1");
 #pragma omp critical(lock1)
             {
+                lock_wait.acquired();
                 if (!X.readChunk(chunk_in, 0, timepoint, M, qMin(chunk_size, N - timepoint))) {
                     qWarning() << "Problem reading chunk in whiten (2)";
                 }
@@ -127,17 +138,14 @@ bool p_whiten(QString timeseries, QString timeseries_out, Whiten_opts opts)
                     }
                 }
             }
+            // The following is needed to make the output deterministic, due to a very tricky floating-point problem that I honestly could not track down
+            // It has something to do with multiplying by very small values of WWptr[bb]. But I truly could not pinpoint the exact problem.
+            P_whiten::quantize(chunk_out.totalSize(), chunk_out.dataPtr(), 0.0001);
+            if (!Y.writeChunk(chunk_out, 0, timepoint)) {
+                qWarning() << "Problem writing chunk in whiten";
+            }
 #pragma omp critical(lock2)
             {
-                // The following is needed to make the output deterministic, due to a very tricky floating-point problem that I honestly could not track down
-                // It has something to do with multiplying by very small values of WWptr[bb]. But I truly could not pinpoint the exact problem.
-                P_whiten::quantize(chunk_out.totalSize(), chunk_out.dataPtr(), 0.0001);
-                if (opts.quantization_unit > 0) {
-                    P_whiten::scale_for_quantization(chunk_out, opts.quantization_unit);
-                }
-                if (!Y.writeChunk(chunk_out, 0, timepoint)) {
-                    qWarning() << "Problem writing chunk in whiten";
-                }
                 num_timepoints_handled += qMin(chunk_size, N - timepoint);
                 if ((timer.elapsed() > 5000) || (num_timepoints_handled == N)) {
                     printf("%ld/%ld (%d%%)\n", num_timepoints_handled, N, (int)(num_timepoints_handled * 1.0 / N * 100));
@@ -146,7 +154,11 @@ bool p_whiten(QString timeseries, QString timeseries_out, Whiten_opts opts)
             }
         }
     }
-    Y.close();
+    ProfilePhase phase("flush_output");
+    if (!Y.close()) {
+        qWarning() << "Problem closing output file" << timeseries_out;
+        return false;
+    }
 
     return true;
 }
@@ -200,7 +212,7 @@ bool p_compute_whitening_matrix(QStringList timeseries_list, const QList<int>& c
                 }
                 Mda XXt0(M2, M2);
                 double* XXt0ptr = XXt0.dataPtr();
-                float* chunkptr = chunk0.dataPtr();
+                const float* chunkptr = chunk0.constDataPtr(); //read only, so that it is not copied from chunks
                 for (bigint i = 0; i < chunk0.N2(); i++) {
                     bigint aa = M2 * i;
                     bigint bb = 0;
@@ -252,10 +264,13 @@ bool p_whiten_clips(QString clips_path, QString whitening_matrix, QString clips_
 
     qDebug().noquote() << "Whitening..." << M << T << L;
 
+    AsyncDiskWriteMda clips_out;
     int dtype = MDAIO_TYPE_FLOAT32;
-    if (opts.quantization_unit > 0)
+    if (opts.quantization_unit > 0) {
         dtype = MDAIO_TYPE_INT16;
-    DiskWriteMda clips_out(dtype, clips_out_path, M, T, L);
+        clips_out.setScale(opts.quantization_unit);
+    }
+    clips_out.open(dtype, clips_out_path, M, T, L);
 
     for (bigint i = 0; i < L; i++) {
         Mda32 chunk;
@@ -280,9 +295,6 @@ bool p_whiten_clips(QString clips_path, QString whitening_matrix, QString clips_
                 }
             }
         }
-        if (opts.quantization_unit > 0) {
-            P_whiten::scale_for_quantization(chunk_out, opts.quantization_unit);
-        }
         if (!clips_out.writeChunk(chunk_out, 0, 0, i)) {
             qWarning() << "Problem writing chunk";
             return false;
@@ -297,6 +309,11 @@ bool p_whiten_clips(QString clips_path, QString whitening_matrix, QString clips_
     }
     */
 
+    if (!clips_out.close()) {
+        qWarning() << "Problem closing output file" << clips_out_path;
+        return false;
+    }
+
     return true;
 }
 
@@ -318,16 +335,19 @@ bool p_apply_whitening_matrix(QString timeseries, QString whitening_matrix, QStr
 
     double* WWptr = WW.dataPtr();
 
-    DiskWriteMda Y;
+    AsyncDiskWriteMda Y;
     int dtype = MDAIO_TYPE_FLOAT32;
-    if (opts.quantization_unit > 0)
+    if (opts.quantization_unit > 0) {
+        //stored as scaled int16, which the readers convert back
         dtype = MDAIO_TYPE_INT16;
+        Y.setScale(opts.quantization_unit);
+    }
     Y.open(dtype, timeseries_out, M, N);
     {
         QTime timer;
         timer.start();
         bigint num_timepoints_handled = 0;
-#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic)
         for (bigint timepoint = 0; timepoint < N; timepoint += chunk_size) {
             Mda32 chunk_in;
 #pragma omp critical(lock1)
@@ -349,17 +369,14 @@ bool p_apply_whitening_matrix(QString timeseries, QString whitening_matrix, QStr
                     }
                 }
             }
+            // The following is needed to make the output deterministic, due to a very tricky floating-point problem that I honestly could not track down
+            // It has something to do with multiplying by very small values of WWptr[bb]. But I truly could not pinpoint the exact problem.
+            P_whiten::quantize(chunk_out.totalSize(), chunk_out.dataPtr(), 0.0001);
+            if (!Y.writeChunk(chunk_out, 0, timepoint)) {
+                qWarning() << "Problem writing chunk in apply whitening matrix";
+            }
 #pragma omp critical(lock2)
             {
-                // The following is needed to make the output deterministic, due to a very tricky floating-point problem that I honestly could not track down
-                // It has something to do with multiplying by very small values of WWptr[bb]. But I truly could not pinpoint the exact problem.
-                P_whiten::quantize(chunk_out.totalSize(), chunk_out.dataPtr(), 0.0001);
-                if (opts.quantization_unit > 0) {
-                    P_whiten::scale_for_quantization(chunk_out, opts.quantization_unit);
-                }
-                if (!Y.writeChunk(chunk_out, 0, timepoint)) {
-                    qWarning() << "Problem writing chunk in apply whitening matrix";
-                }
                 num_timepoints_handled += qMin(chunk_size, N - timepoint);
                 if ((timer.elapsed() > 5000) || (num_timepoints_handled == N)) {
                     printf("%ld/%ld (%d%%)\n", num_timepoints_handled, N, (int)(num_timepoints_handled * 1.0 / N * 100));
@@ -368,7 +385,10 @@ bool p_apply_whitening_matrix(QString timeseries, QString whitening_matrix, QStr
             }
         }
     }
-    Y.close();
+    if (!Y.close()) {
+        qWarning() << "Problem closing output file" << timeseries_out;
+        return false;
+    }
 
     return true;
 }
@@ -387,12 +407,4 @@ Mda32 extract_channels_from_chunk(const Mda32& X, const QList<int>& channels)
     }
     return ret;
 }
-
-void scale_for_quantization(Mda32& X, double quantization_unit)
-{
-    bigint N = X.totalSize();
-    for (bigint i = 0; i < N; i++) {
-        X.set((int)((X.get(i) / quantization_unit) + 0.5), i);
-    }
-}
 }
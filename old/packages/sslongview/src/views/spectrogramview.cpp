@@ -19,6 +19,14 @@
 #include <qlabel.h>
 #include <taskprogress.h>
 #include <QFileDialog>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+
+#define SPECTROGRAM_PYRAMID_FACTOR 4
 
 class SpectrogramViewCalculator {
 public:
@@ -26,26 +34,49 @@ public:
     DiskReadMda32 timeseries;
     int time_resolution = 32;
     QString spectrogram_freq_range = "";
+    double samplerate = 0;
 
     //output
-    DiskReadMda spectrogram;
+    QString processor_name;
+    QMap<QString, QVariant> params; //including the paths of the outputs, which do not exist yet
+    QString spectrogram_path;
+    QString pyramid_path;
 
     void compute();
 };
 
+//runs the processor once the calculation of the view is done, so that the view shows the output while it is written
+class SpectrogramComputeThread : public QThread {
+public:
+    QString processor_name;
+    QMap<QString, QVariant> params;
+
+    void run();
+};
+
 class SpectrogramViewPrivate {
 public:
     SpectrogramView* q;
     DiskReadMda m_spectrogram;
+    DiskReadMda m_pyramid; //the coarser levels, see mountainsort.spectrogram
+    QList<bigint> m_pyramid_level_offsets;
+    bool m_output_open = false;
+    QList<bigint> m_num_bins_ready; //of each level, while the outputs are being written (empty when complete)
     int m_time_resolution = 0; //corresponding to this spectrogram
     double m_window_min = 0, m_window_max = 4;
     double m_brightness_level = 0;
     QString m_spectrogram_freq_range = "";
 
     SpectrogramViewCalculator m_calculator;
+    SpectrogramComputeThread m_compute_thread;
+    QTimer m_refresh_timer;
+    QString m_spectrogram_path, m_pyramid_path;
 
+    void stop_compute_thread();
+    void open_output(bool complete);
+    int choose_level(int t1, int t2, int num_pixels);
     QColor get_pixel_color(double val);
-    Mda get_spectrogram_data(int t1, int t2);
+    Mda get_spectrogram_data(int t1, int t2, int level = 0);
 
     static void parse_freq_range(int& ret_min, int& ret_max, QString str);
 };
@@ -97,12 +128,17 @@ SpectrogramView::SpectrogramView(MVAbstractContext* context)
     this->recalculateOnOptionChanged("spectrogram_freq_range");
     this->recalculateOn(context, SIGNAL(currentTimeseriesChanged()));
 
+    d->m_refresh_timer.setInterval(1000);
+    QObject::connect(&d->m_refresh_timer, SIGNAL(timeout()), this, SLOT(slot_refresh_output()));
+    QObject::connect(&d->m_compute_thread, SIGNAL(finished()), this, SLOT(slot_refresh_output()), Qt::QueuedConnection);
+
     this->recalculate();
 }
 
 SpectrogramView::~SpectrogramView()
 {
     this->stopCalculation();
+    d->stop_compute_thread();
     delete d;
 }
 
@@ -111,10 +147,13 @@ void SpectrogramView::prepareCalculation()
     MVEEGContext* c = qobject_cast<MVEEGContext*>(mvContext());
     Q_ASSERT(c);
 
+    d->stop_compute_thread();
+
     //d->m_layout_needed = true;
     d->m_calculator.timeseries = c->currentTimeseries();
     d->m_calculator.time_resolution = c->option("spectrogram_time_resolution").toInt();
     d->m_calculator.spectrogram_freq_range = c->option("spectrogram_freq_range").toString();
+    d->m_calculator.samplerate = c->sampleRate();
 
     MVTimeSeriesViewBase::prepareCalculation();
 }
@@ -131,10 +170,22 @@ void SpectrogramView::onCalculationFinished()
     MVEEGContext* c = qobject_cast<MVEEGContext*>(mvContext());
     Q_ASSERT(c);
 
-    d->m_spectrogram = d->m_calculator.spectrogram;
+    d->m_spectrogram = DiskReadMda();
+    d->m_pyramid = DiskReadMda();
+    d->m_output_open = false;
+    d->m_num_bins_ready.clear();
+    d->m_spectrogram_path = d->m_calculator.spectrogram_path;
+    d->m_pyramid_path = d->m_calculator.pyramid_path;
     d->m_time_resolution = d->m_calculator.time_resolution;
     d->m_spectrogram_freq_range = d->m_calculator.spectrogram_freq_range;
 
+    if (!d->m_spectrogram_path.isEmpty()) {
+        d->m_compute_thread.processor_name = d->m_calculator.processor_name;
+        d->m_compute_thread.params = d->m_calculator.params;
+        d->m_compute_thread.start();
+        d->m_refresh_timer.start();
+    }
+
     MVTimeSeriesViewBase::onCalculationFinished();
 }
 
@@ -150,7 +201,7 @@ void SpectrogramView::paintContent(QPainter* painter)
     Q_ASSERT(c);
 
     int time_resolution = d->m_time_resolution; //corresponding to the output spectrogram
-    if (!time_resolution)
+    if ((!time_resolution) || (!d->m_output_open))
         return;
 
     MVRange timerange = c->currentTimeRange();
@@ -160,7 +211,8 @@ void SpectrogramView::paintContent(QPainter* painter)
     if (t2 <= t1 + 2)
         return;
 
-    Mda data = d->get_spectrogram_data(t1, t2);
+    QRectF geom = this->contentGeometry();
+    Mda data = d->get_spectrogram_data(t1, t2, d->choose_level(t1, t2, geom.width()));
 
     QImage img = QImage(data.N2(), data.N1(), QImage::Format_RGB32);
     for (int n = 0; n < data.N2(); n++) {
@@ -171,7 +223,6 @@ void SpectrogramView::paintContent(QPainter* painter)
         }
     }
 
-    QRectF geom = this->contentGeometry();
     // TODO: fine adjustment on this based on t1,t2,timerange
     QImage img2 = img.scaled(geom.width(), geom.height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
     painter->drawImage(geom.topLeft(), img2);
@@ -231,6 +282,10 @@ void SpectrogramView::slot_export_csv()
         QMessageBox::warning(0, "Problem exporting", "Problem exporting. time_resolution = 0");
         return;
     }
+    if (d->m_compute_thread.isRunning()) {
+        QMessageBox::warning(0, "Problem exporting", "Problem exporting. The spectrogram is still being computed");
+        return;
+    }
 
     int t1 = 0;
     int t2 = d->m_spectrogram.N2() - 1;
@@ -266,23 +321,43 @@ void SpectrogramView::slot_export_csv()
     TextFile::write(fname, txt);
 }
 
-void SpectrogramViewCalculator::compute()
+void SpectrogramView::slot_refresh_output()
 {
+    bool complete = !d->m_compute_thread.isRunning();
+    if (complete)
+        d->m_refresh_timer.stop();
+    d->open_output(complete);
+    this->update();
+}
 
-    TaskProgress task(TaskProgress::Calculate, "eeg-spectrogram");
+void SpectrogramViewCalculator::compute()
+{
+    //only the inputs and the names of the outputs here -- SpectrogramComputeThread runs the processor
     MountainProcessRunner X;
-    QString processor_name = "eeg-spectrogram";
+    processor_name = "mountainsort.spectrogram";
     X.setProcessorName(processor_name);
 
-    QMap<QString, QVariant> params;
+    params.clear();
     params["timeseries"] = timeseries.makePath();
     params["time_resolution"] = time_resolution;
+    if (samplerate)
+        params["samplerate"] = samplerate;
+    params["pyramid_factor"] = SPECTROGRAM_PYRAMID_FACTOR;
     X.setInputParameters(params);
 
-    QString spectrogram_fname = X.makeOutputFilePath("spectrogram_out");
+    spectrogram_path = X.makeOutputFilePath("spectrogram_out");
+    params["spectrogram_out"] = spectrogram_path;
+    pyramid_path = X.makeOutputFilePath("pyramid_out");
+    params["pyramid_out"] = pyramid_path;
+}
 
-    X.runProcess();
-    spectrogram.setPath(spectrogram_fname);
+void SpectrogramComputeThread::run()
+{
+    TaskProgress task(TaskProgress::Calculate, "Spectrogram");
+    MountainProcessRunner X;
+    X.setProcessorName(processor_name);
+    X.setInputParameters(params);
+    X.runProcess(); //returns early when interruption is requested
 }
 
 SpectrogramDataFactory::SpectrogramDataFactory(MVMainWindow* mw, QObject* parent)
@@ -316,6 +391,70 @@ MVAbstractView* SpectrogramDataFactory::createView(MVAbstractContext* context)
     return X;
 }
 
+void SpectrogramViewPrivate::stop_compute_thread()
+{
+    m_refresh_timer.stop();
+    if (m_compute_thread.isRunning()) {
+        m_compute_thread.requestInterruption();
+        m_compute_thread.wait();
+    }
+}
+
+void SpectrogramViewPrivate::open_output(bool complete)
+{
+    //while the processor runs, its outputs are written to <path>.tmp, which is renamed at the end. Only the bins
+    //listed in <spectrogram_path>.progress are on disk -- until it exists, not even the header
+    if (!complete) {
+        QJsonObject progress = QJsonDocument::fromJson(TextFile::read(m_spectrogram_path + ".progress").toUtf8()).object();
+        QJsonArray num_bins = progress["num_bins"].toArray();
+        if (num_bins.isEmpty())
+            return;
+        m_num_bins_ready.clear();
+        for (int i = 0; i < num_bins.count(); i++)
+            m_num_bins_ready << (bigint)num_bins[i].toDouble();
+        if (m_output_open)
+            return; //the open files are being filled in
+    }
+    else {
+        m_num_bins_ready.clear();
+    }
+    QString suffix = (complete) ? "" : ".tmp";
+    if ((!QFile::exists(m_spectrogram_path + suffix)) || (!QFile::exists(m_pyramid_path + suffix))) {
+        if (complete)
+            qWarning() << "Spectrogram was not computed" << m_spectrogram_path;
+        m_output_open = false;
+        return;
+    }
+    m_spectrogram.setPath(m_spectrogram_path + suffix);
+    m_pyramid.setPath(m_pyramid_path + suffix);
+
+    //levels 1,2,... of the pyramid, each decimated by SPECTROGRAM_PYRAMID_FACTOR from the previous
+    m_pyramid_level_offsets.clear();
+    bigint size = m_spectrogram.N2();
+    bigint offset = 0;
+    while ((size > 1) && (offset < m_pyramid.N2())) {
+        size = (size + SPECTROGRAM_PYRAMID_FACTOR - 1) / SPECTROGRAM_PYRAMID_FACTOR;
+        m_pyramid_level_offsets << offset;
+        offset += size;
+    }
+    m_output_open = (m_spectrogram.N1() > 0);
+}
+
+int SpectrogramViewPrivate::choose_level(int t1, int t2, int num_pixels)
+{
+    //the coarsest that still has a bin per pixel
+    int level = 0;
+    bigint num_bins = t2 - t1 + 1;
+    while ((level < m_pyramid_level_offsets.count()) && (num_bins / SPECTROGRAM_PYRAMID_FACTOR >= num_pixels)) {
+        if ((!m_num_bins_ready.isEmpty()) && (m_num_bins_ready.value(level + 1) == 0))
+            break; //not made yet
+
+        num_bins /= SPECTROGRAM_PYRAMID_FACTOR;
+        level++;
+    }
+    return level;
+}
+
 QColor SpectrogramViewPrivate::get_pixel_color(double val)
 {
     double pct = (val - m_window_min) / (m_window_max - m_window_min);
@@ -326,33 +465,51 @@ QColor SpectrogramViewPrivate::get_pixel_color(double val)
     return gray;
 }
 
-Mda SpectrogramViewPrivate::get_spectrogram_data(int t1, int t2)
+Mda SpectrogramViewPrivate::get_spectrogram_data(int t1, int t2, int level)
 {
-    MVEEGContext* c = qobject_cast<MVEEGContext*>(q->mvContext());
-    Q_ASSERT(c);
+    //bins t1..t2 of the spectrogram, or the bins of a coarser level of the pyramid covering them
+    DiskReadMda* S = &m_spectrogram;
+    bigint offset = 0;
+    bigint size = m_spectrogram.N2();
+    for (int l = 1; l <= level; l++) {
+        t1 /= SPECTROGRAM_PYRAMID_FACTOR;
+        t2 /= SPECTROGRAM_PYRAMID_FACTOR;
+        size = (size + SPECTROGRAM_PYRAMID_FACTOR - 1) / SPECTROGRAM_PYRAMID_FACTOR;
+    }
+    if (level > 0) {
+        S = &m_pyramid;
+        offset = m_pyramid_level_offsets.value(level - 1);
+    }
 
-    int M = m_spectrogram.N1();
+    int M = S->N1();
     int N2 = t2 - t1 + 1;
-    int K = m_spectrogram.N3();
 
     int ifreq_min, ifreq_max;
     SpectrogramViewPrivate::parse_freq_range(ifreq_min, ifreq_max, m_spectrogram_freq_range);
 
+    //only the part of the range that has data -- the rest stays zero
+    bigint j1 = qMax((bigint)t1, (bigint)0);
+    bigint j2 = qMin((bigint)t2, size - 1);
+    if (!m_num_bins_ready.isEmpty())
+        j2 = qMin(j2, m_num_bins_ready.value(level) - 1); //the rest is not written yet
+    Mda ret(M, N2);
+    if (j2 < j1)
+        return ret;
     Mda X;
-    if (!m_spectrogram.readChunk(X, 0, 0, ifreq_min, m_spectrogram.N1(), m_spectrogram.N2(), ifreq_max - ifreq_min + 1)) {
+    if (!S->readChunk(X, 0, offset + j1, ifreq_min, M, j2 - j1 + 1, ifreq_max - ifreq_min + 1)) {
         qWarning() << "Problem reading chunk in spectrogram view";
+        return ret;
     }
 
-    Mda ret(M, N2);
-    for (int n = 0; n < N2; n++) {
+    for (bigint j = j1; j <= j2; j++) {
         for (int m = 0; m < M; m++) {
             double val = 0;
             for (int ii = ifreq_min; ii <= ifreq_max; ii++) {
-                double val2 = X.value(m, t1 + n, ii - ifreq_min);
+                double val2 = X.value(m, j - j1, ii - ifreq_min);
                 if (val2 > val)
                     val = val2;
             }
-            ret.setValue(val, m, n);
+            ret.setValue(val, m, j - t1);
         }
     }
 
@@ -31,6 +31,7 @@ bool PrvDownload::initiateDownloadFromServer(QString server_name, PrvRecord prv)
     downloader->destination_file_name = CacheManager::globalInstance()->makeLocalFile(prv.checksum + ".download_from_server");
     downloader->source_url = remote_url;
     downloader->size = prv.size;
+    downloader->checksum = prv.checksum;
     downloader->num_threads = 5;
     downloader->start();
 
@@ -7,4 +7,7 @@ SUBDIRS =    mda mlcompute taskprogress \
 	     componentmanager \
     counters \
     processmanager \
-    signalhandler
+    signalhandler \
+    mlnetwork \
+    linearclassifier \
+    prvlocationindex
@@ -15,6 +15,7 @@ CONFIG   -= app_bundle
 TEMPLATE = app
 
 include(../../../mlcommon/mlcommon.pri)
+include(../../../mlcommon/mda.pri)
 include(../../../mvcommon/mvcommon.pri)
 
 
@@ -2,6 +2,10 @@
 #include <QtTest>
 #include "icounter.h"
 #include "jscounter.h"
+#include "objectregistry.h"
+#include "processorprofile.h"
+#include "mdaallocator.h"
+#include <QJsonArray>
 
 class CountersTest : public QObject {
     Q_OBJECT
@@ -18,6 +22,7 @@ private Q_SLOTS:
     void testAggregateCounter();
     void testJSCounter_expression();
     void testJSCounter_function();
+    void testProcessorProfile();
 };
 
 CountersTest::CountersTest()
@@ -49,21 +54,24 @@ void CountersTest::testManager()
 
 void CountersTest::testIntCounter()
 {
-    // int uses QAtomicInteger internally
+    // qint64 uses QAtomicInteger internally
     IIntCounter counter("IntCounter");
     QCOMPARE(counter.name(), QStringLiteral("IntCounter"));
     QSignalSpy spy(&counter, SIGNAL(valueChanged()));
-    QCOMPARE(counter.value(), 0);
-    QCOMPARE(counter.genericValue(), QVariant(0));
+    QCOMPARE(counter.value(), (qint64)0);
+    QCOMPARE(counter.genericValue(), QVariant((qlonglong)0));
     QCOMPARE(counter.label(), QVariant("0").toString());
     counter.add(42);
-    QCOMPARE(counter.value(), 42);
+    QCOMPARE(counter.value(), (qint64)42);
     QVERIFY2(spy.size() == 1, "valueChanged() not emiited after add");
     counter.add(0);
-    QCOMPARE(counter.value(), 42);
+    QCOMPARE(counter.value(), (qint64)42);
     QVERIFY2(spy.size() == 1, "valueChanged() emitted but the value didn't change");
-    QCOMPARE(counter.genericValue(), QVariant(42));
+    QCOMPARE(counter.genericValue(), QVariant((qlonglong)42));
     QCOMPARE(counter.label(), QStringLiteral("42"));
+    // byte counts beyond 32 bits
+    counter.add(5LL * 1024 * 1024 * 1024);
+    QCOMPARE(counter.value(), (qint64)(5LL * 1024 * 1024 * 1024 + 42));
 }
 
 void CountersTest::testDoubleCounter()
@@ -112,15 +120,15 @@ void CountersTest::testCustomCounter()
     QCOMPARE(counter.label(), QStringLiteral("0 bytes"));
     counter.add(100);
     QCOMPARE(counter.label(), QStringLiteral("100 bytes"));
-    QCOMPARE(counter.add(924), 1024);
+    QCOMPARE(counter.add(924), (qint64)1024);
     QCOMPARE(counter.label(), QStringLiteral("1 kB"));
-    QCOMPARE(counter.add(512), 1536);
+    QCOMPARE(counter.add(512), (qint64)1536);
     QCOMPARE(counter.label(), QStringLiteral("1.5 kB"));
-    QCOMPARE(counter.add(-512), 1024);
+    QCOMPARE(counter.add(-512), (qint64)1024);
     QCOMPARE(counter.label(), QStringLiteral("1 kB"));
-    QCOMPARE(counter.add(1023 * 1024), 1024 * 1024);
+    QCOMPARE(counter.add(1023 * 1024), (qint64)(1024 * 1024));
     QCOMPARE(counter.label(), QStringLiteral("1 MB"));
-    QCOMPARE(counter.add(512 * 1024), 1536 * 1024);
+    QCOMPARE(counter.add(512 * 1024), (qint64)(1536 * 1024));
     QCOMPARE(counter.label(), QStringLiteral("1.5 MB"));
 }
 
@@ -186,6 +194,61 @@ void CountersTest::testJSCounter_function()
     QVERIFY(exprCounter.value<int>() == 100);
 }
 
+void CountersTest::testProcessorProfile()
+{
+    ObjectRegistry registry;
+    CounterManager manager;
+    IIntCounter allocated("allocated_bytes");
+    IIntCounter freed("freed_bytes");
+    IIntCounter bytes_read("bytes_read");
+    IIntCounter bytes_written("bytes_written");
+    manager.setCounters({ &allocated, &freed, &bytes_read, &bytes_written });
+    ObjectRegistry::addObject(&manager);
+
+    ProcessorProfile profile;
+    profile.setNumThreads(2);
+    profile.start("test.processor");
+    profile.startPhase("read");
+    bytes_read.add(1000);
+    allocated.add(500);
+    freed.add(500);
+    allocated.add(300);
+    profile.endPhase("read");
+    profile.startPhase("write");
+    bytes_written.add(2000);
+    profile.endPhase("write");
+    profile.addLockWait("lock1", 0.5);
+    profile.addLockWait("lock1", 0.25);
+    ObjectRegistry::removeObject(&manager);
+
+    // the peak is taken from the allocator (after the manager is removed, so that the allocator does
+    // not take up its counters); blocks above MDA_POOL_MAX_BYTES go straight to the system
+    void* ptr1 = MdaAllocator::allocate(MDA_POOL_MAX_BYTES + 500);
+    MdaAllocator::release(ptr1, MDA_POOL_MAX_BYTES + 500);
+    void* ptr2 = MdaAllocator::allocate(MDA_POOL_MAX_BYTES + 300);
+    MdaAllocator::release(ptr2, MDA_POOL_MAX_BYTES + 300);
+
+    QJsonObject obj = profile.toJsonObject();
+    QCOMPARE(obj["processor_name"].toString(), QString("test.processor"));
+    QCOMPARE(obj["bytes_read"].toDouble(), 1000.0);
+    QCOMPARE(obj["bytes_written"].toDouble(), 2000.0);
+    QCOMPARE(obj["peak_allocated_bytes"].toDouble(), (double)(MDA_POOL_MAX_BYTES + 500));
+    QCOMPARE(obj["lock_wait_sec"].toDouble(), 0.75);
+    QJsonArray phases = obj["phases"].toArray();
+    QCOMPARE(phases.count(), 2);
+    QCOMPARE(phases[0].toObject()["name"].toString(), QString("read"));
+    QCOMPARE(phases[0].toObject()["bytes_read"].toDouble(), 1000.0);
+    QCOMPARE(phases[0].toObject()["bytes_allocated"].toDouble(), 800.0);
+    QCOMPARE(phases[1].toObject()["bytes_written"].toDouble(), 2000.0);
+
+    QJsonObject agg = ProcessorProfile::aggregate({ obj, obj });
+    QJsonObject X = agg["processors"].toObject()["test.processor"].toObject();
+    QCOMPARE(X["count"].toDouble(), 2.0);
+    QCOMPARE(X["bytes_read"].toDouble(), 2000.0);
+    QCOMPARE(X["phases"].toObject()["write"].toObject()["bytes_written"].toDouble(), 4000.0);
+    QCOMPARE(agg["total"].toObject()["lock_wait_sec"].toDouble(), 1.5);
+}
+
 QTEST_MAIN(CountersTest)
 
 #include "tst_counterstest.moc"
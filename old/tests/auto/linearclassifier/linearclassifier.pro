@@ -0,0 +1,19 @@
+QT       += testlib
+
+QT       -= gui
+
+TARGET = tst_linearclassifiertest
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../../../mlcommon/mlcommon.pri)
+include(../../../mlcommon/mda.pri)
+
+INCLUDEPATH += ../../../mountainsort/src/utils
+HEADERS += ../../../mountainsort/src/utils/linearclassifier.h
+SOURCES += ../../../mountainsort/src/utils/linearclassifier.cpp
+
+SOURCES += tst_linearclassifiertest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
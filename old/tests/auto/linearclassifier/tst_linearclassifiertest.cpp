@@ -0,0 +1,104 @@
+#include <QString>
+#include <QtTest>
+#include "mda32.h"
+#include "linearclassifier.h"
+
+class LinearClassifierTest : public QObject {
+    Q_OBJECT
+
+public:
+    LinearClassifierTest();
+
+private Q_SLOTS:
+    void separable();
+    void separable_data();
+    void needs_both_sides();
+
+private:
+    // L points of dimension D near (offset,...,offset), shifted by shift along dimension 1
+    Mda32 make_points(bigint D, bigint L, double offset, double shift, quint32 seed);
+    // dot(direction,x)-cutoff for each column of X
+    QVector<double> decision_values(const Mda32& X, const QVector<double>& direction, double cutoff);
+};
+
+LinearClassifierTest::LinearClassifierTest()
+{
+}
+
+Mda32 LinearClassifierTest::make_points(bigint D, bigint L, double offset, double shift, quint32 seed)
+{
+    Mda32 X(D, L);
+    for (bigint i = 0; i < L; i++) {
+        for (bigint d = 0; d < D; d++) {
+            seed = seed * 1664525 + 1013904223;
+            double noise = ((seed >> 8) & 0xffff) / 65536.0 - 0.5;
+            X.set(offset + noise + (d == 1 ? shift : 0), d, i);
+        }
+    }
+    return X;
+}
+
+QVector<double> LinearClassifierTest::decision_values(const Mda32& X, const QVector<double>& direction, double cutoff)
+{
+    QVector<double> ret(X.N2());
+    for (bigint i = 0; i < X.N2(); i++) {
+        double val = -cutoff;
+        for (bigint d = 0; d < X.N1(); d++)
+            val += direction[d] * X.value(d, i);
+        ret[i] = val;
+    }
+    return ret;
+}
+
+void LinearClassifierTest::separable()
+{
+    QFETCH(int, D);
+    QFETCH(double, offset);
+    Mda32 X1 = make_points(D, 200, offset, 1.5, 1);
+    Mda32 X2 = make_points(D, 300, offset, -1.5, 2);
+
+    double cutoff;
+    QVector<double> direction;
+    QVERIFY(LinearClassifier::train(cutoff, direction, X1, X2));
+    QCOMPARE(direction.count(), D);
+    // positive on the side of the first set
+    QVERIFY(direction[1] > 0);
+    foreach (double val, decision_values(X1, direction, cutoff)) {
+        QVERIFY(val > 0);
+    }
+    foreach (double val, decision_values(X2, direction, cutoff)) {
+        QVERIFY(val < 0);
+    }
+
+    // swapping the sets flips the sign
+    QVERIFY(LinearClassifier::train(cutoff, direction, X2, X1));
+    QVERIFY(direction[1] < 0);
+    foreach (double val, decision_values(X1, direction, cutoff)) {
+        QVERIFY(val < 0);
+    }
+}
+
+void LinearClassifierTest::separable_data()
+{
+    QTest::addColumn<int>("D");
+    QTest::addColumn<double>("offset");
+    QTest::newRow("centered") << 5 << 0.0;
+    // a large common offset, as clips of neighboring clusters have
+    QTest::newRow("offset") << 5 << 100.0;
+    // where a float sum of the uncentered points would have lost the direction
+    QTest::newRow("offset 1e4") << 5 << 10000.0;
+    QTest::newRow("dimension 50") << 50 << 10.0;
+}
+
+void LinearClassifierTest::needs_both_sides()
+{
+    Mda32 X1 = make_points(3, 10, 0, 1, 1);
+    double cutoff;
+    QVector<double> direction;
+    QVERIFY(!LinearClassifier::train(cutoff, direction, 3, LinearClassifier::columns(X1.constDataPtr(), 3, 10), QVector<const float*>()));
+    QVERIFY(!LinearClassifier::train(cutoff, direction, X1, make_points(4, 10, 0, -1, 2))); // different sizes
+}
+
+QTEST_APPLESS_MAIN(LinearClassifierTest)
+
+#include "tst_linearclassifiertest.moc"
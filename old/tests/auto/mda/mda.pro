@@ -12,4 +12,8 @@ include(../../../mlcommon/mlcommon.pri)
 include(../../../mvcommon/mvcommon.pri)
 
 SOURCES += tst_mdatest.cpp
+
+# a processor that copies timeseries, to check that it keeps the scale of its input
+INCLUDEPATH += ../../../packages/mountainsort2/src
+SOURCES += ../../../packages/mountainsort2/src/p_extract_segment_timeseries.cpp
 DEFINES += SRCDIR=\\\"$$PWD/\\\"
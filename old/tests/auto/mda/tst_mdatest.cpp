@@ -1,7 +1,17 @@
 #include <QString>
 #include <QtTest>
+#include <QFileInfo>
 #include "mda/mda.h"
+#include "mda/mda32.h"
+#include "mda/asyncdiskwritemda.h"
+#include "mda/diskwritemda.h"
+#include "mda/mdatranspose.h"
+#include "mda/diskreadmda32.h"
+#include "mda/sharedmemorymda.h"
+#include "mda/templatesimilarity.h"
+#include "mda/mdaallocator.h"
 #include <objectregistry.h>
+#include "p_extract_segment_timeseries.h"
 
 using VD = QVector<double>;
 
@@ -19,6 +29,15 @@ private Q_SLOTS:
     void get1();
     void get1_data();
     void invalid_readfile();
+    void async_write_out_of_order();
+    void transpose_file_in_tiles();
+    void read_chunk_3d_range();
+    void shared_memory_handoff();
+    void template_similarity();
+    void pooled_move_and_view();
+    void scaled_int16_round_trip();
+    void scaled_int16_extract_segment();
+    void scaled_int16_read_and_transpose();
 
 private:
     ObjectRegistry m_registry; // prevent warnings about missing registry
@@ -223,6 +242,407 @@ void MdaTest::invalid_readfile()
     QCOMPARE(mda.N2(), bigint(1));
 }
 
+void MdaTest::async_write_out_of_order()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/async.mda";
+    bigint M = 3, N = 100, chunk_size = 7;
+
+    AsyncDiskWriteMda Y;
+    Y.setMaxQueuedBytes(4 * M * chunk_size * 2); // force the queue to fill up
+    QVERIFY(Y.open(MDAIO_TYPE_INT16, path, M, N));
+    // write the chunks in reverse order
+    for (bigint t = ((N - 1) / chunk_size) * chunk_size; t >= 0; t -= chunk_size) {
+        Mda32 chunk(M, chunk_size);
+        for (bigint i = 0; i < chunk_size; i++) {
+            for (bigint m = 0; m < M; m++) {
+                chunk.set(m + M * (t + i), m, i);
+            }
+        }
+        QVERIFY(Y.writeChunk(chunk, 0, t));
+    }
+    // readable from <path>.tmp before it is closed, once flushed
+    QVERIFY(Y.flush());
+    {
+        Mda32 X0(path + ".tmp");
+        QCOMPARE(X0.N2(), N);
+        QCOMPARE(X0.get(M * N - 1), (float)(M * N - 1));
+    }
+    QVERIFY(Y.close());
+
+    Mda32 X(path);
+    QCOMPARE(X.N1(), M);
+    QCOMPARE(X.N2(), N);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        QCOMPARE(X.get(i), (float)i);
+    }
+}
+
+void MdaTest::transpose_file_in_tiles()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path_in = dir.path() + "/in.mda";
+    QString path_out = dir.path() + "/out.mda";
+    bigint N1 = 37, N2 = 53;
+
+    Mda32 X(N1, N2);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        X.set(i, i);
+    }
+    QVERIFY(X.write32(path_in));
+    QVERIFY(mda_transpose_file(path_in, path_out, 100)); // a tiny memory budget forces many partial tiles
+
+    Mda32 Y(path_out);
+    QCOMPARE(Y.N1(), N2);
+    QCOMPARE(Y.N2(), N1);
+    for (bigint i = 0; i < N1; i++) {
+        for (bigint j = 0; j < N2; j++) {
+            QCOMPARE(Y.value(j, i), X.value(i, j));
+        }
+    }
+}
+
+void MdaTest::read_chunk_3d_range()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/in.mda";
+    bigint N1 = 3, N2 = 50, N3 = 6;
+
+    Mda32 X(N1, N2, N3);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        X.set(i, i);
+    }
+    QVERIFY(X.write32(path));
+
+    // part of the second dimension, running past its end
+    DiskReadMda32 A(path);
+    Mda32 Y;
+    QVERIFY(A.readChunk(Y, 0, 40, 2, N1, 20, 3));
+    QCOMPARE(Y.N2(), (bigint)20);
+    for (bigint k = 0; k < 3; k++) {
+        for (bigint j = 0; j < 20; j++) {
+            for (bigint i = 0; i < N1; i++) {
+                QCOMPARE(Y.value(i, j, k), X.value(i, 40 + j, 2 + k));
+            }
+        }
+    }
+}
+
+void MdaTest::shared_memory_handoff()
+{
+    if (!SharedMemoryMda::isEnabled())
+        QSKIP("No shared memory on this platform");
+    bigint N1 = 7, N2 = 1000;
+    Mda32 X(N1, N2);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        X.set(i * 0.5, i);
+    }
+
+    QString path = DiskReadMda32(X).makePath();
+    QVERIFY(SharedMemoryMda::isSharedMemoryPath(path));
+    QVERIFY(SharedMemoryMda::publishedPaths().contains(path));
+    QCOMPARE(DiskReadMda32(X).makePath(), path); // same checksum, same object
+
+    QCOMPARE(QFileInfo(path).permissions() & (QFile::ReadOther | QFile::ReadGroup), QFile::Permissions(0));
+    {
+        DiskReadMda32 A(path); // mapped
+        QCOMPARE(A.N1(), N1);
+        QCOMPARE(A.N2(), N2);
+        Mda32 Y;
+        QVERIFY(A.readChunk(Y, 0, 10, N1, 20));
+        for (bigint j = 0; j < 20; j++) {
+            for (bigint i = 0; i < N1; i++) {
+                QCOMPARE(Y.value(i, j), X.value(i, j + 10));
+            }
+        }
+        Mda32 Z(path); // and still an ordinary .mda file for everyone else
+        QCOMPARE(Z.totalSize(), X.totalSize());
+        QCOMPARE(Z.value(N1 - 1, N2 - 1), X.value(N1 - 1, N2 - 1));
+
+        SharedMemoryMdaMapping mapping; // the data is aligned for the vector kernels
+        QVERIFY(mapping.open(path));
+        QCOMPARE((quintptr)mapping.data() % 64, (quintptr)0);
+        QVERIFY(SharedMemoryMda::release(path));
+        QVERIFY(QFile::exists(path)); // still mapped
+    }
+    QVERIFY(!QFile::exists(path)); // the last consumer removed it
+    QCOMPARE(SharedMemoryMda::publishedBytes(), (bigint)0);
+
+    // with a budget for two arrays, publishing a third one releases the least recently used
+    bigint num_bytes = 64 + sizeof(float) * X.totalSize();
+    SharedMemoryMda::setMaxPublishedBytes(2 * num_bytes);
+    QString path1 = SharedMemoryMda::publish(X, "budget1.mda");
+    QString path2 = SharedMemoryMda::publish(X, "budget2.mda");
+    QCOMPARE(SharedMemoryMda::publish(X, "budget1.mda"), path1); // reused, so now the most recent
+    QString path3 = SharedMemoryMda::publish(X, "budget3.mda");
+    QVERIFY(QFile::exists(path1));
+    QVERIFY(!QFile::exists(path2));
+    QVERIFY(QFile::exists(path3));
+    QCOMPARE(SharedMemoryMda::publishedBytes(), 2 * num_bytes);
+    SharedMemoryMda::releaseAll();
+
+    // but a pinned array stays until its consumer is done with it
+    QString pinned1 = SharedMemoryMda::publish(X, "pinned1.mda", true);
+    QString pinned2 = SharedMemoryMda::publish(X, "pinned2.mda", true);
+    QVERIFY(SharedMemoryMda::publish(X, "pinned3.mda").isEmpty());
+    QVERIFY(SharedMemoryMda::unpin(pinned1));
+    QString pinned3 = SharedMemoryMda::publish(X, "pinned3.mda");
+    QVERIFY(!pinned3.isEmpty());
+    QVERIFY(!QFile::exists(pinned1));
+    QVERIFY(QFile::exists(pinned2));
+    SharedMemoryMda::releaseAll();
+    SharedMemoryMda::setMaxPublishedBytes(1024 * 1024 * 1024);
+
+    // an object that nobody holds (left behind by a process that crashed) is swept
+    QString stale_path = QFileInfo(path1).absolutePath() + "/" + QFileInfo(path1).fileName().replace("budget1", "stale");
+    {
+        QFile f(stale_path);
+        QVERIFY(f.open(QFile::WriteOnly));
+    }
+    SharedMemoryMda::sweepStaleObjects();
+    QVERIFY(!QFile::exists(stale_path));
+}
+
+void MdaTest::template_similarity()
+{
+    bigint M = 3, T = 11, K = 70; // more than one tile of templates
+    int max_shift = 4;
+    Mda32 X(M, T, K);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        X.set(sin(i * 0.37) + cos(i * 0.011), i);
+    }
+    Mda dists = TemplateSimilarity::distances(X);
+    Mda corrs = TemplateSimilarity::correlations(X);
+    Mda best_shifts;
+    Mda best_ips = TemplateSimilarity::bestLagInnerProducts(best_shifts, X, max_shift);
+    for (bigint k1 = 0; k1 < K; k1 += 3) {
+        for (bigint k2 = 0; k2 < K; k2++) {
+            const float* ptr1 = X.constDataPtr() + M * T * k1;
+            const float* ptr2 = X.constDataPtr() + M * T * k2;
+            double sumsqr = 0;
+            for (bigint i = 0; i < M * T; i++)
+                sumsqr += (ptr1[i] - ptr2[i]) * (ptr1[i] - ptr2[i]);
+            QVERIFY(qAbs(dists.value(k1, k2) - sqrt(sumsqr)) < 1e-3);
+            QVERIFY(qAbs(corrs.value(k1, k2) - MLCompute::correlation(M * T, ptr1, ptr2)) < 1e-3);
+            double best_ip = 0;
+            int best_shift = 0;
+            for (int s = -max_shift; s <= max_shift; s++) {
+                double ip = 0;
+                for (bigint t = qMax(0, s); t < qMin(T, T + s); t++) {
+                    for (bigint m = 0; m < M; m++)
+                        ip += X.value(m, t, k1) * X.value(m, t - s, k2);
+                }
+                if ((s == -max_shift) || (ip > best_ip)) {
+                    best_ip = ip;
+                    best_shift = s;
+                }
+            }
+            QVERIFY(qAbs(best_ips.value(k1, k2) - best_ip) < 1e-3);
+            QCOMPARE((int)best_shifts.value(k1, k2), best_shift);
+        }
+    }
+    QList<QVector<int> > neighbors = TemplateSimilarity::nearestNeighbors(dists, 5);
+    QCOMPARE(neighbors.count(), (int)K);
+    QCOMPARE(neighbors[0].count(), 5);
+    for (int a = 0; a + 1 < 5; a++) {
+        QVERIFY(dists.value(0, neighbors[0][a]) <= dists.value(0, neighbors[0][a + 1]));
+    }
+}
+
+void MdaTest::pooled_move_and_view()
+{
+    bigint N1 = 5, N2 = 300;
+    const float* released_ptr = 0;
+    {
+        Mda32 X(N1, N2);
+        QCOMPARE((quintptr)X.constDataPtr() % MDA_ALIGNMENT, (quintptr)0);
+        released_ptr = X.constDataPtr();
+    }
+    // the block of the same size class comes back from the free list of this thread, zeroed
+    Mda32 X(N1, N2 + 1);
+    QCOMPARE(X.constDataPtr(), released_ptr);
+    QCOMPARE(X.value(N1 - 1, N2), 0.0f);
+    for (bigint i = 0; i < X.totalSize(); i++) {
+        X.set(i, i);
+    }
+
+    const float* ptr = X.constDataPtr();
+    Mda32 Y(std::move(X));
+    QCOMPARE(Y.constDataPtr(), ptr);
+    QCOMPARE(X.N1(), (bigint)1);
+    QCOMPARE(X.N2(), (bigint)1);
+    Mda32 Z;
+    Z = std::move(Y);
+    QCOMPARE(Z.constDataPtr(), ptr);
+    QCOMPARE(Y.totalSize(), (bigint)1);
+
+    Mda32View V = Z.columnsView(10, 20);
+    QCOMPARE(V.N1(), N1);
+    QCOMPARE(V.N2(), (bigint)20);
+    QCOMPARE(V.constDataPtr(), ptr + N1 * 10);
+    QCOMPARE(V.get(2, 3), Z.value(2, 13));
+
+    // trimming returns the free lists to the system
+    {
+        Mda32 W(N1, N2);
+    }
+    bigint cached_bytes = MdaAllocator::cachedBytes();
+    QVERIFY(cached_bytes >= (bigint)sizeof(float) * N1 * N2);
+    MdaAllocator::trimAll();
+    QVERIFY(MdaAllocator::cachedBytes() <= cached_bytes - (bigint)sizeof(float) * N1 * N2);
+}
+
+void MdaTest::scaled_int16_round_trip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/scaled.mda";
+    bigint M = 4, N = 50;
+    double scale = 0.25;
+
+    Mda32 chunk(M, N);
+    for (bigint i = 0; i < chunk.totalSize(); i++) {
+        chunk.set((i - 100) * 0.3, i);
+    }
+    chunk.set(1e6, 0); // saturates
+    AsyncDiskWriteMda Y;
+    Y.setScale(scale);
+    QVERIFY(Y.open(MDAIO_TYPE_INT16, path, M, N));
+    QVERIFY(Y.writeChunk(chunk, 0, 0));
+    QVERIFY(Y.close());
+    QCOMPARE(mda_read_scale(path), scale);
+    // the scale is in the header, after the dimensions
+    QCOMPARE(QFileInfo(path).size(), (qint64)(3 * 4 + 2 * 4 + 8 + M * N * 2));
+
+    DiskReadMda32 X(path);
+    QCOMPARE(X.mdaioHeader().data_type, MDAIO_TYPE_INT16);
+    QCOMPARE(X.scale(), scale);
+    Mda32 chunk2;
+    QVERIFY(X.readChunk(chunk2, 0, 10, M, N - 10));
+    for (bigint t = 10; t < N; t++) {
+        for (bigint m = 0; m < M; m++) {
+            // rounded to the nearest multiple of the scale
+            QVERIFY(qAbs(chunk2.value(m, t - 10) - chunk.value(m, t)) <= scale / 2 + 1e-5);
+        }
+    }
+    QCOMPARE(X.value(0), (float)(32767 * scale));
+
+    // writing the file again without a scale gives a plain int16 header
+    AsyncDiskWriteMda Y2;
+    QVERIFY(Y2.open(MDAIO_TYPE_INT16, path, M, N));
+    QVERIFY(Y2.close());
+    QCOMPARE(mda_read_scale(path), 1.0);
+    QCOMPARE(QFileInfo(path).size(), (qint64)(3 * 4 + 2 * 4 + M * N * 2));
+
+    // the scale can also be set after open(), before any data; float64 rounds (ties to even) and saturates like float32
+    Mda chunk64(M, N);
+    chunk64.setValue(0.3, 0);
+    chunk64.setValue(-0.375, 1);
+    chunk64.setValue(1e6, 2);
+    chunk64.setValue(-1e6, 3);
+    DiskWriteMda Y3(MDAIO_TYPE_INT16, path, M, N);
+    QVERIFY(Y3.setScale(scale));
+    QVERIFY(Y3.writeChunk(chunk64, 0, 0));
+    QVERIFY(!Y3.setScale(1));
+    Y3.close();
+    Mda X3(path);
+    QCOMPARE(X3.value(0), 0.25);
+    QCOMPARE(X3.value(1), -0.5);
+    QCOMPARE(X3.value(2), 32767 * scale);
+    QCOMPARE(X3.value(3), -32768 * scale);
+    QCOMPARE(X3.value(4), 0.0);
+}
+
+void MdaTest::scaled_int16_extract_segment()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    bigint M = 3, N = 60;
+    QStringList paths;
+    QList<double> scales = QList<double>() << 0.01 << 0.02;
+    for (int ii = 0; ii < scales.count(); ii++) {
+        QString path = dir.path() + QString("/scaled%1.mda").arg(ii);
+        Mda32 chunk(M, N);
+        for (bigint i = 0; i < chunk.totalSize(); i++) {
+            chunk.set(((i * 7) % 37) * 0.013 - 0.2, i);
+        }
+        AsyncDiskWriteMda Y;
+        Y.setScale(scales[ii]);
+        QVERIFY(Y.open(MDAIO_TYPE_INT16, path, M, N));
+        QVERIFY(Y.writeChunk(chunk, 0, 0));
+        QVERIFY(Y.close());
+        paths << path;
+    }
+
+    // the extracted segment keeps the type and the scale, so it reads back as the same values
+    QString out = dir.path() + "/segment.mda";
+    QVERIFY(p_extract_segment_timeseries(paths[0], out, 5, 44, QList<int>()));
+    QCOMPARE(mda_read_scale(out), scales[0]);
+    DiskReadMda32 X0(paths[0]), X(out);
+    QCOMPARE(X.mdaioHeader().data_type, MDAIO_TYPE_INT16);
+    Mda32 expected, chunk;
+    QVERIFY(X0.readChunk(expected, 0, 5, M, 40));
+    QVERIFY(X.readChunk(chunk, 0, 0, M, 40));
+    for (bigint i = 0; i < chunk.totalSize(); i++) {
+        QCOMPARE(chunk.value(i), expected.value(i));
+    }
+
+    // across two files with different scales the segment has to be written as float32
+    QString out2 = dir.path() + "/segment2.mda";
+    QVERIFY(p_extract_segment_timeseries_from_concat_list(paths, out2, N - 10, N + 9, QList<int>()));
+    DiskReadMda32 Xc(2, paths), X2(out2);
+    QCOMPARE(Xc.mdaioHeader().data_type, MDAIO_TYPE_FLOAT32);
+    QCOMPARE(X2.mdaioHeader().data_type, MDAIO_TYPE_FLOAT32);
+    QCOMPARE(X2.scale(), 1.0);
+    QVERIFY(Xc.readChunk(expected, 0, N - 10, M, 20));
+    QVERIFY(X2.readChunk(chunk, 0, 0, M, 20));
+    for (bigint i = 0; i < chunk.totalSize(); i++) {
+        QCOMPARE(chunk.value(i), expected.value(i));
+    }
+}
+
+void MdaTest::scaled_int16_read_and_transpose()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/scaled.mda";
+    bigint M = 3, N = 20;
+    double scale = 0.01;
+    Mda32 chunk(M, N);
+    for (bigint i = 0; i < chunk.totalSize(); i++) {
+        chunk.set(i * 0.37 - 2, i);
+    }
+    AsyncDiskWriteMda Y;
+    Y.setScale(scale);
+    QVERIFY(Y.open(MDAIO_TYPE_INT16, path, M, N));
+    QVERIFY(Y.writeChunk(chunk, 0, 0));
+    QVERIFY(Y.close());
+
+    // reading the whole array applies the scale, as DiskReadMda32 does
+    DiskReadMda32 X(path);
+    Mda32 A(path);
+    Mda B(path);
+    for (bigint i = 0; i < chunk.totalSize(); i++) {
+        QCOMPARE(A.value(i), X.value(i));
+        QVERIFY(qAbs(B.value(i) - X.value(i)) < 1e-5);
+    }
+
+    // the transposed file keeps the scale (it is copied with the header)
+    QString path_t = dir.path() + "/scaled_t.mda";
+    QVERIFY(mda_transpose_file(path, path_t));
+    QCOMPARE(mda_read_scale(path_t), scale);
+    DiskReadMda32 XT(path_t);
+    QCOMPARE(XT.value(N - 1, M - 1), X.value(M - 1, N - 1));
+
+    // and writing plain int16 over it leaves no scale
+    Mda C(M, N);
+    QVERIFY(C.write16i(path_t));
+    QCOMPARE(mda_read_scale(path_t), 1.0);
+}
+
 QTEST_APPLESS_MAIN(MdaTest)
 
 #include "tst_mdatest.moc"
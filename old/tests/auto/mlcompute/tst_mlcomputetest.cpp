@@ -1,8 +1,10 @@
 #include <QString>
 #include <QtTest>
 #include "mlcommon.h"
+#include "mlkernels.h"
 #include <thread>
 #include <future>
+#include <limits>
 
 using VD = QVector<double>;
 
@@ -43,6 +45,10 @@ private Q_SLOTS:
     void correlation_benchmark();
     void correlation_benchmark_alternative();
     void correlation_benchmark_parallel();
+
+    void kernels();
+    void kernels_data();
+    void kernels_benchmark_dot();
 };
 
 MLComputeTest::MLComputeTest()
@@ -383,6 +389,136 @@ void MLComputeTest::correlation_benchmark_parallel()
     }
 }
 
+void MLComputeTest::kernels()
+{
+    QFETCH(int, instruction_set);
+    if (instruction_set > MLKernels::supportedInstructionSet())
+        QSKIP("Not supported by this cpu");
+
+    //lengths that end in the middle of every vector width, and values that saturate
+    qsrand(1);
+    QVector<float> X(1001), Y(1001);
+    for (int i = 0; i < X.count(); i++) {
+        X[i] = (qrand() % 200001 - 100000) / 3.0;
+        Y[i] = (qrand() % 200001 - 100000) / 7.0;
+    }
+    X[1] = 2.5;
+    X[2] = -3.5;
+    X[3] = 32767.4f;
+    X[4] = -32768.6f;
+    QList<int> lengths = QList<int>() << 1 << 3 << 7 << 15 << 17 << 31 << 33 << 1001;
+
+    MLKernels::InstructionSet set = (MLKernels::InstructionSet)instruction_set;
+    MLKernels::InstructionSet default_set = MLKernels::instructionSet();
+    foreach (int N, lengths) {
+        MLKernels::setInstructionSet(MLKernels::Scalar);
+        double dot0 = MLKernels::dot(N, X.data(), Y.data());
+        double centered0 = MLKernels::centeredDot(N, X.data(), Y.data(), 12.5, -3.25);
+        double sum0 = MLKernels::sum(N, X.data());
+        double dist0 = MLKernels::distSquared(N, X.data(), Y.data());
+        QVector<float> axpy0 = Y;
+        MLKernels::axpy(N, 0.3f, X.data(), axpy0.data());
+        float min0, max0;
+        MLKernels::minMax(N, X.data(), min0, max0);
+        QVector<qint16> int0(N);
+        MLKernels::floatToInt16(N, X.data(), int0.data());
+        QVector<float> float0(N);
+        MLKernels::int16ToFloat(N, int0.data(), float0.data());
+
+        MLKernels::setInstructionSet(set);
+        QCOMPARE(MLKernels::instructionSet(), set);
+        QVERIFY(qAbs(MLKernels::dot(N, X.data(), Y.data()) - dot0) <= 1e-12 * MLKernels::dot(N, X.data(), X.data()));
+        QVERIFY(qAbs(MLKernels::centeredDot(N, X.data(), Y.data(), 12.5, -3.25) - centered0) <= 1e-12 * MLKernels::centeredDot(N, X.data(), X.data(), 12.5, 12.5));
+        QVERIFY(qAbs(MLKernels::sum(N, X.data()) - sum0) <= 1e-9);
+        QVERIFY(qAbs(MLKernels::distSquared(N, X.data(), Y.data()) - dist0) <= 1e-12 * dist0);
+        QVector<float> axpy1 = Y;
+        MLKernels::axpy(N, 0.3f, X.data(), axpy1.data());
+        for (int i = 0; i < N; i++)
+            QVERIFY(qAbs(axpy1[i] - axpy0[i]) <= 1e-6 * qAbs(axpy0[i]) + 1e-3);
+        float min1, max1;
+        MLKernels::minMax(N, X.data(), min1, max1);
+        QCOMPARE(min1, min0);
+        QCOMPARE(max1, max0);
+        QVector<qint16> int1(N);
+        MLKernels::floatToInt16(N, X.data(), int1.data());
+        QCOMPARE(int1, int0);
+        QVector<float> float1(N);
+        MLKernels::int16ToFloat(N, int1.data(), float1.data());
+        QCOMPARE(float1, float0);
+    }
+
+    //NaN entries are skipped wherever they fall in the vectors, except as the first entry
+    QVector<float> Z = X;
+    for (int i = 5; i < Z.count(); i += 13)
+        Z[i] = std::numeric_limits<float>::quiet_NaN();
+    foreach (int N, lengths) {
+        MLKernels::setInstructionSet(MLKernels::Scalar);
+        float min0, max0;
+        MLKernels::minMax(N, Z.data(), min0, max0);
+        MLKernels::setInstructionSet(set);
+        float min1, max1;
+        MLKernels::minMax(N, Z.data(), min1, max1);
+        QVERIFY(!qIsNaN(min1));
+        QVERIFY(!qIsNaN(max1));
+        QCOMPARE(min1, min0);
+        QCOMPARE(max1, max0);
+        Z[0] = std::numeric_limits<float>::quiet_NaN();
+        MLKernels::minMax(N, Z.data(), min1, max1);
+        QVERIFY(qIsNaN(min1));
+        QVERIFY(qIsNaN(max1));
+        Z[0] = X[0];
+    }
+    MLKernels::setInstructionSet(default_set);
+
+    //rounding (ties to even) and saturation
+    float vals[4] = { 2.5, -3.5, 32767.4f, -32768.6f };
+    qint16 ints[4];
+    MLKernels::floatToInt16(4, vals, ints);
+    QCOMPARE(ints[0], (qint16)2);
+    QCOMPARE(ints[1], (qint16)-4);
+    QCOMPARE(ints[2], (qint16)32767);
+    QCOMPARE(ints[3], (qint16)-32768);
+
+    //the correlation of data far from zero, where dot - N*mean1*mean2 would cancel
+    QVector<float> A(1001), B(1001);
+    for (int i = 0; i < A.count(); i++) {
+        A[i] = 10000 + sin(i * 0.1);
+        B[i] = 10000 + sin(i * 0.1) + 0.5 * cos(i * 0.37);
+    }
+    double mean1 = 0, mean2 = 0;
+    for (int i = 0; i < A.count(); i++) {
+        mean1 += A[i];
+        mean2 += B[i];
+    }
+    mean1 /= A.count();
+    mean2 /= B.count();
+    double covar = 0, var1 = 0, var2 = 0;
+    for (int i = 0; i < A.count(); i++) {
+        covar += (A[i] - mean1) * (B[i] - mean2);
+        var1 += (A[i] - mean1) * (A[i] - mean1);
+        var2 += (B[i] - mean2) * (B[i] - mean2);
+    }
+    QVERIFY(qAbs(MLCompute::correlation(A.count(), A.data(), B.data()) - covar / sqrt(var1 * var2)) <= 1e-12);
+}
+
+void MLComputeTest::kernels_data()
+{
+    QTest::addColumn<int>("instruction_set");
+    QTest::newRow("SSE2") << (int)MLKernels::SSE2;
+    QTest::newRow("AVX2") << (int)MLKernels::AVX2;
+    QTest::newRow("AVX-512") << (int)MLKernels::AVX512;
+}
+
+void MLComputeTest::kernels_benchmark_dot()
+{
+    QVector<float> data(10000);
+    std::iota(data.begin(), data.end(), 1);
+    QBENCHMARK
+    {
+        MLCompute::dotProduct(data.size(), data.data(), data.data());
+    }
+}
+
 QTEST_APPLESS_MAIN(MLComputeTest)
 
 #include "tst_mlcomputetest.moc"
@@ -0,0 +1,16 @@
+QT       += testlib network
+
+QT       -= gui
+
+TARGET = tst_mlnetworktest
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../../../mlcommon/mlcommon.pri)
+include(../../../mlcommon/mlnetwork.pri)
+include(../../../mlcommon/taskprogress.pri)
+
+SOURCES += tst_mlnetworktest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
@@ -0,0 +1,170 @@
+#include <QString>
+#include <QtTest>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "mlnetwork.h"
+
+// Minimal stand-in for a file server: answers GET requests for one file, honoring the Range header
+class RangeServer : public QObject {
+    Q_OBJECT
+public:
+    QByteArray content;
+    qint64 num_bytes_served = 0;
+    int num_failures_to_inject = 0; //the next requests are answered with a truncated body
+
+    bool listen()
+    {
+        connect(&m_server, SIGNAL(newConnection()), this, SLOT(slot_new_connection()));
+        return m_server.listen(QHostAddress::LocalHost);
+    }
+    QString url() const
+    {
+        return QString("http://127.0.0.1:%1/file.dat").arg(m_server.serverPort());
+    }
+
+private slots:
+    void slot_new_connection()
+    {
+        while (m_server.hasPendingConnections()) {
+            QTcpSocket* socket = m_server.nextPendingConnection();
+            connect(socket, &QTcpSocket::readyRead, [this, socket]() {
+                m_requests[socket] += socket->readAll();
+                if (!m_requests[socket].contains("\r\n\r\n"))
+                    return;
+                respond(socket, QString(m_requests.take(socket)));
+            });
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+private:
+    QTcpServer m_server;
+    QMap<QTcpSocket*, QByteArray> m_requests;
+
+    void respond(QTcpSocket* socket, QString request)
+    {
+        qint64 start = 0, end = content.count() - 1;
+        QRegExp rx("Range: bytes=(\\d+)-(\\d+)", Qt::CaseInsensitive);
+        bool partial = (rx.indexIn(request) >= 0);
+        if (partial) {
+            start = rx.cap(1).toLongLong();
+            end = rx.cap(2).toLongLong();
+        }
+        QByteArray body = content.mid(start, end - start + 1);
+        QByteArray header = QString("HTTP/1.1 %1\r\nContent-Length: %2\r\nConnection: close\r\n").arg(partial ? "206 Partial Content" : "200 OK").arg(body.count()).toLatin1();
+        if (partial)
+            header += QString("Content-Range: bytes %1-%2/%3\r\n").arg(start).arg(end).arg(content.count()).toLatin1();
+        header += "\r\n";
+        if (num_failures_to_inject > 0) {
+            num_failures_to_inject--;
+            body = body.mid(0, body.count() / 2);
+        }
+        num_bytes_served += body.count();
+        socket->write(header + body);
+        socket->disconnectFromHost();
+    }
+};
+
+class MLNetworkTest : public QObject {
+    Q_OBJECT
+
+public:
+    MLNetworkTest();
+
+private Q_SLOTS:
+    void parallel_download();
+    void parallel_download_resume();
+
+private:
+    QByteArray make_content(int size);
+};
+
+MLNetworkTest::MLNetworkTest()
+{
+}
+
+QByteArray MLNetworkTest::make_content(int size)
+{
+    QByteArray ret(size, 0);
+    for (int i = 0; i < size; i++) {
+        ret[i] = (char)((i * 7 + i / 1000) % 251);
+    }
+    return ret;
+}
+
+void MLNetworkTest::parallel_download()
+{
+    RangeServer server;
+    server.content = make_content(1000003);
+    server.num_failures_to_inject = 1; //one part has to be retried
+    QVERIFY(server.listen());
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    MLNetwork::PrvParallelDownloader downloader;
+    downloader.source_url = server.url();
+    downloader.destination_file_name = dir.path() + "/file.dat";
+    downloader.size = server.content.count();
+    downloader.part_size = 100000;
+    downloader.num_threads = 3;
+    downloader.checksum = QString(QCryptographicHash::hash(server.content, QCryptographicHash::Sha1).toHex());
+    downloader.start();
+    QVERIFY(downloader.waitForFinished(20000));
+    QVERIFY2(downloader.success, downloader.error.toUtf8().data());
+
+    QFile f(downloader.destination_file_name);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QVERIFY(f.readAll() == server.content);
+    QVERIFY(!QFile::exists(downloader.destination_file_name + ".download_state"));
+}
+
+void MLNetworkTest::parallel_download_resume()
+{
+    RangeServer server;
+    server.content = make_content(500000);
+    QVERIFY(server.listen());
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.path() + "/file.dat";
+    {
+        //an interrupted download: the file is there, with the first two parts recorded (the second one corrupted)
+        QByteArray partial = server.content;
+        partial.replace(200000, 300000, QByteArray(300000, 0));
+        partial[150000] = partial[150000] + 1;
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(partial);
+        f.close();
+        QJsonObject parts;
+        parts["0"] = QString(QCryptographicHash::hash(server.content.mid(0, 100000), QCryptographicHash::Sha1).toHex());
+        parts["100000"] = QString(QCryptographicHash::hash(server.content.mid(100000, 100000), QCryptographicHash::Sha1).toHex());
+        QJsonObject state;
+        state["source_url"] = server.url();
+        state["size"] = (double)server.content.count();
+        state["part_size"] = 100000;
+        state["parts"] = parts;
+        QVERIFY(TextFile::write(path + ".download_state", QJsonDocument(state).toJson()));
+    }
+
+    MLNetwork::PrvParallelDownloader downloader;
+    downloader.source_url = server.url();
+    downloader.destination_file_name = path;
+    downloader.size = server.content.count();
+    downloader.part_size = 100000;
+    downloader.start();
+    QVERIFY(downloader.waitForFinished(20000));
+    QVERIFY2(downloader.success, downloader.error.toUtf8().data());
+
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QVERIFY(f.readAll() == server.content);
+    QCOMPARE(server.num_bytes_served, (qint64)400000); //only the first part was kept
+}
+
+QTEST_GUILESS_MAIN(MLNetworkTest)
+
+#include "tst_mlnetworktest.moc"
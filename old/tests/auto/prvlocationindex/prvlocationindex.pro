@@ -0,0 +1,14 @@
+QT       += testlib
+
+QT       -= gui
+
+TARGET = tst_prvlocationindextest
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../../../mlcommon/mlcommon.pri)
+
+SOURCES += tst_prvlocationindextest.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
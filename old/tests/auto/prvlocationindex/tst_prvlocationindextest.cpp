@@ -0,0 +1,193 @@
+#include <QString>
+#include <QtTest>
+#include <QTemporaryDir>
+#include "mlcommon.h"
+#include "prvlocationindex.h"
+
+class PrvLocationIndexTest : public QObject {
+    Q_OBJECT
+
+public:
+    PrvLocationIndexTest();
+
+private Q_SLOTS:
+    void locate_files();
+    void reload_index();
+    void rewritten_in_place();
+    void locate_prv_fallback();
+    void checksums_in_journal();
+    void symlink_loop();
+};
+
+static bool write_file(const QString& path, const QByteArray& data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return (file.write(data) == data.size());
+}
+
+static QByteArray make_data(int size, int seed)
+{
+    QByteArray ret(size, 0);
+    for (int i = 0; i < size; i++)
+        ret[i] = (char)((i * 31 + seed * 7) % 251);
+    return ret;
+}
+
+PrvLocationIndexTest::PrvLocationIndexTest()
+{
+}
+
+void PrvLocationIndexTest::locate_files()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    QVERIFY(QDir(dir.path()).mkdir("sub"));
+    QString path_a = dir.path() + "/a.dat";
+    QString path_b = dir.path() + "/sub/b.dat";
+    QString path_c = dir.path() + "/c.dat";
+    QVERIFY(write_file(path_a, make_data(5000, 1)));
+    QVERIFY(write_file(path_b, make_data(5000, 1)));
+    QVERIFY(write_file(path_c, make_data(5000, 2))); //same size, different content
+
+    QString checksum = MLUtil::computeSha1SumOfFile(path_a);
+    QString fcs = "head1000-" + MLUtil::computeSha1SumOfFileHead(path_a, 1000);
+
+    PrvLocationIndex index;
+    index.setIndexDirectory(index_dir.path());
+    QStringList search_paths = QStringList(dir.path());
+    QStringList paths = index.locateFiles(5000, checksum, fcs, search_paths);
+    qSort(paths);
+    QCOMPARE(paths, QStringList() << path_a << path_b);
+    QCOMPARE(index.locateFiles(5000, checksum, fcs, search_paths, true).count(), 1);
+    QCOMPARE(index.locateFiles(5000, checksum, "", search_paths).count(), 2);
+    QVERIFY(index.locateFiles(4999, checksum, fcs, search_paths).isEmpty());
+    QCOMPARE(index.checksumOfFile(path_c, search_paths), MLUtil::computeSha1SumOfFile(path_c));
+}
+
+void PrvLocationIndexTest::reload_index()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    QString path = dir.path() + "/a.dat";
+    QVERIFY(write_file(path, make_data(3000, 3)));
+    QString checksum = MLUtil::computeSha1SumOfFile(path);
+    QStringList search_paths = QStringList(dir.path());
+    {
+        PrvLocationIndex index;
+        index.setIndexDirectory(index_dir.path());
+        index.rescan(search_paths);
+    }
+    QCOMPARE(QDir(index_dir.path()).entryList(QStringList("*.index"), QDir::Files).count(), 1);
+
+    // a second instance loads the index written by the first
+    PrvLocationIndex index;
+    index.setIndexDirectory(index_dir.path());
+    QCOMPARE(index.locateFiles(3000, checksum, "", search_paths), QStringList(path));
+
+    // the file was removed since it was indexed
+    QVERIFY(QFile::remove(path));
+    QVERIFY(index.locateFiles(3000, checksum, "", search_paths).isEmpty());
+}
+
+void PrvLocationIndexTest::rewritten_in_place()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    QString path = dir.path() + "/a.dat";
+    QVERIFY(write_file(path, make_data(2000, 4)));
+    QString checksum_old = MLUtil::computeSha1SumOfFile(path);
+    QStringList search_paths = QStringList(dir.path());
+
+    PrvLocationIndex index;
+    index.setIndexDirectory(index_dir.path());
+    QCOMPARE(index.locateFiles(2000, checksum_old, "", search_paths), QStringList(path));
+
+    // same size, new content: the stale checksum must not match
+    QTest::qSleep(50); //so that the modification time changes
+    QVERIFY(write_file(path, make_data(2000, 5)));
+    QVERIFY(index.locateFiles(2000, checksum_old, "", search_paths).isEmpty());
+
+    // new size: found once the file is updated in the index
+    QVERIFY(write_file(path, make_data(2500, 6)));
+    QString checksum_new = MLUtil::computeSha1SumOfFile(path);
+    index.updateFile(path, search_paths);
+    QCOMPARE(index.locateFiles(2500, checksum_new, "", search_paths), QStringList(path));
+    QVERIFY(index.locateFiles(2000, checksum_old, "", search_paths).isEmpty());
+}
+
+void PrvLocationIndexTest::locate_prv_fallback()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    PrvLocationIndex::globalInstance()->setIndexDirectory(index_dir.path());
+    QString path = dir.path() + "/a.dat";
+    QVERIFY(write_file(path, make_data(2000, 7)));
+    QStringList search_paths = QStringList(dir.path());
+    PrvLocationIndex::globalInstance()->rescan(search_paths);
+
+    // rewriting the file in place does not change the modification time of the directory,
+    // so the index still has it under the old size and locatePrv has to search directly
+    QVERIFY(write_file(path, make_data(2500, 8)));
+    QJsonObject obj = MLUtil::createPrvObject(path);
+    obj.remove("original_path");
+    QCOMPARE(MLUtil::locatePrv(obj, search_paths), path);
+    QCOMPARE(PrvLocationIndex::globalInstance()->locateFiles(2500, obj["original_checksum"].toString(), "", search_paths), QStringList(path));
+    PrvLocationIndex::globalInstance()->setIndexDirectory("");
+}
+
+void PrvLocationIndexTest::checksums_in_journal()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    QString path = dir.path() + "/a.dat";
+    QVERIFY(write_file(path, make_data(1800, 9)));
+    QString checksum = MLUtil::computeSha1SumOfFile(path);
+    QStringList search_paths = QStringList(dir.path());
+    {
+        PrvLocationIndex index;
+        index.setIndexDirectory(index_dir.path());
+        index.rescan(search_paths);
+        QStringList index_files = QDir(index_dir.path()).entryList(QStringList("*.index"), QDir::Files);
+        QCOMPARE(index_files.count(), 1);
+        QString index_file = index_dir.path() + "/" + index_files[0];
+        qint64 index_size = QFileInfo(index_file).size();
+
+        // computing the checksum appends to the journal instead of rewriting the index
+        QCOMPARE(index.locateFiles(1800, checksum, "", search_paths), QStringList(path));
+        QCOMPARE(QFileInfo(index_file).size(), index_size);
+        QVERIFY(QFileInfo(index_file + ".journal").size() > 0);
+    }
+
+    // and a second instance reads it back
+    PrvLocationIndex index;
+    index.setIndexDirectory(index_dir.path());
+    QCOMPARE(index.locateFiles(1800, checksum, "", search_paths), QStringList(path));
+}
+
+void PrvLocationIndexTest::symlink_loop()
+{
+    QTemporaryDir dir, index_dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(index_dir.isValid());
+    QVERIFY(QDir(dir.path()).mkdir("sub"));
+    QVERIFY(QFile::link(dir.path(), dir.path() + "/sub/loop")); //back to the root
+    QString path = dir.path() + "/sub/a.dat";
+    QVERIFY(write_file(path, make_data(1500, 10)));
+    QString checksum = MLUtil::computeSha1SumOfFile(path);
+
+    // the scan terminates and sees the file once
+    PrvLocationIndex index;
+    index.setIndexDirectory(index_dir.path());
+    QCOMPARE(index.locateFiles(1500, checksum, "", QStringList(dir.path())), QStringList(path));
+}
+
+QTEST_MAIN(PrvLocationIndexTest)
+
+#include "tst_prvlocationindextest.moc"
@@ -1,7 +1,30 @@
 #include <QString>
 #include <QtTest>
+#include <QThread>
 #include "taskprogress/taskprogress.h"
 
+class LoggingThread : public QThread {
+public:
+    void run()
+    {
+        TaskProgress task("logging thread");
+        for (int i = 0; i < 10; i++) {
+            task.log(QString("message %1").arg(i));
+            task.setProgress(i * 0.1);
+        }
+    }
+};
+
+static TaskManager::TaskProgressAgent* find_task(const QString& label)
+{
+    TaskManager::TaskProgressMonitor* monitor = TaskManager::TaskProgressMonitor::globalInstance();
+    for (int i = 0; i < monitor->count(); i++) {
+        if (monitor->at(i)->taskInfo().label == label)
+            return monitor->at(i);
+    }
+    return 0;
+}
+
 class TaskProgressTest : public QObject {
     Q_OBJECT
 
@@ -11,6 +34,9 @@ public:
 private Q_SLOTS:
     void model_empty();
     void model_rowCount();
+    void monitor_records();
+    void monitor_records_from_thread();
+    void monitor_logs_overflow();
 
     void testCase1_data();
     void testCase1();
@@ -32,6 +58,57 @@ void TaskProgressTest::model_rowCount()
     TaskManager::TaskProgressMonitor* monitor = TaskManager::TaskProgressMonitor::globalInstance();
 }
 
+void TaskProgressTest::monitor_records()
+{
+    {
+        TaskProgress task("monitor records");
+        int N = 100000;
+        for (int i = 0; i < N; i++) {
+            task.setProgress(i * 1.0 / N);
+            if (i % 10000 == 0)
+                task.log(QString("step %1").arg(i));
+        }
+        QTRY_VERIFY(find_task("monitor records"));
+        TaskManager::TaskProgressAgent* agent = find_task("monitor records");
+        QTRY_COMPARE(agent->taskInfo().log_messages.count(), 10);
+        QCOMPARE(agent->taskInfo().log_messages[3].message, QString("step 30000"));
+        QTRY_VERIFY(agent->taskInfo().progress > 0.99);
+        QVERIFY(!agent->taskInfo().end_time.isValid());
+    }
+    TaskManager::TaskProgressAgent* agent = find_task("monitor records");
+    QTRY_VERIFY(agent->taskInfo().end_time.isValid());
+    QCOMPARE(agent->taskInfo().progress, 1.0);
+}
+
+void TaskProgressTest::monitor_records_from_thread()
+{
+    LoggingThread thread;
+    thread.start();
+    QVERIFY(thread.wait(5000));
+    QTRY_VERIFY(find_task("logging thread"));
+    TaskManager::TaskProgressAgent* agent = find_task("logging thread");
+    QTRY_VERIFY(agent->taskInfo().end_time.isValid());
+    QCOMPARE(agent->taskInfo().log_messages.count(), 10);
+    QCOMPARE(agent->taskInfo().log_messages[9].message, QString("message 9"));
+}
+
+void TaskProgressTest::monitor_logs_overflow()
+{
+    // the records are not drained until we get back to the event loop, so most of these
+    // overflow the ring of this thread and have to be kept, in order, all the same
+    TaskProgress task("logs overflow");
+    int N = 5000;
+    for (int i = 0; i < N; i++) {
+        task.log(QString("log %1").arg(i));
+    }
+    QTRY_VERIFY(find_task("logs overflow"));
+    TaskManager::TaskProgressAgent* agent = find_task("logs overflow");
+    QTRY_COMPARE(agent->taskInfo().log_messages.count(), N);
+    for (int i = 0; i < N; i++) {
+        QCOMPARE(agent->taskInfo().log_messages[i].message, QString("log %1").arg(i));
+    }
+}
+
 void TaskProgressTest::testCase1_data()
 {
     QTest::addColumn<QString>("data");